@@ -0,0 +1,190 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <KOSMIndoorMap/MapData>
+
+#include <osm/abstractreader.h>
+#include <osm/datasetchanges.h>
+#include <osm/io.h>
+#include <osm/spatialindex.h>
+
+#include <QFile>
+#include <QTest>
+
+using namespace KOSMIndoorMap;
+
+class MapDataTest : public QObject
+{
+    Q_OBJECT
+private:
+    [[nodiscard]] static bool readFile(const QString &fileName, QStringView mimeType, OSM::DataSet &dataSet, OSM::DataSetChanges *changes = nullptr)
+    {
+        auto p = OSM::IO::readerForMimeType(mimeType, &dataSet);
+        QFile f(fileName);
+        if (!p || !f.open(QFile::ReadOnly)) {
+            return false;
+        }
+        p->setChangeTracking(changes);
+        p->read(&f);
+        return !p->hasError();
+    }
+
+    /** Level content by element type and id, for comparing independent of element order. */
+    [[nodiscard]] static std::map<int, std::vector<std::pair<OSM::Type, OSM::Id>>> levelContent(const MapData &mapData)
+    {
+        std::map<int, std::vector<std::pair<OSM::Type, OSM::Id>>> content;
+        for (const auto &[level, elements] : mapData.levelMap()) {
+            auto &c = content[level.numericLevel()];
+            for (auto e : elements) {
+                c.emplace_back(e.type(), e.id());
+            }
+            std::sort(c.begin(), c.end());
+        }
+        return content;
+    }
+
+private Q_SLOTS:
+    void testIncrementalChanges()
+    {
+        const auto baseFile = QStringLiteral(SOURCE_DIR "/data/changeset/base.osm");
+        const auto changeFile = QStringLiteral(SOURCE_DIR "/data/changeset/changeset.osc");
+
+        // reference: full processing of the modified data
+        MapData ref;
+        {
+            OSM::DataSet dataSet;
+            QVERIFY(readFile(baseFile, u"application/vnd.openstreetmap.data+xml", dataSet));
+            QVERIFY(readFile(changeFile, u"application/vnd.openstreetmap.changes+xml", dataSet));
+            ref.setDataSet(std::move(dataSet));
+        }
+        QVERIFY(!ref.isEmpty());
+
+        MapData mapData;
+        {
+            OSM::DataSet dataSet;
+            QVERIFY(readFile(baseFile, u"application/vnd.openstreetmap.data+xml", dataSet));
+            mapData.setDataSet(std::move(dataSet));
+        }
+        const auto before = levelContent(mapData);
+
+        const auto revision = mapData.changeRevision();
+        QVERIFY(mapData.changedLevels(revision));
+        QVERIFY(mapData.changedLevels(revision)->empty());
+
+        mapData.beginChanges();
+        OSM::DataSetChanges changes;
+        QVERIFY(readFile(changeFile, u"application/vnd.openstreetmap.changes+xml", mapData.dataSet(), &changes));
+        const auto changedLevels = mapData.endChanges(changes);
+
+        // new elements moved the existing ones in memory
+        QVERIFY(mapData.changeRevision() > revision);
+        QVERIFY(!mapData.changedLevels(revision));
+        QVERIFY(mapData.changedLevels(mapData.changeRevision()));
+
+        QCOMPARE(levelContent(mapData), levelContent(ref));
+        for (const auto &[level, elements] : mapData.levelMap()) {
+            const auto index = mapData.levelIndex(level);
+            QVERIFY(index);
+            QCOMPARE(index->query(mapData.boundingBox()).size(), elements.size());
+        }
+
+        // the new cafe is on the base level, the modified door and room on level -1
+        QVERIFY(std::find(changedLevels.begin(), changedLevels.end(), MapLevel(0)) != changedLevels.end());
+        QVERIFY(std::find(changedLevels.begin(), changedLevels.end(), MapLevel(-10)) != changedLevels.end());
+        for (const auto &level : mapData.levelMap()) {
+            if (std::find(changedLevels.begin(), changedLevels.end(), level.first) == changedLevels.end()) {
+                QCOMPARE(levelContent(mapData)[level.first.numericLevel()], before.at(level.first.numericLevel()));
+            }
+        }
+    }
+
+    void testNestedRelations()
+    {
+        const auto baseFile = QStringLiteral(SOURCE_DIR "/data/changeset/nested-base.osm");
+        const auto changeFile = QStringLiteral(SOURCE_DIR "/data/changeset/nested-changeset.osc");
+
+        MapData ref;
+        {
+            OSM::DataSet dataSet;
+            QVERIFY(readFile(baseFile, u"application/vnd.openstreetmap.data+xml", dataSet));
+            QVERIFY(readFile(changeFile, u"application/vnd.openstreetmap.changes+xml", dataSet));
+            ref.setDataSet(std::move(dataSet));
+        }
+
+        MapData mapData;
+        {
+            OSM::DataSet dataSet;
+            QVERIFY(readFile(baseFile, u"application/vnd.openstreetmap.data+xml", dataSet));
+            mapData.setDataSet(std::move(dataSet));
+        }
+        const auto bboxBefore = mapData.boundingBox();
+
+        mapData.beginChanges();
+        OSM::DataSetChanges changes;
+        const auto revision = mapData.changeRevision();
+        QVERIFY(readFile(changeFile, u"application/vnd.openstreetmap.changes+xml", mapData.dataSet(), &changes));
+        QVERIFY(changes.createdNodes.empty());
+        const auto changedLevels = mapData.endChanges(changes);
+
+        QCOMPARE(levelContent(mapData), levelContent(ref));
+        QVERIFY(std::find(changedLevels.begin(), changedLevels.end(), MapLevel(10)) != changedLevels.end());
+
+        // modifications only, existing elements remain valid
+        const auto revisionLevels = mapData.changedLevels(revision);
+        QVERIFY(revisionLevels);
+        QVERIFY(*revisionLevels == changedLevels);
+        QVERIFY(mapData.changedLevels(mapData.changeRevision())->empty());
+
+        // the moved node is part of a way in a relation in a relation
+        const auto it = mapData.levelMap().find(MapLevel(10));
+        QVERIFY(it != mapData.levelMap().end());
+        QCOMPARE((int)(*it).second.size(), 2);
+        for (const auto e : (*it).second) {
+            const auto refElem = OSM::lookupElement(ref.dataSet(), e.type(), e.id());
+            QVERIFY(refElem);
+            QVERIFY(e.boundingBox() == refElem.boundingBox());
+        }
+
+        // moving the node back inside shrinks the bounding box
+        QVERIFY(mapData.boundingBox() == ref.boundingBox());
+        QVERIFY(mapData.boundingBox().max.longitude < bboxBefore.max.longitude);
+    }
+
+    void testDeletedNode()
+    {
+        const auto baseFile = QStringLiteral(SOURCE_DIR "/data/changeset/nested-base.osm");
+        const auto changeFile = QStringLiteral(SOURCE_DIR "/data/changeset/nested-delete.osc");
+
+        MapData ref;
+        {
+            OSM::DataSet dataSet;
+            QVERIFY(readFile(baseFile, u"application/vnd.openstreetmap.data+xml", dataSet));
+            QVERIFY(readFile(changeFile, u"application/vnd.openstreetmap.changes+xml", dataSet));
+            ref.setDataSet(std::move(dataSet));
+        }
+
+        MapData mapData;
+        {
+            OSM::DataSet dataSet;
+            QVERIFY(readFile(baseFile, u"application/vnd.openstreetmap.data+xml", dataSet));
+            mapData.setDataSet(std::move(dataSet));
+        }
+
+        mapData.beginChanges();
+        OSM::DataSetChanges changes;
+        QVERIFY(readFile(changeFile, u"application/vnd.openstreetmap.changes+xml", mapData.dataSet(), &changes));
+        QCOMPARE(changes.deletedNodes.size(), 1);
+        const auto changedLevels = mapData.endChanges(changes);
+
+        // the deleted node is only referenced by a way, which needs to be processed again
+        QCOMPARE(levelContent(mapData), levelContent(ref));
+        QVERIFY(std::find(changedLevels.begin(), changedLevels.end(), MapLevel(10)) != changedLevels.end());
+        QVERIFY(mapData.boundingBox() == ref.boundingBox());
+    }
+};
+
+QTEST_GUILESS_MAIN(MapDataTest)
+
+#include "mapdatatest.moc"
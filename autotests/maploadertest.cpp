@@ -0,0 +1,248 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <map/loader/mapdata.h>
+#include <map/loader/maploader.h>
+#include <map/loader/tilecache_p.h>
+
+#include <osm/datatypes.h>
+#include <osm/io.h>
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QUrl>
+
+using namespace Qt::Literals;
+using namespace KOSMIndoorMap;
+
+class MapLoaderTest : public QObject
+{
+    Q_OBJECT
+private:
+    /** Place @p dataSet in the tile cache as @p tile. */
+    void writeTile(const Tile &tile, const OSM::DataSet &dataSet, const QDateTime &ttl = {})
+    {
+        QVERIFY(QDir().mkpath(QFileInfo(tilePath(tile)).absolutePath()));
+        QFile f(tilePath(tile));
+        QVERIFY(f.open(QFile::WriteOnly));
+        auto writer = OSM::IO::writerForFileName(f.fileName());
+        QVERIFY(writer);
+        writer->write(dataSet, &f);
+        if (ttl.isValid()) {
+            f.flush();
+            f.setFileTime(ttl, QFile::FileModificationTime);
+        }
+    }
+
+    [[nodiscard]] QString tilePath(const Tile &tile) const
+    {
+        return m_cacheDir.path() + "/%1/%2/%3.o5m"_L1.arg(tile.z).arg(tile.x).arg(tile.y);
+    }
+
+    QTemporaryDir m_cacheDir;
+    OSM::DataSet m_dataSet;
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        QVERIFY(m_cacheDir.isValid());
+        qputenv("KOSMINDOORMAP_CACHE_PATH", QFile::encodeName(m_cacheDir.path() + '/'_L1));
+        // anything not cached fails immediately
+        qputenv("KOSMINDOORMAP_TILESERVER", "http://127.0.0.1:1/");
+
+        QFile f(QStringLiteral(SOURCE_DIR "/data/platforms/hamburg-altona.osm"));
+        QVERIFY(f.open(QFile::ReadOnly));
+        auto reader = OSM::IO::readerForFileName(f.fileName(), &m_dataSet);
+        QVERIFY(reader);
+        reader->read(&f);
+        QVERIFY(!reader->hasError());
+        QVERIFY(!m_dataSet.nodes.empty());
+
+        // a z16 tile consists of four tiles at the loader's zoom level, put the data in one of them
+        const Tile tile(34632, 21194, 16);
+        const auto topLeft = tile.topLeftAtZ(17);
+        writeTile(Tile(topLeft.x, topLeft.y, 17), m_dataSet);
+        const OSM::DataSet empty;
+        writeTile(Tile(topLeft.x + 1, topLeft.y, 17), empty);
+        writeTile(Tile(topLeft.x, topLeft.y + 1, 17), empty);
+        writeTile(Tile(topLeft.x + 1, topLeft.y + 1, 17), empty);
+    }
+
+    void testLoadCachedTiles()
+    {
+        MapLoader loader;
+        QSignalSpy doneSpy(&loader, &MapLoader::done);
+        loader.loadForTile(Tile(34632, 21194, 16));
+        // results are always delivered asynchronously
+        QVERIFY(loader.isLoading());
+        QCOMPARE(doneSpy.size(), 0);
+
+        QVERIFY(doneSpy.wait());
+        QCOMPARE(doneSpy.size(), 1);
+        QVERIFY(!loader.isLoading());
+        QVERIFY(!loader.hasError());
+
+        const auto mapData = loader.takeData();
+        QCOMPARE(mapData.dataSet().nodes.size(), m_dataSet.nodes.size());
+        QCOMPARE(mapData.dataSet().ways.size(), m_dataSet.ways.size());
+        QCOMPARE(mapData.dataSet().relations.size(), m_dataSet.relations.size());
+    }
+
+    void testRestartLoading()
+    {
+        // a new request while tiles of a previous one are still being parsed discards the latter
+        MapLoader loader;
+        QSignalSpy doneSpy(&loader, &MapLoader::done);
+        loader.loadForTile(Tile(34632, 21194, 16));
+        loader.loadForTile(Tile(34632, 21194, 16));
+        QVERIFY(doneSpy.wait());
+        QTest::qWait(100);
+        QCOMPARE(doneSpy.size(), 1);
+        QVERIFY(!loader.hasError());
+
+        const auto mapData = loader.takeData();
+        QCOMPARE(mapData.dataSet().nodes.size(), m_dataSet.nodes.size());
+    }
+
+    void testRestartLoadingElsewhere()
+    {
+        // tiles already parsed for a previous request don't end up in the next one
+        const auto topLeft = Tile(34632, 21194, 16).topLeftAtZ(17);
+        MapLoader loader;
+        QSignalSpy doneSpy(&loader, &MapLoader::done);
+        loader.loadForTile(Tile(34632, 21194, 16));
+        loader.loadForTile(Tile(topLeft.x + 1, topLeft.y, 17));
+        QVERIFY(doneSpy.wait());
+        QCOMPARE(doneSpy.size(), 1);
+        QVERIFY(!loader.hasError());
+        QVERIFY(loader.takeData().dataSet().nodes.empty());
+    }
+
+    void testEmptyBoundingBox()
+    {
+        MapLoader loader;
+        QSignalSpy doneSpy(&loader, &MapLoader::done);
+        loader.loadForBoundingBox(53.56, 9.94, 53.55, 9.93);
+        QVERIFY(doneSpy.wait());
+        QCOMPARE(doneSpy.size(), 1);
+        QVERIFY(!loader.isLoading());
+    }
+
+    void testMissingTile()
+    {
+        MapLoader loader;
+        QSignalSpy doneSpy(&loader, &MapLoader::done);
+        loader.loadForTile(Tile(34633, 21194, 16));
+        QVERIFY(doneSpy.wait());
+        QCOMPARE(doneSpy.size(), 1);
+        QVERIFY(!loader.isLoading());
+        QVERIFY(loader.hasError());
+    }
+
+    void testSnapshotCache()
+    {
+        // the data at its actual location this time, surrounded by empty tiles
+        constexpr double lat = 53.5527;
+        constexpr double lon = 9.9355;
+        const auto center = Tile::fromCoordinate(lat, lon, 17);
+        const auto ttl = QDateTime::currentDateTimeUtc().addDays(1);
+        const OSM::DataSet empty;
+        for (int dx = -8; dx <= 8; ++dx) {
+            for (int dy = -8; dy <= 8; ++dy) {
+                writeTile(Tile(center.x + dx, center.y + dy, 17), dx == 0 && dy == 0 ? m_dataSet : empty, ttl);
+            }
+        }
+
+        MapLoader loader;
+        loader.setUseSnapshotCache(true);
+        QSignalSpy doneSpy(&loader, &MapLoader::done);
+        loader.loadForCoordinate(lat, lon);
+        QVERIFY(doneSpy.wait());
+        QVERIFY(!loader.hasError());
+        const auto mapData = loader.takeData();
+        QVERIFY(!mapData.levelMap().empty());
+        // keyed by the venue found, which contains the start coordinate
+        const QDir snapshotDir(m_cacheDir.path() + "/snapshots/17/%1/%2"_L1.arg(center.x).arg(center.y));
+        QCOMPARE(snapshotDir.entryList(QDir::Files).size(), 1);
+        QVERIFY(OSM::contains(mapData.boundingBox(), OSM::Coordinate(lat, lon)));
+
+        // loaded from the snapshot now, without needing the tiles
+        QVERIFY(QFile::remove(tilePath(center)));
+        MapLoader loader2;
+        loader2.setUseSnapshotCache(true);
+        QSignalSpy doneSpy2(&loader2, &MapLoader::done);
+        loader2.loadForCoordinate(lat, lon);
+        QCOMPARE(doneSpy2.size(), 0);
+        QVERIFY(doneSpy2.wait());
+        QVERIFY(!loader2.hasError());
+        const auto cachedData = loader2.takeData();
+        QCOMPARE(cachedData.dataSet().nodes.size(), mapData.dataSet().nodes.size());
+        QCOMPARE(cachedData.dataSet().ways.size(), mapData.dataSet().ways.size());
+        QCOMPARE(cachedData.levelMap().size(), mapData.levelMap().size());
+        QVERIFY(cachedData.boundingBox() == mapData.boundingBox());
+
+        // change sets need unprocessed data, which is loaded from the (now missing) tiles again
+        const auto changeSet = QUrl::fromLocalFile(QStringLiteral(SOURCE_DIR "/data/platforms/hamburg-altona.osm"));
+        MapLoader loader4;
+        loader4.setUseSnapshotCache(true);
+        QSignalSpy doneSpy4(&loader4, &MapLoader::done);
+        loader4.loadForCoordinate(lat, lon);
+        loader4.addChangeSet(changeSet);
+        QVERIFY(doneSpy4.wait());
+        QCOMPARE(doneSpy4.size(), 1);
+        QVERIFY(loader4.hasError());
+
+        // not possible at all for snapshot files
+        MapLoader loader5;
+        QSignalSpy doneSpy5(&loader5, &MapLoader::done);
+        loader5.loadFromFile(snapshotDir.filePath(snapshotDir.entryList(QDir::Files).at(0)));
+        loader5.addChangeSet(changeSet);
+        QVERIFY(doneSpy5.wait());
+        QVERIFY(loader5.hasError());
+
+        // not used when the data is requested to be cached for longer than the tiles it's built from
+        MapLoader loader3;
+        loader3.setUseSnapshotCache(true);
+        QSignalSpy doneSpy3(&loader3, &MapLoader::done);
+        loader3.loadForCoordinate(lat, lon, ttl.addDays(1));
+        QVERIFY(doneSpy3.wait());
+        QVERIFY(loader3.hasError());
+    }
+
+    void testApplyChangeSet()
+    {
+        MapLoader loader;
+        QSignalSpy doneSpy(&loader, &MapLoader::done);
+        loader.loadFromFile(QStringLiteral(SOURCE_DIR "/data/changeset/nested-base.osm"));
+        QVERIFY(doneSpy.wait());
+        QVERIFY(!loader.hasError());
+        auto mapData = loader.takeData();
+        QVERIFY(!mapData.isEmpty());
+        const auto bboxBefore = mapData.boundingBox();
+        const auto revision = mapData.changeRevision();
+
+        // applied in place, without emitting done
+        QSignalSpy appliedSpy(&loader, &MapLoader::changeSetApplied);
+        loader.applyChangeSet(mapData, QUrl::fromLocalFile(QStringLiteral(SOURCE_DIR "/data/changeset/nested-changeset.osc")));
+        QVERIFY(!loader.isLoading());
+        QVERIFY(appliedSpy.wait());
+        QCOMPARE(doneSpy.size(), 1);
+        QVERIFY(!loader.hasError());
+
+        const auto changedLevels = mapData.changedLevels(revision);
+        QVERIFY(changedLevels);
+        QVERIFY(std::find(changedLevels->begin(), changedLevels->end(), MapLevel(10)) != changedLevels->end());
+        QVERIFY(mapData.boundingBox().max.longitude < bboxBefore.max.longitude);
+    }
+};
+
+QTEST_GUILESS_MAIN(MapLoaderTest)
+
+#include "maploadertest.moc"
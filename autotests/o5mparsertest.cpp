@@ -5,8 +5,13 @@
 */
 
 #include <osm/datatypes.h>
+#include <osm/elementhandler.h>
+#include <osm/io.h>
+#include <osm/o5m.h>
 #include <osm/o5mparser.h>
+#include <osm/o5mwriter.h>
 
+#include <QBuffer>
 #include <QTest>
 
 // see https://wiki.openstreetmap.org/wiki/O5m for the examples used below
@@ -177,6 +182,218 @@ private Q_SLOTS:
         QCOMPARE(rel.tags[0].key.name(), "type");
         QCOMPARE(rel.tags[0].value, "multipolygon");
     }
+
+    void testParseInvalidRelationMember_data()
+    {
+        QTest::addColumn<QByteArray>("data");
+
+        // member type and role referring to an empty string table slot
+        QTest::newRow("unset string") << QByteArray::fromHex("902e0005f498830b010074797065006d756c7469706f6c79676f6e00");
+        // empty member type and role
+        QTest::newRow("empty string") << QByteArray::fromHex("902e0006f498830b00000074797065006d756c7469706f6c79676f6e00");
+    }
+
+    void testParseInvalidRelationMember()
+    {
+        QFETCH(QByteArray, data);
+        const auto beginIt = reinterpret_cast<const uint8_t*>(data.constBegin());
+        const auto endIt = reinterpret_cast<const uint8_t*>(data.constEnd());
+
+        OSM::DataSet dataSet;
+        OSM::O5mParser p(&dataSet);
+        p.readRelation(beginIt, endIt);
+        QVERIFY(p.hasError());
+        QVERIFY(dataSet.relations.empty());
+    }
+
+    void testParsePersistentData()
+    {
+        const auto data = QByteArray::fromHex("902e0011f498830b0031696e6e657200ca93d30d010074797065006d756c7469706f6c79676f6e00");
+        const auto beginIt = reinterpret_cast<const uint8_t*>(data.constBegin());
+        auto it = beginIt;
+        const auto endIt = reinterpret_cast<const uint8_t*>(data.constEnd());
+
+        OSM::DataSet dataSet;
+        OSM::O5mParser p(&dataSet);
+        p.m_dataMemOpt = OSM::StringMemory::Persistent;
+        p.readRelation(it, endIt);
+
+        QCOMPARE(dataSet.relations.size(), 1);
+        const auto &rel = dataSet.relations[0];
+        QCOMPARE(rel.tags.size(), 1);
+        QCOMPARE(rel.tags[0].key.name(), "type");
+        QCOMPARE(rel.tags[0].value, "multipolygon");
+        // roles are stored in tagged pointers, unaligned ones are copied
+        QCOMPARE(rel.members[0].role().name(), "inner");
+        QCOMPARE(rel.members[0].type(), OSM::Type::Way);
+
+        // keys and values refer to the input data directly
+        const auto inData = [&data](const char *s) { return s >= data.constBegin() && s < data.constEnd(); };
+        QVERIFY(inData(rel.tags[0].key.name()));
+        QVERIFY(inData(rel.tags[0].value.constData()));
+    }
+
+    void testParseParallel()
+    {
+        OSM::DataSet dataSet;
+        const auto name = dataSet.makeTagKey("name");
+        const auto outer = dataSet.makeRole("outer");
+        for (OSM::Id id = 1; id <= 60000; ++id) {
+            OSM::Node node;
+            node.id = id * 3;
+            node.coordinate = OSM::Coordinate(52.0 + id * 0.00001, 13.0 - id * 0.00002);
+            if (id % 3 == 0) {
+                OSM::setTagValue(node, name, "node" + QByteArray::number(id % 1000));
+            }
+            dataSet.addNode(std::move(node));
+        }
+        for (OSM::Id id = 1; id <= 20000; ++id) {
+            OSM::Relation rel;
+            rel.id = id;
+            OSM::Member mem;
+            mem.id = id;
+            mem.setRole(outer);
+            mem.setType(OSM::Type::Way);
+            rel.members.push_back(mem);
+            dataSet.addRelation(std::move(rel));
+        }
+
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+        OSM::O5mWriter writer;
+        writer.setResetInterval(OSM::O5M_RESET_INTERVAL);
+        writer.write(dataSet, &buffer);
+        QVERIFY(!writer.hasError());
+        const auto data = buffer.data();
+
+        // reset blocks are only written on request
+        QBuffer plainBuffer;
+        plainBuffer.open(QIODevice::WriteOnly);
+        OSM::O5mWriter plainWriter;
+        plainWriter.write(dataSet, &plainBuffer);
+        QVERIFY(plainBuffer.data().size() < data.size());
+
+        OSM::DataSet result;
+        OSM::O5mParser p(&result);
+        p.setThreadCount(4);
+        QVERIFY(p.splitAtResetBlocks(reinterpret_cast<const uint8_t*>(data.constData()), data.size(), 16).size() > 1);
+        p.read(reinterpret_cast<const uint8_t*>(data.constData()), data.size());
+
+        QCOMPARE(result.nodes.size(), dataSet.nodes.size());
+        for (std::size_t i = 0; i < result.nodes.size(); ++i) {
+            QCOMPARE(result.nodes[i].id, dataSet.nodes[i].id);
+            QVERIFY(result.nodes[i].coordinate == dataSet.nodes[i].coordinate);
+            QCOMPARE(OSM::tagValue(result.nodes[i], result.tagKey("name")), OSM::tagValue(dataSet.nodes[i], name));
+        }
+        QCOMPARE(result.relations.size(), dataSet.relations.size());
+        for (std::size_t i = 0; i < result.relations.size(); ++i) {
+            QCOMPARE(result.relations[i].id, dataSet.relations[i].id);
+            QCOMPARE(result.relations[i].members.size(), 1);
+            QCOMPARE(result.relations[i].members[0].id, dataSet.relations[i].members[0].id);
+            QVERIFY(result.relations[i].members[0].role() == result.role("outer"));
+        }
+    }
+
+    void testParseIncremental()
+    {
+        OSM::DataSet dataSet;
+        const auto name = dataSet.makeTagKey("name");
+        for (OSM::Id id = 1; id <= 2000; ++id) {
+            OSM::Node node;
+            node.id = id;
+            node.coordinate = OSM::Coordinate(52.0 + id * 0.00001, 13.0);
+            OSM::setTagValue(node, name, "node" + QByteArray::number(id % 100));
+            dataSet.addNode(std::move(node));
+        }
+
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+        auto writer = OSM::IO::writerForMimeType(u"application/vnd.openstreetmap.data+o5m");
+        QVERIFY(writer);
+        writer->write(dataSet, &buffer);
+        const auto data = buffer.data();
+
+        // chunks end in the middle of blocks, string table references point to previous chunks
+        OSM::DataSet result;
+        OSM::O5mParser p(&result);
+        for (qsizetype i = 0; i < data.size(); i += 7) {
+            p.addData(data.constData() + i, std::min<qsizetype>(7, data.size() - i));
+        }
+        p.finish();
+        QVERIFY(!p.hasError());
+
+        QCOMPARE(result.nodes.size(), dataSet.nodes.size());
+        for (std::size_t i = 0; i < result.nodes.size(); ++i) {
+            QCOMPARE(result.nodes[i].id, dataSet.nodes[i].id);
+            QVERIFY(result.nodes[i].coordinate == dataSet.nodes[i].coordinate);
+            QCOMPARE(OSM::tagValue(result.nodes[i], result.tagKey("name")), OSM::tagValue(dataSet.nodes[i], name));
+        }
+
+        // truncated input
+        OSM::DataSet truncated;
+        OSM::O5mParser p2(&truncated);
+        p2.addData(data.constData(), data.size() / 2);
+        p2.finish();
+        QVERIFY(!truncated.nodes.empty());
+        QVERIFY(truncated.nodes.size() < dataSet.nodes.size());
+    }
+
+    void testElementHandler()
+    {
+        OSM::DataSet dataSet;
+        const auto name = dataSet.makeTagKey("name");
+        for (OSM::Id id = 1; id <= 100; ++id) {
+            OSM::Node node;
+            node.id = id;
+            OSM::setTagValue(node, name, "node" + QByteArray::number(id % 10));
+            dataSet.addNode(std::move(node));
+        }
+        OSM::Way way;
+        way.id = 1;
+        way.nodes = {1, 2, 3};
+        OSM::setTagValue(way, name, "way");
+        dataSet.addWay(std::move(way));
+
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+        auto writer = OSM::IO::writerForMimeType(u"application/vnd.openstreetmap.data+o5m");
+        QVERIFY(writer);
+        writer->write(dataSet, &buffer);
+        const auto data = buffer.data();
+
+        struct Handler : public OSM::ElementHandler {
+            void handleNode(const OSM::Node &node) override
+            {
+                nodeIds.push_back(node.id);
+                // values are only borrowed, so deep-copy them
+                const auto name = OSM::tagValue(node, "name");
+                names.push_back(QByteArray(name.constData(), name.size()));
+            }
+            void handleWay(const OSM::Way &way) override
+            {
+                wayNodes = way.nodes;
+            }
+            std::vector<OSM::Id> nodeIds;
+            std::vector<QByteArray> names;
+            std::vector<OSM::Id> wayNodes;
+        } handler;
+
+        OSM::DataSet result;
+        OSM::O5mParser p(&result);
+        p.setElementHandler(&handler);
+        p.read(reinterpret_cast<const uint8_t*>(data.constData()), data.size());
+
+        // nothing is stored, only tag keys are registered
+        QVERIFY(result.nodes.empty());
+        QVERIFY(result.ways.empty());
+        QVERIFY(!result.tagKey("name").isNull());
+        QVERIFY(result.tagValue("node1", 5).isNull());
+
+        QCOMPARE(handler.nodeIds.size(), 100);
+        QCOMPARE(handler.nodeIds.front(), 1);
+        QCOMPARE(handler.names[41], "node2");
+        QCOMPARE(handler.wayNodes, std::vector<OSM::Id>({1, 2, 3}));
+    }
 };
 
 QTEST_GUILESS_MAIN(O5mParserTest)
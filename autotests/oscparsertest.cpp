@@ -4,6 +4,7 @@
 */
 
 #include <osm/abstractreader.h>
+#include <osm/datasetchanges.h>
 #include <osm/datatypes.h>
 #include <osm/io.h>
 
@@ -51,6 +52,49 @@ private Q_SLOTS:
         QCOMPARE(OSM::tagValue(*modifiedWay, "name"), "Track 1");
         QCOMPARE(modifiedWay->nodes.size(), 11);
     }
+
+    void testChangeTracking()
+    {
+        OSM::DataSet dataSet;
+        OSM::DataSetChanges changes;
+
+        {
+            auto p = OSM::IO::readerForMimeType(u"application/vnd.openstreetmap.data+xml", &dataSet);
+            QVERIFY(p);
+            p->setChangeTracking(&changes);
+            QFile baseFile(QStringLiteral(SOURCE_DIR "/data/changeset/base.osm"));
+            QVERIFY(baseFile.open(QFile::ReadOnly));
+            p->read(&baseFile);
+            QVERIFY(!p->hasError());
+        }
+        QCOMPARE(changes.createdNodes.size(), 10);
+        QCOMPARE(changes.createdWays, std::vector<OSM::Id>{107673516});
+        QVERIFY(changes.createdRelations.empty());
+        QVERIFY(changes.modifiedNodes.empty());
+        QVERIFY(changes.deletedNodes.empty());
+
+        changes.clear();
+        QVERIFY(changes.isEmpty());
+        {
+            auto p = OSM::IO::readerForMimeType(u"application/vnd.openstreetmap.changes+xml", &dataSet);
+            QVERIFY(p);
+            p->setChangeTracking(&changes);
+            QFile changeFile(QStringLiteral(SOURCE_DIR "/data/changeset/changeset.osc"));
+            QVERIFY(changeFile.open(QFile::ReadOnly));
+            p->read(&changeFile);
+            QVERIFY(!p->hasError());
+        }
+        QVERIFY(!changes.isEmpty());
+        QCOMPARE(changes.createdNodes.size(), 1);
+        QVERIFY(changes.createdNodes[0] < 0);
+        QCOMPARE(OSM::tagValue(*dataSet.node(changes.createdNodes[0]), "name"), "Coffee Bar");
+        QVERIFY(changes.createdWays.empty());
+        QCOMPARE(changes.modifiedNodes, std::vector<OSM::Id>{1237008670});
+        QCOMPARE(changes.modifiedWays, std::vector<OSM::Id>{107673516});
+        QVERIFY(changes.modifiedRelations.empty());
+        QVERIFY(changes.deletedNodes.empty());
+        QVERIFY(changes.deletedWays.empty());
+    }
 };
 
 QTEST_GUILESS_MAIN(OscParserTest)
@@ -39,6 +39,58 @@ private Q_SLOTS:
         QCOMPARE(coord2.longitude, coord.longitude);
     }
 
+    void testComputeZ()
+    {
+        const std::vector<OSM::Coordinate> coords({ OSM::Coordinate(-90.0, -180.0), OSM::Coordinate(52.5, 13.4), OSM::Coordinate(90.0, 180.0) });
+        std::vector<uint64_t> z(coords.size());
+        OSM::computeZ(coords, z);
+        for (std::size_t i = 0; i < coords.size(); ++i) {
+            QCOMPARE(z[i], coords[i].z());
+            QCOMPARE(OSM::Coordinate(z[i]), coords[i]);
+        }
+    }
+
+    void testWayCoordinates()
+    {
+        OSM::DataSet ds;
+        for (OSM::Id id : {1, 2, 3}) {
+            OSM::Node node;
+            node.id = id;
+            node.coordinate = OSM::Coordinate(52.0 + (double)id / 100.0, 13.0);
+            ds.addNode(std::move(node));
+        }
+        OSM::Way way;
+        way.id = 10;
+        way.nodes = {1, 4, 2, 3};
+        ds.addWay(std::move(way));
+        way.id = 11;
+        way.nodes = {1, 2, 1, 3};
+        ds.addWay(std::move(way));
+
+        QVERIFY(ds.wayCoordinates(ds.ways[0]).empty());
+        ds.buildWayCoordinates();
+
+        // missing nodes are skipped
+        const auto coords = ds.wayCoordinates(ds.ways[0]);
+        QCOMPARE(coords.size(), 3);
+        QCOMPARE(coords[0], ds.node(1)->coordinate);
+        QCOMPARE(coords[2], ds.node(3)->coordinate);
+        // paths revisiting their first node are not covered
+        QVERIFY(ds.wayCoordinates(ds.ways[1]).empty());
+
+        // explicit invalidation for in-place changes
+        ds.clearWayCoordinates();
+        QVERIFY(ds.wayCoordinates(ds.ways[0]).empty());
+        ds.buildWayCoordinates();
+        QVERIFY(!ds.wayCoordinates(ds.ways[0]).empty());
+
+        // invalidated by changes to the ways
+        way.id = 12;
+        way.nodes = {1, 2};
+        ds.addWay(std::move(way));
+        QVERIFY(ds.wayCoordinates(ds.ways[0]).empty());
+    }
+
     void testTagKeys()
     {
         OSM::DataSet ds;
@@ -69,6 +121,159 @@ private Q_SLOTS:
         QCOMPARE(OSM::tagValue(node, "bkey"), "bvalue");
         QCOMPARE(OSM::tagValue(node, "akey"), "avalue");
     }
+
+    void testRoles()
+    {
+        OSM::DataSet ds;
+
+        // roles are stored in tagged pointers, so they need to be aligned even when packed or unaligned input is used
+        for (const auto name : { "a", "bc", "def", "ghij" }) {
+            const auto role = ds.makeRole(name, OSM::StringMemory::Transient);
+            QCOMPARE(reinterpret_cast<std::uintptr_t>(role.name()) % 4, 0);
+        }
+        const char data[] = "xouter";
+        const auto role = ds.makeRole(data + 1, OSM::StringMemory::Persistent);
+        QCOMPARE(reinterpret_cast<std::uintptr_t>(role.name()) % 4, 0);
+        QCOMPARE(role.name(), "outer");
+
+        OSM::Member mem;
+        mem.id = 42;
+        mem.setRole(role);
+        mem.setType(OSM::Type::Way);
+        QVERIFY(mem.role() == ds.role("outer"));
+        QCOMPARE(mem.type(), OSM::Type::Way);
+    }
+
+    void testTagValues()
+    {
+        OSM::DataSet ds;
+        QVERIFY(ds.tagValue("yes", 3).isNull());
+
+        const auto v1 = ds.makeTagValue("yes", 3);
+        QCOMPARE(v1, "yes");
+        QCOMPARE(ds.tagValue("yes", 3).constData(), v1.constData());
+        QCOMPARE(ds.makeTagValue("yes", 3, OSM::StringMemory::Persistent).constData(), v1.constData());
+
+        const char persistentValue[] = "platform";
+        const auto v2 = ds.makeTagValue(persistentValue, 8, OSM::StringMemory::Persistent);
+        QCOMPARE(v2.constData(), persistentValue);
+        QCOMPARE(ds.makeTagValue("platform", 8).constData(), persistentValue);
+
+        // long values are not deduplicated
+        const QByteArray longValue(OSM::StringValueRegistry::MaxValueLength + 1, 'x');
+        const auto v3 = ds.makeTagValue(longValue.constData(), longValue.size());
+        QCOMPARE(v3, longValue);
+        QVERIFY(v3.constData() != longValue.constData());
+        QVERIFY(ds.tagValue(longValue.constData(), longValue.size()).isNull());
+    }
+
+    void testMemoryUsage()
+    {
+        OSM::DataSet ds;
+        QCOMPARE(ds.memoryUsage().total(), 0);
+
+        const auto key = ds.makeTagKey("key", OSM::StringMemory::Transient);
+        const auto sharedValue = ds.makeTagValue("shared", 6);
+        for (OSM::Id id = 1; id <= 10; ++id) {
+            OSM::Node node;
+            node.id = id;
+            OSM::setTagValue(node, key, QByteArray(sharedValue));
+            ds.addNode(std::move(node));
+        }
+        OSM::Way way;
+        way.id = 1;
+        way.nodes = {1, 2, 3};
+        ds.addWay(std::move(way));
+
+        auto usage = ds.memoryUsage();
+        QVERIFY(usage.nodes >= 10 * sizeof(OSM::Node));
+        QVERIFY(usage.ways >= sizeof(OSM::Way));
+        QCOMPARE(usage.relations, 0);
+        QVERIFY(usage.tags >= 10 * sizeof(OSM::Tag));
+        // the shared value is only counted once
+        QVERIFY(usage.tagValues > 0);
+        QVERIFY(usage.tagValues < 10 * sizeof(QByteArray));
+        QVERIFY(usage.wayNodes >= 3 * sizeof(OSM::Id));
+        QVERIFY(usage.stringRegistries > 0);
+        QCOMPARE(usage.indexes, 0);
+        QVERIFY(usage.total() > usage.nodes + usage.tags);
+
+        ds.buildNodeIndex();
+        usage = ds.memoryUsage();
+        QVERIFY(usage.indexes > 0);
+    }
+
+    void testNodeIndex()
+    {
+        OSM::DataSet ds;
+        ds.nodes.reserve(10);
+        for (OSM::Id id = 1; id <= 5; ++id) {
+            OSM::Node node;
+            node.id = id * 2;
+            ds.addNode(std::move(node));
+        }
+        ds.buildNodeIndex();
+        QCOMPARE(ds.node(6)->id, OSM::Id(6));
+        QVERIFY(!ds.node(7));
+
+        OSM::Node node;
+        node.id = 7;
+        ds.addNode(std::move(node));
+        QCOMPARE(ds.node(7)->id, OSM::Id(7));
+        QCOMPARE(ds.node(8)->id, OSM::Id(8));
+
+        // direct changes keeping size and location of the node vector
+        ds.buildNodeIndex();
+        ds.nodes.pop_back();
+        node = OSM::Node();
+        node.id = 11;
+        ds.nodes.push_back(std::move(node));
+        ds.elementsChanged();
+        QCOMPARE(ds.node(11)->id, OSM::Id(11));
+        QVERIFY(!ds.node(10));
+    }
+
+    void testBulkLoad()
+    {
+        OSM::DataSet ds;
+        const auto key = ds.makeTagKey("key", OSM::StringMemory::Persistent);
+        for (OSM::Id id : {5, 1, 9}) {
+            OSM::Node node;
+            node.id = id;
+            OSM::setTagValue(node, key, "old");
+            ds.addNode(std::move(node));
+        }
+
+        ds.beginBulkLoad();
+        for (OSM::Id id : {7, 5, 3, 7, 11, 1}) {
+            OSM::Node node;
+            node.id = id;
+            OSM::setTagValue(node, key, QByteArray::number((qlonglong)id));
+            ds.addNode(std::move(node));
+        }
+        // lookup works during bulk loading too
+        QVERIFY(ds.node(3));
+        QVERIFY(ds.node(9));
+        QVERIFY(!ds.node(4));
+        // elements added after a lookup are found as well, the first one in case of duplicates
+        for (const auto value : {"first", "second"}) {
+            OSM::Node node;
+            node.id = 13;
+            OSM::setTagValue(node, key, value);
+            ds.addNode(std::move(node));
+        }
+        QCOMPARE(OSM::tagValue(*ds.node(13), key), "first");
+        ds.endBulkLoad();
+
+        QCOMPARE(ds.nodes.size(), 7);
+        QVERIFY(std::is_sorted(ds.nodes.begin(), ds.nodes.end()));
+        // existing elements win over duplicates
+        QCOMPARE(OSM::tagValue(*ds.node(1), key), "old");
+        QCOMPARE(OSM::tagValue(*ds.node(5), key), "old");
+        QCOMPARE(OSM::tagValue(*ds.node(7), key), "7");
+        QCOMPARE(OSM::tagValue(*ds.node(11), key), "11");
+        QCOMPARE(OSM::tagValue(*ds.node(13), key), "first");
+    }
 };
 
 QTEST_GUILESS_MAIN(OsmTypeTest)
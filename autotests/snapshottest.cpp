@@ -0,0 +1,139 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <osm/datatypes.h>
+#include <osm/snapshotparser.h>
+#include <osm/snapshotwriter.h>
+
+#include <QBuffer>
+#include <QTest>
+
+class SnapshotTest : public QObject
+{
+    Q_OBJECT
+private:
+    static OSM::DataSet makeDataSet()
+    {
+        OSM::DataSet dataSet;
+        const auto name = dataSet.makeTagKey("name");
+        const auto level = dataSet.makeTagKey("level");
+        for (OSM::Id id = 1; id <= 100; ++id) {
+            OSM::Node node;
+            node.id = id;
+            node.coordinate = OSM::Coordinate(52.0 + id * 0.001, 13.0);
+            if (id % 3 == 0) {
+                OSM::setTagValue(node, name, "node" + QByteArray::number(id % 7));
+            }
+            dataSet.addNode(std::move(node));
+        }
+
+        OSM::Way way;
+        way.id = 5;
+        way.nodes = {1, 2, 3, 1};
+        way.bbox = OSM::BoundingBox(OSM::Coordinate(1.0, 2.0), OSM::Coordinate(3.0, 4.0));
+        OSM::setTagValue(way, level, "1;2");
+        OSM::setTagValue(way, name, QByteArray(60, 'x'));
+        dataSet.addWay(std::move(way));
+
+        OSM::Relation rel;
+        rel.id = 7;
+        OSM::Member mem;
+        mem.id = 5;
+        mem.setRole(dataSet.makeRole("outer"));
+        mem.setType(OSM::Type::Way);
+        rel.members.push_back(mem);
+        mem.id = 3;
+        mem.setRole(OSM::Role());
+        mem.setType(OSM::Type::Node);
+        rel.members.push_back(mem);
+        dataSet.addRelation(std::move(rel));
+        return dataSet;
+    }
+
+    static QByteArray writeSnapshot(const OSM::DataSet &dataSet)
+    {
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+        OSM::SnapshotWriter writer;
+        writer.addSection(42, "hello");
+        writer.write(dataSet, &buffer);
+        return buffer.data();
+    }
+
+private Q_SLOTS:
+    void testRoundTrip_data()
+    {
+        QTest::addColumn<OSM::StringMemory>("memOpt");
+        QTest::newRow("persistent") << OSM::StringMemory::Persistent;
+        QTest::newRow("transient") << OSM::StringMemory::Transient;
+    }
+
+    void testRoundTrip()
+    {
+        QFETCH(OSM::StringMemory, memOpt);
+
+        const auto dataSet = makeDataSet();
+        const auto data = writeSnapshot(dataSet);
+        QCOMPARE(data.size() % 8, 0);
+
+        OSM::DataSet result;
+        OSM::SnapshotParser p(&result);
+        p.read(reinterpret_cast<const uint8_t*>(data.constData()), data.size(), memOpt);
+        QVERIFY(!p.hasError());
+
+        QCOMPARE(result.nodes.size(), dataSet.nodes.size());
+        QCOMPARE(result.ways.size(), 1);
+        QCOMPARE(result.relations.size(), 1);
+
+        const auto name = result.tagKey("name");
+        for (std::size_t i = 0; i < result.nodes.size(); ++i) {
+            QCOMPARE(result.nodes[i].id, dataSet.nodes[i].id);
+            QVERIFY(result.nodes[i].coordinate == dataSet.nodes[i].coordinate);
+            QCOMPARE(OSM::tagValue(result.nodes[i], name), OSM::tagValue(dataSet.nodes[i], dataSet.tagKey("name")));
+        }
+
+        const auto &way = result.ways[0];
+        QCOMPARE(way.id, 5);
+        QVERIFY(way.nodes == dataSet.ways[0].nodes);
+        QVERIFY(way.bbox == dataSet.ways[0].bbox);
+        QCOMPARE(OSM::tagValue(way, result.tagKey("level")), "1;2");
+        QCOMPARE(OSM::tagValue(way, name), QByteArray(60, 'x'));
+
+        const auto &rel = result.relations[0];
+        QCOMPARE(rel.id, 7);
+        QCOMPARE(rel.members.size(), 2);
+        QCOMPARE(rel.members[0].id, 5);
+        QVERIFY(rel.members[0].role() == result.role("outer"));
+        QCOMPARE(rel.members[0].type(), OSM::Type::Way);
+        QCOMPARE(rel.members[1].id, 3);
+        QVERIFY(rel.members[1].role().isNull());
+        QCOMPARE(rel.members[1].type(), OSM::Type::Node);
+
+        QCOMPARE(p.section(42), "hello");
+        QVERIFY(p.section(23).isNull());
+    }
+
+    void testInvalid()
+    {
+        const auto data = writeSnapshot(makeDataSet());
+        for (qsizetype len = 0; len < data.size(); len += 7) {
+            OSM::DataSet result;
+            OSM::SnapshotParser p(&result);
+            p.read(reinterpret_cast<const uint8_t*>(data.constData()), len);
+            QVERIFY(p.hasError());
+        }
+
+        auto corrupted = data;
+        corrupted[0] = 'X';
+        OSM::DataSet result;
+        OSM::SnapshotParser p(&result);
+        p.read(reinterpret_cast<const uint8_t*>(corrupted.constData()), corrupted.size());
+        QVERIFY(p.hasError());
+    }
+};
+
+QTEST_GUILESS_MAIN(SnapshotTest)
+
+#include "snapshottest.moc"
@@ -0,0 +1,95 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <osm/spatialindex.h>
+
+#include <QTest>
+
+#include <random>
+
+class SpatialIndexTest : public QObject
+{
+    Q_OBJECT
+private:
+    static std::vector<OSM::BoundingBox> makeBoxes(int count)
+    {
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<double> pos(0.0, 0.01);
+        std::uniform_real_distribution<double> size(0.0, 0.0005);
+
+        std::vector<OSM::BoundingBox> boxes;
+        for (int i = 0; i < count; ++i) {
+            const auto lat = 52.5 + pos(rng);
+            const auto lon = 13.4 + pos(rng);
+            boxes.emplace_back(OSM::Coordinate(lat, lon), OSM::Coordinate(lat + size(rng), lon + size(rng)));
+        }
+        return boxes;
+    }
+
+private Q_SLOTS:
+    void testEmpty()
+    {
+        OSM::SpatialIndex index;
+        QVERIFY(index.isEmpty());
+        QVERIFY(index.query(OSM::BoundingBox(OSM::Coordinate(0.0, 0.0), OSM::Coordinate(1.0, 1.0))).empty());
+        QVERIFY(index.nearest(OSM::Coordinate(0.0, 0.0)).empty());
+
+        // invalid boxes are not indexed
+        index.build({OSM::BoundingBox()});
+        QVERIFY(index.isEmpty());
+    }
+
+    void testQuery_data()
+    {
+        QTest::addColumn<int>("count");
+        QTest::newRow("1") << 1;
+        QTest::newRow("16") << 16;
+        QTest::newRow("17") << 17;
+        QTest::newRow("2000") << 2000;
+    }
+
+    void testQuery()
+    {
+        QFETCH(int, count);
+        const auto boxes = makeBoxes(count);
+        OSM::SpatialIndex index;
+        index.build(boxes);
+        QCOMPARE(index.size(), boxes.size());
+
+        for (const auto &queryBox : makeBoxes(50)) {
+            std::vector<uint32_t> expected;
+            for (uint32_t i = 0; i < boxes.size(); ++i) {
+                if (OSM::intersects(queryBox, boxes[i])) {
+                    expected.push_back(i);
+                }
+            }
+            QCOMPARE(index.query(queryBox), expected);
+        }
+    }
+
+    void testNearest()
+    {
+        const auto boxes = makeBoxes(500);
+        OSM::SpatialIndex index;
+        index.build(boxes);
+
+        for (const auto &box : boxes) {
+            // an item containing the query point has distance zero
+            const auto result = index.nearest(box.center(), 3);
+            QCOMPARE(result.size(), 3);
+            QVERIFY(OSM::contains(boxes[result[0]], box.center()));
+        }
+
+        // a single item south of the rest is the closest one to a point further south
+        auto moreBoxes = boxes;
+        moreBoxes.emplace_back(OSM::Coordinate(52.4, 13.405), OSM::Coordinate(52.4001, 13.4051));
+        index.build(moreBoxes);
+        QCOMPARE(index.nearest(OSM::Coordinate(52.3, 13.405)), std::vector<uint32_t>{(uint32_t)boxes.size()});
+    }
+};
+
+QTEST_GUILESS_MAIN(SpatialIndexTest)
+
+#include "spatialindextest.moc"
@@ -0,0 +1,185 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <map/loader/tilearchive_p.h>
+#include <map/loader/tilecache_p.h>
+
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QTest>
+
+using namespace Qt::Literals;
+using namespace KOSMIndoorMap;
+
+class TileArchiveTest: public QObject
+{
+    Q_OBJECT
+private:
+    [[nodiscard]] static QByteArray tileData(uint32_t x)
+    {
+        return "tile " + QByteArray::number(x) + ' ' + QByteArray(x % 7 * 10, 'x');
+    }
+
+    [[nodiscard]] static QByteArray read(const TileArchive &archive, const Tile &tile)
+    {
+        const auto location = archive.find(tile);
+        QFile f(archive.fileName());
+        if (!location.isValid() || !f.open(QFile::ReadOnly) || !f.seek(location.offset)) {
+            return {};
+        }
+        return f.read(location.size);
+    }
+
+    QTemporaryDir m_dir;
+
+private Q_SLOTS:
+    void testInsertAndFind()
+    {
+        const auto fileName = m_dir.filePath(u"insert.archive"_s);
+        {
+            TileArchive archive;
+            QVERIFY(archive.open(fileName));
+            QCOMPARE((int)archive.size(), 0);
+
+            // enough to grow the index a few times
+            for (uint32_t x = 0; x < 5000; ++x) {
+                QVERIFY(archive.insert(Tile(x, 42, 17), tileData(x), QDateTime::fromMSecsSinceEpoch(x)));
+            }
+            QCOMPARE((int)archive.size(), 5000);
+            for (uint32_t x = 0; x < 5000; ++x) {
+                QCOMPARE(read(archive, Tile(x, 42, 17)), tileData(x));
+                QCOMPARE(archive.ttl(Tile(x, 42, 17)).toMSecsSinceEpoch(), (qint64)x);
+            }
+            QVERIFY(!archive.find(Tile(1, 43, 17)).isValid());
+            QVERIFY(!archive.find(Tile(1, 42, 16)).isValid());
+
+            QVERIFY(archive.insert(Tile(5, 42, 17), "replaced", QDateTime::fromMSecsSinceEpoch(100000)));
+            QCOMPARE(read(archive, Tile(5, 42, 17)), QByteArray("replaced"));
+            QCOMPARE((int)archive.size(), 5000);
+            QVERIFY(archive.garbageRatio() > 0.0);
+
+            archive.setTtl(Tile(6, 42, 17), QDateTime::fromMSecsSinceEpoch(200000));
+        }
+
+        TileArchive archive;
+        QVERIFY(archive.open(fileName));
+        QCOMPARE((int)archive.size(), 5000);
+        QCOMPARE(read(archive, Tile(5, 42, 17)), QByteArray("replaced"));
+        QCOMPARE(read(archive, Tile(4999, 42, 17)), tileData(4999));
+        QCOMPARE(archive.ttl(Tile(6, 42, 17)).toMSecsSinceEpoch(), Q_INT64_C(200000));
+    }
+
+    void testExpireAndCompact()
+    {
+        TileArchive archive;
+        QVERIFY(archive.open(m_dir.filePath(u"expire.archive"_s)));
+        for (uint32_t x = 0; x < 2000; ++x) {
+            QVERIFY(archive.insert(Tile(x, 42, 17), tileData(x), QDateTime::fromMSecsSinceEpoch(x < 1000 ? 1000 : 5000)));
+        }
+        archive.remove(Tile(1500, 42, 17));
+        QVERIFY(!archive.find(Tile(1500, 42, 17)).isValid());
+
+        archive.expire(QDateTime::fromMSecsSinceEpoch(2000));
+        QCOMPARE((int)archive.size(), 999);
+        QVERIFY(!archive.find(Tile(10, 42, 17)).isValid());
+
+        // removed slots are reused
+        for (uint32_t x = 0; x < 500; ++x) {
+            QVERIFY(archive.insert(Tile(x, 42, 17), tileData(x), QDateTime::fromMSecsSinceEpoch(5000)));
+        }
+        QCOMPARE((int)archive.size(), 1499);
+
+        const auto sizeBefore = QFileInfo(archive.fileName()).size();
+        QVERIFY(archive.garbageRatio() > 0.0);
+        QVERIFY(archive.compact());
+        QCOMPARE(archive.garbageRatio(), 0.0);
+        QVERIFY(QFileInfo(archive.fileName()).size() < sizeBefore);
+        QCOMPARE((int)archive.size(), 1499);
+        for (uint32_t x = 0; x < 2000; ++x) {
+            if ((x >= 500 && x < 1000) || x == 1500) {
+                QVERIFY(!archive.find(Tile(x, 42, 17)).isValid());
+            } else {
+                QCOMPARE(read(archive, Tile(x, 42, 17)), tileData(x));
+            }
+        }
+    }
+
+    void testReserve()
+    {
+        TileArchive archive;
+        QVERIFY(archive.open(m_dir.filePath(u"reserve.archive"_s)));
+
+        // interleaved incremental writes
+        const auto offset1 = archive.reserve(6);
+        const auto offset2 = archive.reserve(10);
+        QVERIFY(offset1 >= 0);
+        QVERIFY(offset2 >= offset1 + 6);
+        QVERIFY(archive.write(offset1, "abc"));
+        QVERIFY(archive.write(offset2, "uvw"));
+        QVERIFY(archive.write(offset1 + 3, "def"));
+        QVERIFY(archive.write(offset2 + 3, "xyz"));
+        QVERIFY(!archive.write(offset1 + 3, "ghij"));
+        QVERIFY(!archive.find(Tile(1, 42, 17)).isValid());
+        QVERIFY(!archive.compact());
+
+        QVERIFY(archive.commit(Tile(1, 42, 17), offset1, 6, QDateTime::currentDateTimeUtc().addDays(1)));
+        QVERIFY(archive.commit(Tile(2, 42, 17), offset2, 6, QDateTime::currentDateTimeUtc().addDays(1)));
+        QVERIFY(!archive.commit(Tile(3, 42, 17), offset2, 6, QDateTime::currentDateTimeUtc().addDays(1)));
+        QCOMPARE(read(archive, Tile(1, 42, 17)), QByteArray("abcdef"));
+        QCOMPARE(read(archive, Tile(2, 42, 17)), QByteArray("uvwxyz"));
+
+        // unused reserved space is reclaimed by compaction
+        const auto offset3 = archive.reserve(100);
+        QVERIFY(offset3 >= 0);
+        archive.release(offset3);
+        QVERIFY(!archive.write(offset3, "abc"));
+        QVERIFY(archive.garbageRatio() > 0.0);
+        QVERIFY(archive.compact());
+        QCOMPARE(archive.garbageRatio(), 0.0);
+        QCOMPARE(read(archive, Tile(1, 42, 17)), QByteArray("abcdef"));
+        QCOMPARE(read(archive, Tile(2, 42, 17)), QByteArray("uvwxyz"));
+    }
+
+    void testExclusiveAccess()
+    {
+        const auto fileName = m_dir.filePath(u"exclusive.archive"_s);
+        TileArchive archive;
+        QVERIFY(archive.open(fileName));
+
+        TileArchive archive2;
+        QVERIFY(!archive2.open(fileName));
+        QVERIFY(!archive2.isOpen());
+
+        // compaction keeps the lock
+        QVERIFY(archive.insert(Tile(1, 2, 3), "abc", QDateTime::currentDateTimeUtc()));
+        QVERIFY(archive.compact());
+        QVERIFY(!archive2.open(fileName));
+
+        archive.close();
+        QVERIFY(archive2.open(fileName));
+        QCOMPARE(read(archive2, Tile(1, 2, 3)), QByteArray("abc"));
+    }
+
+    void testInvalidFile()
+    {
+        const auto fileName = m_dir.filePath(u"invalid.archive"_s);
+        QFile f(fileName);
+        QVERIFY(f.open(QFile::WriteOnly));
+        f.write(QByteArray(1000, 'x'));
+        f.close();
+
+        TileArchive archive;
+        QVERIFY(archive.open(fileName));
+        QCOMPARE((int)archive.size(), 0);
+        QVERIFY(archive.insert(Tile(1, 2, 3), "abc", QDateTime::currentDateTimeUtc()));
+        QCOMPARE(read(archive, Tile(1, 2, 3)), QByteArray("abc"));
+    }
+};
+
+QTEST_GUILESS_MAIN(TileArchiveTest)
+
+#include "tilearchivetest.moc"
@@ -7,14 +7,121 @@
 #include <map/loader/tilecache_p.h>
 #include <osm/datatypes.h>
 
+#include <QDateTime>
+#include <QDirIterator>
+#include <QNetworkAccessManager>
+#include <QSignalSpy>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
 #include <QTest>
+#include <QTimer>
 
+#include <memory>
+#include <unordered_map>
+
+using namespace Qt::Literals;
 using namespace KOSMIndoorMap;
 
+/** Minimal local HTTP server standing in for the tile server.
+ *  Responses are delayed to observe how many requests are in flight at the same time,
+ *  tiles with y = 404 don't exist.
+ */
+class TileServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TileServer(QObject *parent = nullptr)
+        : QObject(parent)
+    {
+        m_server.listen(QHostAddress::LocalHost);
+        connect(&m_server, &QTcpServer::newConnection, this, [this]() {
+            while (auto socket = m_server.nextPendingConnection()) {
+                connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { readRequests(socket); });
+                connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+                    m_buffers.erase(socket);
+                    socket->deleteLater();
+                });
+            }
+        });
+    }
+
+    [[nodiscard]] QByteArray url() const
+    {
+        return "http://127.0.0.1:" + QByteArray::number(m_server.serverPort()) + '/';
+    }
+
+    int delay = 50;
+    int requestCount = 0;
+    QList<QByteArray> requestedPaths;
+    int inFlight = 0;
+    int maxInFlight = 0;
+
+private:
+    void readRequests(QTcpSocket *socket)
+    {
+        auto &buffer = m_buffers[socket];
+        buffer += socket->readAll();
+        // requests can be pipelined, responses are sent in the same order due to the constant delay
+        for (auto idx = buffer.indexOf("\r\n\r\n"); idx >= 0; idx = buffer.indexOf("\r\n\r\n")) {
+            const auto path = buffer.left(buffer.indexOf("\r\n")).split(' ').value(1);
+            buffer.remove(0, idx + 4);
+            ++requestCount;
+            requestedPaths.push_back(path);
+            maxInFlight = std::max(maxInFlight, ++inFlight);
+            QTimer::singleShot(delay, socket, [this, socket, path]() {
+                --inFlight;
+                if (path.endsWith("/404.o5m")) {
+                    socket->write("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+                    return;
+                }
+                const QByteArray body = "tile " + path;
+                socket->write(QByteArray("HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: " + QByteArray::number(body.size()) + "\r\n\r\n" + body));
+            });
+        }
+    }
+
+    QTcpServer m_server;
+    std::unordered_map<QTcpSocket*, QByteArray> m_buffers;
+};
+
 class TileCacheTest: public QObject
 {
     Q_OBJECT
+private:
+    [[nodiscard]] QStringList partialFiles() const
+    {
+        QStringList files;
+        QDirIterator it(m_cacheDir->path(), {u"*.part"_s}, QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            files.push_back(it.next());
+        }
+        return files;
+    }
+
+    [[nodiscard]] static QByteArray tileContent(const TileCache &cache, const Tile &tile)
+    {
+        const auto cachedTile = cache.cachedTile(tile);
+        QFile f(cachedTile.fileName);
+        if (!cachedTile.isValid() || !f.open(QFile::ReadOnly) || !f.seek(cachedTile.offset)) {
+            return {};
+        }
+        return f.read(cachedTile.size);
+    }
+
+    std::unique_ptr<QTemporaryDir> m_cacheDir;
+    std::unique_ptr<TileServer> m_server;
+
 private Q_SLOTS:
+    void init()
+    {
+        m_cacheDir = std::make_unique<QTemporaryDir>();
+        QVERIFY(m_cacheDir->isValid());
+        qputenv("KOSMINDOORMAP_CACHE_PATH", QFile::encodeName(m_cacheDir->path() + '/'_L1));
+        m_server = std::make_unique<TileServer>();
+        qputenv("KOSMINDOORMAP_TILESERVER", m_server->url());
+    }
+
     void testTileFromCoordinate_data()
     {
         QTest::addColumn<int>("z");
@@ -50,6 +157,224 @@ private Q_SLOTS:
         QCOMPARE(t.boundingBox().max.latF(), 85.0511287);
         QCOMPARE(t.boundingBox().max.lonF(), 0.0);
     }
+
+    void testParallelDownloads()
+    {
+        QNetworkAccessManager nam;
+        TileCache cache([&nam]() { return &nam; });
+        cache.setMaximumParallelDownloads(3);
+        QSignalSpy loadedSpy(&cache, &TileCache::tileLoaded);
+        QSignalSpy errorSpy(&cache, &TileCache::tileError);
+
+        for (uint32_t x = 0; x < 8; ++x) {
+            cache.ensureCached(Tile(x, 42, 17));
+        }
+        // already queued tiles are not downloaded twice
+        cache.ensureCached(Tile(0, 42, 17));
+        QCOMPARE(cache.pendingDownloads(), 8);
+
+        QTRY_COMPARE(loadedSpy.size(), 8);
+        QCOMPARE(errorSpy.size(), 0);
+        QCOMPARE(cache.pendingDownloads(), 0);
+        QCOMPARE(m_server->requestCount, 8);
+        QCOMPARE(m_server->maxInFlight, 3);
+
+        for (uint32_t x = 0; x < 8; ++x) {
+            QCOMPARE(tileContent(cache, Tile(x, 42, 17)), QByteArray("tile /17/" + QByteArray::number(x) + "/42.o5m"));
+        }
+        QVERIFY(partialFiles().isEmpty());
+    }
+
+    void testDownloadError()
+    {
+        QNetworkAccessManager nam;
+        TileCache cache([&nam]() { return &nam; });
+        QSignalSpy loadedSpy(&cache, &TileCache::tileLoaded);
+        QSignalSpy errorSpy(&cache, &TileCache::tileError);
+
+        cache.ensureCached(Tile(1, 42, 17));
+        cache.ensureCached(Tile(1, 404, 17));
+        cache.ensureCached(Tile(2, 42, 17));
+
+        QTRY_COMPARE(cache.pendingDownloads(), 0);
+        QCOMPARE(loadedSpy.size(), 2);
+        QCOMPARE(errorSpy.size(), 1);
+        QCOMPARE(errorSpy.at(0).at(0).value<Tile>().y, 404);
+        QVERIFY(!cache.cachedTile(Tile(1, 404, 17)).isValid());
+        QVERIFY(cache.cachedTile(Tile(1, 42, 17)).isValid());
+        QVERIFY(cache.cachedTile(Tile(2, 42, 17)).isValid());
+        QVERIFY(partialFiles().isEmpty());
+    }
+
+    void testLocalWriteError()
+    {
+        // a file where the tile directory would need to be
+        QVERIFY(QDir().mkpath(m_cacheDir->path() + "/17"_L1));
+        QFile f(m_cacheDir->path() + "/17/5"_L1);
+        QVERIFY(f.open(QFile::WriteOnly));
+        f.close();
+
+        QNetworkAccessManager nam;
+        TileCache cache([&nam]() { return &nam; });
+        QSignalSpy loadedSpy(&cache, &TileCache::tileLoaded);
+        QSignalSpy errorSpy(&cache, &TileCache::tileError);
+        cache.ensureCached(Tile(5, 42, 17));
+        cache.ensureCached(Tile(6, 42, 17));
+        // reported asynchronously, and doesn't affect other tiles
+        QCOMPARE(errorSpy.size(), 0);
+        QTRY_COMPARE(errorSpy.size(), 1);
+        QCOMPARE(errorSpy.at(0).at(0).value<Tile>().x, 5);
+        QTRY_COMPARE(loadedSpy.size(), 1);
+
+        // not reported anymore after cancellation
+        cache.ensureCached(Tile(5, 42, 17));
+        cache.cancelPending();
+        QTest::qWait(10);
+        QCOMPARE(errorSpy.size(), 1);
+    }
+
+    void testPrefetch()
+    {
+        QNetworkAccessManager nam;
+        TileCache cache([&nam]() { return &nam; });
+        cache.setMaximumParallelDownloads(1);
+        QSignalSpy loadedSpy(&cache, &TileCache::tileLoaded);
+
+        // prefetches don't count as pending, and only run when nothing else is waiting
+        cache.prefetchTile(Tile(1, 42, 17));
+        cache.prefetchTile(Tile(2, 42, 17));
+        QCOMPARE(cache.pendingDownloads(), 0);
+        cache.ensureCached(Tile(3, 42, 17));
+        QCOMPARE(cache.pendingDownloads(), 1);
+        // requesting a tile that is being prefetched turns that into a regular download
+        cache.ensureCached(Tile(1, 42, 17));
+        QCOMPARE(cache.pendingDownloads(), 2);
+
+        QTRY_COMPARE(loadedSpy.size(), 3);
+        QCOMPARE(cache.pendingDownloads(), 0);
+        QCOMPARE(m_server->requestedPaths, QList<QByteArray>({"/17/1/42.o5m", "/17/3/42.o5m", "/17/2/42.o5m"}));
+
+        // cached tiles are not prefetched again
+        cache.prefetchTile(Tile(2, 42, 17));
+        QTest::qWait(2 * m_server->delay);
+        QCOMPARE(m_server->requestCount, 3);
+    }
+
+    void testCancel()
+    {
+        m_server->delay = 500;
+        QNetworkAccessManager nam;
+        TileCache cache([&nam]() { return &nam; });
+        cache.setMaximumParallelDownloads(2);
+        QSignalSpy loadedSpy(&cache, &TileCache::tileLoaded);
+        QSignalSpy errorSpy(&cache, &TileCache::tileError);
+
+        for (uint32_t x = 0; x < 5; ++x) {
+            cache.ensureCached(Tile(x, 42, 17));
+        }
+        QTRY_COMPARE(m_server->inFlight, 2);
+        QCOMPARE(partialFiles().size(), 2);
+
+        cache.cancelPending();
+        QCOMPARE(cache.pendingDownloads(), 0);
+        QVERIFY(partialFiles().isEmpty());
+
+        QTest::qWait(2 * m_server->delay);
+        QCOMPARE(loadedSpy.size(), 0);
+        QCOMPARE(errorSpy.size(), 0);
+        QCOMPARE(m_server->requestCount, 2);
+        for (uint32_t x = 0; x < 5; ++x) {
+            QVERIFY(!cache.cachedTile(Tile(x, 42, 17)).isValid());
+        }
+    }
+
+    void testArchive()
+    {
+        QNetworkAccessManager nam;
+        TileCache cache([&nam]() { return &nam; });
+        cache.setUseArchive(true);
+        QSignalSpy loadedSpy(&cache, &TileCache::tileLoaded);
+
+        for (uint32_t x = 0; x < 4; ++x) {
+            cache.ensureCached(Tile(x, 42, 17));
+        }
+        QTRY_COMPARE(loadedSpy.size(), 4);
+        QVERIFY(partialFiles().isEmpty());
+        QVERIFY(!QFile::exists(m_cacheDir->path() + "/17"_L1));
+
+        for (uint32_t x = 0; x < 4; ++x) {
+            const auto cachedTile = cache.cachedTile(Tile(x, 42, 17));
+            QVERIFY(cachedTile.fileName.endsWith("tiles.archive"_L1));
+            QCOMPARE(tileContent(cache, Tile(x, 42, 17)), QByteArray("tile /17/" + QByteArray::number(x) + "/42.o5m"));
+        }
+
+        // only usable by one cache at a time, the other one falls back to individual files
+        TileCache cache2([&nam]() { return &nam; });
+        cache2.setUseArchive(true);
+        QVERIFY(!cache2.cachedTile(Tile(2, 42, 17)).isValid());
+
+        // still there when reopening, and not downloaded again
+        cache.setUseArchive(false);
+        cache2.setUseArchive(true);
+        cache2.ensureCached(Tile(2, 42, 17));
+        QCOMPARE(cache2.pendingDownloads(), 0);
+        QCOMPARE(tileContent(cache2, Tile(2, 42, 17)), QByteArray("tile /17/2/42.o5m"));
+
+        // switching back to individual files ignores the archive
+        cache2.setUseArchive(false);
+        QVERIFY(!cache2.cachedTile(Tile(2, 42, 17)).isValid());
+    }
+
+    void testArchiveMigration()
+    {
+        const auto writeTile = [this](const QString &path, const QByteArray &content, const QDateTime &ttl) {
+            QDir().mkpath(QFileInfo(m_cacheDir->path() + path).absolutePath());
+            QFile f(m_cacheDir->path() + path);
+            QVERIFY(f.open(QFile::WriteOnly));
+            f.write(content);
+            f.flush();
+            f.setFileTime(ttl, QFile::FileModificationTime);
+        };
+        const auto now = QDateTime::currentDateTimeUtc();
+        writeTile(u"/17/1/42.o5m"_s, "tile 1", now.addDays(2));
+        writeTile(u"/17/2/42.o5m"_s, "tile 2", now.addDays(2));
+        writeTile(u"/17/3/42.o5m"_s, "expired", now.addDays(-2));
+
+        QNetworkAccessManager nam;
+        TileCache cache([&nam]() { return &nam; });
+        QCOMPARE(tileContent(cache, Tile(1, 42, 17)), QByteArray("tile 1"));
+        cache.setUseArchive(true);
+
+        QCOMPARE(tileContent(cache, Tile(1, 42, 17)), QByteArray("tile 1"));
+        QCOMPARE(tileContent(cache, Tile(2, 42, 17)), QByteArray("tile 2"));
+        QVERIFY(!cache.cachedTile(Tile(3, 42, 17)).isValid());
+        QVERIFY(!QFile::exists(m_cacheDir->path() + "/17"_L1));
+    }
+
+    void testFindSnapshot()
+    {
+        QNetworkAccessManager nam;
+        TileCache cache([&nam]() { return &nam; });
+        const Tile tile(1, 42, 17);
+        QVERIFY(cache.findSnapshot(tile, OSM::Coordinate(150u, 150u)).isEmpty());
+
+        const OSM::BoundingBox large(OSM::Coordinate(100u, 100u), OSM::Coordinate(300u, 300u));
+        const OSM::BoundingBox small(OSM::Coordinate(140u, 140u), OSM::Coordinate(160u, 160u));
+        const OSM::BoundingBox other(OSM::Coordinate(400u, 400u), OSM::Coordinate(500u, 500u));
+        for (const auto &bbox : {large, small, other}) {
+            const auto fileName = cache.snapshotPath(tile, bbox);
+            QVERIFY(QDir().mkpath(QFileInfo(fileName).absolutePath()));
+            QFile f(fileName);
+            QVERIFY(f.open(QFile::WriteOnly));
+        }
+
+        // the venue containing the coordinate is used, the smallest one if there are several
+        QCOMPARE(cache.findSnapshot(tile, OSM::Coordinate(150u, 150u)), cache.snapshotPath(tile, small));
+        QCOMPARE(cache.findSnapshot(tile, OSM::Coordinate(200u, 200u)), cache.snapshotPath(tile, large));
+        QCOMPARE(cache.findSnapshot(tile, OSM::Coordinate(450u, 450u)), cache.snapshotPath(tile, other));
+        QVERIFY(cache.findSnapshot(tile, OSM::Coordinate(350u, 350u)).isEmpty());
+        QVERIFY(cache.findSnapshot(Tile(2, 42, 17), OSM::Coordinate(150u, 150u)).isEmpty());
+    }
 };
 
 QTEST_GUILESS_MAIN(TileCacheTest)
@@ -0,0 +1,121 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <osm/varint.h>
+
+#include <QTest>
+
+#include <limits>
+#include <random>
+#include <vector>
+
+using namespace OSM;
+
+static void writeUnsigned(uint64_t v, std::vector<uint8_t> &out)
+{
+    do {
+        out.push_back((v & 0x7f) | (v > 0x7f ? 0x80 : 0));
+        v >>= 7;
+    } while (v);
+}
+
+static uint64_t zigzagEncode(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+class VarintTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testReadUnsigned_data()
+    {
+        QTest::addColumn<quint64>("value");
+        QTest::addColumn<int>("padding");
+        for (const auto value : {0ull, 1ull, 127ull, 128ull, 300ull, 16384ull, (1ull << 49) - 1, 1ull << 56, std::numeric_limits<uint64_t>::max()}) {
+            // with and without enough data after the value for the word-wise fast path
+            QTest::addRow("%llu", value) << (quint64)value << 0;
+            QTest::addRow("%llu padded", value) << (quint64)value << 16;
+        }
+    }
+
+    void testReadUnsigned()
+    {
+        QFETCH(quint64, value);
+        QFETCH(int, padding);
+
+        std::vector<uint8_t> data;
+        writeUnsigned(value, data);
+        const auto size = data.size();
+        data.resize(size + padding, 0xff);
+
+        const uint8_t *it = data.data();
+        QCOMPARE(Varint::readUnsigned(it, data.data() + data.size()), value);
+        QCOMPARE(it, data.data() + size);
+    }
+
+    void testReadTruncated()
+    {
+        const std::vector<uint8_t> data{0x80, 0x81, 0x82};
+        const uint8_t *it = data.data();
+        (void)Varint::readUnsigned(it, data.data() + data.size());
+        QCOMPARE(it, data.data() + data.size());
+    }
+
+    void testZigZag()
+    {
+        QCOMPARE(Varint::zigzagDecode(0), 0);
+        QCOMPARE(Varint::zigzagDecode(1), -1);
+        QCOMPARE(Varint::zigzagDecode(2), 1);
+        QCOMPARE(Varint::zigzagDecode(3), -2);
+        QCOMPARE(Varint::zigzagDecode(zigzagEncode(std::numeric_limits<int64_t>::min())), std::numeric_limits<int64_t>::min());
+        QCOMPARE(Varint::zigzagDecode(zigzagEncode(std::numeric_limits<int64_t>::max())), std::numeric_limits<int64_t>::max());
+    }
+
+    void testDecodeDeltaZigZag()
+    {
+        std::mt19937_64 rng(42);
+        for (int round = 0; round < 1000; ++round) {
+            // mix long runs of small deltas (the vectorized path) with larger values
+            std::vector<int64_t> values;
+            std::vector<uint8_t> data;
+            const auto count = rng() % 100;
+            for (std::size_t i = 0; i < count; ++i) {
+                const int64_t v = rng() % 4 ? (int64_t)(rng() % 128) - 64 : (int64_t)(rng() >> (rng() % 40 + 24)) - (1ll << 20);
+                values.push_back(v);
+                writeUnsigned(zigzagEncode(v), data);
+            }
+
+            std::vector<int64_t> result(data.size());
+            int64_t state = 42;
+            const auto n = Varint::decodeDeltaZigZag(data.data(), data.data() + data.size(), result.data(), state);
+            QCOMPARE(n, values.size());
+            int64_t expected = 42;
+            for (std::size_t i = 0; i < n; ++i) {
+                expected += values[i];
+                QCOMPARE(result[i], expected);
+            }
+            QCOMPARE(state, expected);
+        }
+    }
+
+    void testDecodeUnsigned()
+    {
+        std::vector<uint8_t> data;
+        std::vector<int32_t> values;
+        for (int32_t i = 0; i < 1000; i += (i < 100 ? 1 : 97)) {
+            values.push_back(i);
+            writeUnsigned(i, data);
+        }
+
+        std::vector<int32_t> result(data.size());
+        result.resize(Varint::decodeUnsigned(data.data(), data.data() + data.size(), result.data()));
+        QCOMPARE(result, values);
+    }
+};
+
+QTEST_GUILESS_MAIN(VarintTest)
+
+#include "varinttest.moc"
@@ -0,0 +1,184 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <osm/abstractreader.h>
+#include <osm/datatypes.h>
+#include <osm/io.h>
+#include <osm/readerfilter.h>
+
+#include <QFile>
+#include <QTest>
+
+using namespace Qt::Literals::StringLiterals;
+
+static const char xmlData[] = R"(<?xml version="1.0" encoding="UTF-8"?>
+<!DOCTYPE osm>
+<osm version="0.6">
+  <!-- <node id="99"/> -->
+  <![CDATA[ <node id="98"/> ]]>
+  <node id="1" lat="-12.5" lon="-0.0000001">
+    <tag k="name" v="A &amp; B &lt;&#x41;&#66;&#x20AC;&gt;"/>
+    <tag k='quote' v='"x"'/>
+  </node>
+  <node id = "2" lat="48.1234567891" lon="11.1"/>
+  <node id="3"/>
+  <way id="5">text<nd ref="1"/><nd ref="2"/><tag k="bBox" v="11,48,12,49"/></way>
+  <relation id="7">
+    <member type="way" ref="5" role="outer"/>
+    <member type="node" ref="3"/>
+  </relation>
+</osm>
+)";
+
+class XmlParserTest : public QObject
+{
+    Q_OBJECT
+private:
+    void verifyDataSet(const OSM::DataSet &dataSet)
+    {
+        QCOMPARE(dataSet.nodes.size(), 3);
+        QCOMPARE(dataSet.nodes[0].id, 1);
+        QCOMPARE(dataSet.nodes[0].coordinate.latitude, 775000000);
+        QCOMPARE(dataSet.nodes[0].coordinate.longitude, 1799999999);
+        QCOMPARE(OSM::tagValue(dataSet.nodes[0], "name"), "A & B <AB€>");
+        QCOMPARE(OSM::tagValue(dataSet.nodes[0], "quote"), "\"x\"");
+        QCOMPARE(dataSet.nodes[1].coordinate.latitude, 1381234567);
+        QVERIFY(!dataSet.nodes[2].coordinate.isValid());
+
+        QCOMPARE(dataSet.ways.size(), 1);
+        QCOMPARE(dataSet.ways[0].nodes.size(), 2);
+        QVERIFY(dataSet.ways[0].tags.empty());
+        QVERIFY(dataSet.ways[0].bbox.isValid());
+
+        QCOMPARE(dataSet.relations.size(), 1);
+        QCOMPARE(dataSet.relations[0].members.size(), 2);
+        QCOMPARE(dataSet.relations[0].members[0].type(), OSM::Type::Way);
+        QCOMPARE(dataSet.relations[0].members[0].role().name(), "outer");
+        QCOMPARE(dataSet.relations[0].members[1].type(), OSM::Type::Node);
+    }
+
+private Q_SLOTS:
+    void testParse()
+    {
+        OSM::DataSet dataSet;
+        auto p = OSM::IO::readerForMimeType(u"application/vnd.openstreetmap.data+xml", &dataSet);
+        QVERIFY(p);
+        p->read(reinterpret_cast<const uint8_t*>(xmlData), sizeof(xmlData) - 1);
+        QVERIFY(!p->hasError());
+        verifyDataSet(dataSet);
+    }
+
+    void testParseIncremental()
+    {
+        // chunks end in the middle of elements, attributes and entities
+        OSM::DataSet dataSet;
+        auto p = OSM::IO::readerForMimeType(u"application/vnd.openstreetmap.data+xml", &dataSet);
+        QVERIFY(p);
+        for (std::size_t i = 0; i < sizeof(xmlData) - 1; i += 3) {
+            p->addData(xmlData + i, std::min<std::size_t>(3, sizeof(xmlData) - 1 - i));
+        }
+        p->finish();
+        QVERIFY(!p->hasError());
+        verifyDataSet(dataSet);
+    }
+
+    void testParseError_data()
+    {
+        QTest::addColumn<QByteArray>("data");
+        QTest::newRow("truncated") << QByteArray(R"(<osm><node id="1" lat="1" lon="2"><tag k="a" v="b"/>)");
+        QTest::newRow("unclosed") << QByteArray(R"(<osm><node id="1" lat="1" lon="2"/>)");
+        QTest::newRow("invalid attribute") << QByteArray(R"(<osm><node id=1/></osm>)");
+        QTest::newRow("remark") << QByteArray(R"(<osm><remark>runtime error</remark></osm>)");
+    }
+
+    void testParseError()
+    {
+        QFETCH(QByteArray, data);
+        OSM::DataSet dataSet;
+        auto p = OSM::IO::readerForMimeType(u"application/vnd.openstreetmap.data+xml", &dataSet);
+        QVERIFY(p);
+        p->read(reinterpret_cast<const uint8_t*>(data.constData()), data.size());
+        QVERIFY(p->hasError());
+    }
+
+    void testFilter()
+    {
+        static const char filterData[] = R"(<osm>
+  <node id="1" lat="1" lon="1"><tag k="amenity" v="cafe"/></node>
+  <node id="2" lat="1" lon="1"><tag k="shop" v="bakery"/></node>
+  <node id="3" lat="50" lon="50"><tag k="amenity" v="bar"/></node>
+  <node id="4" lat="1.1" lon="1.1"/>
+  <node id="5" lat="1.2" lon="1.2"/>
+  <node id="6" lat="10" lon="10"/>
+  <node id="7" lat="11" lon="11"/>
+  <node id="8" lat="1.3" lon="1.3"/>
+  <way id="10"><nd ref="5"/><nd ref="6"/><tag k="amenity" v="parking"/></way>
+  <way id="11"><nd ref="6"/><nd ref="7"/><tag k="amenity" v="parking"/></way>
+  <way id="12"><nd ref="5"/><nd ref="8"/><tag k="shop" v="mall"/></way>
+  <relation id="20"><member type="way" ref="12" role="outer"/><tag k="amenity" v="marketplace"/></relation>
+</osm>
+)";
+
+        OSM::DataSet dataSet;
+        OSM::ReaderFilter filter;
+        filter.setBoundingBox({OSM::Coordinate(0.0, 0.0), OSM::Coordinate(2.0, 2.0)});
+        filter.setTagKeys({dataSet.makeTagKey("amenity", OSM::StringMemory::Transient)});
+        auto p = OSM::IO::readerForMimeType(u"application/vnd.openstreetmap.data+xml", &dataSet);
+        QVERIFY(p);
+        p->setFilter(&filter);
+        p->read(reinterpret_cast<const uint8_t*>(filterData), sizeof(filterData) - 1);
+        QVERIFY(!p->hasError());
+
+        // rejected elements are dropped, unless needed by accepted ones
+        QCOMPARE(dataSet.nodes.size(), 4);
+        QCOMPARE(dataSet.nodes[0].id, 1);
+        QCOMPARE(OSM::tagValue(dataSet.nodes[0], "amenity"), "cafe");
+        QCOMPARE(dataSet.nodes[1].id, 5);
+        QCOMPARE(dataSet.nodes[2].id, 6);
+        QCOMPARE(dataSet.nodes[3].id, 8);
+        QCOMPARE(dataSet.ways.size(), 2);
+        QCOMPARE(dataSet.ways[0].id, 10);
+        QCOMPARE(OSM::tagValue(dataSet.ways[0], "amenity"), "parking");
+        QCOMPARE(dataSet.ways[1].id, 12);
+        QVERIFY(dataSet.ways[1].tags.empty());
+        QCOMPARE(dataSet.relations.size(), 1);
+        QCOMPARE(OSM::tagValue(dataSet.relations[0], "amenity"), "marketplace");
+
+        // elements that were in the data set already are not removed
+        OSM::DataSet existingDataSet;
+        OSM::Node existingNode;
+        existingNode.id = 100;
+        existingNode.coordinate = OSM::Coordinate(1.5, 1.5);
+        existingDataSet.addNode(std::move(existingNode));
+        filter.setTagKeys({existingDataSet.makeTagKey("amenity", OSM::StringMemory::Transient)});
+        p = OSM::IO::readerForMimeType(u"application/vnd.openstreetmap.data+xml", &existingDataSet);
+        QVERIFY(p);
+        p->setFilter(&filter);
+        p->read(reinterpret_cast<const uint8_t*>(filterData), sizeof(filterData) - 1);
+        QVERIFY(!p->hasError());
+        QCOMPARE(existingDataSet.nodes.size(), 5);
+        QCOMPARE(existingDataSet.nodes[4].id, 100);
+        QCOMPARE(existingDataSet.ways.size(), 2);
+        QCOMPARE(existingDataSet.relations.size(), 1);
+    }
+
+    void testParseFile()
+    {
+        OSM::DataSet dataSet;
+        auto p = OSM::IO::readerForMimeType(u"application/vnd.openstreetmap.data+xml", &dataSet);
+        QVERIFY(p);
+        QFile f(QStringLiteral(SOURCE_DIR "/data/platforms/berlin-central.osm"));
+        QVERIFY(f.open(QFile::ReadOnly));
+        p->read(&f);
+        QVERIFY(!p->hasError());
+        QVERIFY(!dataSet.nodes.empty());
+        QVERIFY(!dataSet.ways.empty());
+        QVERIFY(!dataSet.relations.empty());
+    }
+};
+
+QTEST_GUILESS_MAIN(XmlParserTest)
+
+#include "xmlparsertest.moc"
@@ -43,7 +43,15 @@ MapData AmenityModel::mapData() const
 void AmenityModel::setMapData(const MapData &data)
 {
     if (m_data == data) {
-        return;
+        if (m_changeRevision == data.changeRevision()) {
+            return;
+        }
+        if (const auto changedLevels = data.changedLevels(m_changeRevision)) {
+            m_changeRevision = data.changeRevision();
+            updateLevels(*changedLevels);
+            Q_EMIT mapDataChanged();
+            return;
+        }
     }
 
     if (m_style.isEmpty()) {
@@ -58,6 +66,7 @@ void AmenityModel::setMapData(const MapData &data)
     beginResetModel();
     m_entries.clear();
     m_data = data;
+    m_changeRevision = m_data.changeRevision();
     if (!m_data.isEmpty()) {
         m_style.compile(m_data.dataSet());
     }
@@ -211,89 +220,148 @@ struct {
 };
 
 void AmenityModel::populateModel()
+{
+    for (auto it = m_data.levelMap().begin(); it != m_data.levelMap().end(); ++it) {
+        appendEntries((*it).first, (*it).second, m_entries);
+    }
+    deduplicateEntries(m_entries);
+
+    // sort by group
+    std::sort(m_entries.begin(), m_entries.end(), [](const auto &lhs, const auto &rhs) {
+        return lhs.group < rhs.group;
+    });
+    qCDebug(Log) << m_entries.size() << "amenities found";
+}
+
+void AmenityModel::appendEntries(const MapLevel &level, const std::vector<OSM::Element> &elements, std::vector<Entry> &entries) const
 {
     const auto layerKey = m_data.dataSet().tagKey("layer");
 
     MapCSSResult filterResult;
-    for (auto it = m_data.levelMap().begin(); it != m_data.levelMap().end(); ++it) {
-        for (const auto &e : (*it).second) {
-            if (!OSM::contains(m_data.boundingBox(), e.center())) {
-                continue;
-            }
+    for (const auto &e : elements) {
+        if (!OSM::contains(m_data.boundingBox(), e.center())) {
+            continue;
+        }
 
-            MapCSSState filterState;
-            filterState.element = e;
-            m_style.initializeState(filterState);
-            m_style.evaluate(filterState, filterResult);
+        MapCSSState filterState;
+        filterState.element = e;
+        m_style.initializeState(filterState);
+        m_style.evaluate(filterState, filterResult);
 
-            const auto &res = filterResult[{}];
-            if (auto prop = res.declaration(MapCSSProperty::Opacity); !prop || prop->doubleValue() < 1.0) {
-                continue; // hidden element
-            }
+        const auto &res = filterResult[{}];
+        if (auto prop = res.declaration(MapCSSProperty::Opacity); !prop || prop->doubleValue() < 1.0) {
+            continue; // hidden element
+        }
 
-            const auto group = res.resolvedTagValue(layerKey, filterState);
-            if (!group) {
-                continue;
-            }
-            const auto groupIt = std::find_if(std::begin(group_map), std::end(group_map), [&group](const auto &m) { return std::strcmp(m.groupName, (*group).constData()) == 0; });
-            if (groupIt == std::end(group_map)) {
-                continue; // no group assigned
-            }
+        const auto group = res.resolvedTagValue(layerKey, filterState);
+        if (!group) {
+            continue;
+        }
+        const auto groupIt = std::find_if(std::begin(group_map), std::end(group_map), [&group](const auto &m) { return std::strcmp(m.groupName, (*group).constData()) == 0; });
+        if (groupIt == std::end(group_map)) {
+            continue; // no group assigned
+        }
 
-            Entry entry;
-            entry.element = e;
-            entry.group = (*groupIt).group;
+        Entry entry;
+        entry.element = e;
+        entry.group = (*groupIt).group;
 
-            QByteArray typeKey;
-            if (auto prop = res.declaration(MapCSSProperty::FontFamily); prop) {
-                typeKey = prop->keyValue();
-            }
-            if (typeKey.isEmpty()) {
-                continue;
-            }
+        QByteArray typeKey;
+        if (auto prop = res.declaration(MapCSSProperty::FontFamily); prop) {
+            typeKey = prop->keyValue();
+        }
+        if (typeKey.isEmpty()) {
+            continue;
+        }
 
-            const auto types = e.tagValue(typeKey.constData()).split(';');
-            for (const auto &type : types) {
-                if (Localization::hasAmenityTypeTranslation(type.trimmed().constData())) {
-                    entry.typeKey = std::move(typeKey);
-                    break;
-                }
-            }
-            if (entry.typeKey.isEmpty()) {
-                qCDebug(Log) << "unknown type: " << types << e.url();
-                continue;
+        const auto types = e.tagValue(typeKey.constData()).split(';');
+        for (const auto &type : types) {
+            if (Localization::hasAmenityTypeTranslation(type.trimmed().constData())) {
+                entry.typeKey = std::move(typeKey);
+                break;
             }
+        }
+        if (entry.typeKey.isEmpty()) {
+            qCDebug(Log) << "unknown type: " << types << e.url();
+            continue;
+        }
 
-            if (auto prop = res.declaration(MapCSSProperty::IconImage); prop) {
-                entry.icon = prop->stringValue();
-                if (entry.icon.isEmpty()) {
-                    entry.icon = QString::fromUtf8(e.tagValue(prop->keyValue().constData()));
-                }
+        if (auto prop = res.declaration(MapCSSProperty::IconImage); prop) {
+            entry.icon = prop->stringValue();
+            if (entry.icon.isEmpty()) {
+                entry.icon = QString::fromUtf8(e.tagValue(prop->keyValue().constData()));
             }
-
-            entry.level = (*it).first.numericLevel(); // TODO we only need one entry, not one per level!
-            m_entries.push_back(std::move(entry));
         }
+
+        entry.level = level.numericLevel(); // TODO we only need one entry, not one per level!
+        entries.push_back(std::move(entry));
     }
+}
 
+void AmenityModel::deduplicateEntries(std::vector<Entry> &entries)
+{
     // de-duplicate multi-level entries
     // we could also just iterate over the non-level-split data, but
     // then we need to reparse the level data here...
-    std::sort(m_entries.begin(), m_entries.end(), [](const auto &lhs, const auto &rhs) {
+    std::sort(entries.begin(), entries.end(), [](const auto &lhs, const auto &rhs) {
         if (lhs.element == rhs.element) {
             return std::abs(lhs.level) < std::abs(rhs.level);
         }
         return lhs.element < rhs.element;
     });
-    m_entries.erase(std::unique(m_entries.begin(), m_entries.end(), [](const auto &lhs, const auto &rhs) {
+    entries.erase(std::unique(entries.begin(), entries.end(), [](const auto &lhs, const auto &rhs) {
         return lhs.element == rhs.element;
-    }), m_entries.end());
+    }), entries.end());
+}
 
-    // sort by group
-    std::sort(m_entries.begin(), m_entries.end(), [](const auto &lhs, const auto &rhs) {
-        return lhs.group < rhs.group;
-    });
-    qCDebug(Log) << m_entries.size() << "amenities found";
+void AmenityModel::updateLevels(const std::vector<MapLevel> &changedLevels)
+{
+    // change sets can introduce new tag keys
+    m_style.compile(m_data.dataSet());
+    if (m_entries.empty()) {
+        return; // not populated yet, that happens on first use
+    }
+
+    std::vector<Entry> entries;
+    for (const auto &level : changedLevels) {
+        if (const auto it = m_data.levelMap().find(level); it != m_data.levelMap().end()) {
+            appendEntries((*it).first, (*it).second, entries);
+        }
+    }
+    deduplicateEntries(entries);
+
+    // remove entries of the changed levels, in contiguous blocks
+    const auto isChangedLevel = [&changedLevels](int level) {
+        return std::any_of(changedLevels.begin(), changedLevels.end(), [level](const auto &l) { return l.numericLevel() == level; });
+    };
+    for (auto row = (int)m_entries.size() - 1; row >= 0;) {
+        if (!isChangedLevel(m_entries[row].level)) {
+            --row;
+            continue;
+        }
+        auto first = row;
+        while (first > 0 && isChangedLevel(m_entries[first - 1].level)) {
+            --first;
+        }
+        beginRemoveRows({}, first, row);
+        m_entries.erase(m_entries.begin() + first, m_entries.begin() + row + 1);
+        endRemoveRows();
+        row = first - 1;
+    }
+
+    // add the new ones in group order, unless already present from an unchanged level
+    for (auto &entry : entries) {
+        if (std::any_of(m_entries.begin(), m_entries.end(), [&entry](const auto &e) { return e.element == entry.element; })) {
+            continue;
+        }
+        const auto it = std::upper_bound(m_entries.begin(), m_entries.end(), entry.group, [](Group group, const auto &e) {
+            return group < e.group;
+        });
+        const auto row = (int)std::distance(m_entries.begin(), it);
+        beginInsertRows({}, row, row);
+        m_entries.insert(it, std::move(entry));
+        endInsertRows();
+    }
 }
 
 #include "moc_amenitymodel.cpp"
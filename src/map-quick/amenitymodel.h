@@ -25,6 +25,9 @@ public:
     ~AmenityModel();
 
     [[nodiscard]] MapData mapData() const;
+    /** Setting the same map data again after it has been changed in place only
+     *  evaluates the changed levels again, see MapData::changedLevels().
+     */
     void setMapData(const MapData &data);
 
     enum Role {
@@ -74,9 +77,13 @@ private:
     };
 
     void populateModel();
+    void updateLevels(const std::vector<MapLevel> &changedLevels);
+    void appendEntries(const MapLevel &level, const std::vector<OSM::Element> &elements, std::vector<Entry> &entries) const;
+    static void deduplicateEntries(std::vector<Entry> &entries);
     static QString iconSource(const Entry &entry);
 
     MapData m_data;
+    int m_changeRevision = 0;
     MapCSSStyle m_style;
     std::vector<Entry> m_entries;
     OSM::Languages m_langs;
@@ -19,6 +19,8 @@
 #include <QQuickWindow>
 #include <QTimeZone>
 
+#include <utility>
+
 using namespace KOSMIndoorMap;
 
 MapItem::MapItem(QQuickItem *parent)
@@ -29,6 +31,7 @@ MapItem::MapItem(QQuickItem *parent)
 {
     connect(m_loader, &MapLoader::isLoadingChanged, this, &MapItem::clear);
     connect(m_loader, &MapLoader::done, this, &MapItem::loaderDone);
+    connect(m_loader, &MapLoader::changeSetApplied, this, &MapItem::changeSetApplied);
 
     m_view->setScreenSize({100, 100}); // FIXME this breaks view when done too late!
     m_controller.setView(m_view);
@@ -128,6 +131,7 @@ void MapItem::loaderDone()
         }
         data.setTimeZone(m_data.timeZone());
         m_data = std::move(data);
+        m_changeRevision = m_data.changeRevision();
         m_view->setSceneBoundingBox(m_data.boundingBox());
         m_controller.setMapData(m_data);
         m_style.compile(m_data.dataSet());
@@ -142,6 +146,30 @@ void MapItem::loaderDone()
     update();
 }
 
+void MapItem::changeSetApplied()
+{
+    if (!m_data.changedLevels(m_changeRevision)) {
+        // elements moved in memory, consumers not updating in place must not hold on to any of them
+        m_sg.clear();
+        m_floorLevelModel->setMapData(nullptr);
+        const auto data = std::exchange(m_data, MapData());
+        m_controller.setMapData(m_data);
+        Q_EMIT mapDataChanged();
+        m_data = data;
+    }
+    m_changeRevision = m_data.changeRevision();
+
+    // consumers getting the same map data again only update the changed levels
+    // the view is kept as is, rather than being reset to the new bounding box
+    m_style.compile(m_data.dataSet());
+    m_controller.setMapData(m_data);
+    m_controller.setStyleSheet(&m_style);
+    m_floorLevelModel->setMapData(&m_data);
+    Q_EMIT mapDataChanged();
+    Q_EMIT errorChanged();
+    update();
+}
+
 OSMElement MapItem::elementAt(double x, double y) const
 {
     HitDetector detector;
@@ -165,6 +193,7 @@ void MapItem::clear()
     m_sg.clear();
     m_data = MapData();
     m_controller.setMapData(m_data);
+    m_floorLevelModel->setMapData(nullptr);
     Q_EMIT mapDataChanged();
     Q_EMIT errorChanged();
     update();
@@ -99,6 +99,7 @@ protected:
 private:
     void clear();
     void loaderDone();
+    void changeSetApplied();
     [[nodiscard]] MapData mapData() const;
     [[nodiscard]] QVariant overlaySources() const;
     void setOverlaySources(const QVariant &overlays);
@@ -112,6 +113,8 @@ private:
 
     MapLoader *m_loader = nullptr;
     MapData m_data;
+    /** Revision of m_data propagated to consumers, see MapData::changeRevision(). */
+    int m_changeRevision = 0;
     SceneGraph m_sg;
     View *m_view = nullptr;
     QUrl m_styleSheetUrl;
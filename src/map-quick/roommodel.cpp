@@ -14,6 +14,8 @@
 #include <KOSMIndoorMap/MapCSSParser>
 #include <KOSMIndoorMap/MapCSSResult>
 
+#include <osm/spatialindex.h>
+
 #include <KLocalizedString>
 
 #include <QDebug>
@@ -46,7 +48,15 @@ MapData RoomModel::mapData() const
 void RoomModel::setMapData(const MapData &data)
 {
     if (m_data == data) {
-        return;
+        if (m_changeRevision == data.changeRevision()) {
+            return;
+        }
+        if (const auto changedLevels = data.changedLevels(m_changeRevision)) {
+            m_changeRevision = data.changeRevision();
+            updateLevels(*changedLevels);
+            Q_EMIT mapDataChanged();
+            return;
+        }
     }
 
     if (m_style.isEmpty()) {
@@ -62,6 +72,7 @@ void RoomModel::setMapData(const MapData &data)
     m_buildings.clear();
     m_rooms.clear();
     m_data = data;
+    m_changeRevision = m_data.changeRevision();
     if (!m_data.isEmpty()) {
         m_style.compile(m_data.dataSet());
     }
@@ -161,7 +172,7 @@ QHash<int, QByteArray> RoomModel::roleNames() const
 
 int RoomModel::buildingCount() const
 {
-    return (int)m_buildings.size();
+    return m_buildingCount;
 }
 
 bool RoomModel::isEmpty() const
@@ -185,6 +196,7 @@ void RoomModel::populateModel()
     const auto nameKey = m_data.dataSet().tagKey("name");
     const auto refKey = m_data.dataSet().tagKey("ref");
 
+    m_structureLevels.clear();
     for (auto it = m_data.levelMap().begin(); it != m_data.levelMap().end(); ++it) {
         for (const auto &e : (*it).second) {
             if (e.type() == OSM::Type::Node || !OSM::contains(m_data.boundingBox(), e.center())) {
@@ -195,10 +207,19 @@ void RoomModel::populateModel()
                 building.element = e;
                 // building.outerPath = e.outerPath(m_data.dataSet()); TODO needed?
                 m_buildings.push_back(std::move(building));
+                m_structureLevels.push_back((*it).first.numericLevel());
             }
         }
     }
 
+    // spatial index to find the building containing a level or room
+    std::vector<OSM::BoundingBox> buildingBoxes;
+    buildingBoxes.reserve(m_buildings.size());
+    std::transform(m_buildings.begin(), m_buildings.end(), std::back_inserter(buildingBoxes), [](const auto &building) {
+        return building.element.boundingBox();
+    });
+    m_buildingIndex.build(buildingBoxes);
+
     // find floor levels for each building
     const auto indoorKey = m_data.dataSet().tagKey("indoor");
     for (auto it = m_data.levelMap().begin(); it != m_data.levelMap().end(); ++it) {
@@ -210,101 +231,192 @@ void RoomModel::populateModel()
                 Level level;
                 level.element = e;
                 level.level = (*it).first.numericLevel();
+                m_structureLevels.push_back(level.level);
 
                 // find building this level belongs to
-                for (auto &building : m_buildings) {
-                    // TODO this is likely not precise enough?
-                    if (OSM::intersects(e.boundingBox(), building.element.boundingBox())) {
-                        building.levels.push_back(level);
-                        break;
-                    }
+                // TODO this is likely not precise enough?
+                if (const auto buildings = m_buildingIndex.query(e.boundingBox()); !buildings.empty()) {
+                    m_buildings[buildings.front()].levels.push_back(level);
                 }
             }
         }
     }
 
     // find all rooms
-    MapCSSResult filterResult;
     OpeningHoursCache ohCache;
     ohCache.setMapData(mapData());
     ohCache.setTimeRange(m_beginTime, m_endTime);
-
     for (auto it = m_data.levelMap().begin(); it != m_data.levelMap().end(); ++it) {
-        for (const auto &e : (*it).second) {
-            if (e.type() == OSM::Type::Node || !OSM::contains(m_data.boundingBox(), e.center())) {
-                continue;
-            }
+        appendRooms((*it).first, (*it).second, ohCache, m_rooms);
+    }
+    deduplicateRooms(m_rooms);
 
-            MapCSSState filterState;
-            filterState.element = e;
-            filterState.openingHours = &ohCache;
-            m_style.initializeState(filterState);
-            m_style.evaluate(filterState, filterResult);
+    // sort by building
+    std::sort(m_rooms.begin(), m_rooms.end(), [](const auto &lhs, const auto &rhs) {
+        return lhs.buildingElement < rhs.buildingElement;
+    });
+    updateBuildingCount();
 
-            const auto &res = filterResult[{}];
-            if (auto prop = res.declaration(MapCSSProperty::Opacity); !prop || prop->doubleValue() < 1.0) {
-                continue; // hidden element
-            }
+    qCDebug(Log) << m_buildingCount << "buildings found";
+    qCDebug(Log) << m_rooms.size() << "rooms found";
+    Q_EMIT populated();
+}
 
-            Room room;
-            room.element = e;
-            room.level = (*it).first.numericLevel(); // TODO we only need one entry, not one per level!
+void RoomModel::appendRooms(const MapLevel &level, const std::vector<OSM::Element> &elements, OpeningHoursCache &ohCache, std::vector<Room> &rooms) const
+{
+    MapCSSResult filterResult;
+    for (const auto &e : elements) {
+        if (e.type() == OSM::Type::Node || !OSM::contains(m_data.boundingBox(), e.center())) {
+            continue;
+        }
 
-            // find the building this room is in
-            for (auto &building :m_buildings) {
-                // TODO this is likely not precise enough?
-                if (OSM::intersects(e.boundingBox(), building.element.boundingBox())) {
-                    room.buildingElement = building.element;
-                    ++building.roomCount;
-
-                    // find level meta-data if available
-                    for (const auto &level : building.levels) {
-                        if (level.level == room.level) {
-                            room.levelElement = level.element;
-                            break;
-                        }
-                    }
+        MapCSSState filterState;
+        filterState.element = e;
+        filterState.openingHours = &ohCache;
+        m_style.initializeState(filterState);
+        m_style.evaluate(filterState, filterResult);
 
+        const auto &res = filterResult[{}];
+        if (auto prop = res.declaration(MapCSSProperty::Opacity); !prop || prop->doubleValue() < 1.0) {
+            continue; // hidden element
+        }
+
+        Room room;
+        room.element = e;
+        room.level = level.numericLevel(); // TODO we only need one entry, not one per level!
+
+        // find the building this room is in
+        // TODO this is likely not precise enough?
+        if (const auto buildings = m_buildingIndex.query(e.boundingBox()); !buildings.empty()) {
+            const auto &building = m_buildings[buildings.front()];
+            room.buildingElement = building.element;
+
+            // find level meta-data if available
+            for (const auto &buildingLevel : building.levels) {
+                if (buildingLevel.level == room.level) {
+                    room.levelElement = buildingLevel.element;
                     break;
                 }
             }
+        }
 
-            const auto name = filterResult[{}].resolvedTagValue(m_langs, "name", filterState);
-            if (name) {
-                room.name = QString::fromUtf8(*name);
-            }
-            m_rooms.push_back(std::move(room));
+        const auto name = filterResult[{}].resolvedTagValue(m_langs, "name", filterState);
+        if (name) {
+            room.name = QString::fromUtf8(*name);
         }
+        rooms.push_back(std::move(room));
     }
+}
 
+void RoomModel::deduplicateRooms(std::vector<Room> &rooms)
+{
     // TODO we could accumulate the covered levels and show all of them?
     // de-duplicate multi-level entries
     // we could also just iterate over the non-level-split data, but
     // then we need to reparse the level data here...
-    std::sort(m_rooms.begin(), m_rooms.end(), [](const auto &lhs, const auto &rhs) {
+    std::sort(rooms.begin(), rooms.end(), [](const auto &lhs, const auto &rhs) {
         if (lhs.element == rhs.element) {
             return std::abs(lhs.level) < std::abs(rhs.level);
         }
         return lhs.element < rhs.element;
     });
-    m_rooms.erase(std::unique(m_rooms.begin(), m_rooms.end(), [](const auto &lhs, const auto &rhs) {
+    rooms.erase(std::unique(rooms.begin(), rooms.end(), [](const auto &lhs, const auto &rhs) {
         return lhs.element == rhs.element;
-    }), m_rooms.end());
+    }), rooms.end());
 
     // de-duplicate multi-level rooms that consist of multiple OSM elements (e.g. due to varying sizes per floor)
     // TODO
+}
 
-    // sort by building
-    std::sort(m_rooms.begin(), m_rooms.end(), [](const auto &lhs, const auto &rhs) {
-        return lhs.buildingElement < rhs.buildingElement;
+void RoomModel::updateBuildingCount()
+{
+    // buildings with rooms, m_rooms is sorted by building
+    m_buildingCount = 0;
+    for (auto it = m_rooms.begin(); it != m_rooms.end(); ++it) {
+        if ((*it).buildingElement && (it == m_rooms.begin() || (*std::prev(it)).buildingElement != (*it).buildingElement)) {
+            ++m_buildingCount;
+        }
+    }
+}
+
+void RoomModel::updateLevels(const std::vector<MapLevel> &changedLevels)
+{
+    // change sets can introduce new tag keys
+    m_style.compile(m_data.dataSet());
+    if (m_rooms.empty()) {
+        return; // not populated yet, that happens on first use
+    }
+
+    // all rooms depend on buildings and floor levels, if those changed everything is evaluated again
+    const auto buildingKey = m_data.dataSet().tagKey("building");
+    const auto indoorKey = m_data.dataSet().tagKey("indoor");
+    const auto isStructureChanged = std::any_of(changedLevels.begin(), changedLevels.end(), [&](const auto &level) {
+        if (std::find(m_structureLevels.begin(), m_structureLevels.end(), level.numericLevel()) != m_structureLevels.end()) {
+            return true;
+        }
+        const auto it = m_data.levelMap().find(level);
+        return it != m_data.levelMap().end() && std::any_of((*it).second.begin(), (*it).second.end(), [&](OSM::Element e) {
+            return e.hasTag(buildingKey) || e.tagValue(indoorKey) == "level";
+        });
     });
+    if (isStructureChanged) {
+        beginResetModel();
+        m_buildings.clear();
+        m_rooms.clear();
+        m_buildingCount = 0;
+        endResetModel();
+        return;
+    }
+
+    OpeningHoursCache ohCache;
+    ohCache.setMapData(mapData());
+    ohCache.setTimeRange(m_beginTime, m_endTime);
+    std::vector<Room> rooms;
+    for (const auto &level : changedLevels) {
+        if (const auto it = m_data.levelMap().find(level); it != m_data.levelMap().end()) {
+            appendRooms((*it).first, (*it).second, ohCache, rooms);
+        }
+    }
+    deduplicateRooms(rooms);
+
+    // remove rooms of the changed levels, in contiguous blocks
+    const auto isChangedLevel = [&changedLevels](int level) {
+        return std::any_of(changedLevels.begin(), changedLevels.end(), [level](const auto &l) { return l.numericLevel() == level; });
+    };
+    for (auto row = (int)m_rooms.size() - 1; row >= 0;) {
+        if (!isChangedLevel(m_rooms[row].level)) {
+            --row;
+            continue;
+        }
+        auto first = row;
+        while (first > 0 && isChangedLevel(m_rooms[first - 1].level)) {
+            --first;
+        }
+        beginRemoveRows({}, first, row);
+        m_rooms.erase(m_rooms.begin() + first, m_rooms.begin() + row + 1);
+        endRemoveRows();
+        row = first - 1;
+    }
 
-    // remove buildings without rooms
-    m_buildings.erase(std::remove_if(m_buildings.begin(), m_buildings.end(), [](const auto &b) { return b.roomCount == 0; }), m_buildings.end());
+    // add the new ones in building order, unless already present from an unchanged level
+    for (auto &room : rooms) {
+        if (std::any_of(m_rooms.begin(), m_rooms.end(), [&room](const auto &r) { return r.element == room.element; })) {
+            continue;
+        }
+        const auto it = std::upper_bound(m_rooms.begin(), m_rooms.end(), room.buildingElement, [](OSM::Element building, const auto &r) {
+            return building < r.buildingElement;
+        });
+        const auto row = (int)std::distance(m_rooms.begin(), it);
+        beginInsertRows({}, row, row);
+        m_rooms.insert(it, std::move(room));
+        endInsertRows();
+    }
 
-    qCDebug(Log) << m_buildings.size() << "buildings found";
-    qCDebug(Log) << m_rooms.size() << "rooms found";
-    Q_EMIT populated();
+    const auto buildingCount = m_buildingCount;
+    updateBuildingCount();
+    if (buildingCount != m_buildingCount) {
+        Q_EMIT populated();
+    }
 }
 
 int RoomModel::findRoom(const QString &name) const
@@ -10,6 +10,7 @@
 #include <KOSMIndoorMap/MapCSSStyle>
 
 #include <KOSM/Element>
+#include <KOSM/SpatialIndex>
 
 #include <QAbstractListModel>
 #include <QDateTime>
@@ -17,6 +18,8 @@
 
 namespace KOSMIndoorMap {
 
+class OpeningHoursCache;
+
 /** List all rooms of buildings in a given data set. */
 class RoomModel : public QAbstractListModel
 {
@@ -40,6 +43,9 @@ public:
     ~RoomModel();
 
     [[nodiscard]] MapData mapData() const;
+    /** Setting the same map data again after it has been changed in place only
+     *  evaluates the changed levels again where possible, see MapData::changedLevels().
+     */
     void setMapData(const MapData &data);
 
     enum Role {
@@ -80,7 +86,6 @@ private:
         OSM::Element element;
         QPolygonF outerPath;
         std::vector<Level> levels;
-        int roomCount = 0;
     };
 
     struct Room {
@@ -93,14 +98,24 @@ private:
 
     void ensurePopulated() const;
     void populateModel();
+    void updateLevels(const std::vector<MapLevel> &changedLevels);
+    void appendRooms(const MapLevel &level, const std::vector<OSM::Element> &elements, OpeningHoursCache &ohCache, std::vector<Room> &rooms) const;
+    static void deduplicateRooms(std::vector<Room> &rooms);
+    void updateBuildingCount();
 
     MapData m_data;
+    int m_changeRevision = 0;
     MapCSSStyle m_style;
 
     QDateTime m_beginTime;
     QDateTime m_endTime;
 
     std::vector<Building> m_buildings;
+    /** Spatial index over m_buildings. */
+    OSM::SpatialIndex m_buildingIndex;
+    /** Levels containing buildings or floor levels, everything depends on those. */
+    std::vector<int> m_structureLevels;
+    int m_buildingCount = 0;
     std::vector<Room> m_rooms;
 
     OSM::Languages m_langs;
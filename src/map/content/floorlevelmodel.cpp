@@ -8,6 +8,8 @@
 
 #include <KOSMIndoorMap/MapData>
 
+#include <algorithm>
+
 using namespace KOSMIndoorMap;
 
 FloorLevelModel::FloorLevelModel(QObject *parent)
@@ -20,8 +22,18 @@ FloorLevelModel::~FloorLevelModel() = default;
 
 void FloorLevelModel::setMapData(MapData *data)
 {
+    if (data && m_data == *data && !data->isEmpty()) {
+        if (const auto changedLevels = data->changedLevels(m_changeRevision)) {
+            m_changeRevision = data->changeRevision();
+            updateLevels(*changedLevels);
+            return;
+        }
+    }
+
     beginResetModel();
     m_level.clear();
+    m_data = data ? *data : MapData();
+    m_changeRevision = m_data.changeRevision();
     if (data) {
         for (const auto &l : data->levelMap()) {
             if (l.first.isFullLevel()) {
@@ -32,6 +44,38 @@ void FloorLevelModel::setMapData(MapData *data)
     endResetModel();
 }
 
+void FloorLevelModel::updateLevels(const std::vector<MapLevel> &changedLevels)
+{
+    const auto rowCountBefore = m_level.size();
+    for (const auto &level : changedLevels) {
+        if (!level.isFullLevel()) {
+            continue;
+        }
+        // m_level is in level map order
+        const auto it = std::lower_bound(m_level.begin(), m_level.end(), level);
+        const auto row = (int)std::distance(m_level.begin(), it);
+        const auto isInModel = it != m_level.end() && (*it) == level;
+        const auto levelIt = m_data.levelMap().find(level);
+        if (levelIt == m_data.levelMap().end()) {
+            if (isInModel) {
+                beginRemoveRows({}, row, row);
+                m_level.erase(it);
+                endRemoveRows();
+            }
+        } else if (isInModel) {
+            (*it) = (*levelIt).first;
+            Q_EMIT dataChanged(index(row, 0), index(row, 0));
+        } else {
+            beginInsertRows({}, row, row);
+            m_level.insert(it, (*levelIt).first);
+            endInsertRows();
+        }
+    }
+    if (m_level.size() != rowCountBefore) {
+        Q_EMIT contentChanged();
+    }
+}
+
 int FloorLevelModel::rowCount(const QModelIndex &parent) const
 {
     if (parent.isValid()) {
@@ -9,15 +9,14 @@
 
 #include <kosmindoormap_export.h>
 
+#include <KOSMIndoorMap/MapData>
+
 #include <QAbstractListModel>
 
 #include <vector>
 
 namespace KOSMIndoorMap {
 
-class MapData;
-class MapLevel;
-
 /** Floor level model. */
 class KOSMINDOORMAP_EXPORT FloorLevelModel : public QAbstractListModel
 {
@@ -32,6 +31,9 @@ public:
         MapLevelRole = Qt::UserRole
     };
 
+    /** Setting the same map data again after it has been changed in place only
+     *  updates the changed levels, see MapData::changedLevels().
+     */
     void setMapData(MapData *data);
 
     int rowCount(const QModelIndex &parent = {}) const override;
@@ -68,7 +70,11 @@ Q_SIGNALS:
     void contentChanged();
 
 private:
+    void updateLevels(const std::vector<MapLevel> &changedLevels);
+
     std::vector<MapLevel> m_level;
+    MapData m_data;
+    int m_changeRevision = 0;
 };
 
 }
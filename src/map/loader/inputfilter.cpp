@@ -0,0 +1,65 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "inputfilter_p.h"
+#include "logging.h"
+
+#include "style/mapcssdeclaration_p.h"
+#include "style/mapcssresult.h"
+#include "style/mapcssstate_p.h"
+
+#include <KOSMIndoorMap/MapCSSParser>
+#include <KOSMIndoorMap/MapCSSProperty>
+
+#include <osm/element.h>
+
+using namespace Qt::Literals::StringLiterals;
+using namespace KOSMIndoorMap;
+
+InputFilter::InputFilter(OSM::DataSet &dataSet)
+    : m_countryTag(dataSet.makeTagKey("addr:country"))
+{
+    MapCSSParser p;
+    m_style = p.parse(u":/org.kde.kosmindoormap/assets/css/input-filter.mapcss"_s);
+    if (p.hasError()) {
+        qCWarning(Log) << p.errorMessage();
+    }
+    // tag keys only appear in the data set while reading
+    m_style.compileForLoading(dataSet);
+}
+
+InputFilter::~InputFilter() = default;
+
+bool InputFilter::acceptNode(const OSM::Node &node) const
+{
+    return ReaderFilter::acceptNode(node) && accept(&node);
+}
+
+bool InputFilter::acceptWay(const OSM::Way &way) const
+{
+    return ReaderFilter::acceptWay(way) && accept(&way);
+}
+
+bool InputFilter::acceptRelation(const OSM::Relation &relation) const
+{
+    return ReaderFilter::acceptRelation(relation) && accept(&relation);
+}
+
+bool InputFilter::accept(OSM::Element e) const
+{
+    // MapData detects the region from this before applying the input filter itself
+    if (!e.tagValue(m_countryTag).isEmpty()) {
+        return true;
+    }
+
+    // local state, this is called from multiple threads when parsing in parallel
+    MapCSSState state;
+    state.element = e;
+    m_style.initializeState(state);
+    MapCSSResult result;
+    m_style.evaluate(state, result);
+    const auto prop = result[{}].declaration(MapCSSProperty::Opacity);
+    return !prop || prop->doubleValue() != 0.0;
+}
@@ -0,0 +1,43 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KOSMINDOORMAP_INPUTFILTER_P_H
+#define KOSMINDOORMAP_INPUTFILTER_P_H
+
+#include <KOSMIndoorMap/MapCSSStyle>
+
+#include <osm/datatypes.h>
+#include <osm/readerfilter.h>
+
+namespace OSM {
+class Element;
+}
+
+namespace KOSMIndoorMap {
+
+/** Applies the input filter style sheet while reading, discarding elements it assigns opacity 0.
+ *  This is the same criterion as used by MapData, but avoids storing those elements in the first place.
+ */
+class InputFilter : public OSM::ReaderFilter
+{
+public:
+    /** @p dataSet is the data set that is going to be read into. */
+    explicit InputFilter(OSM::DataSet &dataSet);
+    ~InputFilter();
+
+    [[nodiscard]] bool acceptNode(const OSM::Node &node) const override;
+    [[nodiscard]] bool acceptWay(const OSM::Way &way) const override;
+    [[nodiscard]] bool acceptRelation(const OSM::Relation &relation) const override;
+
+private:
+    [[nodiscard]] bool accept(OSM::Element e) const;
+
+    MapCSSStyle m_style;
+    OSM::TagKey m_countryTag;
+};
+
+}
+
+#endif // KOSMINDOORMAP_INPUTFILTER_P_H
@@ -18,11 +18,16 @@
 #include <KOSMIndoorMap/MapCSSStyle>
 #endif
 
+#include <osm/datasetchanges.h>
 #include <osm/geomath.h>
+#include <osm/spatialindex.h>
 
+#include <QDebug>
 #include <QPointF>
 #include <QTimeZone>
 
+#include <cassert>
+
 using namespace KOSMIndoorMap;
 
 MapLevel::MapLevel(int level)
@@ -81,6 +86,13 @@ int MapLevel::numericLevel() const
 }
 
 namespace KOSMIndoorMap {
+/** Refers to an element independent of its storage location in the data set. */
+struct ElementKey {
+    OSM::Type type;
+    OSM::Id id;
+    auto operator<=>(const ElementKey&) const = default;
+};
+
 class MapDataPrivate {
 public:
     OSM::DataSet m_dataSet;
@@ -90,13 +102,61 @@ public:
     OSM::TagKey m_nameTag;
 
     std::map<MapLevel, std::vector<OSM::Element>> m_levelMap;
+    std::map<MapLevel, OSM::SpatialIndex> m_levelIndex;
     std::map<MapLevel, std::size_t> m_dependentElementCounts;
+    /** Level map content during changes, in level map order, see MapData::beginChanges(). */
+    std::vector<std::vector<ElementKey>> m_levelMapKeys;
+
+    /** See MapData::changeRevision(). */
+    int m_changeRevision = 0;
+    /** Revision each level last changed in place in, including removed levels. */
+    std::map<MapLevel, int> m_levelRevisions;
+    /** Last revision in which existing elements moved in memory. */
+    int m_elementsMovedRevision = 0;
 
     QString m_regionCode;
     QTimeZone m_timeZone;
 };
 }
 
+struct MapData::ProcessingContext {
+    explicit ProcessingContext(OSM::DataSet &dataSet);
+
+    OSM::TagKey levelTag;
+    OSM::TagKey repeatOnTag;
+    OSM::TagKey buildingLevelsTag;
+    OSM::TagKey buildingMinLevelTag;
+    OSM::TagKey buildingLevelsUndergroundTag;
+    OSM::TagKey maxLevelTag;
+    OSM::TagKey minLevelTag;
+    OSM::TagKey countryTag;
+
+#if !BUILD_TOOLS_ONLY
+    MapCSSStyle filter;
+    MapCSSResult filterResult;
+#endif
+};
+
+MapData::ProcessingContext::ProcessingContext(OSM::DataSet &dataSet)
+    : levelTag(dataSet.tagKey("level"))
+    , repeatOnTag(dataSet.tagKey("repeat_on"))
+    , buildingLevelsTag(dataSet.tagKey("building:levels"))
+    , buildingMinLevelTag(dataSet.tagKey("building:min_level"))
+    , buildingLevelsUndergroundTag(dataSet.tagKey("building:levels:underground"))
+    , maxLevelTag(dataSet.tagKey("max_level"))
+    , minLevelTag(dataSet.tagKey("min_level"))
+    , countryTag(dataSet.tagKey("addr:country"))
+{
+#if !BUILD_TOOLS_ONLY
+    MapCSSParser p;
+    filter = p.parse(QStringLiteral(":/org.kde.kosmindoormap/assets/css/input-filter.mapcss"));
+    if (p.hasError()) {
+        qWarning() << p.errorMessage();
+    }
+    filter.compile(dataSet);
+#endif
+}
+
 MapData::MapData()
     : d(std::make_shared<MapDataPrivate>())
 {
@@ -131,16 +191,226 @@ OSM::DataSet& MapData::dataSet()
 
 void MapData::setDataSet(OSM::DataSet &&dataSet)
 {
+    d->m_elementsMovedRevision = ++d->m_changeRevision;
+    d->m_levelRevisions.clear();
+
     d->m_dataSet = std::move(dataSet);
+    d->m_dataSet.buildNodeIndex();
 
     d->m_levelRefTag = d->m_dataSet.tagKey("level:ref");
     d->m_nameTag = d->m_dataSet.tagKey("name");
 
     d->m_levelMap.clear();
+    d->m_levelIndex.clear();
     d->m_bbox = {};
 
     processElements();
     filterLevels();
+    // after processElements(), which can update way bounding boxes
+    buildIndexes();
+}
+
+void MapData::setProcessedDataSet(OSM::DataSet &&dataSet, std::map<MapLevel, std::vector<OSM::Element>> &&levelMap)
+{
+    d->m_elementsMovedRevision = ++d->m_changeRevision;
+    d->m_levelRevisions.clear();
+
+    d->m_dataSet = std::move(dataSet);
+    d->m_dataSet.buildNodeIndex();
+    d->m_levelMap = std::move(levelMap);
+    d->m_dependentElementCounts.clear();
+    buildIndexes();
+}
+
+static void buildLevelIndex(OSM::SpatialIndex &index, const std::vector<OSM::Element> &elements, std::vector<OSM::BoundingBox> &boxes)
+{
+    boxes.clear();
+    boxes.reserve(elements.size());
+    std::transform(elements.begin(), elements.end(), std::back_inserter(boxes), [](OSM::Element e) { return e.boundingBox(); });
+    index.build(boxes);
+}
+
+void MapData::buildIndexes()
+{
+    d->m_dataSet.buildWayCoordinates();
+
+    d->m_levelIndex.clear();
+    std::vector<OSM::BoundingBox> boxes;
+    for (const auto &level : d->m_levelMap) {
+        buildLevelIndex(d->m_levelIndex[level.first], level.second, boxes);
+    }
+}
+
+void MapData::beginChanges()
+{
+    d->m_levelMapKeys.clear();
+    d->m_levelMapKeys.reserve(d->m_levelMap.size());
+    for (const auto &[level, elements] : d->m_levelMap) {
+        auto &keys = d->m_levelMapKeys.emplace_back();
+        keys.reserve(elements.size());
+        std::transform(elements.begin(), elements.end(), std::back_inserter(keys), [](OSM::Element e) { return ElementKey{e.type(), e.id()}; });
+    }
+}
+
+std::vector<MapLevel> MapData::endChanges(const OSM::DataSetChanges &changes)
+{
+    auto &dataSet = d->m_dataSet;
+    dataSet.buildNodeIndex();
+    d->m_levelRefTag = dataSet.tagKey("level:ref");
+    d->m_nameTag = dataSet.tagKey("name");
+
+    // elements to process again, moving nodes also changes the geometry of everything containing them
+    std::vector<ElementKey> affected;
+    const auto addAffected = [&affected](OSM::Type type, const std::vector<OSM::Id> &ids) {
+        std::transform(ids.begin(), ids.end(), std::back_inserter(affected), [type](OSM::Id id) { return ElementKey{type, id}; });
+    };
+    addAffected(OSM::Type::Node, changes.modifiedNodes);
+    addAffected(OSM::Type::Node, changes.deletedNodes);
+    addAffected(OSM::Type::Way, changes.modifiedWays);
+    addAffected(OSM::Type::Way, changes.deletedWays);
+    addAffected(OSM::Type::Relation, changes.modifiedRelations);
+    addAffected(OSM::Type::Relation, changes.deletedRelations);
+
+    if (!changes.modifiedNodes.empty() || !changes.deletedNodes.empty()) {
+        auto nodeIds = changes.modifiedNodes;
+        nodeIds.insert(nodeIds.end(), changes.deletedNodes.begin(), changes.deletedNodes.end());
+        std::sort(nodeIds.begin(), nodeIds.end());
+        for (const auto &way : dataSet.ways) {
+            if (std::any_of(way.nodes.begin(), way.nodes.end(), [&nodeIds](OSM::Id id) { return std::binary_search(nodeIds.begin(), nodeIds.end(), id); })) {
+                affected.push_back({OSM::Type::Way, way.id});
+            }
+        }
+    }
+    std::sort(affected.begin(), affected.end());
+    affected.erase(std::unique(affected.begin(), affected.end()), affected.end());
+
+    const auto isAffected = [&affected](ElementKey key) {
+        return std::binary_search(affected.begin(), affected.end(), key);
+    };
+    // relations can contain other relations, so repeat until nothing new is affected
+    std::vector<ElementKey> affectedRelations;
+    do {
+        affectedRelations.clear();
+        for (const auto &rel : dataSet.relations) {
+            if (isAffected({OSM::Type::Relation, rel.id})) {
+                continue;
+            }
+            if (std::any_of(rel.members.begin(), rel.members.end(), [&isAffected](const auto &mem) { return isAffected({mem.type(), mem.id}); })) {
+                affectedRelations.push_back({OSM::Type::Relation, rel.id});
+            }
+        }
+        affected.insert(affected.end(), affectedRelations.begin(), affectedRelations.end());
+        std::sort(affected.begin(), affected.end());
+    } while (!affectedRelations.empty());
+
+    // remove affected elements, and look up the remaining ones again
+    std::vector<MapLevel> changedLevels;
+    std::map<MapLevel, std::size_t> levelSizes;
+    assert(d->m_levelMapKeys.size() == d->m_levelMap.size());
+    auto keysIt = d->m_levelMapKeys.begin();
+    for (auto &[level, elements] : d->m_levelMap) {
+        const auto &keys = *keysIt++;
+        elements.clear();
+        for (const auto key : keys) {
+            if (isAffected(key)) {
+                continue;
+            }
+            if (const auto e = OSM::lookupElement(dataSet, key.type, key.id)) {
+                elements.push_back(e);
+            }
+        }
+        if (elements.size() != keys.size()) {
+            changedLevels.push_back(level);
+        }
+        levelSizes[level] = elements.size();
+    }
+    d->m_levelMapKeys.clear();
+
+    // process changed and new elements
+    d->m_dependentElementCounts.clear();
+    ProcessingContext context(dataSet);
+    const auto process = [&](OSM::Type type, OSM::Id id) {
+        if (const auto e = OSM::lookupElement(dataSet, type, id)) {
+            processElement(e, context);
+        }
+    };
+    for (const auto key : affected) {
+        process(key.type, key.id);
+    }
+    for (const auto id : changes.createdNodes) {
+        process(OSM::Type::Node, id);
+    }
+    for (const auto id : changes.createdWays) {
+        process(OSM::Type::Way, id);
+    }
+    for (const auto id : changes.createdRelations) {
+        process(OSM::Type::Relation, id);
+    }
+
+    // same as filterLevels() for new levels, and drop levels that became empty
+    for (auto it = d->m_levelMap.begin(); it != d->m_levelMap.end();) {
+        const auto sizeIt = levelSizes.find((*it).first);
+        const auto isNewLevel = sizeIt == levelSizes.end();
+        if (isNewLevel || (*sizeIt).second != (*it).second.size()) {
+            changedLevels.push_back((*it).first);
+        }
+        if ((*it).first.numericLevel() != 0 && ((*it).second.empty() || (isNewLevel && d->m_dependentElementCounts[(*it).first] == (*it).second.size()))) {
+            d->m_levelIndex.erase((*it).first);
+            it = d->m_levelMap.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    d->m_dependentElementCounts.clear();
+    std::sort(changedLevels.begin(), changedLevels.end());
+    changedLevels.erase(std::unique(changedLevels.begin(), changedLevels.end()), changedLevels.end());
+
+    // changed or removed elements can also shrink the bounding box, so compute that from scratch
+    d->m_bbox = {};
+    for (const auto &[level, elements] : d->m_levelMap) {
+        for (const auto e : elements) {
+            d->m_bbox = OSM::unite(e.boundingBox(), d->m_bbox);
+        }
+    }
+
+    dataSet.buildWayCoordinates();
+    std::vector<OSM::BoundingBox> boxes;
+    for (const auto &level : changedLevels) {
+        if (const auto it = d->m_levelMap.find(level); it != d->m_levelMap.end()) {
+            buildLevelIndex(d->m_levelIndex[level], (*it).second, boxes);
+        }
+    }
+
+    ++d->m_changeRevision;
+    for (const auto &level : changedLevels) {
+        d->m_levelRevisions[level] = d->m_changeRevision;
+    }
+    // adding elements to the data set moves the existing ones
+    if (!changes.createdNodes.empty() || !changes.createdWays.empty() || !changes.createdRelations.empty()) {
+        d->m_elementsMovedRevision = d->m_changeRevision;
+    }
+
+    return changedLevels;
+}
+
+int MapData::changeRevision() const
+{
+    return d ? d->m_changeRevision : 0;
+}
+
+std::optional<std::vector<MapLevel>> MapData::changedLevels(int revision) const
+{
+    if (!d || d->m_elementsMovedRevision > revision) {
+        return {};
+    }
+
+    std::vector<MapLevel> levels;
+    for (const auto &[level, levelRevision] : d->m_levelRevisions) {
+        if (levelRevision > revision) {
+            levels.push_back(level);
+        }
+    }
+    return levels;
 }
 
 OSM::BoundingBox MapData::boundingBox() const
@@ -158,103 +428,119 @@ const std::map<MapLevel, std::vector<OSM::Element>>& MapData::levelMap() const
     return d->m_levelMap;
 }
 
-void MapData::processElements()
+const OSM::SpatialIndex* MapData::levelIndex(const MapLevel &level) const
 {
-    const auto levelTag = d->m_dataSet.tagKey("level");
-    const auto repeatOnTag = d->m_dataSet.tagKey("repeat_on");
-    const auto buildingLevelsTag = d->m_dataSet.tagKey("building:levels");
-    const auto buildingMinLevelTag = d->m_dataSet.tagKey("building:min_level");
-    const auto buildingLevelsUndergroundTag = d->m_dataSet.tagKey("building:levels:underground");
-    const auto maxLevelTag = d->m_dataSet.tagKey("max_level");
-    const auto minLevelTag = d->m_dataSet.tagKey("min_level");
-    const auto countryTag = d->m_dataSet.tagKey("addr:country");
+    const auto it = d->m_levelIndex.find(level);
+    return it != d->m_levelIndex.end() ? &(*it).second : nullptr;
+}
 
-#if !BUILD_TOOLS_ONLY
-    MapCSSParser p;
-    auto filter = p.parse(QStringLiteral(":/org.kde.kosmindoormap/assets/css/input-filter.mapcss"));
-    if (p.hasError()) {
-        qWarning() << p.errorMessage();
+std::size_t MapDataMemoryUsage::total() const
+{
+    return dataSet.total() + levelMap + levelIndexes;
+}
+
+// rough estimate of the per-entry overhead of a std::map node
+template <typename Key, typename Value>
+static constexpr std::size_t mapNodeSize = sizeof(std::pair<const Key, Value>) + 4 * sizeof(void*);
+
+MapDataMemoryUsage MapData::memoryUsage() const
+{
+    MapDataMemoryUsage usage;
+    usage.dataSet = d->m_dataSet.memoryUsage();
+    for (const auto &[level, elements] : d->m_levelMap) {
+        usage.levelMap += mapNodeSize<MapLevel, std::vector<OSM::Element>> + elements.capacity() * sizeof(OSM::Element);
     }
-    filter.compile(d->m_dataSet);
-    MapCSSResult filterResult;
-#endif
+    usage.levelMap += d->m_dependentElementCounts.size() * mapNodeSize<MapLevel, std::size_t>;
+    for (const auto &[level, index] : d->m_levelIndex) {
+        usage.levelIndexes += mapNodeSize<MapLevel, OSM::SpatialIndex> + index.memoryUsage();
+    }
+    return usage;
+}
 
+void MapData::processElements()
+{
+    ProcessingContext context(d->m_dataSet);
     OSM::for_each(d->m_dataSet, [&](auto e) {
-        // discard everything here that is tag-less (and thus likely part of a higher-level geometry)
-        if (!e.hasTags()) {
-            return;
-        }
+        processElement(e, context);
+    });
+}
 
-        // attempt to detect the country we are in
-        if (d->m_regionCode.isEmpty()) {
-            const auto countryCode = e.tagValue(countryTag);
-            if (countryCode.size() == 2 && std::isupper(static_cast<unsigned char>(countryCode[0])) && std::isupper(static_cast<unsigned char>(countryCode[1]))) {
-                d->m_regionCode = QString::fromUtf8(countryCode);
-            }
+void MapData::processElement(OSM::Element e, ProcessingContext &context)
+{
+    // discard everything here that is tag-less (and thus likely part of a higher-level geometry)
+    if (!e.hasTags()) {
+        return;
+    }
+
+    // attempt to detect the country we are in
+    if (d->m_regionCode.isEmpty()) {
+        const auto countryCode = e.tagValue(context.countryTag);
+        if (countryCode.size() == 2 && std::isupper(static_cast<unsigned char>(countryCode[0])) && std::isupper(static_cast<unsigned char>(countryCode[1]))) {
+            d->m_regionCode = QString::fromUtf8(countryCode);
         }
+    }
 
-        // apply the input filter, anything that explicitly got opacity 0 will be discarded
-        bool isDependentElement = false;
+    // apply the input filter, anything that explicitly got opacity 0 will be discarded
+    bool isDependentElement = false;
 #if !BUILD_TOOLS_ONLY
-        MapCSSState filterState;
-        filterState.element = e;
-        filter.initializeState(filterState);
-        filter.evaluate(filterState, filterResult);
-        if (auto prop = filterResult[{}].declaration(MapCSSProperty::Opacity)) {
-            if (prop->doubleValue() == 0.0) {
-                qDebug() << "input filter dropped" << e.url();
-                return;
-            }
-            // anything that doesn't work on its own is a "dependent element"
-            // we discard levels only containing dependent elements, but we retain all of them if the
-            // level contains an element we are sure about that we can display it
-            if (prop->doubleValue() < 1.0) {
-                isDependentElement = true;
-            }
+    MapCSSState filterState;
+    filterState.element = e;
+    context.filter.initializeState(filterState);
+    context.filter.evaluate(filterState, context.filterResult);
+    if (auto prop = context.filterResult[{}].declaration(MapCSSProperty::Opacity)) {
+        if (prop->doubleValue() == 0.0) {
+            qDebug() << "input filter dropped" << e.url();
+            return;
         }
+        // anything that doesn't work on its own is a "dependent element"
+        // we discard levels only containing dependent elements, but we retain all of them if the
+        // level contains an element we are sure about that we can display it
+        if (prop->doubleValue() < 1.0) {
+            isDependentElement = true;
+        }
+    }
 #endif
 
-        // bbox computation
-        e.recomputeBoundingBox(d->m_dataSet);
-        d->m_bbox = OSM::unite(e.boundingBox(), d->m_bbox);
-
-        // multi-level building element
-        // we handle this first, before level=, as level is often used instead
-        // of building:min_level in combination with building:level
-        const auto buildingLevels = e.tagValue(buildingLevelsTag, maxLevelTag).toInt();
-        if (buildingLevels > 0) {
-            const auto startLevel = e.tagValue(buildingMinLevelTag, levelTag, minLevelTag).toInt();
-            //qDebug() << startLevel << buildingLevels << e.url();
-            for (auto i = startLevel; i < startLevel + buildingLevels; ++i) {
-                addElement(i * 10, e, true);
-            }
-        }
-        const auto undergroundLevels = e.tagValue(buildingLevelsUndergroundTag).toUInt();
-        for (auto i = undergroundLevels; i > 0; --i) {
-            addElement(-i * 10, e, true);
-        }
-        if (buildingLevels > 0 || undergroundLevels > 0) {
-            return;
+    // bbox computation
+    e.recomputeBoundingBox(d->m_dataSet);
+    d->m_bbox = OSM::unite(e.boundingBox(), d->m_bbox);
+
+    // multi-level building element
+    // we handle this first, before level=, as level is often used instead
+    // of building:min_level in combination with building:level
+    const auto buildingLevels = e.tagValue(context.buildingLevelsTag, context.maxLevelTag).toInt();
+    if (buildingLevels > 0) {
+        const auto startLevel = e.tagValue(context.buildingMinLevelTag, context.levelTag, context.minLevelTag).toInt();
+        //qDebug() << startLevel << buildingLevels << e.url();
+        for (auto i = startLevel; i < startLevel + buildingLevels; ++i) {
+            addElement(i * 10, e, true);
         }
+    }
+    const auto undergroundLevels = e.tagValue(context.buildingLevelsUndergroundTag).toUInt();
+    for (auto i = undergroundLevels; i > 0; --i) {
+        addElement(-i * 10, e, true);
+    }
+    if (buildingLevels > 0 || undergroundLevels > 0) {
+        return;
+    }
 
-        // element with explicit level specified
-        auto level = e.tagValue(levelTag);
-        auto repeatOn = e.tagValue(repeatOnTag);
-        if (level.isEmpty() && repeatOn.isEmpty()) {
-            // no level information available
-            d->m_levelMap[MapLevel{}].push_back(e);
-            if (isDependentElement) {
-                d->m_dependentElementCounts[MapLevel{}]++;
-            }
-        } else {
-            LevelParser::parse(std::move(level), e, [this, isDependentElement](int level, OSM::Element e) {
-                addElement(level, e, isDependentElement);
-            });
-            LevelParser::parse(std::move(repeatOn), e, [this, isDependentElement](int level, OSM::Element e) {
-                addElement(level, e, isDependentElement);
-            });
+    // element with explicit level specified
+    auto level = e.tagValue(context.levelTag);
+    auto repeatOn = e.tagValue(context.repeatOnTag);
+    if (level.isEmpty() && repeatOn.isEmpty()) {
+        // no level information available
+        d->m_levelMap[MapLevel{}].push_back(e);
+        if (isDependentElement) {
+            d->m_dependentElementCounts[MapLevel{}]++;
         }
-    });
+    } else {
+        LevelParser::parse(std::move(level), e, [this, isDependentElement](int level, OSM::Element e) {
+            addElement(level, e, isDependentElement);
+        });
+        LevelParser::parse(std::move(repeatOn), e, [this, isDependentElement](int level, OSM::Element e) {
+            addElement(level, e, isDependentElement);
+        });
+    }
 }
 
 void MapData::addElement(int level, OSM::Element e, bool isDependentElement)
@@ -352,4 +638,14 @@ QString MapData::timeZoneId() const
     return QString::fromUtf8(d->m_timeZone.id());
 }
 
+QDebug operator<<(QDebug debug, const KOSMIndoorMap::MapDataMemoryUsage &usage)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace() << "MapDataMemoryUsage(total: " << usage.total()
+        << ", level map: " << usage.levelMap
+        << ", level indexes: " << usage.levelIndexes
+        << ", data set: " << usage.dataSet << ')';
+    return debug;
+}
+
 #include "moc_mapdata.cpp"
@@ -16,11 +16,18 @@
 
 #include <map>
 #include <memory>
+#include <optional>
 #include <vector>
 
+class QDebug;
 class QPointF;
 class QTimeZone;
 
+namespace OSM {
+class DataSetChanges;
+class SpatialIndex;
+}
+
 namespace KOSMIndoorMap {
 
 /** A floor level. */
@@ -54,6 +61,23 @@ Q_DECLARE_METATYPE(KOSMIndoorMap::MapLevel)
 
 namespace KOSMIndoorMap {
 class MapDataPrivate;
+class MapDataSnapshot;
+
+/** Approximate heap memory used by MapData, in bytes.
+ *  @see MapData::memoryUsage()
+ */
+class KOSMINDOORMAP_EXPORT MapDataMemoryUsage
+{
+public:
+    /** Total of the data set and the level structures. */
+    [[nodiscard]] std::size_t total() const;
+
+    OSM::DataSetMemoryUsage dataSet;
+    /** Level map and the per-level element vectors. */
+    std::size_t levelMap = 0;
+    /** Per-level spatial indexes. */
+    std::size_t levelIndexes = 0;
+};
 
 /** Raw OSM map data, separated by levels. */
 class KOSMINDOORMAP_EXPORT MapData
@@ -86,10 +110,44 @@ public:
     [[nodiscard]] OSM::DataSet& dataSet();
     void setDataSet(OSM::DataSet &&dataSet);
 
+    /** Prepare for modifying dataSet() in place, e.g. when applying a change set.
+     *  Elements in levelMap() must not be used until endChanges() has been called,
+     *  as adding elements to the data set can invalidate them.
+     */
+    void beginChanges();
+    /** Update levels and indexes for the @p changes made to dataSet() since beginChanges().
+     *  Only the elements affected by @p changes are processed again, rather than everything
+     *  as in setDataSet(). The bounding box is computed from the resulting levels, replacing
+     *  one set via setBoundingBox().
+     *
+     *  Anything holding on to this map data can find out what changed in place via
+     *  changeRevision() and changedLevels(). MapLoader::applyChangeSet() uses this.
+     *
+     *  @returns The levels whose content changed, including those that have been removed.
+     */
+    std::vector<MapLevel> endChanges(const OSM::DataSetChanges &changes);
+
+    /** Incremented by every endChanges() and setDataSet() call. */
+    [[nodiscard]] int changeRevision() const;
+    /** The levels changed in place after @p revision of changeRevision(), in level map order.
+     *  Returns nothing if elements have been added to the data set since then, or it has
+     *  been replaced entirely. That moves existing elements in memory and thus invalidates
+     *  all OSM::Element instances obtained before, so everything has to be reset then.
+     */
+    [[nodiscard]] std::optional<std::vector<MapLevel>> changedLevels(int revision) const;
+
     [[nodiscard]] OSM::BoundingBox boundingBox() const;
     void setBoundingBox(OSM::BoundingBox bbox);
 
     [[nodiscard]] const std::map<MapLevel, std::vector<OSM::Element>>& levelMap() const;
+    /** Spatial index over the element bounding boxes of @p level.
+     *  Item positions refer to the element vector of that level in levelMap().
+     *  @returns @c nullptr if @p level doesn't exist.
+     */
+    [[nodiscard]] const OSM::SpatialIndex* levelIndex(const MapLevel &level) const;
+
+    /** Approximate memory used by this map data. */
+    [[nodiscard]] MapDataMemoryUsage memoryUsage() const;
 
     [[nodiscard]] QPointF center() const;
     [[nodiscard]] float radius() const;
@@ -103,10 +161,18 @@ public:
     void setTimeZone(const QTimeZone &tz);
 
 private:
+    friend class MapDataSnapshot;
+
+    struct ProcessingContext;
     void processElements();
+    void processElement(OSM::Element e, ProcessingContext &context);
     void addElement(int level, OSM::Element e, bool isDependentElement);
     [[nodiscard]] QString levelName(OSM::Element e) const;
     void filterLevels();
+    /** Build lookup indexes for the final level map and data set. */
+    void buildIndexes();
+    /** Set already processed data, e.g. from a snapshot. */
+    void setProcessedDataSet(OSM::DataSet &&dataSet, std::map<MapLevel, std::vector<OSM::Element>> &&levelMap);
 
     [[nodiscard]] QString timeZoneId() const;
 
@@ -117,4 +183,6 @@ private:
 
 Q_DECLARE_METATYPE(KOSMIndoorMap::MapData)
 
+KOSMINDOORMAP_EXPORT QDebug operator<<(QDebug debug, const KOSMIndoorMap::MapDataMemoryUsage &usage);
+
 #endif // KOSMINDOORMAP_MAPDATA_H
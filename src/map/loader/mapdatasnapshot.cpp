@@ -0,0 +1,184 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "mapdatasnapshot_p.h"
+#include "mapdata.h"
+
+#include <osm/datatypes.h>
+#include <osm/element.h>
+#include <osm/snapshotparser.h>
+#include <osm/snapshotwriter.h>
+
+#include <QDataStream>
+#include <QFile>
+#include <QIODevice>
+#include <QTimeZone>
+
+#include <cstring>
+
+using namespace Qt::Literals::StringLiterals;
+using namespace KOSMIndoorMap;
+
+enum : uint32_t {
+    // extension section ids
+    MapDataSection = 0x4b4d4441, // "KMDA"
+    LevelElementsSection = 0x4b4c564c, // "KLVL"
+
+    // bump this when changes to the map data processing would result in different content
+    MapDataVersion = 1,
+
+    // element references in the level element section: type in the upper two bits, element position in the rest
+    ElementTypeShift = 30,
+    ElementIndexMask = (1u << ElementTypeShift) - 1,
+};
+
+template <typename Elem>
+[[nodiscard]] static uint32_t elementIndex(const std::vector<Elem> &elems, const Elem *elem)
+{
+    return (uint32_t)(elem - elems.data());
+}
+
+bool MapDataSnapshot::write(const MapData &data, QIODevice *io, QString &errorMessage)
+{
+    const auto &dataSet = data.dataSet();
+    const auto &levelMap = data.levelMap();
+
+    QByteArray mapData;
+    QDataStream stream(&mapData, QIODevice::WriteOnly);
+    const auto bbox = data.boundingBox();
+    stream << (quint32)MapDataVersion
+        << bbox.min.latitude << bbox.min.longitude << bbox.max.latitude << bbox.max.longitude
+        << data.regionCode() << data.timeZone().id() << (quint32)levelMap.size();
+
+    std::vector<uint32_t> levelElements;
+    for (const auto &[level, elements] : levelMap) {
+        stream << (qint32)level.numericLevel() << (level.hasName() ? level.name() : QString()) << (quint32)elements.size();
+        for (const auto e : elements) {
+            uint32_t idx = 0;
+            switch (e.type()) {
+                case OSM::Type::Null:
+                    Q_UNREACHABLE();
+                case OSM::Type::Node:
+                    idx = elementIndex(dataSet.nodes, e.node());
+                    break;
+                case OSM::Type::Way:
+                    idx = elementIndex(dataSet.ways, e.way());
+                    break;
+                case OSM::Type::Relation:
+                    idx = elementIndex(dataSet.relations, e.relation());
+                    break;
+            }
+            if (idx > ElementIndexMask) {
+                errorMessage = u"Too many elements for a snapshot."_s;
+                return false;
+            }
+            levelElements.push_back((static_cast<uint32_t>(e.type()) << ElementTypeShift) | idx);
+        }
+    }
+
+    OSM::SnapshotWriter writer;
+    writer.addSection(MapDataSection, mapData);
+    writer.addSection(LevelElementsSection, QByteArray(reinterpret_cast<const char*>(levelElements.data()), (qsizetype)(levelElements.size() * sizeof(uint32_t))));
+    writer.write(dataSet, io);
+    if (writer.hasError()) {
+        errorMessage = writer.errorString();
+        return false;
+    }
+    return true;
+}
+
+MapData MapDataSnapshot::read(std::unique_ptr<QFile> &&file, QString &errorMessage)
+{
+    OSM::DataSet dataSet;
+    OSM::SnapshotParser parser(&dataSet);
+    if (const auto data = file->map(0, file->size())) {
+        parser.read(data, file->size(), OSM::StringMemory::Persistent);
+        dataSet.addMappedFile(std::move(file));
+    } else {
+        parser.read(file.get());
+    }
+    if (parser.hasError()) {
+        errorMessage = parser.errorString();
+        return {};
+    }
+
+    QDataStream stream(parser.section(MapDataSection));
+    quint32 version = 0;
+    stream >> version;
+    if (version != MapDataVersion) {
+        errorMessage = u"Unsupported map data snapshot version."_s;
+        return {};
+    }
+    OSM::BoundingBox bbox;
+    QString regionCode;
+    QByteArray timeZoneId;
+    quint32 levelCount = 0;
+    stream >> bbox.min.latitude >> bbox.min.longitude >> bbox.max.latitude >> bbox.max.longitude
+        >> regionCode >> timeZoneId >> levelCount;
+
+    const auto levelElements = parser.section(LevelElementsSection);
+    const auto levelElementCount = (std::size_t)levelElements.size() / sizeof(uint32_t);
+    std::size_t levelElementIdx = 0;
+
+    const auto &ds = dataSet;
+    std::map<MapLevel, std::vector<OSM::Element>> levelMap;
+    for (quint32 i = 0; i < levelCount && stream.status() == QDataStream::Ok; ++i) {
+        qint32 numericLevel = 0;
+        QString name;
+        quint32 elementCount = 0;
+        stream >> numericLevel >> name >> elementCount;
+        if (elementCount > levelElementCount - levelElementIdx) {
+            errorMessage = u"Invalid map data snapshot level."_s;
+            return {};
+        }
+
+        MapLevel level(numericLevel);
+        level.setName(name);
+        std::vector<OSM::Element> elements;
+        elements.reserve(elementCount);
+        for (quint32 j = 0; j < elementCount; ++j, ++levelElementIdx) {
+            uint32_t ref = 0;
+            std::memcpy(&ref, levelElements.constData() + levelElementIdx * sizeof(uint32_t), sizeof(uint32_t));
+            const auto idx = ref & ElementIndexMask;
+            switch (static_cast<OSM::Type>(ref >> ElementTypeShift)) {
+                case OSM::Type::Node:
+                    if (idx < ds.nodes.size()) {
+                        elements.emplace_back(&ds.nodes[idx]);
+                        continue;
+                    }
+                    break;
+                case OSM::Type::Way:
+                    if (idx < ds.ways.size()) {
+                        elements.emplace_back(&ds.ways[idx]);
+                        continue;
+                    }
+                    break;
+                case OSM::Type::Relation:
+                    if (idx < ds.relations.size()) {
+                        elements.emplace_back(&ds.relations[idx]);
+                        continue;
+                    }
+                    break;
+                case OSM::Type::Null:
+                    break;
+            }
+            errorMessage = u"Invalid map data snapshot element."_s;
+            return {};
+        }
+        levelMap[level] = std::move(elements);
+    }
+    if (stream.status() != QDataStream::Ok) {
+        errorMessage = u"Map data snapshot truncated."_s;
+        return {};
+    }
+
+    // moving the data set retains the element addresses
+    MapData result;
+    result.setProcessedDataSet(std::move(dataSet), std::move(levelMap));
+    result.setBoundingBox(bbox);
+    result.setRegionCode(regionCode);
+    result.setTimeZone(QTimeZone(timeZoneId));
+    return result;
+}
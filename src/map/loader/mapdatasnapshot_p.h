@@ -0,0 +1,48 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KOSMINDOORMAP_MAPDATASNAPSHOT_P_H
+#define KOSMINDOORMAP_MAPDATASNAPSHOT_P_H
+
+#include "kosmindoormap_export.h"
+
+#include <QString>
+
+#include <memory>
+
+class QFile;
+class QIODevice;
+
+namespace KOSMIndoorMap {
+
+class MapData;
+
+/** Binary snapshot of fully processed map data.
+ *  This contains the data set in the OSM snapshot format (see OSM::SnapshotWriter),
+ *  along with the bounding box, region, timezone and level map. Loading this skips
+ *  parsing, geometry assembly, boundary search and element processing entirely.
+ */
+class KOSMINDOORMAP_EXPORT MapDataSnapshot
+{
+public:
+    /** Write @p data as snapshot into @p io.
+     *  @returns @c false if @p data can't be represented as a snapshot, with @p errorMessage set.
+     *  Partial output might have been written to @p io in that case.
+     */
+    [[nodiscard]] static bool write(const MapData &data, QIODevice *io, QString &errorMessage);
+
+    /** Load a snapshot from @p file.
+     *  @param file has to be open, it's memory-mapped and kept alive by the returned data if possible.
+     *  @returns empty map data on failure, with @p errorMessage set.
+     */
+    [[nodiscard]] static MapData read(std::unique_ptr<QFile> &&file, QString &errorMessage);
+
+    /** File name extension of snapshot files. */
+    static constexpr inline const char FileExtension[] = ".kosm";
+};
+
+}
+
+#endif // KOSMINDOORMAP_MAPDATASNAPSHOT_P_H
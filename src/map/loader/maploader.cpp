@@ -10,31 +10,48 @@
 #include "boundarysearch_p.h"
 #include "logging.h"
 #include "mapdata.h"
+#include "mapdatasnapshot_p.h"
 #include "marblegeometryassembler_p.h"
 #include "tilecache_p.h"
 
+#if !BUILD_TOOLS_ONLY
+#include "inputfilter_p.h"
+#endif
+
 #include "network/useragent_p.h"
 
 #include <osm/datatypes.h>
+#include <osm/datasetchanges.h>
 #include <osm/datasetmergebuffer.h>
 #include <osm/element.h>
 #include <osm/o5mparser.h>
 #include <osm/io.h>
 
 #include <QDateTime>
+#include <QDir>
 #include <QElapsedTimer>
 #include <QFile>
+#include <QFileInfo>
 #include <QNetworkReply>
 #include <QNetworkRequest>
 #include <QRect>
+#include <QSaveFile>
+#include <QTemporaryFile>
+#include <QThread>
+#include <QThreadPool>
 #include <QUrl>
 
+#include <algorithm>
 #include <deque>
+#include <memory>
+#include <optional>
+#include <utility>
 
 using namespace Qt::Literals::StringLiterals;
 
 enum {
-    TileZoomLevel = 17
+    TileZoomLevel = 17,
+    DefaultTilePrefetchLimit = 16,
 };
 
 inline void initResources()  // needs to be outside of a namespace
@@ -47,6 +64,11 @@ inline void initResources()  // needs to be outside of a namespace
 namespace KOSMIndoorMap {
 class MapLoaderPrivate {
 public:
+    void cancelPending();
+    void parseTile(const CachedTile &tile, QThread *targetThread);
+    [[nodiscard]] bool loadSnapshot(const Tile &tile, OSM::Coordinate coord, const QDateTime &ttl);
+    void writeSnapshot(const Tile &tile, OSM::Coordinate coord);
+
     NetworkAccessManagerFactory m_nam = KOSMIndoorMap::defaultNetworkAccessManagerFactory; // TODO make externally configurable
     OSM::DataSet m_dataSet;
     OSM::DataSetMergeBuffer m_mergeBuffer;
@@ -60,11 +82,143 @@ public:
     std::unique_ptr<BoundarySearch> m_boundarySearcher;
     QDateTime m_ttl;
     std::deque<QUrl> m_pendingChangeSets;
+    /** Maximum and remaining number of tiles to prefetch for the current request. */
+    int m_tilePrefetchLimit = DefaultTilePrefetchLimit;
+    int m_tilePrefetchBudget = 0;
+    /** m_data has been loaded from a snapshot and needs no further processing. */
+    bool m_isSnapshot = false;
+    /** m_dataSet has been processed into m_data, change sets are applied to that in place. */
+    bool m_isProcessed = false;
+    /** Applying change sets to map data loaded before, see MapLoader::applyChangeSet(). */
+    bool m_isUpdate = false;
+    /** Levels changed by the change sets applied so far in that case. */
+    std::vector<MapLevel> m_changedLevels;
+    bool m_useSnapshotCache = false;
+    /** Start tile of a coordinate request whose result is to be cached as snapshot,
+     *  with the earliest expiry time of the tiles it's built from.
+     */
+    std::optional<Tile> m_snapshotTile;
+    /** Coordinate of the last loadForCoordinate() request, invalid when loading a snapshot file. */
+    OSM::Coordinate m_snapshotCoordinate;
 
     QString m_errorMessage;
+    QElapsedTimer m_loadTime;
+
+    /** Tiles of the current round not parsed yet. */
+    std::size_t m_unparsedTiles = 0;
+    /** Incremented on cancellation, to discard results of tiles parsed for a previous request. */
+    int m_generation = 0;
+    /** Parses and merges tiles one at a time as they become available, while others are still downloading.
+     *  This has exclusive access to m_dataSet, m_mergeBuffer and m_marbleMerger while m_unparsedTiles > 0.
+     *  Declared last so it's destroyed first, waiting for a running job.
+     */
+    QThreadPool m_tileParser;
 };
 }
 
+void MapLoaderPrivate::cancelPending()
+{
+    m_tileCache.cancelPending();
+    m_tileParser.clear();
+    m_tileParser.waitForDone();
+    m_unparsedTiles = 0;
+    // tiles parsed for the cancelled request must not end up in the next one
+    m_dataSet = OSM::DataSet();
+    m_mergeBuffer.clear();
+    m_marbleMerger.setDataSet(&m_dataSet);
+    m_snapshotTile.reset();
+    m_isProcessed = false;
+    m_isUpdate = false;
+    m_changedLevels.clear();
+    ++m_generation;
+}
+
+void MapLoaderPrivate::parseTile(const CachedTile &tile, QThread *targetThread)
+{
+    qCDebug(Log) << "loading tile" << tile.fileName << tile.offset;
+    auto f = std::make_unique<QFile>(tile.fileName);
+    if (!f->open(QFile::ReadOnly)) {
+        qWarning() << "Failed to open tile!" << f->fileName() << f->errorString();
+        return;
+    }
+
+    const auto data = f->map(tile.offset, tile.size);
+    if (!data) {
+        qCritical() << "Failed to mmap tile!" << f->fileName() << tile.offset << tile.size << f->errorString();
+        return;
+    }
+
+    // the data set keeps the mapping alive, so tags can refer to that directly
+    OSM::O5mParser p(&m_dataSet);
+    p.setMergeBuffer(&m_mergeBuffer);
+    p.read(data, tile.size, OSM::StringMemory::Persistent);
+    f->moveToThread(targetThread);
+    m_dataSet.addMappedFile(std::move(f));
+    m_marbleMerger.merge(&m_mergeBuffer);
+}
+
+bool MapLoaderPrivate::loadSnapshot(const Tile &tile, OSM::Coordinate coord, const QDateTime &ttl)
+{
+    const auto fileName = m_tileCache.findSnapshot(tile, coord);
+    if (fileName.isEmpty()) {
+        return false;
+    }
+
+    // expired, or not cached for as long as requested: replaced by loading the tiles again
+    auto f = std::make_unique<QFile>(fileName);
+    if (!f->open(QFile::ReadOnly) || f->fileTime(QFileDevice::FileModificationTime) < std::max(QDateTime::currentDateTimeUtc(), ttl)) {
+        return false;
+    }
+
+    QString errorMessage;
+    auto data = MapDataSnapshot::read(std::move(f), errorMessage);
+    if (!errorMessage.isEmpty()) {
+        qCWarning(Log) << "discarding invalid snapshot" << fileName << errorMessage;
+        QFile::remove(fileName);
+        return false;
+    }
+    m_data = std::move(data);
+    return true;
+}
+
+void MapLoaderPrivate::writeSnapshot(const Tile &tile, OSM::Coordinate coord)
+{
+    if (!tile.ttl.isValid() || tile.ttl < QDateTime::currentDateTimeUtc()) {
+        return;
+    }
+    // snapshots are found by the bounding box of the venue, one not containing the start coordinate would never be used
+    if (!OSM::contains(m_targetBbox, coord)) {
+        return;
+    }
+
+    const auto fileName = m_tileCache.snapshotPath(tile, m_targetBbox);
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    QSaveFile f(fileName);
+    if (!f.open(QFile::WriteOnly)) {
+        qCWarning(Log) << fileName << f.errorString();
+        return;
+    }
+    QString errorMessage;
+    if (!MapDataSnapshot::write(m_data, &f, errorMessage)) {
+        qCWarning(Log) << "failed to write snapshot" << fileName << errorMessage;
+        f.cancelWriting();
+        return;
+    }
+    if (!f.commit()) {
+        qCWarning(Log) << fileName << f.errorString();
+        return;
+    }
+
+    // expiry time as modification time, same as for the tiles
+    // without that the snapshot would be considered expired already, or worse, valid for too long
+    QFile ttlFile(fileName);
+    if (!ttlFile.open(QFile::WriteOnly | QFile::Append) || !ttlFile.setFileTime(tile.ttl, QFile::FileModificationTime)) {
+        qCWarning(Log) << "failed to set snapshot expiry time" << fileName << ttlFile.errorString();
+        ttlFile.close();
+        QFile::remove(fileName);
+    }
+}
+
 using namespace KOSMIndoorMap;
 
 MapLoader::MapLoader(QObject *parent)
@@ -72,32 +226,58 @@ MapLoader::MapLoader(QObject *parent)
     , d(new MapLoaderPrivate)
 {
     initResources();
+    d->m_tileParser.setMaxThreadCount(1);
     connect(&d->m_tileCache, &TileCache::tileLoaded, this, &MapLoader::downloadFinished);
     connect(&d->m_tileCache, &TileCache::tileError, this, &MapLoader::downloadFailed);
     d->m_tileCache.expire();
 }
 
-MapLoader::~MapLoader() = default;
+MapLoader::~MapLoader()
+{
+    d->cancelPending();
+}
 
 void MapLoader::loadFromFile(const QString &fileName)
 {
     QElapsedTimer loadTime;
     loadTime.start();
 
+    d->cancelPending();
     d->m_errorMessage.clear();
-    QFile f(fileName.contains(QLatin1Char(':')) ? QUrl::fromUserInput(fileName).toLocalFile() : fileName);
-    if (!f.open(QFile::ReadOnly)) {
-        qCritical() << f.fileName() << f.errorString();
+    auto f = std::make_unique<QFile>(fileName.contains(QLatin1Char(':')) ? QUrl::fromUserInput(fileName).toLocalFile() : fileName);
+    if (!f->open(QFile::ReadOnly)) {
+        qCritical() << f->fileName() << f->errorString();
+        return;
+    }
+
+    if (fileName.endsWith(QLatin1StringView(MapDataSnapshot::FileExtension))) {
+        d->m_data = MapDataSnapshot::read(std::move(f), d->m_errorMessage);
+        d->m_isSnapshot = true;
+        d->m_snapshotCoordinate = {};
+        qCDebug(Log) << "snapshot loading took" << loadTime.elapsed() << "ms";
+        QMetaObject::invokeMethod(this, &MapLoader::applyNextChangeSet, Qt::QueuedConnection);
         return;
     }
-    const auto data = f.map(0, f.size());
+    d->m_isSnapshot = false;
+
+    const auto data = f->map(0, f->size());
 
     auto reader = OSM::IO::readerForFileName(fileName, &d->m_dataSet);
     if (!reader) {
         qCWarning(Log) << "no file reader for" << fileName;
         return;
     }
-    reader->read(data, f.size());
+#if !BUILD_TOOLS_ONLY
+    // drop what MapData would discard anyway before storing it, matters for large inputs
+    InputFilter filter(d->m_dataSet);
+    reader->setFilter(&filter);
+#endif
+    if (data) {
+        reader->read(data, f->size(), OSM::StringMemory::Persistent);
+        d->m_dataSet.addMappedFile(std::move(f));
+    } else {
+        reader->read(f.get());
+    }
     d->m_data = MapData();
     qCDebug(Log) << "o5m loading took" << loadTime.elapsed() << "ms";
     QMetaObject::invokeMethod(this, &MapLoader::applyNextChangeSet, Qt::QueuedConnection);
@@ -110,18 +290,34 @@ void MapLoader::loadForCoordinate(double lat, double lon)
 
 void MapLoader::loadForCoordinate(double lat, double lon, const QDateTime &ttl)
 {
-    d->m_tileCache.cancelPending();
+    d->cancelPending();
+    d->m_loadTime.start();
     d->m_ttl = ttl;
     d->m_tileBbox = {};
     d->m_targetBbox = {};
     d->m_pendingTiles.clear();
     d->m_boundarySearcher = std::make_unique<BoundarySearch>();
+    d->m_tilePrefetchBudget = d->m_tilePrefetchLimit;
     d->m_boundarySearcher->init(OSM::Coordinate(lat, lon));
     d->m_errorMessage.clear();
     d->m_marbleMerger.setDataSet(&d->m_dataSet);
     d->m_data = MapData();
 
     auto tile = Tile::fromCoordinate(lat, lon, TileZoomLevel);
+    tile.ttl = ttl;
+    d->m_snapshotCoordinate = OSM::Coordinate(lat, lon);
+    if (d->m_useSnapshotCache) {
+        if (d->loadSnapshot(tile, OSM::Coordinate(lat, lon), ttl)) {
+            d->m_boundarySearcher.reset();
+            d->m_isSnapshot = true;
+            qCDebug(Log) << "snapshot loading took" << d->m_loadTime.elapsed() << "ms";
+            QMetaObject::invokeMethod(this, &MapLoader::applyNextChangeSet, Qt::QueuedConnection);
+            return;
+        }
+        d->m_snapshotTile = Tile(tile.x, tile.y, tile.z);
+    }
+    d->m_isSnapshot = false;
+
     d->m_loadedTiles = QRect(tile.x, tile.y, 1, 1);
     d->m_pendingTiles.push_back(std::move(tile));
     downloadTiles();
@@ -129,7 +325,8 @@ void MapLoader::loadForCoordinate(double lat, double lon, const QDateTime &ttl)
 
 void MapLoader::loadForBoundingBox(OSM::BoundingBox box)
 {
-    d->m_tileCache.cancelPending();
+    d->cancelPending();
+    d->m_loadTime.start();
     d->m_ttl = {};
     d->m_tileBbox = box;
     d->m_targetBbox = box;
@@ -155,7 +352,8 @@ void MapLoader::loadForBoundingBox(double minLat, double minLon, double maxLat,
 
 void MapLoader::loadForTile(Tile tile)
 {
-    d->m_tileCache.cancelPending();
+    d->cancelPending();
+    d->m_loadTime.start();
     d->m_ttl = {};
     d->m_tileBbox = tile.boundingBox();
     d->m_targetBbox = {};
@@ -179,11 +377,50 @@ void MapLoader::loadForTile(Tile tile)
     downloadTiles();
 }
 
+void MapLoader::setTilePrefetchLimit(int tiles)
+{
+    d->m_tilePrefetchLimit = std::max(0, tiles);
+}
+
+void MapLoader::setUseSnapshotCache(bool useSnapshotCache)
+{
+    d->m_useSnapshotCache = useSnapshotCache;
+}
+
+void MapLoader::setUseTileArchive(bool useArchive)
+{
+    d->cancelPending();
+    d->m_tileCache.setUseArchive(useArchive);
+}
+
 void MapLoader::addChangeSet(const QUrl &url)
 {
     d->m_pendingChangeSets.push_back(url);
 }
 
+void MapLoader::applyChangeSet(const MapData &data, const QUrl &url)
+{
+    if (data.isEmpty()) {
+        qCWarning(Log) << "no map data to apply change set to" << url;
+        return;
+    }
+    if (d->m_isUpdate && d->m_data == data && !d->m_pendingChangeSets.empty()) {
+        d->m_pendingChangeSets.push_back(url);
+        return;
+    }
+
+    d->cancelPending();
+    d->m_errorMessage.clear();
+    d->m_targetBbox = {};
+    d->m_pendingChangeSets.clear();
+    d->m_pendingChangeSets.push_back(url);
+    d->m_data = data;
+    d->m_isSnapshot = false;
+    d->m_isProcessed = true;
+    d->m_isUpdate = true;
+    QMetaObject::invokeMethod(this, &MapLoader::applyNextChangeSet, Qt::QueuedConnection);
+}
+
 MapData&& MapLoader::takeData()
 {
     return std::move(d->m_data);
@@ -191,57 +428,65 @@ MapData&& MapLoader::takeData()
 
 void MapLoader::downloadTiles()
 {
+    if (d->m_pendingTiles.empty()) {
+        // nothing to wait for, but still deliver the result via the event loop
+        QMetaObject::invokeMethod(this, &MapLoader::loadTiles, Qt::QueuedConnection);
+        return;
+    }
+
+    d->m_unparsedTiles = d->m_pendingTiles.size();
     for (const auto &tile : d->m_pendingTiles) {
+        // download errors are reported asynchronously, so this can't cancel m_pendingTiles under us
         d->m_tileCache.ensureCached(tile);
+        // parse what we have locally already while the rest is downloading
+        if (d->m_tileCache.cachedTile(tile).isValid()) {
+            parseTile(tile);
+        }
     }
-    if (d->m_tileCache.pendingDownloads() == 0) {
-        // still go through the event loop when having everything cached already
-        // this makes outside behavior more identical in both cases, and avoids
-        // signal connection races etc.
-        QMetaObject::invokeMethod(this, &MapLoader::loadTiles, Qt::QueuedConnection);
-    } else {
-        Q_EMIT isLoadingChanged();
-    }
+    Q_EMIT isLoadingChanged();
 }
 
-void MapLoader::downloadFinished()
+void MapLoader::downloadFinished(const Tile &tile)
 {
-    if (d->m_tileCache.pendingDownloads() > 0) {
+    // prefetched tiles just remain in the cache until needed
+    if (std::find(d->m_pendingTiles.begin(), d->m_pendingTiles.end(), tile) == d->m_pendingTiles.end()) {
         return;
     }
-    loadTiles();
+    parseTile(tile);
 }
 
-void MapLoader::loadTiles()
+void MapLoader::parseTile(const Tile &tile)
 {
-    QElapsedTimer loadTime;
-    loadTime.start();
-
-    OSM::O5mParser p(&d->m_dataSet);
-    p.setMergeBuffer(&d->m_mergeBuffer);
-    for (const auto &tile : d->m_pendingTiles) {
-        const auto fileName = d->m_tileCache.cachedTile(tile);
-        qCDebug(Log) << "loading tile" << fileName;
-        QFile f(fileName);
-        if (!f.open(QFile::ReadOnly)) {
-            qWarning() << "Failed to open tile!" << f.fileName() << f.errorString();
-            continue;
-        }
-
-        const auto data = f.map(0, f.size());
-        if (!data) {
-            qCritical() << "Failed to mmap tile!" << f.fileName() << f.size() << f.errorString();
-            continue;
-        }
-
-        p.read(data, f.size());
-        d->m_marbleMerger.merge(&d->m_mergeBuffer);
+    // results always arrive via the event loop, even with everything cached already
+    // this makes outside behavior more identical in both cases, and avoids
+    // signal connection races etc.
+    const auto cachedTile = d->m_tileCache.cachedTile(tile);
+    if (auto &snapshotTile = d->m_snapshotTile; snapshotTile && (!snapshotTile->ttl.isValid() || cachedTile.ttl < snapshotTile->ttl)) {
+        snapshotTile->ttl = cachedTile.ttl;
+    }
+    d->m_tileParser.start([this, tile, cachedTile, generation = d->m_generation, targetThread = thread()]() {
+        d->parseTile(cachedTile, targetThread);
+        QMetaObject::invokeMethod(this, [this, tile, generation]() { tileParsed(tile, generation); }, Qt::QueuedConnection);
+    });
+}
 
-        d->m_tileBbox = OSM::unite(d->m_tileBbox, tile.boundingBox());
+void MapLoader::tileParsed(const Tile &tile, int generation)
+{
+    if (generation != d->m_generation) {
+        return;
+    }
+    d->m_tileBbox = OSM::unite(d->m_tileBbox, tile.boundingBox());
+    if (--d->m_unparsedTiles == 0) {
+        loadTiles();
     }
+}
+
+void MapLoader::loadTiles()
+{
     d->m_pendingTiles.clear();
 
     if (d->m_boundarySearcher) {
+        const auto previousTiles = d->m_loadedTiles;
         const auto bbox = d->m_boundarySearcher->boundingBox(d->m_dataSet);
         qCDebug(Log) << "needed bbox:" << bbox << "got:" << d->m_tileBbox << d->m_loadedTiles;
 
@@ -275,6 +520,7 @@ void MapLoader::loadTiles()
 
         if (!d->m_pendingTiles.empty()) {
             downloadTiles();
+            prefetchTiles(previousTiles);
             return;
         }
         d->m_targetBbox = bbox;
@@ -283,7 +529,7 @@ void MapLoader::loadTiles()
     d->m_marbleMerger.finalize();
     d->m_boundarySearcher.reset();
 
-    qCDebug(Log) << "o5m loading took" << loadTime.elapsed() << "ms";
+    qCDebug(Log) << "o5m loading took" << d->m_loadTime.elapsed() << "ms";
     applyNextChangeSet();
 }
 
@@ -294,18 +540,83 @@ Tile MapLoader::makeTile(uint32_t x, uint32_t y) const
     return tile;
 }
 
+void MapLoader::prefetchTiles(const QRect &previousTiles)
+{
+    if (hasError()) {
+        return;
+    }
+
+    // the building most likely continues further in the directions we just had to expand to,
+    // so speculatively also fetch the next column or row of tiles there, saving another network
+    // round trip should that be needed next
+    const auto &loadedTiles = d->m_loadedTiles;
+    auto nextTiles = loadedTiles;
+    if (loadedTiles.left() < previousTiles.left()) {
+        nextTiles.setLeft(loadedTiles.left() - 1);
+    }
+    if (loadedTiles.right() > previousTiles.right()) {
+        nextTiles.setRight(loadedTiles.right() + 1);
+    }
+    if (loadedTiles.top() < previousTiles.top()) {
+        nextTiles.setTop(loadedTiles.top() - 1);
+    }
+    if (loadedTiles.bottom() > previousTiles.bottom()) {
+        nextTiles.setBottom(loadedTiles.bottom() + 1);
+    }
+
+    std::vector<QRect> sides;
+    if (nextTiles.left() < loadedTiles.left()) {
+        sides.emplace_back(nextTiles.left(), nextTiles.top(), 1, nextTiles.height());
+    }
+    if (nextTiles.right() > loadedTiles.right()) {
+        sides.emplace_back(nextTiles.right(), nextTiles.top(), 1, nextTiles.height());
+    }
+    if (nextTiles.top() < loadedTiles.top()) {
+        sides.emplace_back(nextTiles.left(), nextTiles.top(), nextTiles.width(), 1);
+    }
+    if (nextTiles.bottom() > loadedTiles.bottom()) {
+        sides.emplace_back(nextTiles.left(), nextTiles.bottom(), nextTiles.width(), 1);
+    }
+
+    std::vector<Tile> tiles;
+    for (const auto &side : sides) {
+        const auto sideBegin = tiles.size();
+        for (int x = side.left(); x <= side.right(); ++x) {
+            for (int y = side.top(); y <= side.bottom(); ++y) {
+                auto tile = makeTile(x, y);
+                if (std::find(tiles.begin(), tiles.end(), tile) == tiles.end() && !d->m_tileCache.cachedTile(tile).isValid()) {
+                    tiles.push_back(std::move(tile));
+                }
+            }
+        }
+        // an incomplete column or row would still need another round trip
+        if ((int)tiles.size() > d->m_tilePrefetchBudget) {
+            tiles.resize(sideBegin);
+        }
+    }
+
+    qCDebug(Log) << "prefetching" << tiles.size() << "tiles";
+    for (const auto &tile : tiles) {
+        d->m_tileCache.prefetchTile(tile);
+    }
+    d->m_tilePrefetchBudget -= (int)tiles.size();
+}
+
 void MapLoader::downloadFailed(Tile tile, const QString& errorMessage)
 {
-    Q_UNUSED(tile);
+    if (std::find(d->m_pendingTiles.begin(), d->m_pendingTiles.end(), tile) == d->m_pendingTiles.end()) {
+        qCDebug(Log) << "failed to prefetch tile" << tile.x << tile.y << errorMessage;
+        return;
+    }
     d->m_errorMessage = errorMessage;
-    d->m_tileCache.cancelPending();
+    d->cancelPending();
     Q_EMIT isLoadingChanged();
     Q_EMIT done();
 }
 
 bool MapLoader::isLoading() const
 {
-    return d->m_tileCache.pendingDownloads() > 0 || !d->m_pendingChangeSets.empty();
+    return d->m_tileCache.pendingDownloads() > 0 || d->m_unparsedTiles > 0 || (!d->m_pendingChangeSets.empty() && !d->m_isUpdate);
 }
 
 bool MapLoader::hasError() const
@@ -320,12 +631,47 @@ QString MapLoader::errorMessage() const
 
 void MapLoader::applyNextChangeSet()
 {
-    if (d->m_pendingChangeSets.empty() || hasError()) {
+    if (d->m_isSnapshot) {
+        d->m_isSnapshot = false;
+        if (!d->m_pendingChangeSets.empty() && !hasError()) {
+            // change sets apply to unprocessed data, for a cached result load that from the tiles again
+            if (d->m_snapshotCoordinate.isValid()) {
+                const auto useSnapshotCache = std::exchange(d->m_useSnapshotCache, false);
+                loadForCoordinate(d->m_snapshotCoordinate.latF(), d->m_snapshotCoordinate.lonF(), d->m_ttl);
+                d->m_useSnapshotCache = useSnapshotCache;
+                return;
+            }
+            d->m_errorMessage = u"Change sets cannot be applied to map data snapshots."_s;
+        }
+        Q_EMIT isLoadingChanged();
+        Q_EMIT done();
+        return;
+    }
+
+    if (!d->m_isProcessed) {
+        // process what we loaded once, change sets are then applied to that in place
         d->m_data.setDataSet(std::move(d->m_dataSet));
+        d->m_dataSet = OSM::DataSet();
+        d->m_isProcessed = true;
         if (d->m_targetBbox.isValid()) {
             d->m_data.setBoundingBox(d->m_targetBbox);
         }
+        // change sets are not part of the cached result
+        if (d->m_snapshotTile && !hasError()) {
+            d->writeSnapshot(*d->m_snapshotTile, d->m_snapshotCoordinate);
+        }
+        d->m_snapshotTile.reset();
+    }
 
+    if (d->m_pendingChangeSets.empty() || hasError()) {
+        if (d->m_isUpdate) {
+            // the data has been changed in place and is owned by the caller
+            d->m_pendingChangeSets.clear();
+            d->m_data = MapData();
+            d->m_isUpdate = false;
+            Q_EMIT changeSetApplied(std::exchange(d->m_changedLevels, {}));
+            return;
+        }
         Q_EMIT isLoadingChanged();
         Q_EMIT done();
         return;
@@ -338,19 +684,51 @@ void MapLoader::applyNextChangeSet()
             qCWarning(Log) << f.fileName() << f.errorString();
             d->m_errorMessage = f.errorString();
         } else {
-            applyChangeSet(url, &f);
+            readChangeSet(url, &f);
         }
     } else if (url.scheme() == "https"_L1) {
+        if (!OSM::IO::readerForFileName(url.fileName(), &d->m_data.dataSet())) {
+            qCWarning(Log) << "unable to find reader for" << url;
+            d->m_pendingChangeSets.pop_front();
+            applyNextChangeSet();
+            return;
+        }
+
+        // only apply complete and successful downloads, partial changes can't be rolled back
+        // spool to disk rather than holding the entire change set in memory until then
+        auto buffer = std::make_shared<QTemporaryFile>();
+        if (!buffer->open()) {
+            qCWarning(Log) << buffer->fileName() << buffer->errorString();
+            d->m_errorMessage = buffer->errorString();
+            d->m_pendingChangeSets.pop_front();
+            applyNextChangeSet();
+            return;
+        }
+
         QNetworkRequest req(url);
         req.setHeader(QNetworkRequest::UserAgentHeader, KOSMIndoorMap::userAgent());
+        // fail stalled downloads rather than loading forever
+        req.setTransferTimeout();
         auto reply = d->m_nam()->get(req);
-        connect(reply, &QNetworkReply::finished, this, [this, reply, url]() {
+        connect(reply, &QNetworkReply::readyRead, this, [reply, buffer]() {
+            buffer->write(reply->readAll());
+        });
+        connect(reply, &QNetworkReply::finished, this, [this, reply, buffer, url]() {
             reply->deleteLater();
 
+            buffer->write(reply->readAll());
+            const auto httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
             if (reply->error() != QNetworkReply::NoError) {
+                qCWarning(Log) << reply->errorString() << url;
                 d->m_errorMessage = reply->errorString();
+            } else if (httpStatus != 200) {
+                qCWarning(Log) << "unexpected HTTP status" << httpStatus << url;
+                d->m_errorMessage = u"Failed to download change set (HTTP status %1)."_s.arg(httpStatus);
+            } else if (!buffer->flush() || buffer->error() != QFileDevice::NoError || !buffer->seek(0)) {
+                qCWarning(Log) << buffer->fileName() << buffer->errorString();
+                d->m_errorMessage = buffer->errorString();
             } else {
-                applyChangeSet(url, reply);
+                readChangeSet(url, buffer.get());
             }
 
             d->m_pendingChangeSets.pop_front();
@@ -363,18 +741,31 @@ void MapLoader::applyNextChangeSet()
     applyNextChangeSet();
 }
 
-void MapLoader::applyChangeSet(const QUrl &url, QIODevice *io)
+void MapLoader::readChangeSet(const QUrl &url, QIODevice *io)
 {
-    auto reader = OSM::IO::readerForFileName(url.fileName(), &d->m_dataSet);
+    auto reader = OSM::IO::readerForFileName(url.fileName(), &d->m_data.dataSet());
     if (!reader) {
         qCWarning(Log) << "unable to find reader for" << url;
         return;
     }
 
+    OSM::DataSetChanges changes;
+    reader->setChangeTracking(&changes);
+    d->m_data.beginChanges();
     reader->read(io);
+    const auto changedLevels = d->m_data.endChanges(changes);
+    if (d->m_targetBbox.isValid()) {
+        d->m_data.setBoundingBox(d->m_targetBbox);
+    }
     if (reader->hasError()) {
         d->m_errorMessage = reader->errorString();
     }
+
+    if (d->m_isUpdate) {
+        d->m_changedLevels.insert(d->m_changedLevels.end(), changedLevels.begin(), changedLevels.end());
+        std::sort(d->m_changedLevels.begin(), d->m_changedLevels.end());
+        d->m_changedLevels.erase(std::unique(d->m_changedLevels.begin(), d->m_changedLevels.end()), d->m_changedLevels.end());
+    }
 }
 
 #include "moc_maploader.cpp"
@@ -9,10 +9,14 @@
 
 #include "kosmindoormap_export.h"
 
+#include <KOSMIndoorMap/MapData>
+
 #include <QObject>
 
 #include <memory>
 
+class QRect;
+
 namespace OSM {
 class BoundingBox;
 }
@@ -20,7 +24,6 @@ class BoundingBox;
 /** OSM-based multi-floor indoor maps for buildings. */
 namespace KOSMIndoorMap {
 
-class MapData;
 class MapLoaderPrivate;
 class Tile;
 
@@ -28,13 +31,18 @@ class Tile;
 class KOSMINDOORMAP_EXPORT MapLoader : public QObject
 {
     Q_OBJECT
-    /** Indicates we are downloading content. Use for progress display. */
+    /** Indicates we are downloading content. Use for progress display.
+     *  Applying change sets via applyChangeSet() doesn't count as loading, the map data
+     *  being changed remains valid meanwhile.
+     */
     Q_PROPERTY(bool isLoading READ isLoading NOTIFY isLoadingChanged)
 public:
     explicit MapLoader(QObject *parent = nullptr);
     ~MapLoader();
 
-    /** Load a single O5M or OSM PBF file. */
+    /** Load a single O5M, OSM PBF or map data snapshot file.
+     *  Change sets can't be applied to map data snapshot files.
+     */
     Q_INVOKABLE void loadFromFile(const QString &fileName);
     /** Load map for the given coordinates.
      *  This can involve online access.
@@ -51,12 +59,46 @@ public:
     /** Load map data for the given tile. */
     void loadForTile(Tile tile);
 
+    /** Maximum number of tiles to download speculatively when loading for a coordinate.
+     *  Large buildings need several rounds of loading adjacent tiles, prefetching the tiles
+     *  likely needed next saves network round trips. Unused tiles remain in the cache.
+     *  Set to 0 to disable this, the default is 16.
+     */
+    void setTilePrefetchLimit(int tiles);
+
+    /** Additionally cache the fully processed result of loadForCoordinate().
+     *  Loading for a coordinate within the same venue again then skips tile parsing, geometry
+     *  assembly and map data processing entirely, until any of the tiles the result was
+     *  built from expires. Change sets are not part of the cached result, and change sets
+     *  added for a cached result cause the map data to be loaded from the tiles again.
+     *  Off by default.
+     */
+    void setUseSnapshotCache(bool useSnapshotCache);
+
+    /** Store cached tiles in a single archive file rather than in one file per tile.
+     *  Tiles cached in individual files so far are moved to the archive. This cancels
+     *  any ongoing loading, so call this before any of the load methods.
+     *  The archive can only be used by one loader at a time, if it is in use already
+     *  tiles remain in individual files.
+     *  Off by default.
+     */
+    void setUseTileArchive(bool useArchive);
+
     /** Add a changeset to be applied on top of the data loaded by any of the load() methods.
      *  Needs to be called after any of the load methods and before returning to the event loop.
      *  @param url can be a local file or a HTTP URL which is downloaded if needed.
      */
     Q_INVOKABLE void addChangeSet(const QUrl &url);
 
+    /** Apply a change set to map data loaded before, such as the result of takeData().
+     *  Unlike addChangeSet() this doesn't load anything again, @p data is changed in place
+     *  and only the elements affected by the change set are processed again.
+     *  This cancels any ongoing loading, unless that is applying change sets to @p data as well,
+     *  in which case @p url is applied after those. changeSetApplied() is emitted once all are done.
+     *  @param url can be a local file or a HTTP URL which is downloaded if needed.
+     */
+    Q_INVOKABLE void applyChangeSet(const KOSMIndoorMap::MapData &data, const QUrl &url);
+
     /** Take out the completely loaded result.
      *  Do this before loading the next map with the same loader.
      */
@@ -71,15 +113,23 @@ Q_SIGNALS:
     /** Emitted when the requested data has been loaded. */
     void done();
     void isLoadingChanged();
+    /** Emitted when the change sets passed to applyChangeSet() have been applied,
+     *  which can include failures, see hasError().
+     *  @param changedLevels The levels whose content changed, see MapData::endChanges().
+     */
+    void changeSetApplied(const std::vector<KOSMIndoorMap::MapLevel> &changedLevels);
 
 private:
     void downloadTiles();
-    void downloadFinished();
+    void downloadFinished(const Tile &tile);
     void downloadFailed(Tile tile, const QString &errorMessage);
+    void parseTile(const Tile &tile);
+    void tileParsed(const Tile &tile, int generation);
     void loadTiles();
+    void prefetchTiles(const QRect &previousTiles);
     [[nodiscard]] Tile makeTile(uint32_t x, uint32_t y) const;
     void applyNextChangeSet();
-    void applyChangeSet(const QUrl &url, QIODevice *io);
+    void readChangeSet(const QUrl &url, QIODevice *io);
 
     std::unique_ptr<MapLoaderPrivate> d;
 };
@@ -30,6 +30,11 @@ void MarbleGeometryAssembler::setDataSet(OSM::DataSet* dataSet)
     m_dataSet = dataSet;
     m_mxoidKey = m_dataSet->makeTagKey("mx:oid");
     m_typeKey = m_dataSet->makeTagKey("type");
+    m_nodeIdMap.clear();
+    m_wayIdMap.clear();
+    m_relIdMap.clear();
+    m_duplicateWays.clear();
+    m_pendingWays.clear();
 }
 
 void MarbleGeometryAssembler::merge(OSM::DataSetMergeBuffer *mergeBuffer)
@@ -48,6 +53,7 @@ void MarbleGeometryAssembler::merge(OSM::DataSetMergeBuffer *mergeBuffer)
     mergeWays(mergeBuffer->ways);
     mergeWays(prevPendingWays);
     mergeRelations(mergeBuffer);
+    m_dataSet->elementsChanged();
 
     mergeBuffer->clear();
 }
@@ -61,6 +67,7 @@ void MarbleGeometryAssembler::finalize()
         }
     }
     std::sort(m_dataSet->ways.begin(), m_dataSet->ways.end());
+    m_dataSet->elementsChanged();
 }
 
 void MarbleGeometryAssembler::mergeNodes(OSM::DataSetMergeBuffer *mergeBuffer)
@@ -26,7 +26,8 @@ public:
     ~MarbleGeometryAssembler();
 
     /** Set the dataset to merge into.
-     *  Has to be called before the first call to merge().
+     *  Has to be called before the first call to merge(), this discards
+     *  any state left from merging into a previous data set.
      */
     void setDataSet(OSM::DataSet *dataSet);
 
@@ -0,0 +1,511 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "tilearchive_p.h"
+#include "logging.h"
+#include "tilecache_p.h"
+
+#include <QDateTime>
+#include <QLockFile>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <tuple>
+
+using namespace Qt::Literals;
+using namespace KOSMIndoorMap;
+
+namespace {
+struct ArchiveHeader {
+    char magic[8];
+    uint32_t version;
+    /** Number of hash table slots, a power of two. */
+    uint32_t capacity;
+    uint64_t indexOffset;
+    /** End of the used part of the file. */
+    uint64_t dataEnd;
+    /** Bytes in the used part of the file not referenced anymore. */
+    uint64_t garbage;
+    uint32_t count;
+    /** Tiles and removed entries. */
+    uint32_t usedSlots;
+    uint8_t reserved[16];
+};
+static_assert(sizeof(ArchiveHeader) == 64);
+
+struct ArchiveEntry {
+    uint32_t x;
+    uint32_t y;
+    uint8_t z;
+    uint8_t state;
+    uint16_t reserved;
+    uint32_t size;
+    /** Expiry time, in milliseconds since the epoch. */
+    int64_t ttl;
+    uint64_t offset;
+};
+static_assert(sizeof(ArchiveEntry) == 32);
+}
+
+enum : uint32_t {
+    ArchiveVersion = 1,
+    InitialCapacity = 1024,
+};
+
+enum : uint8_t {
+    EmptySlot = 0,
+    UsedSlot = 1,
+    RemovedSlot = 2,
+};
+
+static constexpr const char ArchiveMagic[8] = {'K', 'O', 'S', 'M', 'T', 'A', 'R', 'C'};
+
+[[nodiscard]] static ArchiveHeader* header(uchar *data)
+{
+    return reinterpret_cast<ArchiveHeader*>(data);
+}
+
+[[nodiscard]] static ArchiveEntry* entries(uchar *data)
+{
+    return reinterpret_cast<ArchiveEntry*>(data);
+}
+
+[[nodiscard]] static uint32_t tileHash(uint32_t x, uint32_t y, uint8_t z)
+{
+    return (x * 73856093u) ^ (y * 19349663u) ^ (z * 83492791u);
+}
+
+[[nodiscard]] static bool isValidHeader(const ArchiveHeader *h, qint64 fileSize)
+{
+    return std::memcmp(h->magic, ArchiveMagic, sizeof(ArchiveMagic)) == 0
+        && h->version == ArchiveVersion
+        && std::has_single_bit(h->capacity)
+        && h->indexOffset >= sizeof(ArchiveHeader)
+        && h->indexOffset % alignof(ArchiveEntry) == 0
+        && h->indexOffset + (uint64_t)h->capacity * sizeof(ArchiveEntry) <= (uint64_t)fileSize
+        && h->dataEnd <= (uint64_t)fileSize
+        && h->count <= h->usedSlots
+        && h->usedSlots < h->capacity;
+}
+
+/** Insert @p entry into a hash table without removed entries. */
+static void insertEntry(ArchiveEntry *index, uint32_t capacity, const ArchiveEntry &entry)
+{
+    const auto mask = capacity - 1;
+    auto i = tileHash(entry.x, entry.y, entry.z) & mask;
+    while (index[i].state != EmptySlot) {
+        i = (i + 1) & mask;
+    }
+    index[i] = entry;
+}
+
+TileArchive::TileArchive() = default;
+
+TileArchive::~TileArchive()
+{
+    close();
+}
+
+bool TileArchive::open(const QString &fileName)
+{
+    close();
+
+    // compaction replaces the file and invalidates all tile locations, and the header
+    // isn't safe for concurrent modification either, so we need exclusive access
+    m_lock = std::make_unique<QLockFile>(fileName + ".lock"_L1);
+    m_lock->setStaleLockTime(0); // only stale if the owning process is gone
+    if (!m_lock->tryLock()) {
+        qCWarning(Log) << "tile archive is in use elsewhere" << fileName << m_lock->error();
+        m_lock.reset();
+        return false;
+    }
+
+    m_file.setFileName(fileName);
+    if (!openFile()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool TileArchive::openFile()
+{
+    // unbuffered, so tile data is readable from elsewhere right away
+    if (!m_file.open(QFile::ReadWrite | QFile::Unbuffered)) {
+        qCWarning(Log) << "failed to open tile archive" << m_file.fileName() << m_file.errorString();
+        return false;
+    }
+
+    if (m_file.size() >= (qint64)sizeof(ArchiveHeader)) {
+        m_header = m_file.map(0, sizeof(ArchiveHeader));
+        if (m_header && isValidHeader(header(m_header), m_file.size()) && mapIndex()) {
+            return true;
+        }
+        qCWarning(Log) << "discarding invalid tile archive" << m_file.fileName();
+    }
+    return initialize();
+}
+
+void TileArchive::close()
+{
+    closeFile();
+    m_lock.reset();
+}
+
+void TileArchive::closeFile()
+{
+    // unmaps everything
+    m_file.close();
+    m_header = nullptr;
+    m_index = nullptr;
+    m_reservations.clear();
+}
+
+bool TileArchive::isOpen() const
+{
+    return m_header && m_index;
+}
+
+QString TileArchive::fileName() const
+{
+    return m_file.fileName();
+}
+
+bool TileArchive::initialize()
+{
+    if (m_header) {
+        m_file.unmap(m_header);
+        m_header = nullptr;
+    }
+
+    const auto indexSize = (qint64)InitialCapacity * (qint64)sizeof(ArchiveEntry);
+    if (!m_file.resize(0) || !m_file.resize(sizeof(ArchiveHeader) + indexSize)) {
+        qCWarning(Log) << "failed to initialize tile archive" << m_file.fileName() << m_file.errorString();
+        closeFile();
+        return false;
+    }
+    m_header = m_file.map(0, sizeof(ArchiveHeader));
+    if (!m_header) {
+        closeFile();
+        return false;
+    }
+
+    auto h = header(m_header);
+    std::memcpy(h->magic, ArchiveMagic, sizeof(ArchiveMagic));
+    h->version = ArchiveVersion;
+    h->capacity = InitialCapacity;
+    h->indexOffset = sizeof(ArchiveHeader);
+    h->dataEnd = sizeof(ArchiveHeader) + indexSize;
+    if (!mapIndex()) {
+        closeFile();
+        return false;
+    }
+    return true;
+}
+
+bool TileArchive::mapIndex()
+{
+    const auto h = header(m_header);
+    m_index = m_file.map((qint64)h->indexOffset, (qint64)h->capacity * (qint64)sizeof(ArchiveEntry));
+    return m_index;
+}
+
+bool TileArchive::growIndex()
+{
+    // a new index is appended, so existing tile data never moves
+    auto h = header(m_header);
+    const auto capacity = std::bit_ceil(std::max<uint32_t>(InitialCapacity, (h->count + 1) * 4));
+    const auto indexOffset = (h->dataEnd + alignof(ArchiveEntry) - 1) & ~(uint64_t)(alignof(ArchiveEntry) - 1);
+    const auto indexSize = (qint64)capacity * (qint64)sizeof(ArchiveEntry);
+    if (!m_file.resize((qint64)indexOffset + indexSize)) {
+        qCWarning(Log) << "failed to grow tile archive" << m_file.fileName() << m_file.errorString();
+        return false;
+    }
+    auto index = m_file.map((qint64)indexOffset, indexSize);
+    if (!index) {
+        qCWarning(Log) << "failed to map tile archive index" << m_file.errorString();
+        return false;
+    }
+
+    const auto oldEntries = entries(m_index);
+    for (uint32_t i = 0; i < h->capacity; ++i) {
+        if (oldEntries[i].state == UsedSlot) {
+            insertEntry(entries(index), capacity, oldEntries[i]);
+        }
+    }
+    m_file.unmap(m_index);
+    m_index = index;
+
+    h->garbage += (uint64_t)h->capacity * sizeof(ArchiveEntry) + (indexOffset - h->dataEnd);
+    h->capacity = capacity;
+    h->indexOffset = indexOffset;
+    h->usedSlots = h->count;
+    h->dataEnd = indexOffset + indexSize;
+    return true;
+}
+
+int64_t TileArchive::findSlot(const Tile &tile, bool forInsert) const
+{
+    const auto index = entries(m_index);
+    const auto mask = header(m_header)->capacity - 1;
+    int64_t removedSlot = -1;
+    for (auto i = tileHash(tile.x, tile.y, tile.z) & mask;; i = (i + 1) & mask) {
+        const auto &entry = index[i];
+        if (entry.state == EmptySlot) {
+            if (!forInsert) {
+                return -1;
+            }
+            return removedSlot >= 0 ? removedSlot : i;
+        }
+        if (entry.state == RemovedSlot) {
+            if (removedSlot < 0) {
+                removedSlot = i;
+            }
+            continue;
+        }
+        if (entry.x == tile.x && entry.y == tile.y && entry.z == tile.z) {
+            return i;
+        }
+    }
+}
+
+TileArchive::Location TileArchive::find(const Tile &tile) const
+{
+    if (!isOpen()) {
+        return {};
+    }
+    const auto slot = findSlot(tile, false);
+    if (slot < 0) {
+        return {};
+    }
+    const auto &entry = entries(m_index)[slot];
+    return { (qint64)entry.offset, (qint64)entry.size };
+}
+
+QDateTime TileArchive::ttl(const Tile &tile) const
+{
+    if (!isOpen()) {
+        return {};
+    }
+    const auto slot = findSlot(tile, false);
+    return slot < 0 ? QDateTime() : QDateTime::fromMSecsSinceEpoch(entries(m_index)[slot].ttl);
+}
+
+bool TileArchive::insert(const Tile &tile, const QByteArray &data, const QDateTime &ttl)
+{
+    const auto offset = reserve(data.size());
+    if (offset < 0) {
+        return false;
+    }
+    if (!write(offset, data)) {
+        release(offset);
+        return false;
+    }
+    return commit(tile, offset, data.size(), ttl);
+}
+
+qint64 TileArchive::reserve(qint64 size)
+{
+    if (!isOpen() || size <= 0 || size > std::numeric_limits<uint32_t>::max()) {
+        return -1;
+    }
+
+    // the file always covers all reserved space, otherwise it would be considered invalid after a crash
+    auto h = header(m_header);
+    const auto offset = (qint64)h->dataEnd;
+    if (!m_file.resize(offset + size)) {
+        qCWarning(Log) << "failed to grow tile archive" << m_file.fileName() << m_file.errorString();
+        return -1;
+    }
+
+    // counted as unused until committed, so space of aborted downloads is reclaimed by compaction
+    h->dataEnd += size;
+    h->garbage += size;
+    m_reservations.push_back({offset, size});
+    return offset;
+}
+
+bool TileArchive::write(qint64 offset, const QByteArray &data)
+{
+    const auto isReserved = std::any_of(m_reservations.begin(), m_reservations.end(), [offset, &data](const auto &r) {
+        return offset >= r.offset && offset + data.size() <= r.offset + r.size;
+    });
+    if (!isOpen() || !isReserved) {
+        return false;
+    }
+    if (!m_file.seek(offset) || m_file.write(data) != data.size()) {
+        qCWarning(Log) << "failed to write to tile archive" << m_file.fileName() << m_file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool TileArchive::commit(const Tile &tile, qint64 offset, qint64 size, const QDateTime &ttl)
+{
+    const auto it = std::find_if(m_reservations.begin(), m_reservations.end(), [offset](const auto &r) { return r.offset == offset; });
+    if (!isOpen() || it == m_reservations.end()) {
+        return false;
+    }
+    const auto reservedSize = (*it).size;
+    m_reservations.erase(it);
+    if (size <= 0 || size > reservedSize) {
+        return false;
+    }
+
+    // keep the hash table at most half full
+    if ((header(m_header)->usedSlots + 1) * 2 > header(m_header)->capacity && !growIndex()) {
+        return false;
+    }
+
+    auto h = header(m_header);
+    auto &entry = entries(m_index)[findSlot(tile, true)];
+    if (entry.state == UsedSlot) {
+        h->garbage += entry.size;
+    } else {
+        if (entry.state == EmptySlot) {
+            ++h->usedSlots;
+        }
+        ++h->count;
+    }
+    entry.x = tile.x;
+    entry.y = tile.y;
+    entry.z = tile.z;
+    entry.state = UsedSlot;
+    entry.size = (uint32_t)size;
+    entry.ttl = ttl.toMSecsSinceEpoch();
+    entry.offset = (uint64_t)offset;
+    h->garbage -= (uint64_t)size;
+    return true;
+}
+
+void TileArchive::release(qint64 offset)
+{
+    // the space remains counted as unused
+    m_reservations.erase(std::remove_if(m_reservations.begin(), m_reservations.end(), [offset](const auto &r) { return r.offset == offset; }), m_reservations.end());
+}
+
+void TileArchive::setTtl(const Tile &tile, const QDateTime &ttl)
+{
+    if (!isOpen()) {
+        return;
+    }
+    if (const auto slot = findSlot(tile, false); slot >= 0) {
+        entries(m_index)[slot].ttl = ttl.toMSecsSinceEpoch();
+    }
+}
+
+void TileArchive::remove(const Tile &tile)
+{
+    if (!isOpen()) {
+        return;
+    }
+    if (const auto slot = findSlot(tile, false); slot >= 0) {
+        auto &entry = entries(m_index)[slot];
+        entry.state = RemovedSlot;
+        header(m_header)->garbage += entry.size;
+        --header(m_header)->count;
+    }
+}
+
+void TileArchive::expire(const QDateTime &now)
+{
+    if (!isOpen()) {
+        return;
+    }
+    const auto nowMSecs = now.toMSecsSinceEpoch();
+    auto h = header(m_header);
+    const auto index = entries(m_index);
+    for (uint32_t i = 0; i < h->capacity; ++i) {
+        if (index[i].state == UsedSlot && index[i].ttl < nowMSecs) {
+            index[i].state = RemovedSlot;
+            h->garbage += index[i].size;
+            --h->count;
+        }
+    }
+}
+
+std::size_t TileArchive::size() const
+{
+    return isOpen() ? header(m_header)->count : 0;
+}
+
+double TileArchive::garbageRatio() const
+{
+    if (!isOpen()) {
+        return 0.0;
+    }
+    const auto h = header(m_header);
+    return (double)h->garbage / (double)h->dataEnd;
+}
+
+bool TileArchive::compact()
+{
+    // reserved space is being written to, and would get lost
+    if (!isOpen() || !m_reservations.empty()) {
+        return false;
+    }
+
+    // tiles ordered by position, so that adjacent tiles are close in the file as well
+    const auto h = header(m_header);
+    std::vector<ArchiveEntry> tiles;
+    tiles.reserve(h->count);
+    std::copy_if(entries(m_index), entries(m_index) + h->capacity, std::back_inserter(tiles), [](const auto &entry) { return entry.state == UsedSlot; });
+    std::sort(tiles.begin(), tiles.end(), [](const auto &lhs, const auto &rhs) {
+        return std::tie(lhs.z, lhs.x, lhs.y) < std::tie(rhs.z, rhs.x, rhs.y);
+    });
+
+    ArchiveHeader newHeader = {};
+    std::memcpy(newHeader.magic, ArchiveMagic, sizeof(ArchiveMagic));
+    newHeader.version = ArchiveVersion;
+    newHeader.capacity = std::bit_ceil(std::max<uint32_t>(InitialCapacity, (uint32_t)tiles.size() * 4));
+    newHeader.indexOffset = sizeof(ArchiveHeader);
+    newHeader.count = (uint32_t)tiles.size();
+    newHeader.usedSlots = newHeader.count;
+    std::vector<ArchiveEntry> index(newHeader.capacity);
+    auto offset = newHeader.indexOffset + (uint64_t)newHeader.capacity * sizeof(ArchiveEntry);
+    for (const auto &tile : tiles) {
+        auto entry = tile;
+        entry.offset = offset;
+        offset += entry.size;
+        insertEntry(index.data(), newHeader.capacity, entry);
+    }
+    newHeader.dataEnd = offset;
+
+    QSaveFile out(m_file.fileName());
+    if (!out.open(QFile::WriteOnly)) {
+        qCWarning(Log) << "failed to compact tile archive" << out.fileName() << out.errorString();
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(&newHeader), sizeof(newHeader));
+    out.write(reinterpret_cast<const char*>(index.data()), (qint64)(index.size() * sizeof(ArchiveEntry)));
+    for (const auto &tile : tiles) {
+        if (!m_file.seek((qint64)tile.offset)) {
+            out.cancelWriting();
+            break;
+        }
+        const auto data = m_file.read(tile.size);
+        if (data.size() != (qsizetype)tile.size) {
+            out.cancelWriting();
+            break;
+        }
+        out.write(data);
+    }
+
+    // keeps the lock, nobody else must see the archive in between
+    closeFile();
+    const auto success = out.commit();
+    if (!success) {
+        qCWarning(Log) << "failed to compact tile archive" << out.fileName() << out.errorString();
+    }
+    if (!openFile()) {
+        close();
+        return false;
+    }
+    return success;
+}
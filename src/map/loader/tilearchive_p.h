@@ -0,0 +1,117 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KOSMINDOORMAP_TILEARCHIVE_P_H
+#define KOSMINDOORMAP_TILEARCHIVE_P_H
+
+#include "kosmindoormap_export.h"
+
+#include <QFile>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class QDateTime;
+class QLockFile;
+
+namespace KOSMIndoorMap {
+
+class Tile;
+
+/** Single file storage for cached tiles.
+ *
+ *  The file starts with a header, followed by a hash table indexing all tiles and
+ *  the tile data. The hash table is memory-mapped, allowing lookups and expiry time
+ *  updates without any I/O. Tile data is only ever appended, when the hash table
+ *  needs to grow a new one is appended as well. Space used by replaced or expired
+ *  tiles is only reclaimed by compact().
+ *
+ *  The archive file is used exclusively by one instance at a time, guarded by a lock file.
+ *  This uses the native byte order, and is therefore not portable between machines.
+ *  @internal only exported for unit tests
+ */
+class KOSMINDOORMAP_EXPORT TileArchive
+{
+public:
+    TileArchive();
+    ~TileArchive();
+
+    /** Open or create the archive file @p fileName.
+     *  Invalid or incompatible existing files are discarded.
+     *  Fails if the archive is already in use by another instance, in this or another process.
+     */
+    bool open(const QString &fileName);
+    void close();
+    [[nodiscard]] bool isOpen() const;
+    [[nodiscard]] QString fileName() const;
+
+    /** Location of a tile's data in the archive file. */
+    class Location {
+    public:
+        qint64 offset = 0;
+        qint64 size = 0;
+        [[nodiscard]] constexpr inline bool isValid() const { return size > 0; }
+    };
+
+    /** Location of the data of @p tile, invalid if not present. */
+    [[nodiscard]] Location find(const Tile &tile) const;
+    /** Expiry time of @p tile. */
+    [[nodiscard]] QDateTime ttl(const Tile &tile) const;
+
+    /** Add @p tile with content @p data, replacing a previous version of it. */
+    bool insert(const Tile &tile, const QByteArray &data, const QDateTime &ttl);
+
+    /** Reserve @p size bytes at the end of the archive, for tile data arriving incrementally.
+     *  Returns the offset of the reserved space, or -1 on failure.
+     *  Fill it with write() and add it with commit(), or give it up with release().
+     *  Reserved space not committed is unused until compact().
+     */
+    [[nodiscard]] qint64 reserve(qint64 size);
+    /** Write @p data at @p offset, which has to be within reserved space. */
+    bool write(qint64 offset, const QByteArray &data);
+    /** Add @p tile with the first @p size bytes of the space reserved at @p offset as content. */
+    bool commit(const Tile &tile, qint64 offset, qint64 size, const QDateTime &ttl);
+    /** Give up the space reserved at @p offset. */
+    void release(qint64 offset);
+    /** Change the expiry time of @p tile, if present. */
+    void setTtl(const Tile &tile, const QDateTime &ttl);
+    void remove(const Tile &tile);
+    /** Remove all tiles expired before @p now. */
+    void expire(const QDateTime &now);
+
+    /** Number of tiles in the archive. */
+    [[nodiscard]] std::size_t size() const;
+    /** Fraction of the file not used by current tiles or the index. */
+    [[nodiscard]] double garbageRatio() const;
+
+    /** Rewrite the archive file without unused space.
+     *  This invalidates all previously returned locations, and fails while there is reserved space.
+     */
+    bool compact();
+
+private:
+    bool openFile();
+    void closeFile();
+    bool initialize();
+    bool mapIndex();
+    bool growIndex();
+    [[nodiscard]] int64_t findSlot(const Tile &tile, bool forInsert) const;
+
+    struct Reservation {
+        qint64 offset;
+        qint64 size;
+    };
+
+    QFile m_file;
+    std::unique_ptr<QLockFile> m_lock;
+    std::vector<Reservation> m_reservations;
+    uchar *m_header = nullptr;
+    uchar *m_index = nullptr;
+};
+
+}
+
+#endif // KOSMINDOORMAP_TILEARCHIVE_P_H
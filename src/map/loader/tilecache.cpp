@@ -6,6 +6,8 @@
 
 #include "tilecache_p.h"
 #include "logging.h"
+#include "mapdatasnapshot_p.h"
+#include "tilearchive_p.h"
 #include "network/useragent_p.h"
 
 #include <osm/datatypes.h>
@@ -21,15 +23,26 @@
 #include <QStandardPaths>
 #include <QUrl>
 
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <limits>
+#include <utility>
 
 using namespace Qt::Literals;
 using namespace KOSMIndoorMap;
 
 enum {
     DefaultCacheDays = 14,
+    DefaultParallelDownloads = 4,
 };
 
+/** Compact the tile archive once more than this fraction of it is unused. */
+static constexpr double MaxArchiveGarbageRatio = 0.5;
+static constexpr auto ArchiveFileName = "tiles.archive"_L1;
+static constexpr auto ArchiveLockFileName = "tiles.archive.lock"_L1;
+static constexpr auto SnapshotDirectory = "snapshots/"_L1;
+
 Tile Tile::fromCoordinate(double lat, double lon, uint8_t z)
 {
     Tile t;
@@ -86,50 +99,165 @@ Tile Tile::bottomRightAtZ(uint8_t z) const
 TileCache::TileCache(const NetworkAccessManagerFactory &namFactory, QObject *parent)
     : QObject(parent)
     , m_nam(namFactory)
+    , m_maxParallelDownloads(DefaultParallelDownloads)
 {
 }
 
 TileCache::~TileCache() = default;
 
-QString TileCache::cachedTile(const Tile &tile) const
+CachedTile TileCache::cachedTile(const Tile &tile) const
 {
+    if (m_archive) {
+        const auto location = m_archive->find(tile);
+        return location.isValid() ? CachedTile{m_archive->fileName(), location.offset, location.size, m_archive->ttl(tile)} : CachedTile{};
+    }
+
     auto p = cachePath(tile);
-    if (QFileInfo info(p); info.exists() && p.size() > 0) {
-        return p;
+    if (QFileInfo info(p); info.exists() && info.size() > 0) {
+        return {p, 0, info.size(), info.lastModified()};
     }
     return {};
 }
 
+QString TileCache::snapshotDirectory(const Tile &tile)
+{
+    return cacheBasePath() + SnapshotDirectory
+        + QString::number(tile.z) + '/'_L1
+        + QString::number(tile.x) + '/'_L1
+        + QString::number(tile.y) + '/'_L1;
+}
+
+QString TileCache::snapshotPath(const Tile &tile, OSM::BoundingBox bbox) const
+{
+    // several venues can be found starting from the same tile, so the snapshot is identified by the venue's bounding box
+    return snapshotDirectory(tile)
+        + QString::number(bbox.min.latitude) + '_'_L1
+        + QString::number(bbox.min.longitude) + '_'_L1
+        + QString::number(bbox.max.latitude) + '_'_L1
+        + QString::number(bbox.max.longitude) + QLatin1StringView(MapDataSnapshot::FileExtension);
+}
+
+QString TileCache::findSnapshot(const Tile &tile, OSM::Coordinate coord) const
+{
+    QString fileName;
+    uint64_t area = std::numeric_limits<uint64_t>::max();
+
+    QDirIterator it(snapshotDirectory(tile), {'*'_L1 + QLatin1StringView(MapDataSnapshot::FileExtension)}, QDir::Files);
+    while (it.hasNext()) {
+        it.next();
+        const auto parts = it.fileInfo().completeBaseName().split('_'_L1);
+        if (parts.size() != 4) {
+            continue;
+        }
+        std::array<uint32_t, 4> values;
+        bool ok = true;
+        for (std::size_t i = 0; i < values.size() && ok; ++i) {
+            values[i] = parts[(qsizetype)i].toUInt(&ok);
+        }
+        const OSM::BoundingBox bbox(OSM::Coordinate(values[0], values[1]), OSM::Coordinate(values[2], values[3]));
+        if (!ok || !OSM::contains(bbox, coord)) {
+            continue;
+        }
+        if (const auto a = (uint64_t)bbox.width() * bbox.height(); a < area) {
+            area = a;
+            fileName = it.filePath();
+        }
+    }
+    return fileName;
+}
+
+void TileCache::setUseArchive(bool useArchive)
+{
+    if (useArchive == (bool)m_archive) {
+        return;
+    }
+    // running downloads are stored in the current mode
+    cancelPending();
+    if (!useArchive) {
+        m_archive.reset();
+        return;
+    }
+
+    QDir().mkpath(cacheBasePath());
+    auto archive = std::make_unique<TileArchive>();
+    if (!archive->open(archivePath())) {
+        return;
+    }
+    m_archive = std::move(archive);
+    importTiles();
+    expire();
+}
+
 void TileCache::ensureCached(const Tile &tile)
 {
-    const auto t = cachedTile(tile);
-    if (t.isEmpty()) {
+    if (!cachedTile(tile).isValid()) {
         downloadTile(tile);
         return;
     }
 
     if (tile.ttl.isValid()) {
-        updateTtl(t, tile.ttl);
+        updateTtl(tile, tile.ttl);
     }
 }
 
 void TileCache::downloadTile(const Tile &tile)
 {
+    // already being prefetched: keep that download, it just becomes a regular one
+    if (const auto it = std::find_if(m_activeDownloads.begin(), m_activeDownloads.end(), [&tile](const auto &d) { return d.tile == tile; }); it != m_activeDownloads.end()) {
+        (*it).prefetch = false;
+        return;
+    }
+    if (const auto it = std::find(m_pendingPrefetches.begin(), m_pendingPrefetches.end(), tile); it != m_pendingPrefetches.end()) {
+        m_pendingPrefetches.erase(it);
+    }
+
+    // parallel downloads of the same tile would write to the same file
+    if (isPending(tile)) {
+        return;
+    }
     m_pendingDownloads.push_back(tile);
     downloadNext();
 }
 
-QString TileCache::cachePath(const Tile &tile) const
+void TileCache::prefetchTile(const Tile &tile)
+{
+    if (isPending(tile) || cachedTile(tile).isValid()) {
+        return;
+    }
+    m_pendingPrefetches.push_back(tile);
+    downloadNext();
+}
+
+void TileCache::setMaximumParallelDownloads(int count)
+{
+    m_maxParallelDownloads = std::max(1, count);
+    downloadNext();
+}
+
+bool TileCache::isPending(const Tile &tile) const
+{
+    return std::find(m_pendingDownloads.begin(), m_pendingDownloads.end(), tile) != m_pendingDownloads.end()
+        || std::find(m_pendingPrefetches.begin(), m_pendingPrefetches.end(), tile) != m_pendingPrefetches.end()
+        || std::any_of(m_activeDownloads.begin(), m_activeDownloads.end(), [&tile](const auto &d) { return d.tile == tile; });
+}
+
+QString TileCache::cacheBasePath()
 {
-    QString base;
     if (!qEnvironmentVariableIsSet("KOSMINDOORMAP_CACHE_PATH")) {
-        base = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+        return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
             + "/org.kde.osm/vectorosm/"_L1;
-    } else {
-        base = qEnvironmentVariable("KOSMINDOORMAP_CACHE_PATH");
     }
+    return qEnvironmentVariable("KOSMINDOORMAP_CACHE_PATH");
+}
+
+QString TileCache::archivePath()
+{
+    return cacheBasePath() + ArchiveFileName;
+}
 
-    return base
+QString TileCache::cachePath(const Tile &tile) const
+{
+    return cacheBasePath()
         + QString::number(tile.z) + '/'_L1
         + QString::number(tile.x) + '/'_L1
         + QString::number(tile.y) + ".o5m"_L1;
@@ -137,19 +265,39 @@ QString TileCache::cachePath(const Tile &tile) const
 
 void TileCache::downloadNext()
 {
-    if (m_output.isOpen() || m_pendingDownloads.empty()) {
-        return;
+    while ((int)m_activeDownloads.size() < m_maxParallelDownloads) {
+        if (!m_pendingDownloads.empty()) {
+            const auto tile = m_pendingDownloads.front();
+            m_pendingDownloads.pop_front();
+            startDownload(tile, false);
+        } else if (!m_pendingPrefetches.empty()) {
+            const auto tile = m_pendingPrefetches.front();
+            m_pendingPrefetches.pop_front();
+            startDownload(tile, true);
+        } else {
+            break;
+        }
     }
+}
 
-    const auto tile = m_pendingDownloads.front();
-    m_pendingDownloads.pop_front();
-
-    QFileInfo fi(cachePath(tile));
-    QDir().mkpath(fi.absolutePath());
-    m_output.setFileName(fi.absoluteFilePath() + ".part"_L1);
-    if (!m_output.open(QFile::WriteOnly)) {
-        qCWarning(Log) << m_output.fileName() << m_output.errorString();
-        return;
+void TileCache::startDownload(const Tile &tile, bool prefetch)
+{
+    // in archive mode data is written into the archive directly
+    std::unique_ptr<QFile> output;
+    if (!m_archive) {
+        QFileInfo fi(cachePath(tile) + ".part"_L1);
+        QDir().mkpath(fi.absolutePath());
+        output = std::make_unique<QFile>(fi.absoluteFilePath());
+        if (!output->open(QFile::WriteOnly)) {
+            qCWarning(Log) << output->fileName() << output->errorString();
+            // we are called from downloadNext(), possibly in the middle of ensureCached(), so don't re-enter the caller
+            QMetaObject::invokeMethod(this, [this, tile, errorMessage = output->errorString(), generation = m_generation]() {
+                if (generation == m_generation) {
+                    Q_EMIT tileError(tile, errorMessage);
+                }
+            }, Qt::QueuedConnection);
+            return;
+        }
     }
 
     QUrl url;
@@ -175,25 +323,79 @@ void TileCache::downloadNext()
     auto reply = m_nam()->get(req);
     reply->setParent(this);
     connect(reply, &QNetworkReply::readyRead, this, [this, reply]() { dataReceived(reply); });
-    connect(reply, &QNetworkReply::finished, this, [this, reply, tile]() { downloadFinished(reply, tile); });
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() { downloadFinished(reply); });
     connect(reply, &QNetworkReply::sslErrors, this, [reply](const auto &sslErrors) { reply->setProperty("_ssl_errors", QVariant::fromValue(sslErrors)); });
-    m_currentReply = reply;
+    Download download;
+    download.tile = tile;
+    download.reply = reply;
+    download.output = std::move(output);
+    download.prefetch = prefetch;
+    m_activeDownloads.push_back(std::move(download));
 }
 
 void TileCache::dataReceived(QNetworkReply *reply)
 {
-    m_output.write(reply->read(reply->bytesAvailable()));
+    const auto it = std::find_if(m_activeDownloads.begin(), m_activeDownloads.end(), [reply](const auto &d) { return d.reply == reply; });
+    if (it == m_activeDownloads.end()) {
+        return;
+    }
+    auto &download = *it;
+    const auto data = reply->read(reply->bytesAvailable());
+    if (download.output) {
+        download.output->write(data);
+        download.received += data.size();
+        return;
+    }
+
+    // stream into the archive if we know how much space we need, otherwise buffer until complete
+    if (download.received == 0 && m_archive) {
+        const auto size = reply->header(QNetworkRequest::ContentLengthHeader).toLongLong();
+        if (size > 0 && reply->rawHeader("Content-Encoding").isEmpty()) {
+            download.archiveOffset = m_archive->reserve(size);
+            download.archiveSize = size;
+        }
+    }
+    if (download.archiveOffset >= 0 && download.received + data.size() > download.archiveSize) {
+        // more than announced, continue in memory with what we have so far
+        QFile f(m_archive->fileName());
+        if (f.open(QFile::ReadOnly) && f.seek(download.archiveOffset)) {
+            download.buffer = f.read(download.received);
+        }
+        m_archive->release(download.archiveOffset);
+        download.archiveOffset = -1;
+        if (download.buffer.size() != download.received) {
+            reply->abort(); // can finish synchronously, invalidating download
+            return;
+        }
+    }
+    if (download.archiveOffset >= 0) {
+        if (!m_archive->write(download.archiveOffset + download.received, data)) {
+            reply->abort();
+            return;
+        }
+    } else {
+        download.buffer += data;
+    }
+    download.received += data.size();
 }
 
-void TileCache::downloadFinished(QNetworkReply* reply, const Tile &tile)
+void TileCache::downloadFinished(QNetworkReply* reply)
 {
     reply->deleteLater();
-    m_currentReply = {};
-    m_output.close();
+    const auto it = std::find_if(m_activeDownloads.begin(), m_activeDownloads.end(), [reply](const auto &d) { return d.reply == reply; });
+    if (it == m_activeDownloads.end()) {
+        return;
+    }
+    auto download = std::move(*it);
+    m_activeDownloads.erase(it);
+    const auto &tile = download.tile;
+    if (download.output) {
+        download.output->close();
+    }
 
-    if (reply->error() != QNetworkReply::NoError || m_output.size() == 0) {
+    if (reply->error() != QNetworkReply::NoError || download.received == 0) {
         qCWarning(Log) << reply->errorString() << reply->url();
-        m_output.remove();
+        discard(download);
         if (reply->error() == QNetworkReply::SslHandshakeFailedError) {
             const auto sslErrors = reply->property("_ssl_errors").value<QList<QSslError>>();
             QStringList errorStrings;
@@ -208,12 +410,21 @@ void TileCache::downloadFinished(QNetworkReply* reply, const Tile &tile)
         return;
     }
 
-    const auto t = cachePath(tile);
-    m_output.rename(t);
-    if (tile.ttl.isValid()) {
-        updateTtl(t, std::max(QDateTime::currentDateTimeUtc().addDays(1), tile.ttl));
+    const auto ttl = tile.ttl.isValid()
+        ? std::max(QDateTime::currentDateTimeUtc().addDays(1), tile.ttl)
+        : QDateTime::currentDateTimeUtc().addDays(DefaultCacheDays);
+    if (m_archive) {
+        const auto stored = download.archiveOffset >= 0
+            ? m_archive->commit(tile, download.archiveOffset, download.received, ttl)
+            : m_archive->insert(tile, download.buffer, ttl);
+        if (!stored) {
+            Q_EMIT tileError(tile, u"Failed to store tile in the tile archive."_s);
+            downloadNext();
+            return;
+        }
     } else {
-        updateTtl(t, QDateTime::currentDateTimeUtc().addDays(DefaultCacheDays));
+        download.output->rename(cachePath(tile));
+        updateTtl(tile, ttl);
     }
 
     Q_EMIT tileLoaded(tile);
@@ -222,16 +433,31 @@ void TileCache::downloadFinished(QNetworkReply* reply, const Tile &tile)
 
 int TileCache::pendingDownloads() const
 {
-    return (int)m_pendingDownloads.size() + (m_output.isOpen() ? 1 : 0);
+    return (int)m_pendingDownloads.size() + (int)std::count_if(m_activeDownloads.begin(), m_activeDownloads.end(), [](const auto &d) { return !d.prefetch; });
 }
 
 void TileCache::cancelPending()
 {
+    ++m_generation;
     m_pendingDownloads.clear();
-    delete m_currentReply.get();
-    if (m_output.isOpen()) {
-        m_output.close();
-        m_output.remove();
+    m_pendingPrefetches.clear();
+    for (auto &download : std::exchange(m_activeDownloads, {})) {
+        if (download.reply) {
+            disconnect(download.reply.get(), nullptr, this, nullptr);
+            delete download.reply.get();
+        }
+        discard(download);
+    }
+}
+
+void TileCache::discard(Download &download)
+{
+    if (download.output) {
+        download.output->close();
+        download.output->remove();
+    }
+    if (download.archiveOffset >= 0 && m_archive) {
+        m_archive->release(download.archiveOffset);
     }
 }
 
@@ -241,6 +467,10 @@ static void expireRecursive(const QString &path)
     while (it.hasNext()) {
         it.next();
 
+        // expired separately when in use, kept otherwise
+        if (it.fileName() == ArchiveFileName || it.fileName() == ArchiveLockFileName) {
+            continue;
+        }
         if (it.fileInfo().isDir()) {
             expireRecursive(it.filePath());
             if (QDir(it.filePath()).isEmpty()) {
@@ -255,13 +485,59 @@ static void expireRecursive(const QString &path)
 }
 void TileCache::expire()
 {
-    const QString base = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/org.kde.osm/vectorosm/"_L1;
-    expireRecursive(base);
+    if (m_archive) {
+        m_archive->expire(QDateTime::currentDateTimeUtc());
+        // compaction moves tile data, which running downloads are written into
+        const auto isIdle = m_activeDownloads.empty() && m_pendingDownloads.empty() && m_pendingPrefetches.empty();
+        if (isIdle && m_archive->garbageRatio() > MaxArchiveGarbageRatio && !m_archive->compact() && !m_archive->isOpen()) {
+            m_archive.reset();
+        }
+        expireRecursive(cacheBasePath() + SnapshotDirectory);
+        return;
+    }
+
+    expireRecursive(cacheBasePath());
 }
 
-void TileCache::updateTtl(const QString &filePath, const QDateTime &ttl)
+void TileCache::importTiles()
 {
-    QFile f(filePath);
+    // tiles are stored as <z>/<x>/<y>.o5m, with the expiry time as modification time
+    const QDir base(cacheBasePath());
+    const auto now = QDateTime::currentDateTimeUtc();
+    QDirIterator it(base.path(), {u"*.o5m"_s}, QDir::Files | QDir::NoSymLinks, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        const auto parts = base.relativeFilePath(it.filePath()).split('/'_L1);
+        if (parts.size() != 3 || it.fileInfo().lastModified() < now) {
+            continue;
+        }
+        bool xOk = false, yOk = false, zOk = false;
+        const Tile tile(parts[1].toUInt(&xOk), QStringView(parts[2]).chopped(4).toUInt(&yOk), parts[0].toUShort(&zOk));
+        if (!xOk || !yOk || !zOk) {
+            continue;
+        }
+
+        QFile f(it.filePath());
+        if (!f.open(QFile::ReadOnly) || !m_archive->insert(tile, f.readAll(), it.fileInfo().lastModified())) {
+            qCWarning(Log) << "failed to import cached tile" << it.filePath();
+        }
+        // tiles that couldn't be imported are downloaded again when needed, cached tiles are only looked up in the archive from now on
+        f.remove();
+    }
+    qCDebug(Log) << "tile archive contains" << m_archive->size() << "tiles";
+
+    // removes expired tiles and the then empty tile directories
+    expireRecursive(base.path());
+}
+
+void TileCache::updateTtl(const Tile &tile, const QDateTime &ttl)
+{
+    if (m_archive) {
+        m_archive->setTtl(tile, std::max(m_archive->ttl(tile), ttl));
+        return;
+    }
+
+    QFile f(cachePath(tile));
     f.open(QFile::WriteOnly | QFile::Append);
     f.setFileTime(std::max(f.fileTime(QFileDevice::FileModificationTime), ttl), QFile::FileModificationTime);
 }
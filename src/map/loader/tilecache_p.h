@@ -17,6 +17,8 @@
 #include <QObject>
 
 #include <deque>
+#include <memory>
+#include <vector>
 
 class QNetworkAccessManager;
 class QNetworkReply;
@@ -28,6 +30,8 @@ class Coordinate;
 
 namespace KOSMIndoorMap {
 
+class TileArchive;
+
 /** Identifier of a slippy map tile.
  *  @see https://wiki.openstreetmap.org/wiki/Slippy_map_tilenames
  *  @internal only exported for unit tests
@@ -41,6 +45,12 @@ public:
 
     [[nodiscard]] static Tile fromCoordinate(double lat, double lon, uint8_t z);
 
+    /** Same tile, regardless of the cache expiry time. */
+    [[nodiscard]] inline bool operator==(const Tile &other) const
+    {
+        return x == other.x && y == other.y && z == other.z;
+    }
+
     [[nodiscard]] OSM::Coordinate topLeft() const;
     [[nodiscard]] OSM::BoundingBox boundingBox() const;
 
@@ -54,6 +64,21 @@ public:
     QDateTime ttl;
 };
 
+/** Location of the content of a locally cached tile.
+ *  That's either an entire file, or a part of the tile archive file.
+ */
+class CachedTile
+{
+public:
+    QString fileName;
+    qint64 offset = 0;
+    qint64 size = 0;
+    /** Expiry time. */
+    QDateTime ttl;
+
+    [[nodiscard]] constexpr inline bool isValid() const { return size > 0; }
+};
+
 /** OSM vector tile downloading and cache management. */
 class TileCache : public QObject
 {
@@ -62,8 +87,26 @@ public:
     explicit TileCache(const NetworkAccessManagerFactory &namFactory,  QObject *parent = nullptr);
     ~TileCache();
 
-    /** Returns the path to the cached content of @p tile, if present locally. */
-    [[nodiscard]] QString cachedTile(const Tile &tile) const;
+    /** Returns the location of the cached content of @p tile, if present locally. */
+    [[nodiscard]] CachedTile cachedTile(const Tile &tile) const;
+
+    /** Path of a cached map data snapshot of the venue with bounding box @p bbox, found when loading starting from @p tile.
+     *  Like individual tile files this uses the modification time as expiry time, and is expired along with the tiles.
+     */
+    [[nodiscard]] QString snapshotPath(const Tile &tile, OSM::BoundingBox bbox) const;
+    /** Path of the cached snapshot of a venue found when loading starting from @p tile containing @p coord.
+     *  If there are several, the smallest one is picked. Returns an empty string if there is none.
+     */
+    [[nodiscard]] QString findSnapshot(const Tile &tile, OSM::Coordinate coord) const;
+
+    /** Store tiles in a single archive file rather than in one file per tile.
+     *  Enabling this moves tiles already cached in individual files into the archive,
+     *  disabling it leaves the archive alone, tiles are downloaded again as needed then.
+     *  Changing this invalidates previously returned cached tile locations.
+     *  @note Moving tiles into the archive happens synchronously, for a large existing
+     *  cache this blocks for a while. Ideally call this before any tiles are cached.
+     */
+    void setUseArchive(bool useArchive);
 
     /** Ensure @p tile is locally cached. */
     void ensureCached(const Tile &tile);
@@ -71,30 +114,71 @@ public:
     /** Triggers the download of tile @p tile. */
     void downloadTile(const Tile &tile);
 
-    /** Number of pending downloads. */
+    /** Download @p tile with low priority, if not locally cached yet.
+     *  This only starts when no regular downloads are waiting, and isn't considered pending.
+     *  tileLoaded() and tileError() are emitted for such tiles as well.
+     *  A subsequent call to downloadTile() or ensureCached() for the same tile turns this into a regular download.
+     */
+    void prefetchTile(const Tile &tile);
+
+    /** Maximum number of downloads running in parallel. */
+    void setMaximumParallelDownloads(int count);
+
+    /** Number of pending downloads, not including prefetched tiles. */
     [[nodiscard]] int pendingDownloads() const;
 
-    /** Cancel all pending downloads. */
+    /** Cancel all pending downloads, including prefetched tiles.
+     *  No signals are emitted for cancelled downloads anymore.
+     */
     void cancelPending();
 
-    /** Expire old cached tiles. */
+    /** Expire old cached tiles.
+     *  In archive mode this also compacts the archive if needed, unless downloads are pending.
+     *  Compaction invalidates previously returned cached tile locations, so this must not be
+     *  called while those are still in use.
+     */
     void expire();
 
 Q_SIGNALS:
     void tileLoaded(const Tile &tile);
+    /** Download or storage of @p tile failed. Never emitted synchronously from a call into this. */
     void tileError(const Tile &tile, const QString &errorMessage);
 
 private:
+    [[nodiscard]] static QString cacheBasePath();
+    [[nodiscard]] static QString archivePath();
     [[nodiscard]] QString cachePath(const Tile &tile) const;
+    [[nodiscard]] static QString snapshotDirectory(const Tile &tile);
+    void importTiles();
+    [[nodiscard]] bool isPending(const Tile &tile) const;
     void downloadNext();
+    void startDownload(const Tile &tile, bool prefetch);
     void dataReceived(QNetworkReply *reply);
-    void downloadFinished(QNetworkReply *reply, const Tile &tile);
-    void updateTtl(const QString &filePath, const QDateTime &ttl);
+    void downloadFinished(QNetworkReply *reply);
+    void updateTtl(const Tile &tile, const QDateTime &ttl);
+
+    struct Download {
+        Tile tile;
+        QPointer<QNetworkReply> reply;
+        /** Partial tile file, when not using the archive. */
+        std::unique_ptr<QFile> output;
+        /** Space reserved in the archive if the size is known upfront, otherwise data is buffered. */
+        qint64 archiveOffset = -1;
+        qint64 archiveSize = 0;
+        QByteArray buffer;
+        qint64 received = 0;
+        bool prefetch = false;
+    };
+    void discard(Download &download);
 
     NetworkAccessManagerFactory m_nam;
-    QPointer<QNetworkReply> m_currentReply;
-    QFile m_output;
+    std::vector<Download> m_activeDownloads;
     std::deque<Tile> m_pendingDownloads;
+    std::deque<Tile> m_pendingPrefetches;
+    int m_maxParallelDownloads;
+    /** Incremented on cancellation, to drop errors queued for a previous request. */
+    int m_generation = 0;
+    std::unique_ptr<TileArchive> m_archive;
 };
 
 }
@@ -28,6 +28,7 @@
 
 #include <osm/element.h>
 #include <osm/datatypes.h>
+#include <osm/spatialindex.h>
 
 #include <QDebug>
 #include <QElapsedTimer>
@@ -61,6 +62,11 @@ public:
     OSM::TagKey m_typeTag;
     OSM::Languages m_langs;
 
+    /** Revision of m_data the scene graph has been updated for, see MapData::changeRevision(). */
+    int m_changeRevision = 0;
+    /** Levels changed in place since the last update. */
+    std::vector<int> m_changedLevels;
+    bool m_discardPreviousItems = false;
     bool m_dirty = true;
     bool m_overlay = false;
 };
@@ -76,6 +82,19 @@ SceneController::~SceneController() = default;
 
 void SceneController::setMapData(const MapData &data)
 {
+    if (d->m_data == data && !data.isEmpty()) {
+        if (const auto changedLevels = data.changedLevels(d->m_changeRevision)) {
+            for (const auto &level : *changedLevels) {
+                d->m_changedLevels.push_back(level.numericLevel());
+            }
+        } else {
+            // elements moved in memory, so we cannot even look at the previous items anymore
+            d->m_discardPreviousItems = true;
+            d->m_hoverElement = {};
+        }
+    }
+    d->m_changeRevision = data.changeRevision();
+
     d->m_data = data;
     if (!d->m_data.isEmpty()) {
         d->m_layerTag = data.dataSet().tagKey("layer");
@@ -133,7 +152,17 @@ void SceneController::updateScene(SceneGraph &sg) const
     d->m_openingHours.setTimeRange(d->m_view->beginTime(), d->m_view->endTime());
     d->m_dirty = false;
 
+    if (d->m_discardPreviousItems) {
+        sg.clear();
+        sg.setZoomLevel(d->m_view->zoomLevel());
+        sg.setCurrentFloorLevel(d->m_view->level());
+    }
     sg.beginSwap();
+    for (const auto level : d->m_changedLevels) {
+        sg.discardPreviousItems(level);
+    }
+    d->m_changedLevels.clear();
+    d->m_discardPreviousItems = false;
     std::for_each(d->m_overlaySources.begin(), d->m_overlaySources.end(), std::mem_fn(&AbstractOverlaySource::beginSwap));
     updateCanvas(sg);
 
@@ -173,8 +202,14 @@ void SceneController::updateScene(SceneGraph &sg) const
     // for each level, update or create scene graph elements, after a some basic bounding box check
     const auto geoBbox = d->m_view->mapSceneToGeo(d->m_view->sceneBoundingBox());
     for (auto it = beginIt; it != endIt; ++it) {
-        for (auto e : (*it).second) {
-            if (OSM::intersects(geoBbox, e.boundingBox()) && !std::binary_search(d->m_hiddenElements.begin(), d->m_hiddenElements.end(), e)) {
+        const auto index = d->m_data.levelIndex((*it).first);
+        if (!index) {
+            continue;
+        }
+        // query results are in level map order, retaining the element order of a full scan
+        for (const auto pos : index->query(geoBbox)) {
+            const auto e = (*it).second[pos];
+            if (!std::binary_search(d->m_hiddenElements.begin(), d->m_hiddenElements.end(), e)) {
                 updateElement(e, (*it).first.numericLevel(), sg);
             }
         }
@@ -569,6 +604,17 @@ void SceneController::updateElement(const MapCSSState &state, int level, SceneGr
 
 QPolygonF SceneController::createPolygon(OSM::Element e) const
 {
+    if (e.type() == OSM::Type::Way) {
+        if (const auto coords = d->m_data.dataSet().wayCoordinates(*e.way()); !coords.empty()) {
+            QPolygonF poly;
+            poly.reserve(coords.size());
+            for (const auto coord : coords) {
+                poly.push_back(d->m_view->mapGeoToScene(coord));
+            }
+            return poly;
+        }
+    }
+
     const auto path = e.outerPath(d->m_data.dataSet());
     if (path.empty()) {
         return {};
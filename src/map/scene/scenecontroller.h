@@ -40,6 +40,9 @@ public:
     explicit SceneController();
     ~SceneController();
 
+    /** Setting the same map data again after it has been changed in place only
+     *  recreates the scene graph items on the changed levels, see MapData::changedLevels().
+     */
     void setMapData(const MapData &data);
     void setStyleSheet(const MapCSSStyle *styleSheet);
     void setView(const View *view);
@@ -71,6 +71,13 @@ void SceneGraph::beginSwap()
     m_layerOffsets.clear();
 }
 
+void SceneGraph::discardPreviousItems(int level)
+{
+    m_previousItems.erase(std::remove_if(m_previousItems.begin(), m_previousItems.end(), [level](const auto &item) {
+        return item.level == level;
+    }), m_previousItems.end());
+}
+
 void SceneGraph::endSwap()
 {
     m_previousItems.clear();
@@ -44,6 +44,8 @@ public:
     void addItem(SceneGraphItem &&item);
     template <typename T>
     std::unique_ptr<SceneGraphItemPayload> findOrCreatePayload(OSM::Element e, int level, LayerSelectorKey layerSelector);
+    /** Don't re-use any previous item on @p level in this swap, as its underlying data changed. */
+    void discardPreviousItems(int level);
     void zSort();
     void endSwap();
 
@@ -24,13 +24,16 @@ static double toNumber(const QByteArray &val)
     return res ? n : NAN;
 }
 
-void MapCSSCondition::compile(const OSM::DataSet &dataSet)
+void MapCSSCondition::compile(OSM::DataSet &dataSet, bool createTagKeys)
 {
+    const auto tagKey = [&dataSet, createTagKeys](const char *key) {
+        return createTagKeys ? dataSet.makeTagKey(key, OSM::StringMemory::Transient) : dataSet.tagKey(key);
+    };
     if (m_key == "mx:closed") {
-        m_tagKey = dataSet.tagKey("opening_hours");
+        m_tagKey = tagKey("opening_hours");
         m_op = (m_op == KeyNotSet ? IsNotClosed : IsClosed);
     } else {
-        m_tagKey = dataSet.tagKey(m_key.constData());
+        m_tagKey = tagKey(m_key.constData());
     }
 
     switch(m_op) {
@@ -33,8 +33,10 @@ public:
     ~MapCSSCondition();
     MapCSSCondition& operator=(const MapCSSCondition&) = delete;
 
-    /** Resolve tag keys. */
-    void compile(const OSM::DataSet &dataSet);
+    /** Resolve tag keys.
+     *  @param createTagKeys add tag keys not yet present in @p dataSet.
+     */
+    void compile(OSM::DataSet &dataSet, bool createTagKeys);
     /** Condition matches the given evaluation state. */
     bool matches(const MapCSSState &state, const MapCSSResultLayer &result) const;
     /** Condition matches the given state for a canvas element. */
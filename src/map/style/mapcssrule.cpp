@@ -18,9 +18,9 @@ using namespace KOSMIndoorMap;
 MapCSSRule::MapCSSRule() = default;
 MapCSSRule::~MapCSSRule() = default;
 
-void MapCSSRule::compile(OSM::DataSet &dataSet)
+void MapCSSRule::compile(OSM::DataSet &dataSet, bool createTagKeys)
 {
-    m_selector->compile(dataSet);
+    m_selector->compile(dataSet, createTagKeys);
     for (const auto &decl : m_declarations) {
         decl->compile(dataSet);
     }
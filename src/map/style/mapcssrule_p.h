@@ -31,8 +31,8 @@ public:
     explicit MapCSSRule();
     ~MapCSSRule();
 
-    /** Perform tag key resolution. */
-    void compile(OSM::DataSet &dataSet);
+    /** Perform tag key resolution, see MapCSSCondition::compile(). */
+    void compile(OSM::DataSet &dataSet, bool createTagKeys);
 
     /** Rule evaluation, @see MapCSSStyle. */
     void evaluate(const MapCSSState &state, MapCSSResult &result) const;
@@ -24,10 +24,10 @@ MapCSSSelector::~MapCSSSelector() = default;
 MapCSSBasicSelector::MapCSSBasicSelector() = default;
 MapCSSBasicSelector::~MapCSSBasicSelector() = default;
 
-void MapCSSBasicSelector::compile(const OSM::DataSet &dataSet)
+void MapCSSBasicSelector::compile(OSM::DataSet &dataSet, bool createTagKeys)
 {
     for (const auto &c : conditions) {
-        c->compile(dataSet);
+        c->compile(dataSet, createTagKeys);
     }
 }
 
@@ -196,10 +196,10 @@ void MapCSSBasicSelector::setLayer(LayerSelectorKey key)
 }
 
 
-void MapCSSChainedSelector::compile(const OSM::DataSet &dataSet)
+void MapCSSChainedSelector::compile(OSM::DataSet &dataSet, bool createTagKeys)
 {
     for (const auto &s : selectors) {
-        s->compile(dataSet);
+        s->compile(dataSet, createTagKeys);
     }
 }
 
@@ -236,11 +236,11 @@ void MapCSSChainedSelector::write(QIODevice *out) const
 MapCSSUnionSelector::MapCSSUnionSelector() = default;
 MapCSSUnionSelector::~MapCSSUnionSelector() = default;
 
-void MapCSSUnionSelector::compile(const OSM::DataSet &dataSet)
+void MapCSSUnionSelector::compile(OSM::DataSet &dataSet, bool createTagKeys)
 {
     for (const auto &ls : m_selectors) {
         for (const auto &s : ls.selectors) {
-            s->compile(dataSet);
+            s->compile(dataSet, createTagKeys);
         }
     }
 }
@@ -33,8 +33,8 @@ class MapCSSSelector
 public:
     virtual ~MapCSSSelector();
 
-    /** Resolve tag keys. */
-    virtual void compile(const OSM::DataSet &dataSet) = 0;
+    /** Resolve tag keys, see MapCSSCondition::compile(). */
+    virtual void compile(OSM::DataSet &dataSet, bool createTagKeys) = 0;
     /** Returns @c true if this selector matches the evaluation state. */
     virtual bool matches(const MapCSSState &state, MapCSSResult &result, const std::vector<std::unique_ptr<MapCSSDeclaration>> &declarations) const = 0;
     /** Selector matches the canvas element. */
@@ -55,7 +55,7 @@ public:
     explicit MapCSSBasicSelector();
     ~MapCSSBasicSelector();
 
-    void compile(const OSM::DataSet &dataSet) override;
+    void compile(OSM::DataSet &dataSet, bool createTagKeys) override;
     [[nodiscard]] bool matches(const MapCSSState &state, MapCSSResult &result, const std::vector<std::unique_ptr<MapCSSDeclaration>> &declarations) const override;
     [[nodiscard]] bool matchesCanvas(const MapCSSState &state) const override;
     [[nodiscard]] LayerSelectorKey layerSelector() const override;
@@ -83,7 +83,7 @@ private:
 class MapCSSChainedSelector : public MapCSSSelector
 {
 public:
-    void compile(const OSM::DataSet &dataSet) override;
+    void compile(OSM::DataSet &dataSet, bool createTagKeys) override;
     bool matches(const MapCSSState &state, MapCSSResult &result, const std::vector<std::unique_ptr<MapCSSDeclaration>> &declarations) const override;
     bool matchesCanvas(const MapCSSState &state) const override;
     LayerSelectorKey layerSelector() const override;
@@ -98,7 +98,7 @@ public:
     explicit MapCSSUnionSelector();
     ~MapCSSUnionSelector();
 
-    void compile(const OSM::DataSet &dataSet) override;
+    void compile(OSM::DataSet &dataSet, bool createTagKeys) override;
     bool matches(const MapCSSState &state, MapCSSResult &result, const std::vector<std::unique_ptr<MapCSSDeclaration>> &declarations) const override;
     bool matchesCanvas(const MapCSSState &state) const override;
     LayerSelectorKey layerSelector() const override;
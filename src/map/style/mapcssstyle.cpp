@@ -78,16 +78,29 @@ bool MapCSSStyle::isEmpty() const
 
 void MapCSSStyle::compile(OSM::DataSet &dataSet)
 {
-    d->m_areaKey = dataSet.tagKey("area");
-    d->m_typeKey = dataSet.tagKey("type");
+    d->compile(dataSet, false);
+}
+
+void MapCSSStyle::compileForLoading(OSM::DataSet &dataSet)
+{
+    d->compile(dataSet, true);
+}
 
-    for (auto &rule : d->m_wayTypeRules) {
-        rule.tag = dataSet.tagKey(rule.tagName);
+void MapCSSStylePrivate::compile(OSM::DataSet &dataSet, bool createTagKeys)
+{
+    const auto tagKey = [&dataSet, createTagKeys](const char *key) {
+        return createTagKeys ? dataSet.makeTagKey(key, OSM::StringMemory::Transient) : dataSet.tagKey(key);
+    };
+    m_areaKey = tagKey("area");
+    m_typeKey = tagKey("type");
+
+    for (auto &rule : m_wayTypeRules) {
+        rule.tag = tagKey(rule.tagName);
     }
-    std::sort(d->m_wayTypeRules.begin(), d->m_wayTypeRules.end(), [](const auto &lhs, const auto &rhs) { return lhs.tag < rhs.tag; });
+    std::sort(m_wayTypeRules.begin(), m_wayTypeRules.end(), [](const auto &lhs, const auto &rhs) { return lhs.tag < rhs.tag; });
 
-    for (const auto &rule : d->m_rules) {
-        rule->compile(dataSet);
+    for (const auto &rule : m_rules) {
+        rule->compile(dataSet, createTagKeys);
     }
 }
 
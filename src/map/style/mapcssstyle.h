@@ -49,6 +49,13 @@ public:
      */
     void compile(OSM::DataSet &dataSet);
 
+    /** Same as compile(), but also adds the tag keys used in selectors to @p dataSet
+     *  if they don't exist there yet.
+     *  Use this for evaluating elements while @p dataSet is still being populated,
+     *  such as for filtering input data during loading.
+     */
+    void compileForLoading(OSM::DataSet &dataSet);
+
     /** Initializes the evaluation state.
      *  Call this on a MapCSSState instance for each element being evaluated.
      *  The state object can be reused for multiple elements to reduce allocations.
@@ -25,6 +25,8 @@ class MapCSSStylePrivate {
 public:
     explicit MapCSSStylePrivate();
 
+    void compile(OSM::DataSet &dataSet, bool createTagKeys);
+
     std::vector<std::unique_ptr<MapCSSRule>> m_rules;
     OSM::StringKeyRegistry<ClassSelectorKey> m_classSelectorRegistry;
     OSM::StringKeyRegistry<LayerSelectorKey> m_layerSelectorRegistry;
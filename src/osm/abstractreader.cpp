@@ -5,16 +5,28 @@
 
 #include "abstractreader.h"
 #include "datatypes.h"
+#include "datasetchanges.h"
 #include "datasetmergebuffer.h"
+#include "element.h"
+#include "elementhandler.h"
+#include "readerfilter.h"
 
 #include <QDebug>
 #include <QIODevice>
+#include <QMutex>
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <iterator>
+#include <unordered_set>
 
 using namespace OSM;
 
+enum {
+    ReadChunkSize = 256 * 1024,
+};
+
 namespace OSM {
 /** Readonly QIODevice adapter for memory-mapped data. */
 class MemoryMapIoDevice : public QIODevice
@@ -82,17 +94,101 @@ void AbstractReader::setMergeBuffer(OSM::DataSetMergeBuffer *buffer)
     m_mergeBuffer = buffer;
 }
 
-void AbstractReader::read(const uint8_t *data, std::size_t len)
+void AbstractReader::setElementHandler(OSM::ElementHandler *handler)
+{
+    m_elementHandler = handler;
+}
+
+void AbstractReader::setFilter(OSM::ReaderFilter *filter)
+{
+    m_filter = filter;
+}
+
+void AbstractReader::setChangeTracking(OSM::DataSetChanges *changes)
 {
+    m_changes = changes;
+}
+
+void AbstractReader::read(const uint8_t *data, std::size_t len, StringMemory memOpt)
+{
+    beginRead();
+    m_dataMemOpt = memOpt;
     readFromData(data, len);
-    if (!m_error.isEmpty()) {
-        qWarning() << m_error;
-    }
+    endRead();
 }
 
 void AbstractReader::read(QIODevice *io)
 {
+    beginRead();
+    m_dataMemOpt = StringMemory::Transient;
     readFromIODevice(io);
+    endRead();
+}
+
+void AbstractReader::addData(const char *data, std::size_t len)
+{
+    if (!m_isIncrementalRead) {
+        beginRead();
+        m_isIncrementalRead = true;
+        m_dataMemOpt = StringMemory::Transient;
+        beginIncrementalRead();
+    }
+    addDataIncremental(data, len, false);
+}
+
+void AbstractReader::finish()
+{
+    if (!m_isIncrementalRead) {
+        beginRead();
+        m_dataMemOpt = StringMemory::Transient;
+        beginIncrementalRead();
+    }
+    addDataIncremental(nullptr, 0, true);
+    m_isIncrementalRead = false;
+    endRead();
+}
+
+static void sortAndDeduplicate(std::vector<Id> &ids)
+{
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+}
+
+/** Elements already present in the data set are not added again, so they aren't created by reading. */
+[[nodiscard]] static bool containsElement(const DataSet &dataSet, QMutex *mutex, Type type, Id id)
+{
+    QMutexLocker locker(mutex);
+    return lookupElement(dataSet, type, id).type() != Type::Null;
+}
+
+void AbstractReader::beginRead()
+{
+    // without a merge buffer we add directly to the data set, use bulk loading for that
+    // to avoid paying for sorted insertion of every single element
+    if (!m_mergeBuffer && !m_elementHandler) {
+        m_dataSet->beginBulkLoad();
+        // filtering only removes what this read added, not what was in the data set already
+        if (m_filter) {
+            m_filterCreated = std::make_unique<DataSetChanges>();
+        }
+    }
+}
+
+void AbstractReader::endRead()
+{
+    if (!m_mergeBuffer && !m_elementHandler) {
+        m_dataSet->endBulkLoad();
+        if (m_filterCreated) {
+            removeFilteredElements();
+            m_filterCreated.reset();
+        }
+    }
+    if (m_changes) {
+        // elements read more than once are only added once
+        sortAndDeduplicate(m_changes->createdNodes);
+        sortAndDeduplicate(m_changes->createdWays);
+        sortAndDeduplicate(m_changes->createdRelations);
+    }
     if (!m_error.isEmpty()) {
         qWarning() << m_error;
     }
@@ -109,8 +205,56 @@ void AbstractReader::readFromData(const uint8_t *data, std::size_t len)
 void AbstractReader::readFromIODevice(QIODevice *io)
 {
     assert(io);
-    QByteArray data = io->readAll();
-    readFromData(reinterpret_cast<const uint8_t*>(data.constData()), data.size());
+    beginIncrementalRead();
+    QByteArray chunk(ReadChunkSize, Qt::Uninitialized);
+    while (!hasError()) {
+        const auto size = io->read(chunk.data(), chunk.size());
+        if (size <= 0) {
+            break;
+        }
+        addDataIncremental(chunk.constData(), size, false);
+    }
+    addDataIncremental(nullptr, 0, true);
+}
+
+std::size_t AbstractReader::readIncremental(const uint8_t *data, std::size_t len, [[maybe_unused]] std::size_t offset, bool atEnd)
+{
+    if (!atEnd) {
+        return 0;
+    }
+    readFromData(data, len);
+    return len;
+}
+
+void AbstractReader::beginIncrementalRead()
+{
+    m_pendingData.clear();
+    m_pendingOffset = 0;
+}
+
+void AbstractReader::addDataIncremental(const char *data, std::size_t len, bool atEnd)
+{
+    if (hasError()) {
+        return;
+    }
+
+    std::size_t consumed = 0;
+    if (m_pendingData.isEmpty() && data) {
+        // nothing left over, parse directly from the input and only keep what remains
+        consumed = readIncremental(reinterpret_cast<const uint8_t*>(data), len, m_pendingOffset, atEnd);
+        if (!atEnd && consumed < len) {
+            m_pendingData.append(data + consumed, (qsizetype)(len - consumed));
+        }
+    } else {
+        m_pendingData.append(data, (qsizetype)len);
+        consumed = readIncremental(reinterpret_cast<const uint8_t*>(m_pendingData.constData()), m_pendingData.size(), m_pendingOffset, atEnd);
+        m_pendingData.remove(0, (qsizetype)consumed);
+    }
+    m_pendingOffset += consumed;
+
+    if (atEnd) {
+        m_pendingData.clear();
+    }
 }
 
 bool AbstractReader::hasError() const
@@ -125,17 +269,236 @@ QString AbstractReader::errorString() const
 
 void AbstractReader::addNode(OSM::Node &&node)
 {
+    if (m_elementHandler) {
+        m_elementHandler->handleNode(node);
+        return;
+    }
+    if (m_filter && !node.tags.empty()) {
+        applyFilter(node, m_filter->acceptNode(node));
+    }
+    if ((m_changes || m_filterCreated) && !containsElement(*m_dataSet, m_mutex, Type::Node, node.id)) {
+        if (m_changes) {
+            m_changes->createdNodes.push_back(node.id);
+        }
+        if (m_filterCreated) {
+            m_filterCreated->createdNodes.push_back(node.id);
+        }
+    }
     m_mergeBuffer ? m_mergeBuffer->nodes.push_back(std::move(node)) : m_dataSet->addNode(std::move(node));
 }
 
 void AbstractReader::addWay(OSM::Way &&way)
 {
+    if (m_elementHandler) {
+        m_elementHandler->handleWay(way);
+        return;
+    }
+    if (m_filter && !way.tags.empty()) {
+        applyFilter(way, m_filter->acceptWay(way));
+    }
+    if ((m_changes || m_filterCreated) && !containsElement(*m_dataSet, m_mutex, Type::Way, way.id)) {
+        if (m_changes) {
+            m_changes->createdWays.push_back(way.id);
+        }
+        if (m_filterCreated) {
+            m_filterCreated->createdWays.push_back(way.id);
+        }
+    }
     m_mergeBuffer ? m_mergeBuffer->ways.push_back(std::move(way)) : m_dataSet->addWay(std::move(way));
 }
 
 void AbstractReader::addRelation(OSM::Relation &&relation)
 {
+    if (m_elementHandler) {
+        m_elementHandler->handleRelation(relation);
+        return;
+    }
+    if (m_filter && !relation.tags.empty()) {
+        applyFilter(relation, m_filter->acceptRelation(relation));
+    }
+    if ((m_changes || m_filterCreated) && !containsElement(*m_dataSet, m_mutex, Type::Relation, relation.id)) {
+        if (m_changes) {
+            m_changes->createdRelations.push_back(relation.id);
+        }
+        if (m_filterCreated) {
+            m_filterCreated->createdRelations.push_back(relation.id);
+        }
+    }
     m_mergeBuffer ? m_mergeBuffer->relations.push_back(std::move(relation)) : m_dataSet->addRelation(std::move(relation));
 }
 
+void AbstractReader::reserveElements(std::size_t nodeCount, std::size_t wayCount, std::size_t relationCount)
+{
+    if (m_elementHandler) {
+        return;
+    }
+    if (m_mergeBuffer) {
+        m_mergeBuffer->nodes.reserve(m_mergeBuffer->nodes.size() + nodeCount);
+        m_mergeBuffer->ways.reserve(m_mergeBuffer->ways.size() + wayCount);
+        m_mergeBuffer->relations.reserve(m_mergeBuffer->relations.size() + relationCount);
+    } else {
+        QMutexLocker locker(m_mutex);
+        m_dataSet->nodes.reserve(m_dataSet->nodes.size() + nodeCount);
+        m_dataSet->ways.reserve(m_dataSet->ways.size() + wayCount);
+        m_dataSet->relations.reserve(m_dataSet->relations.size() + relationCount);
+    }
+}
+
+template <typename Elem>
+void AbstractReader::applyFilter(Elem &elem, bool accepted)
+{
+    if (!accepted) {
+        elem.tags = {};
+        return;
+    }
+    QMutexLocker locker(m_mutex);
+    for (auto &tag : elem.tags) {
+        tag.value = m_dataSet->makeTagValue(tag.value.constData(), tag.value.size(), m_filteredTagMemOpt);
+    }
+}
+
+QByteArray AbstractReader::makeTagValue(const char *value, std::size_t len, StringMemory memOpt)
+{
+    if (m_elementHandler) {
+        return QByteArray::fromRawData(value, (qsizetype)len);
+    }
+    if (m_filter) {
+        // only stored once the element is accepted
+        m_filteredTagMemOpt = memOpt;
+        return QByteArray::fromRawData(value, (qsizetype)len);
+    }
+    return m_dataSet->makeTagValue(value, len, memOpt);
+}
+
+/** Removes untagged elements in @p created not contained in @p referenced.
+ *  Returns whether anything was removed.
+ */
+template <typename Elem>
+static bool removeUnreferenced(std::vector<Elem> &elements, const std::vector<Id> &created, std::vector<Id> &&referenced)
+{
+    sortAndDeduplicate(referenced);
+    std::vector<Id> candidates;
+    std::set_difference(created.begin(), created.end(), referenced.begin(), referenced.end(), std::back_inserter(candidates));
+    if (candidates.empty()) {
+        return false;
+    }
+
+    // elements are sorted by id, everything before the first candidate stays in place
+    const auto begin = std::lower_bound(elements.begin(), elements.end(), candidates.front(), [](const Elem &elem, Id id) {
+        return elem.id < id;
+    });
+    const auto end = std::remove_if(begin, elements.end(), [&candidates](const Elem &elem) {
+        return elem.tags.empty() && std::binary_search(candidates.begin(), candidates.end(), elem.id);
+    });
+    const auto removed = end != elements.end();
+    elements.erase(end, elements.end());
+    return removed;
+}
+
+void AbstractReader::removeFilteredElements()
+{
+    auto &created = *m_filterCreated;
+    sortAndDeduplicate(created.createdNodes);
+    sortAndDeduplicate(created.createdWays);
+    sortAndDeduplicate(created.createdRelations);
+
+    // ways and relations outside of the bounding box, which we can only determine
+    // now that all node coordinates are available
+    if (const auto bbox = m_filter->boundingBox(); bbox.isValid()) {
+        const auto wayBbox = [this](const Way &way) {
+            if (way.bbox.isValid()) {
+                return way.bbox;
+            }
+            BoundingBox wayBbox;
+            for (const auto id : way.nodes) {
+                if (const auto node = m_dataSet->node(id)) {
+                    wayBbox = OSM::unite(wayBbox, {node->coordinate, node->coordinate});
+                }
+            }
+            return wayBbox;
+        };
+
+        for (const auto id : created.createdRelations) {
+            auto rel = m_dataSet->relation(id);
+            if (!rel || rel->tags.empty() || rel->bbox.isValid()) {
+                continue;
+            }
+            BoundingBox relBbox;
+            for (const auto &mem : rel->members) {
+                if (mem.type() == Type::Node) {
+                    if (const auto node = m_dataSet->node(mem.id)) {
+                        relBbox = OSM::unite(relBbox, {node->coordinate, node->coordinate});
+                    }
+                } else if (mem.type() == Type::Way) {
+                    if (const auto way = m_dataSet->way(mem.id)) {
+                        relBbox = OSM::unite(relBbox, wayBbox(*way));
+                    }
+                }
+            }
+            if (relBbox.isValid() && !OSM::intersects(relBbox, bbox)) {
+                rel->tags = {};
+            }
+        }
+        for (const auto id : created.createdWays) {
+            auto way = m_dataSet->way(id);
+            if (!way || way->tags.empty() || way->bbox.isValid()) {
+                continue;
+            }
+            if (const auto b = wayBbox(*way); b.isValid() && !OSM::intersects(b, bbox)) {
+                way->tags = {};
+            }
+        }
+    }
+
+    // keep accepted elements, everything that was in the data set before, and everything
+    // they refer to, recursively
+    std::vector<Id> relationIds;
+    for (const auto &rel : m_dataSet->relations) {
+        if (!rel.tags.empty() || !std::binary_search(created.createdRelations.begin(), created.createdRelations.end(), rel.id)) {
+            relationIds.push_back(rel.id);
+        }
+    }
+    std::unordered_set<Id> visitedRelations(relationIds.begin(), relationIds.end());
+    std::vector<Id> wayIds;
+    std::vector<Id> nodeIds;
+    for (std::size_t i = 0; i < relationIds.size(); ++i) {
+        const auto rel = m_dataSet->relation(relationIds[i]);
+        if (!rel) {
+            continue;
+        }
+        for (const auto &mem : rel->members) {
+            switch (mem.type()) {
+                case Type::Null:
+                    break;
+                case Type::Node:
+                    nodeIds.push_back(mem.id);
+                    break;
+                case Type::Way:
+                    wayIds.push_back(mem.id);
+                    break;
+                case Type::Relation:
+                    if (visitedRelations.insert(mem.id).second) {
+                        relationIds.push_back(mem.id);
+                    }
+                    break;
+            }
+        }
+    }
+    auto removed = removeUnreferenced(m_dataSet->relations, created.createdRelations, std::move(relationIds));
+    removed |= removeUnreferenced(m_dataSet->ways, created.createdWays, std::move(wayIds));
+
+    for (const auto &way : m_dataSet->ways) {
+        nodeIds.insert(nodeIds.end(), way.nodes.begin(), way.nodes.end());
+    }
+    removed |= removeUnreferenced(m_dataSet->nodes, created.createdNodes, std::move(nodeIds));
+    if (removed) {
+        m_dataSet->elementsChanged();
+    }
+}
+
+bool AbstractReader::hasElementHandler() const
+{
+    return m_elementHandler != nullptr;
+}
+
 #include "abstractreader.moc"
@@ -7,19 +7,25 @@
 #define OSM_ABSTRACTREADER_H
 
 #include "kosm_export.h"
+#include "stringpool.h"
 
 #include <QString>
 
 #include <cstdint>
 #include <cstddef>
+#include <memory>
 
 class QIODevice;
+class QMutex;
 
 namespace OSM {
 
 class DataSet;
+class DataSetChanges;
 class DataSetMergeBuffer;
+class ElementHandler;
 class Node;
+class ReaderFilter;
 class Relation;
 class Way;
 
@@ -39,14 +45,53 @@ public:
      */
     void setMergeBuffer(OSM::DataSetMergeBuffer *buffer);
 
+    /** Sets an element handler.
+     *  When set, all elements are passed to @p handler rather than being stored,
+     *  in file order and with tag values not being deduplicated. This allows processing
+     *  inputs larger than the available memory.
+     *  @note The OSM::DataSet specified in the constructor is still used for tag keys and roles.
+     */
+    void setElementHandler(OSM::ElementHandler *handler);
+
+    /** Sets a filter selecting the elements to keep.
+     *  Elements rejected by @p filter are dropped before their tag values are stored.
+     *  When reading into the OSM::DataSet directly, all elements created by reading that are neither
+     *  accepted nor needed by any element of the data set are removed from it at the end of reading. With a merge
+     *  buffer, rejected elements are retained without tags instead.
+     *  This has no effect when an element handler is set.
+     */
+    void setFilter(OSM::ReaderFilter *filter);
+
+    /** Records the elements affected by reading in @p changes.
+     *  Plain file formats only create elements, change sets (OSC) also modify and delete them.
+     *  This allows consumers of the OSM::DataSet to only update what changed.
+     *  This has no effect when an element handler is set.
+     */
+    void setChangeTracking(OSM::DataSetChanges *changes);
+
     /** Read the given data.
      *  Useful e.g. for working on memory-mapped data.
+     *  @param memOpt Pass OSM::StringMemory::Persistent if @p data remains valid for
+     *  the lifetime of the OSM::DataSet (see OSM::DataSet::addMappedFile()). Readers
+     *  supporting this then refer to @p data directly rather than copying strings.
      */
-    void read(const uint8_t *data, std::size_t len);
+    void read(const uint8_t *data, std::size_t len, StringMemory memOpt = StringMemory::Transient);
 
-    /** Read data from the given QIODevice. */
+    /** Read data from the given QIODevice.
+     *  This reads in chunks, readers supporting incremental parsing only keep
+     *  incomplete records in memory then.
+     */
     void read(QIODevice *io);
 
+    /** Incrementally read data as it becomes available, e.g. during a download.
+     *  Call finish() once all data has been added. The OSM::DataSet
+     *  is in bulk loading mode until then.
+     *  Readers not supporting incremental parsing buffer all input until finish().
+     */
+    void addData(const char *data, std::size_t len);
+    /** End incremental reading, see addData(). */
+    void finish();
+
     /** Error message in case parsing failed for some reason. */
     [[nodiscard]] QString errorString() const;
     [[nodiscard]] bool hasError() const;
@@ -61,16 +106,65 @@ protected:
     virtual void readFromData(const uint8_t *data, std::size_t len);
     virtual void readFromIODevice(QIODevice *io);
 
-    /** Add read elements to the merge buffer if set, or the dataset otherwise. */
+    /** Implement for incremental parsing.
+     *  Parse as many complete records from the start of @p data as possible, and return the
+     *  number of bytes consumed. The remainder is passed again on the next call, followed by
+     *  newly arrived data. Reading stops once an error is set.
+     *  @param offset Position of @p data in the entire input, 0 for the start of a new input.
+     *  @param atEnd @c true if no more data follows.
+     *  The default implementation consumes nothing until @p atEnd, and then calls readFromData().
+     */
+    virtual std::size_t readIncremental(const uint8_t *data, std::size_t len, std::size_t offset, bool atEnd);
+
+    /** Add read elements to the merge buffer if set, or the dataset otherwise.
+     *  In the latter case the dataset is in bulk loading mode while reading,
+     *  see OSM::DataSet::beginBulkLoad().
+     */
     void addNode(OSM::Node &&node);
     void addWay(OSM::Way &&way);
     void addRelation(OSM::Relation &&relation);
+    /** Reserve space for the given number of elements to be added, if the size of the input is known upfront. */
+    void reserveElements(std::size_t nodeCount, std::size_t wayCount, std::size_t relationCount);
+
+    /** Create a tag value for an element.
+     *  @p value has to remain valid until the element has been added via the above methods,
+     *  it's referenced directly rather than deduplicated when an element handler or a filter is set.
+     *  Otherwise @p memOpt describes the lifetime of @p value, as in OSM::DataSet::makeTagValue().
+     *  @p memOpt has to be the same for all tag values of an element.
+     */
+    [[nodiscard]] QByteArray makeTagValue(const char *value, std::size_t len, StringMemory memOpt);
+    /** Elements are passed on as they are read, parallel parsing would only add buffering then. */
+    [[nodiscard]] bool hasElementHandler() const;
 
     DataSet *m_dataSet = nullptr;
     QString m_error;
+    /** Lifetime of the data passed to readFromData(). */
+    StringMemory m_dataMemOpt = StringMemory::Transient;
+    /** Serializes access to the data set when parsing on a worker thread. */
+    QMutex *m_mutex = nullptr;
+    ReaderFilter *m_filter = nullptr;
+    DataSetChanges *m_changes = nullptr;
 
 private:
+    void beginRead();
+    void endRead();
+    void beginIncrementalRead();
+    void addDataIncremental(const char *data, std::size_t len, bool atEnd);
+    template <typename Elem>
+    void applyFilter(Elem &elem, bool accepted);
+    void removeFilteredElements();
+
     DataSetMergeBuffer *m_mergeBuffer = nullptr;
+    ElementHandler *m_elementHandler = nullptr;
+    /** Lifetime of the not yet stored tag values of the current element in filter mode. */
+    StringMemory m_filteredTagMemOpt = StringMemory::Transient;
+    /** Elements created by the current read, for limiting removeFilteredElements() to those. */
+    std::unique_ptr<DataSetChanges> m_filterCreated;
+
+    // incremental reading state
+    QByteArray m_pendingData;
+    std::size_t m_pendingOffset = 0;
+    bool m_isIncrementalRead = false;
 };
 
 }
@@ -7,6 +7,7 @@
 
 #include <QIODevice>
 
+#include <algorithm>
 #include <cassert>
 
 using namespace OSM;
@@ -17,5 +18,21 @@ void AbstractWriter::write(const OSM::DataSet &dataSet, QIODevice *io)
 {
     assert(io);
     assert(io->isOpen());
+    m_error.clear();
     writeToIODevice(dataSet, io);
 }
+
+void AbstractWriter::setCompressionLevel(int level)
+{
+    m_compressionLevel = std::clamp(level, -1, 9);
+}
+
+QString AbstractWriter::errorString() const
+{
+    return m_error;
+}
+
+bool AbstractWriter::hasError() const
+{
+    return !m_error.isEmpty();
+}
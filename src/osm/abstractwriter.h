@@ -8,6 +8,8 @@
 
 #include "kosm_export.h"
 
+#include <QString>
+
 class QIODevice;
 
 namespace OSM {
@@ -25,8 +27,22 @@ public:
      */
     void write(const OSM::DataSet &dataSet, QIODevice *io);
 
+    /** Set the compression level for formats supporting that.
+     *  This ranges from 1 (fastest) to 9 (smallest), 0 disables compression
+     *  and -1 (the default) uses the default level of the format.
+     *  Ignored by formats without compression.
+     */
+    void setCompressionLevel(int level);
+
+    /** Error message in case writing failed for some reason. */
+    [[nodiscard]] QString errorString() const;
+    [[nodiscard]] bool hasError() const;
+
 protected:
     virtual void writeToIODevice(const OSM::DataSet &dataSet, QIODevice *io) = 0;
+
+    QString m_error;
+    int m_compressionLevel = -1;
 };
 
 }
@@ -0,0 +1,20 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "datasetchanges.h"
+
+using namespace OSM;
+
+void DataSetChanges::clear()
+{
+    *this = {};
+}
+
+bool DataSetChanges::isEmpty() const
+{
+    return createdNodes.empty() && createdWays.empty() && createdRelations.empty()
+        && modifiedNodes.empty() && modifiedWays.empty() && modifiedRelations.empty()
+        && deletedNodes.empty() && deletedWays.empty() && deletedRelations.empty();
+}
@@ -0,0 +1,46 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef OSM_DATASETCHANGES_H
+#define OSM_DATASETCHANGES_H
+
+#include "kosm_export.h"
+#include "datatypes.h"
+
+#include <vector>
+
+namespace OSM {
+
+/** Elements affected by reading into an existing OSM::DataSet, e.g. when applying a change set.
+ *  @see OSM::AbstractReader::setChangeTracking()
+ */
+class KOSM_EXPORT DataSetChanges
+{
+public:
+    void clear();
+    [[nodiscard]] bool isEmpty() const;
+
+    /** Elements added to the data set, with the ids they have there, sorted by id.
+     *  Elements that already existed in the data set are not added again, and are thus not included here.
+     *  This can include elements removed again by an OSM::ReaderFilter.
+     */
+    std::vector<Id> createdNodes;
+    std::vector<Id> createdWays;
+    std::vector<Id> createdRelations;
+
+    /** Elements changed in place. */
+    std::vector<Id> modifiedNodes;
+    std::vector<Id> modifiedWays;
+    std::vector<Id> modifiedRelations;
+
+    /** Deleted elements. Those remain in the data set without tags, to not break references to them. */
+    std::vector<Id> deletedNodes;
+    std::vector<Id> deletedWays;
+    std::vector<Id> deletedRelations;
+};
+
+}
+
+#endif // OSM_DATASETCHANGES_H
@@ -6,6 +6,14 @@
 
 #include "datatypes.h"
 
+#include <QFile>
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <numeric>
+#include <unordered_set>
+
 using namespace OSM;
 
 const char* OSM::typeName(Type type)
@@ -30,11 +38,21 @@ TagKey DataSet::makeTagKey(const char *keyName, OSM::StringMemory keyMemOpt)
     return m_tagKeyRegistry.makeKey(keyName, keyMemOpt);
 }
 
+TagKey DataSet::makeTagKey(const char *keyName, std::size_t len)
+{
+    return m_tagKeyRegistry.makeKey(keyName, len, OSM::StringMemory::Transient);
+}
+
 Role DataSet::makeRole(const char *roleName, OSM::StringMemory memOpt)
 {
     return m_roleRegistry.makeKey(roleName, memOpt);
 }
 
+Role DataSet::makeRole(const char *roleName, std::size_t len)
+{
+    return m_roleRegistry.makeKey(roleName, len, OSM::StringMemory::Transient);
+}
+
 TagKey DataSet::tagKey(const char *keyName) const
 {
     return m_tagKeyRegistry.key(keyName);
@@ -45,76 +63,402 @@ Role DataSet::role(const char *roleName) const
     return m_roleRegistry.key(roleName);
 }
 
-const Node* DataSet::node(Id id) const
+QByteArray DataSet::tagValue(const char *value, std::size_t len) const
 {
-    if (const auto it = std::lower_bound(nodes.begin(), nodes.end(), id); it != nodes.end() && (*it).id == id) {
-        return &(*it);
+    return m_tagValueRegistry.value(value, len);
+}
+
+QByteArray DataSet::makeTagValue(const char *value, std::size_t len, OSM::StringMemory memOpt)
+{
+    return m_tagValueRegistry.makeValue(value, len, memOpt);
+}
+
+void DataSet::addMappedFile(std::unique_ptr<QFile> &&file)
+{
+    m_mappedFiles.push_back(std::move(file));
+}
+
+void NodeIndex::build(const std::vector<Node> &nodes, uint64_t generation)
+{
+    clear();
+    if (nodes.empty() || nodes.size() >= std::numeric_limits<uint32_t>::max()) {
+        return;
     }
-    if (transientNodes) {
-        if (const auto it = std::lower_bound(transientNodes->begin(), transientNodes->end(), id); it != transientNodes->end() && (*it).id == id) {
-            return &(*it);
+
+    // at most 50% load factor, keeps linear probing sequences short
+    m_shift = 63;
+    while ((1ull << (64 - m_shift)) < 2 * nodes.size()) {
+        --m_shift;
+    }
+    m_slots.resize(1ull << (64 - m_shift), 0);
+    const auto mask = m_slots.size() - 1;
+
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        auto slot = slotForId(nodes[i].id);
+        while (m_slots[slot]) {
+            slot = (slot + 1) & mask;
         }
+        m_slots[slot] = (uint32_t)(i + 1);
     }
-    return nullptr;
+
+    m_nodesData = nodes.data();
+    m_nodesSize = nodes.size();
+    m_generation = generation;
 }
 
-const Way* DataSet::way(Id id) const
+std::size_t NodeIndex::memoryUsage() const
 {
-    const auto it = std::lower_bound(ways.begin(), ways.end(), id);
-    if (it != ways.end() && (*it).id == id) {
-        return &(*it);
+    return m_slots.capacity() * sizeof(uint32_t);
+}
+
+void NodeIndex::clear()
+{
+    m_slots.clear();
+    m_slots.shrink_to_fit();
+    m_nodesData = nullptr;
+    m_nodesSize = 0;
+    m_generation = 0;
+    m_shift = 64;
+}
+
+const Node* NodeIndex::find(const std::vector<Node> &nodes, Id id) const
+{
+    const auto mask = m_slots.size() - 1;
+    for (auto slot = slotForId(id); m_slots[slot]; slot = (slot + 1) & mask) {
+        const auto &node = nodes[m_slots[slot] - 1];
+        if (node.id == id) {
+            return &node;
+        }
     }
     return nullptr;
 }
 
-Way* DataSet::way(Id id)
+void OSM::computeZ(std::span<const Coordinate> coords, std::span<uint64_t> z)
+{
+    assert(z.size() >= coords.size());
+    for (std::size_t i = 0; i < coords.size(); ++i) {
+        z[i] = coords[i].z();
+    }
+}
+
+void WayCoordinates::build(const DataSet &dataSet, uint64_t generation)
 {
-    const auto it = std::lower_bound(ways.begin(), ways.end(), id);
-    if (it != ways.end() && (*it).id == id) {
+    clear();
+    const auto &ways = dataSet.ways;
+    if (ways.empty() || ways.size() >= std::numeric_limits<uint32_t>::max()) {
+        return;
+    }
+
+    // lay out ways in z-order of their bounding box center
+    std::vector<Coordinate> centers;
+    centers.reserve(ways.size());
+    std::transform(ways.begin(), ways.end(), std::back_inserter(centers), [](const auto &way) { return way.bbox.center(); });
+    std::vector<uint64_t> z(ways.size());
+    computeZ(centers, z);
+    std::vector<uint32_t> order(ways.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&z](auto lhs, auto rhs) { return z[lhs] < z[rhs]; });
+
+    m_entries.resize(ways.size());
+    std::vector<const Node*> path;
+    for (const auto wayIdx : order) {
+        const auto &way = ways[wayIdx];
+        path.clear();
+        for (const auto id : way.nodes) {
+            if (const auto node = dataSet.node(id)) {
+                path.push_back(node);
+            }
+        }
+        // paths reconnecting to their first node before the end need special handling when rendering
+        if (path.size() > 2 && std::find(std::next(path.begin()), std::prev(path.end()), path.front()) != std::prev(path.end())) {
+            continue;
+        }
+        if (m_coordinates.size() + path.size() >= std::numeric_limits<uint32_t>::max()) {
+            break;
+        }
+        m_entries[wayIdx] = { (uint32_t)m_coordinates.size(), (uint32_t)path.size() };
+        std::transform(path.begin(), path.end(), std::back_inserter(m_coordinates), [](auto node) { return node->coordinate; });
+    }
+
+    m_waysData = ways.data();
+    m_waysSize = ways.size();
+    m_generation = generation;
+}
+
+void WayCoordinates::clear()
+{
+    m_coordinates.clear();
+    m_coordinates.shrink_to_fit();
+    m_entries.clear();
+    m_entries.shrink_to_fit();
+    m_waysData = nullptr;
+    m_waysSize = 0;
+    m_generation = 0;
+}
+
+std::span<const Coordinate> WayCoordinates::coordinates(const Way &way) const
+{
+    const auto &entry = m_entries[&way - m_waysData];
+    return std::span<const Coordinate>(m_coordinates).subspan(entry.begin, entry.size);
+}
+
+std::size_t WayCoordinates::memoryUsage() const
+{
+    return m_coordinates.capacity() * sizeof(Coordinate) + m_entries.capacity() * sizeof(Entry);
+}
+
+void DataSet::BulkLoadIndex::clear()
+{
+    positions = {};
+    indexedEnd = 0;
+}
+
+/** Find element @p id in @p elems, with the first @p sortedCount elements being sorted.
+ *  Elements appended after that are looked up in @p tailIndex, which is extended as needed.
+ */
+template <typename Elem, typename Index>
+[[nodiscard]] static Elem* findElement(std::vector<Elem> &elems, std::size_t sortedCount, Index &tailIndex, Id id)
+{
+    const auto sortedEnd = elems.begin() + sortedCount;
+    if (const auto it = std::lower_bound(elems.begin(), sortedEnd, id); it != sortedEnd && (*it).id == id) {
         return &(*it);
     }
+    if (sortedCount == elems.size()) {
+        return nullptr;
+    }
+
+    if (tailIndex.indexedEnd < sortedCount || tailIndex.indexedEnd > elems.size()) {
+        tailIndex.clear();
+        tailIndex.indexedEnd = sortedCount;
+    }
+    // the first of several elements with the same id is the one retained by endBulkLoad()
+    for (; tailIndex.indexedEnd < elems.size(); ++tailIndex.indexedEnd) {
+        tailIndex.positions.try_emplace(elems[tailIndex.indexedEnd].id, tailIndex.indexedEnd);
+    }
+    if (const auto it = tailIndex.positions.find(id); it != tailIndex.positions.end()) {
+        return &elems[(*it).second];
+    }
     return nullptr;
 }
 
-const Relation* DataSet::relation(Id id) const
+const Node* DataSet::node(Id id) const
 {
-    const auto it = std::lower_bound(relations.begin(), relations.end(), id);
-    if (it != relations.end() && (*it).id == id) {
-        return &(*it);
+    return const_cast<DataSet*>(this)->node(id);
+}
+
+Node* DataSet::node(Id id)
+{
+    if (m_nodeIndex.isValidFor(nodes, m_generation)) {
+        if (const auto n = m_nodeIndex.find(nodes, id)) {
+            return const_cast<Node*>(n);
+        }
+    } else if (const auto n = findElement(nodes, m_bulkLoadDepth ? m_bulkLoadNodeCount : nodes.size(), m_bulkLoadNodeIndex, id)) {
+        return n;
+    }
+    if (transientNodes) {
+        if (const auto it = std::lower_bound(transientNodes->begin(), transientNodes->end(), id); it != transientNodes->end() && (*it).id == id) {
+            return const_cast<Node*>(&(*it));
+        }
     }
     return nullptr;
 }
 
+void DataSet::buildNodeIndex()
+{
+    m_nodeIndex.build(nodes, m_generation);
+}
+
+void DataSet::clearNodeIndex()
+{
+    m_nodeIndex.clear();
+}
+
+void DataSet::buildWayCoordinates()
+{
+    m_wayCoordinates.build(*this, m_generation);
+}
+
+void DataSet::clearWayCoordinates()
+{
+    m_wayCoordinates.clear();
+}
+
+std::span<const Coordinate> DataSet::wayCoordinates(const Way &way) const
+{
+    if (!m_wayCoordinates.isValidFor(ways, m_generation) || &way < ways.data() || &way >= ways.data() + ways.size()) {
+        return {};
+    }
+    return m_wayCoordinates.coordinates(way);
+}
+
+void DataSet::elementsChanged()
+{
+    ++m_generation;
+}
+
+const Way* DataSet::way(Id id) const
+{
+    return const_cast<DataSet*>(this)->way(id);
+}
+
+Way* DataSet::way(Id id)
+{
+    return findElement(ways, m_bulkLoadDepth ? m_bulkLoadWayCount : ways.size(), m_bulkLoadWayIndex, id);
+}
+
+const Relation* DataSet::relation(Id id) const
+{
+    return const_cast<DataSet*>(this)->relation(id);
+}
+
+Relation* DataSet::relation(Id id)
+{
+    return findElement(relations, m_bulkLoadDepth ? m_bulkLoadRelationCount : relations.size(), m_bulkLoadRelationIndex, id);
+}
+
 void DataSet::addNode(Node &&node)
 {
+    if (m_bulkLoadDepth) {
+        ++m_generation;
+        nodes.push_back(std::move(node));
+        return;
+    }
+
     const auto it = std::lower_bound(nodes.begin(), nodes.end(), node);
     if (it != nodes.end() && (*it).id == node.id) {
         // do we need to merge something here?
         return;
     }
+    ++m_generation;
     nodes.insert(it, std::move(node));
 }
 
 void DataSet::addWay(Way &&way)
 {
+    if (m_bulkLoadDepth) {
+        ++m_generation;
+        ways.push_back(std::move(way));
+        return;
+    }
+
     const auto it = std::lower_bound(ways.begin(), ways.end(), way);
     if (it != ways.end() && (*it).id == way.id) {
         // already there?
         return;
     }
+    ++m_generation;
     ways.insert(it, std::move(way));
 }
 
 void DataSet::addRelation(Relation &&rel)
 {
+    if (m_bulkLoadDepth) {
+        ++m_generation;
+        relations.push_back(std::move(rel));
+        return;
+    }
+
     const auto it = std::lower_bound(relations.begin(), relations.end(), rel);
     if (it != relations.end() && (*it).id == rel.id) {
         // do we need to merge something here?
         return;
     }
+    ++m_generation;
     relations.insert(it, std::move(rel));
 }
 
+void DataSet::beginBulkLoad()
+{
+    if (m_bulkLoadDepth++ > 0) {
+        return;
+    }
+    m_bulkLoadNodeCount = nodes.size();
+    m_bulkLoadWayCount = ways.size();
+    m_bulkLoadRelationCount = relations.size();
+    m_bulkLoadNodeIndex.clear();
+    m_bulkLoadWayIndex.clear();
+    m_bulkLoadRelationIndex.clear();
+}
+
+/** Sort the elements appended after @p sortedCount into @p elems, dropping later duplicates. */
+template <typename Elem>
+static void mergeAppendedElements(std::vector<Elem> &elems, std::size_t sortedCount)
+{
+    if (sortedCount == elems.size()) {
+        return;
+    }
+    const auto sortedEnd = elems.begin() + sortedCount;
+    // input from snapshots or sorted files is usually in order already
+    if (!std::is_sorted(sortedEnd, elems.end())) {
+        std::stable_sort(sortedEnd, elems.end());
+    }
+    if (sortedCount > 0 && *sortedEnd < *std::prev(sortedEnd)) {
+        std::inplace_merge(elems.begin(), sortedEnd, elems.end());
+    }
+    elems.erase(std::unique(elems.begin(), elems.end(), [](const auto &lhs, const auto &rhs) { return lhs.id == rhs.id; }), elems.end());
+}
+
+void DataSet::endBulkLoad()
+{
+    assert(m_bulkLoadDepth > 0);
+    if (--m_bulkLoadDepth > 0) {
+        return;
+    }
+    mergeAppendedElements(nodes, m_bulkLoadNodeCount);
+    mergeAppendedElements(ways, m_bulkLoadWayCount);
+    mergeAppendedElements(relations, m_bulkLoadRelationCount);
+    ++m_generation;
+    m_bulkLoadNodeIndex.clear();
+    m_bulkLoadWayIndex.clear();
+    m_bulkLoadRelationIndex.clear();
+}
+
+std::size_t DataSetMemoryUsage::total() const
+{
+    return nodes + ways + relations + tags + tagValues + wayNodes + relationMembers + stringRegistries + indexes;
+}
+
+template <typename Elem>
+static void tagMemoryUsage(const std::vector<Elem> &elems, DataSetMemoryUsage &usage, std::unordered_set<const char*> &tagValues)
+{
+    for (const auto &elem : elems) {
+        usage.tags += elem.tags.capacity() * sizeof(Tag);
+        for (const auto &tag : elem.tags) {
+            // raw data wrappers and literals have no allocated capacity
+            if (tag.value.capacity() > 0 && tagValues.insert(tag.value.constData()).second) {
+                usage.tagValues += sizeof(QArrayData) + tag.value.capacity() + 1;
+            }
+        }
+    }
+}
+
+DataSetMemoryUsage DataSet::memoryUsage() const
+{
+    DataSetMemoryUsage usage;
+    usage.nodes = nodes.capacity() * sizeof(Node);
+    usage.ways = ways.capacity() * sizeof(Way);
+    usage.relations = relations.capacity() * sizeof(Relation);
+
+    std::unordered_set<const char*> tagValues;
+    tagMemoryUsage(nodes, usage, tagValues);
+    tagMemoryUsage(ways, usage, tagValues);
+    tagMemoryUsage(relations, usage, tagValues);
+
+    for (const auto &way : ways) {
+        usage.wayNodes += way.nodes.capacity() * sizeof(Id);
+    }
+    for (const auto &rel : relations) {
+        usage.relationMembers += rel.members.capacity() * sizeof(Member);
+    }
+
+    usage.stringRegistries = m_tagKeyRegistry.memoryUsage() + m_roleRegistry.memoryUsage() + m_tagValueRegistry.memoryUsage();
+    usage.indexes = m_nodeIndex.memoryUsage() + m_wayCoordinates.memoryUsage();
+    for (const auto &file : m_mappedFiles) {
+        usage.mappedFiles += (std::size_t)file->size();
+    }
+    return usage;
+}
+
 OSM::Id DataSet::nextInternalId() const
 {
     static OSM::Id nextId = 0;
@@ -162,3 +506,20 @@ QDebug operator<<(QDebug debug, OSM::BoundingBox bbox)
     debug.nospace() << '[' << bbox.min.latF() << ',' << bbox.min.lonF() << '|' << bbox.max.latF() << ',' << bbox.max.lonF() << ']';
     return debug;
 }
+
+QDebug operator<<(QDebug debug, const OSM::DataSetMemoryUsage &usage)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace() << "DataSetMemoryUsage(total: " << usage.total()
+        << ", nodes: " << usage.nodes
+        << ", ways: " << usage.ways
+        << ", relations: " << usage.relations
+        << ", tags: " << usage.tags
+        << ", tag values: " << usage.tagValues
+        << ", way nodes: " << usage.wayNodes
+        << ", relation members: " << usage.relationMembers
+        << ", string registries: " << usage.stringRegistries
+        << ", indexes: " << usage.indexes
+        << ", mapped files: " << usage.mappedFiles << ')';
+    return debug;
+}
@@ -18,8 +18,13 @@
 
 #include <cstdint>
 #include <cstring>
+#include <memory>
+#include <span>
+#include <unordered_map>
 #include <vector>
 
+class QFile;
+
 /** Low-level types and functions to work with raw OSM data as efficiently as possible. */
 namespace OSM {
 
@@ -48,13 +53,9 @@ public:
 
     /** Create a coordinate from a z-order curve index. */
     explicit constexpr Coordinate(uint64_t z)
-        : latitude(0)
-        , longitude(0)
+        : latitude(Internal::deinterleaveBits(z))
+        , longitude(Internal::deinterleaveBits(z >> 1))
     {
-        for (int i = 0; i < 32; ++i) {
-            latitude += (z & (1ull << (i * 2))) >> i;
-            longitude += (z & (1ull << (1 + i * 2))) >> (i + 1);
-        }
     }
 
     [[nodiscard]] constexpr inline bool isValid() const
@@ -69,12 +70,7 @@ public:
     /** Z-order curve value for this coordinate. */
     [[nodiscard]] constexpr inline uint64_t z() const
     {
-        uint64_t z = 0;
-        for (int i = 0; i < 32; ++i) {
-            z += ((uint64_t)latitude & (1 << i)) << i;
-            z += ((uint64_t)longitude & (1 << i)) << (i + 1);
-        }
-        return z;
+        return Internal::interleaveBits(latitude) | (Internal::interleaveBits(longitude) << 1);
     }
 
     [[nodiscard]] constexpr inline double latF() const
@@ -90,6 +86,10 @@ public:
     uint32_t longitude = std::numeric_limits<uint32_t>::max();
 };
 
+/** Compute the z-order curve values for all of @p coords into @p z.
+ *  @p z has to be at least as large as @p coords.
+ */
+KOSM_EXPORT void computeZ(std::span<const Coordinate> coords, std::span<uint64_t> z);
 
 /** Bounding box, ie. a pair of coordinates. */
 class BoundingBox {
@@ -278,6 +278,9 @@ class Role : public StringKey
 {
 public:
     constexpr inline Role() = default;
+
+    /** Roles are stored in tagged pointers, see Member. */
+    static constexpr std::size_t Alignment = 4;
 private:
     friend class Member;
     explicit constexpr inline Role(const char *keyData) : StringKey(keyData) {}
@@ -342,6 +345,112 @@ public:
     std::vector<Tag> tags;
 };
 
+/** Hash index for constant-time node lookup by id.
+ *  This is an open-addressing hash table storing positions into
+ *  the node vector it has been built for, see DataSet::buildNodeIndex().
+ *  @internal
+ */
+class NodeIndex {
+public:
+    /** Build the index for @p nodes, at data set modification count @p generation. */
+    void build(const std::vector<Node> &nodes, uint64_t generation);
+    /** Release all memory held by the index. */
+    void clear();
+
+    /** Returns @c true if this index was built for @p nodes at modification count @p generation. */
+    [[nodiscard]] inline bool isValidFor(const std::vector<Node> &nodes, uint64_t generation) const
+    {
+        return !m_slots.empty() && m_generation == generation && m_nodesData == nodes.data() && m_nodesSize == nodes.size();
+    }
+
+    /** Look up node @p id in @p nodes.
+     *  @returns @c nullptr if the node doesn't exist.
+     */
+    [[nodiscard]] const Node* find(const std::vector<Node> &nodes, Id id) const;
+
+    /** Heap memory used by the index, in bytes. */
+    [[nodiscard]] std::size_t memoryUsage() const;
+
+private:
+    [[nodiscard]] inline std::size_t slotForId(Id id) const
+    {
+        // Fibonacci hashing, the upper bits are the well-distributed ones
+        return (std::size_t)(((uint64_t)id * 0x9E3779B97F4A7C15ull) >> m_shift);
+    }
+
+    /** Positions in the node vector, offset by one so that 0 marks an empty slot. */
+    std::vector<uint32_t> m_slots;
+    const Node *m_nodesData = nullptr;
+    std::size_t m_nodesSize = 0;
+    uint64_t m_generation = 0;
+    uint8_t m_shift = 64;
+};
+
+/** Way node coordinates stored contiguously, see DataSet::buildWayCoordinates().
+ *  Ways are laid out in z-order of their bounding box center, so that spatially close
+ *  ways are also close in memory.
+ *  @internal
+ */
+class KOSM_EXPORT WayCoordinates {
+public:
+    /** Build the coordinate array for all ways in @p dataSet, at its modification count @p generation. */
+    void build(const DataSet &dataSet, uint64_t generation);
+    /** Release all memory held by this. */
+    void clear();
+
+    /** Returns @c true if this was built for @p ways at modification count @p generation. */
+    [[nodiscard]] inline bool isValidFor(const std::vector<Way> &ways, uint64_t generation) const
+    {
+        return !m_entries.empty() && m_generation == generation && m_waysData == ways.data() && m_waysSize == ways.size();
+    }
+
+    /** Coordinates of @p way, which has to be an element of the way vector this was built for. */
+    [[nodiscard]] std::span<const Coordinate> coordinates(const Way &way) const;
+
+    /** Heap memory used by the coordinate array, in bytes. */
+    [[nodiscard]] std::size_t memoryUsage() const;
+
+private:
+    struct Entry {
+        uint32_t begin = 0;
+        uint32_t size = 0;
+    };
+    std::vector<Coordinate> m_coordinates;
+    /** Coordinate ranges, in the order of the way vector. */
+    std::vector<Entry> m_entries;
+    const Way *m_waysData = nullptr;
+    std::size_t m_waysSize = 0;
+    uint64_t m_generation = 0;
+};
+
+/** Approximate heap memory used by a DataSet, in bytes.
+ *  @see DataSet::memoryUsage()
+ */
+class KOSM_EXPORT DataSetMemoryUsage {
+public:
+    /** Total of all of the below, except for mapped files. */
+    [[nodiscard]] std::size_t total() const;
+
+    /** Element vectors. */
+    std::size_t nodes = 0;
+    std::size_t ways = 0;
+    std::size_t relations = 0;
+    /** Tag vectors of all elements. */
+    std::size_t tags = 0;
+    /** Tag value payloads, shared values are counted once. */
+    std::size_t tagValues = 0;
+    /** Way node lists. */
+    std::size_t wayNodes = 0;
+    /** Relation member lists. */
+    std::size_t relationMembers = 0;
+    /** Tag key, role and tag value registries. */
+    std::size_t stringRegistries = 0;
+    /** Node index and way coordinates. */
+    std::size_t indexes = 0;
+    /** Memory-mapped input files, backed by the page cache rather than the heap. */
+    std::size_t mappedFiles = 0;
+};
+
 /** A set of nodes, ways and relations. */
 class KOSM_EXPORT DataSet {
 public:
@@ -357,6 +466,43 @@ public:
      *  @returns @c nullptr if the node doesn't exist.
      */
     [[nodiscard]] const Node* node(Id id) const;
+    [[nodiscard]] Node* node(Id id);
+
+    /** Build an index for constant-time node lookup.
+     *  Call this once loading has been completed, node() will otherwise
+     *  do a binary search over all nodes. Any subsequent change to
+     *  the set of nodes invalidates the index, node() then falls
+     *  back to the binary search until this is called again.
+     */
+    void buildNodeIndex();
+    /** Drop the node index, freeing the memory used by it. */
+    void clearNodeIndex();
+
+    /** Build a contiguous array of way node coordinates.
+     *  This is useful for geometry processing of many ways, as it avoids looking up
+     *  every node and the random memory access pattern of that.
+     *  Any subsequent change to the set of ways invalidates this, as do changes to
+     *  way node lists or node coordinates, so call this once loading has been completed.
+     */
+    void buildWayCoordinates();
+    /** Drop the way coordinate array, freeing the memory used by it.
+     *  Changes to the set of elements are detected automatically, call this
+     *  after modifying node coordinates or way node lists in place.
+     */
+    void clearWayCoordinates();
+    /** Coordinates of all nodes of @p way.
+     *  This is only available after calling buildWayCoordinates() and only for ways which
+     *  form a single path, ie. where the first node doesn't reoccur before the last position.
+     *  Nodes that don't exist are skipped, as with OSM::Element::outerPath().
+     *  @returns an empty range if not available, use the node list of @p way in that case.
+     */
+    [[nodiscard]] std::span<const Coordinate> wayCoordinates(const Way &way) const;
+
+    /** Call this after adding or removing elements directly in the element vectors,
+     *  rather than via addNode(), addWay() or addRelation().
+     *  This invalidates the node index and the way coordinates.
+     */
+    void elementsChanged();
 
     /** Find a way by its id.
      *  @returns @c nullptr if the way doesn't exist.
@@ -368,11 +514,30 @@ public:
      *  @returns @c nullptr if the relation doesn't exist.
      */
     [[nodiscard]] const Relation* relation(Id id) const;
+    [[nodiscard]] Relation* relation(Id id);
 
+    /** Add elements, unless an element with the same id already exists.
+     *  Outside of bulk loading mode this keeps the element vectors sorted.
+     */
     void addNode(Node &&node);
     void addWay(Way &&way);
     void addRelation(Relation &&rel);
 
+    /** Enter bulk loading mode.
+     *  In this mode addNode(), addWay() and addRelation() merely append elements,
+     *  sorting and removing duplicates is deferred to endBulkLoad(). This avoids the
+     *  quadratic cost of sorted insertion when adding many elements. Element lookup
+     *  works during bulk loading, elements added in this mode are found via a hash index
+     *  that is extended on lookup. Lookups in this mode therefore must not run concurrently.
+     *  Calls can be nested, sorting happens when leaving the outermost bulk loading scope.
+     */
+    void beginBulkLoad();
+    /** Leave bulk loading mode.
+     *  Elements added since beginBulkLoad() are sorted into the existing ones,
+     *  in case of duplicate ids the element added first is retained.
+     */
+    void endBulkLoad();
+
     /** Look up a tag key for the given tag name, if it exists.
      *  If no key exists, an empty/invalid/null key is returned.
      *  Use this for tag lookup, not for creating/adding tags.
@@ -386,6 +551,8 @@ public:
      *  the string is copied if needed, and released in the DataSet destructor.
      */
     [[nodiscard]] TagKey makeTagKey(const char *keyName, StringMemory keyMemOpt = StringMemory::Transient);
+    /** Create a tag key for a tag name that isn't null-terminated, it is copied if needed. */
+    [[nodiscard]] TagKey makeTagKey(const char *keyName, std::size_t len);
 
     /** Looks up a role name key.
      *  @see tagKey()
@@ -395,6 +562,33 @@ public:
      *  @see makeTagKey()
      */
     [[nodiscard]] Role makeRole(const char *roleName, StringMemory memOpt = StringMemory::Transient);
+    /** Creates a role name key for a name that isn't null-terminated, it is copied if needed. */
+    [[nodiscard]] Role makeRole(const char *roleName, std::size_t len);
+
+    /** Looks up a deduplicated tag value.
+     *  Returns a null value if that doesn't exist, which does not imply that no element
+     *  has a tag with this value, as tag values don't have to be created via makeTagValue().
+     */
+    [[nodiscard]] QByteArray tagValue(const char *value, std::size_t len) const;
+
+    /** Create a tag value.
+     *  Short values are deduplicated, equal values then share the same memory.
+     *  @param memOpt specifies whether @p value is persistent for the lifetime of this
+     *  instance. In that case the returned value references @p value directly rather than
+     *  holding a copy of it.
+     */
+    [[nodiscard]] QByteArray makeTagValue(const char *value, std::size_t len, StringMemory memOpt = StringMemory::Transient);
+
+    /** Keep the memory-mapped @p file alive for the lifetime of this instance.
+     *  This allows to read from its mapped memory with OSM::StringMemory::Persistent,
+     *  with tag keys, roles and tag values then directly referring to that.
+     */
+    void addMappedFile(std::unique_ptr<QFile> &&file);
+
+    /** Approximate memory used by this data set.
+     *  This iterates over all elements, so it's not for use in performance-critical code.
+     */
+    [[nodiscard]] DataSetMemoryUsage memoryUsage() const;
 
     /** Create a unique id for internal use (ie. one that will not clash with official OSM ids). */
     [[nodiscard]] Id nextInternalId() const;
@@ -413,6 +607,28 @@ private:
 
     StringKeyRegistry<TagKey> m_tagKeyRegistry;
     StringKeyRegistry<Role> m_roleRegistry;
+    StringValueRegistry m_tagValueRegistry;
+    NodeIndex m_nodeIndex;
+    WayCoordinates m_wayCoordinates;
+    // incremented on every change to the set of elements
+    uint64_t m_generation = 0;
+    std::vector<std::unique_ptr<QFile>> m_mappedFiles;
+
+    // number of sorted elements at the start of bulk loading
+    int m_bulkLoadDepth = 0;
+    std::size_t m_bulkLoadNodeCount = 0;
+    std::size_t m_bulkLoadWayCount = 0;
+    std::size_t m_bulkLoadRelationCount = 0;
+
+    /** Positions of the elements appended during bulk loading, indexed up to @c indexedEnd. */
+    struct BulkLoadIndex {
+        void clear();
+        std::unordered_map<Id, std::size_t> positions;
+        std::size_t indexedEnd = 0;
+    };
+    BulkLoadIndex m_bulkLoadNodeIndex;
+    BulkLoadIndex m_bulkLoadWayIndex;
+    BulkLoadIndex m_bulkLoadRelationIndex;
 };
 
 /** Returns the tag value for @p key of @p elem. */
@@ -510,6 +726,7 @@ inline void removeTag(Elem &elem, TagKey key)
 
 KOSM_EXPORT QDebug operator<<(QDebug debug, OSM::Coordinate coord);
 KOSM_EXPORT QDebug operator<<(QDebug debug, OSM::BoundingBox bbox);
+KOSM_EXPORT QDebug operator<<(QDebug debug, const OSM::DataSetMemoryUsage &usage);
 
 Q_DECLARE_METATYPE(OSM::BoundingBox)
 
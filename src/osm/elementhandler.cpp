@@ -0,0 +1,22 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "elementhandler.h"
+
+using namespace OSM;
+
+ElementHandler::~ElementHandler() = default;
+
+void ElementHandler::handleNode([[maybe_unused]] const OSM::Node &node)
+{
+}
+
+void ElementHandler::handleWay([[maybe_unused]] const OSM::Way &way)
+{
+}
+
+void ElementHandler::handleRelation([[maybe_unused]] const OSM::Relation &relation)
+{
+}
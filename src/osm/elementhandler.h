@@ -0,0 +1,39 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef OSM_ELEMENTHANDLER_H
+#define OSM_ELEMENTHANDLER_H
+
+#include "kosm_export.h"
+
+namespace OSM {
+
+class Node;
+class Relation;
+class Way;
+
+/** Receives elements from a reader, instead of those being stored in an OSM::DataSet.
+ *  @see OSM::AbstractReader::setElementHandler()
+ *
+ *  Elements are only borrowed for the duration of the call. Tag values can refer
+ *  to the input data directly, so those need to be deep-copied to retain them
+ *  (e.g. via OSM::DataSet::makeTagValue()). Tag keys and roles remain valid for
+ *  the lifetime of the OSM::DataSet passed to the reader.
+ *
+ *  The default implementations ignore the respective element type.
+ */
+class KOSM_EXPORT ElementHandler
+{
+public:
+    virtual ~ElementHandler();
+
+    virtual void handleNode(const OSM::Node &node);
+    virtual void handleWay(const OSM::Way &way);
+    virtual void handleRelation(const OSM::Relation &relation);
+};
+
+}
+
+#endif // OSM_ELEMENTHANDLER_H
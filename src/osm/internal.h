@@ -8,10 +8,49 @@
 #define OSM_INTERNAL_H
 
 #include <cstdint>
+#include <type_traits>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
 
 namespace OSM {
 
 namespace Internal {
+/** Spread the bits of @p v to the even bits of the result. */
+[[nodiscard]] constexpr inline uint64_t interleaveBits(uint32_t v)
+{
+#if defined(__BMI2__)
+    if (!std::is_constant_evaluated()) {
+        return _pdep_u64(v, 0x5555555555555555ull);
+    }
+#endif
+    uint64_t x = v;
+    x = (x | (x << 16)) & 0x0000ffff0000ffffull;
+    x = (x | (x << 8)) & 0x00ff00ff00ff00ffull;
+    x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0full;
+    x = (x | (x << 2)) & 0x3333333333333333ull;
+    x = (x | (x << 1)) & 0x5555555555555555ull;
+    return x;
+}
+
+/** Inverse of interleaveBits(), collects the even bits of @p x. */
+[[nodiscard]] constexpr inline uint32_t deinterleaveBits(uint64_t x)
+{
+#if defined(__BMI2__)
+    if (!std::is_constant_evaluated()) {
+        return (uint32_t)_pext_u64(x, 0x5555555555555555ull);
+    }
+#endif
+    x &= 0x5555555555555555ull;
+    x = (x | (x >> 1)) & 0x3333333333333333ull;
+    x = (x | (x >> 2)) & 0x0f0f0f0f0f0f0f0full;
+    x = (x | (x >> 4)) & 0x00ff00ff00ff00ffull;
+    x = (x | (x >> 8)) & 0x0000ffff0000ffffull;
+    x = (x | (x >> 16)) & 0x00000000ffffffffull;
+    return (uint32_t)x;
+}
+
 /** Pointer with the lower bits used for compact flag storage. */
 template <typename T> class TaggedPointer
 {
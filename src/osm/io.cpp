@@ -16,6 +16,7 @@ using namespace OSM;
 
 Q_IMPORT_PLUGIN(OSM_O5mIOPlugin)
 Q_IMPORT_PLUGIN(OSM_OscIOPlugin)
+Q_IMPORT_PLUGIN(OSM_SnapshotIOPlugin)
 Q_IMPORT_PLUGIN(OSM_XmlIOPlugin)
 
 IOPluginInterface::~IOPluginInterface() = default;
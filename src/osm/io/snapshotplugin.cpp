@@ -0,0 +1,19 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#define QT_STATICPLUGIN 1
+
+#include "../ioplugin.h"
+#include "../snapshotparser.h"
+#include "../snapshotwriter.h"
+
+class OSM_SnapshotIOPlugin : public QObject, public OSM::IOPlugin<OSM::SnapshotParser, OSM::SnapshotWriter>
+{
+    Q_OBJECT
+    Q_PLUGIN_METADATA(IID OSMIOPluginInteraface_iid FILE "snapshotplugin.json")
+    Q_INTERFACES(OSM::IOPluginInterface)
+};
+
+#include "snapshotplugin.moc"
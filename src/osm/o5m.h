@@ -39,6 +39,11 @@ enum : uint16_t {
     O5M_STRING_TABLE_MAXLEN = 250,
 };
 
+/** Suggested number of elements between reset blocks, see OSM::O5mWriter::setResetInterval().
+ *  Reset blocks allow OSM::O5mParser to split the file for parallel parsing.
+ */
+constexpr inline uint32_t O5M_RESET_INTERVAL = 16384;
+
 constexpr inline const char O5M_HEADER[] = "o5m2";
 
 }
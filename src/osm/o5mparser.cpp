@@ -8,44 +8,123 @@
 #include "o5m.h"
 #include "datatypes.h"
 #include "datasetmergebuffer.h"
+#include "varint.h"
 
 #include <QDebug>
+#include <QMutex>
+#include <QThread>
+#include <QThreadPool>
 
 #include <cstdlib>
 #include <cstring>
+#include <unordered_map>
+#include <utility>
 
+using namespace Qt::Literals::StringLiterals;
 using namespace OSM;
 
+enum {
+    ParallelParsingMinimumSize = 4 * 1024 * 1024,
+    ChunksPerThread = 4,
+    // string pair including both null terminators
+    StringStorageSlotSize = O5M_STRING_TABLE_MAXLEN + 2,
+};
+
+/** State of a parser working on a single chunk of a file parsed in parallel. */
+struct O5mParser::ChunkContext {
+    DataSetMergeBuffer buffer;
+    // strings are repeated via the string table by address, so this avoids most of the locking for interning
+    std::unordered_map<const char*, TagKey> tagKeys;
+    std::unordered_map<const char*, QByteArray> tagValues;
+    std::unordered_map<const char*, Role> roles;
+};
+
 O5mParser::O5mParser(DataSet *dataSet)
     : AbstractReader(dataSet)
 {
     m_stringLookupTable.resize(O5M_STRING_TABLE_SIZE);
 }
 
+O5mParser::~O5mParser() = default;
+
+void O5mParser::setThreadCount(int threadCount)
+{
+    m_threadCount = threadCount;
+}
+
 void O5mParser::readFromData(const uint8_t* data, std::size_t len)
 {
-    std::fill(m_stringLookupTable.begin(), m_stringLookupTable.end(), nullptr);
+    // by default only parallelize when that's worth the overhead
+    const auto threadCount = m_threadCount > 0 ? m_threadCount : len >= ParallelParsingMinimumSize ? QThread::idealThreadCount() : 1;
+    if (threadCount > 1 && !hasElementHandler()) {
+        const auto chunks = splitAtResetBlocks(data, len, (std::size_t)threadCount * ChunksPerThread);
+        if (chunks.size() > 1) {
+            readChunksParallel(chunks, threadCount);
+            return;
+        }
+    }
+    readBlocks(data, len);
+}
+
+void O5mParser::readBlocks(const uint8_t *data, std::size_t len)
+{
+    m_copyStrings = false;
+    resetStringTable();
     resetDeltaCodingState();
 
+    const auto consumed = parseBlocks(data, len);
+    if (consumed < len && !hasError()) {
+        qWarning() << "premature end of file, or blocksize too large" << (len - consumed);
+    }
+}
+
+std::size_t O5mParser::readIncremental(const uint8_t *data, std::size_t len, std::size_t offset, bool atEnd)
+{
+    if (offset == 0) {
+        // the input data doesn't remain valid until strings are referenced again
+        m_copyStrings = true;
+        m_stringStorage.resize((std::size_t)O5M_STRING_TABLE_SIZE * StringStorageSlotSize);
+        resetStringTable();
+        resetDeltaCodingState();
+    }
+
+    const auto consumed = parseBlocks(data, len);
+    if (atEnd && consumed < len && !hasError()) {
+        qWarning() << "premature end of file, or blocksize too large" << (len - consumed);
+    }
+    return consumed;
+}
+
+std::size_t O5mParser::parseBlocks(const uint8_t *data, std::size_t len)
+{
     const auto endIt = data + len;
-    for (auto it = data; it < endIt - 1;) {
+    auto it = data;
+    while (it < endIt) {
         const auto blockType = (*it);
         if (blockType == O5M_BLOCK_RESET) {
+            // resets apply to the string table as well, that's what makes chunks independently parsable
+            resetStringTable();
             resetDeltaCodingState();
             ++it;
             continue;
         }
+        if (blockType == O5M_TRAILER) {
+            return len;
+        }
 
-        auto blockSize = readUnsigned(++it, endIt);
-        if (blockSize >= (uint64_t)(endIt - it)) {
-            qWarning() << "premature end of file, or blocksize too large" << (endIt - it) << blockType << blockSize;
+        auto blockIt = it + 1;
+        if (!hasCompleteNumber(blockIt, endIt)) {
+            break;
+        }
+        const auto blockSize = readUnsigned(blockIt, endIt);
+        if (blockSize > (uint64_t)(endIt - blockIt)) {
             break;
         }
         switch (blockType) {
             case O5M_BLOCK_HEADER:
-                if (blockSize != 4 || std::strncmp(reinterpret_cast<const char*>(it), O5M_HEADER, 4) != 0) {
-                    qWarning() << "Invalid file header";
-                    return;
+                if (blockSize != 4 || std::strncmp(reinterpret_cast<const char*>(blockIt), O5M_HEADER, 4) != 0) {
+                    m_error = u"Invalid o5m file header."_s;
+                    return len;
                 }
                 break;
             case O5M_BLOCK_BOUNDING_BOX:
@@ -53,37 +132,178 @@ void O5mParser::readFromData(const uint8_t* data, std::size_t len)
                 // not of interest at the moment
                 break;
             case O5M_BLOCK_NODE:
-                readNode(it, it + blockSize);
+                readNode(blockIt, blockIt + blockSize);
                 break;
             case O5M_BLOCK_WAY:
-                readWay(it, it + blockSize);
+                readWay(blockIt, blockIt + blockSize);
                 break;
             case O5M_BLOCK_RELATION:
-                readRelation(it, it + blockSize);
+                readRelation(blockIt, blockIt + blockSize);
                 break;
             default:
-                qDebug() << "unhandled o5m block type:" << (it - data) << blockType << blockSize;
+                qDebug() << "unhandled o5m block type:" << (blockIt - data) << blockType << blockSize;
+        }
+        if (hasError()) {
+            return len;
+        }
+
+        it = blockIt + blockSize;
+    }
+    return it - data;
+}
+
+bool O5mParser::hasCompleteNumber(const uint8_t *it, const uint8_t *endIt)
+{
+    for (; it < endIt; ++it) {
+        if (((*it) & O5M_NUMBER_CONTINUATION) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void O5mParser::resetStringTable()
+{
+    std::fill(m_stringLookupTable.begin(), m_stringLookupTable.end(), nullptr);
+    m_stringLookupPosition = 0;
+}
+
+const char* O5mParser::addToStringTable(const char *s, std::size_t size)
+{
+    const char *entry = s;
+    if (m_copyStrings) {
+        auto slot = m_stringStorage.data() + m_stringLookupPosition * StringStorageSlotSize;
+        std::memcpy(slot, s, size);
+        entry = slot;
+    }
+    m_stringLookupTable[m_stringLookupPosition] = entry;
+    m_stringLookupPosition = (m_stringLookupPosition + 1) % O5M_STRING_TABLE_SIZE;
+    return entry;
+}
+
+std::vector<std::pair<const uint8_t*, const uint8_t*>> O5mParser::splitAtResetBlocks(const uint8_t *data, std::size_t len, std::size_t maxChunks) const
+{
+    std::vector<std::pair<const uint8_t*, const uint8_t*>> chunks;
+    const auto minChunkSize = len / maxChunks;
+    const auto endIt = data + len;
+    auto chunkBegin = data;
+    for (auto it = data; it < endIt - 1;) {
+        const auto blockType = (*it);
+        if (blockType == O5M_BLOCK_RESET) {
+            if ((std::size_t)(it - chunkBegin) >= minChunkSize) {
+                chunks.emplace_back(chunkBegin, it);
+                chunkBegin = it;
+            }
+            ++it;
+            continue;
         }
 
+        const auto blockSize = readUnsigned(++it, endIt);
+        if (blockSize > (uint64_t)(endIt - it)) {
+            break;
+        }
+        if (blockType == O5M_BLOCK_HEADER && (blockSize != 4 || std::strncmp(reinterpret_cast<const char*>(it), O5M_HEADER, 4) != 0)) {
+            return {};
+        }
         it += blockSize;
     }
+    chunks.emplace_back(chunkBegin, endIt);
+    return chunks;
 }
 
-uint64_t O5mParser::readUnsigned(const uint8_t *&it, const uint8_t *endIt) const
+void O5mParser::readChunksParallel(const std::vector<std::pair<const uint8_t*, const uint8_t*>> &chunks, int threadCount)
+{
+    QMutex mutex;
+    QThreadPool pool;
+    pool.setMaxThreadCount(threadCount);
+
+    std::vector<std::unique_ptr<O5mParser>> parsers;
+    parsers.reserve(chunks.size());
+    for (const auto &[begin, end] : chunks) {
+        auto parser = std::make_unique<O5mParser>(m_dataSet);
+        parser->m_dataMemOpt = m_dataMemOpt;
+        parser->m_chunkContext = std::make_unique<ChunkContext>();
+        parser->m_mutex = &mutex;
+        parser->setFilter(m_filter);
+        parser->setMergeBuffer(&parser->m_chunkContext->buffer);
+        pool.start([parser = parser.get(), begin, end]() {
+            parser->readBlocks(begin, end - begin);
+        });
+        parsers.push_back(std::move(parser));
+    }
+    pool.waitForDone();
+
+    // merge in file order, so the result is the same as when parsing sequentially
+    // the filter has already been applied by the chunk parsers
+    const auto filter = std::exchange(m_filter, nullptr);
+    for (auto &parser : parsers) {
+        if (parser->hasError()) {
+            m_error = parser->errorString();
+            break;
+        }
+        auto &buffer = parser->m_chunkContext->buffer;
+        for (auto &node : buffer.nodes) {
+            addNode(std::move(node));
+        }
+        for (auto &way : buffer.ways) {
+            addWay(std::move(way));
+        }
+        for (auto &rel : buffer.relations) {
+            addRelation(std::move(rel));
+        }
+        parser.reset();
+    }
+    m_filter = filter;
+}
+
+template <typename T, typename MakeFunc>
+[[nodiscard]] static T makeCached(std::unordered_map<const char*, T> &cache, QMutex *mutex, const char *s, MakeFunc make)
+{
+    if (const auto it = cache.find(s); it != cache.end()) {
+        return (*it).second;
+    }
+    QMutexLocker locker(mutex);
+    return (*cache.emplace(s, make()).first).second;
+}
+
+TagKey O5mParser::makeTagKey(const char *key)
+{
+    if (!m_chunkContext) {
+        return m_dataSet->makeTagKey(key, m_dataMemOpt);
+    }
+    return makeCached(m_chunkContext->tagKeys, m_mutex, key, [this, key]() {
+        return m_dataSet->makeTagKey(key, m_dataMemOpt);
+    });
+}
+
+QByteArray O5mParser::makeTagValue(const char *value)
 {
-    uint64_t result = 0;
-    int i = 0;
-    for (; it < endIt && ((*it) & O5M_NUMBER_CONTINUATION); ++it, ++i) {
-        result |= ((*it) & O5M_NUMBER_MASK) << (i * 7);
+    if (!m_chunkContext || m_filter) {
+        return AbstractReader::makeTagValue(value, std::strlen(value), m_dataMemOpt);
     }
-    result |= ((uint64_t)(*it++) & O5M_NUMBER_MASK) << (i * 7);
-    return result;
+    return makeCached(m_chunkContext->tagValues, m_mutex, value, [this, value]() {
+        return m_dataSet->makeTagValue(value, std::strlen(value), m_dataMemOpt);
+    });
+}
+
+Role O5mParser::makeRole(const char *role)
+{
+    if (!m_chunkContext) {
+        return m_dataSet->makeRole(role, m_dataMemOpt);
+    }
+    return makeCached(m_chunkContext->roles, m_mutex, role, [this, role]() {
+        return m_dataSet->makeRole(role, m_dataMemOpt);
+    });
+}
+
+uint64_t O5mParser::readUnsigned(const uint8_t *&it, const uint8_t *endIt) const
+{
+    return Varint::readUnsigned(it, endIt);
 }
 
 int64_t O5mParser::readSigned(const uint8_t *&it, const uint8_t *endIt) const
 {
-    const uint64_t u = readUnsigned(it, endIt);
-    return (u & O5M_NUMBER_SIGNED_BIT) ? (-(u >> 1) -1) : (u >> 1);
+    return Varint::zigzagDecode(readUnsigned(it, endIt));
 }
 
 template <typename T>
@@ -102,8 +322,7 @@ const char* O5mParser::readString(const uint8_t *&it, const uint8_t *endIt)
         const auto s = reinterpret_cast<const char*>(it);
         const auto len = std::strlen(s);
         if (len <= O5M_STRING_TABLE_MAXLEN) {
-            m_stringLookupTable[m_stringLookupPosition] = s;
-            m_stringLookupPosition = (m_stringLookupPosition + 1) % O5M_STRING_TABLE_SIZE;
+            addToStringTable(s, len + 1);
         }
         it += len + 1;
         return s;
@@ -126,8 +345,7 @@ std::pair<const char*, const char*> O5mParser::readStringPair(const uint8_t *&it
         const auto len2 = std::strlen(s + len1 + 1);
 
         if (len1 + len2 <= O5M_STRING_TABLE_MAXLEN) {
-            m_stringLookupTable[m_stringLookupPosition] = s;
-            m_stringLookupPosition = (m_stringLookupPosition + 1) % O5M_STRING_TABLE_SIZE;
+            addToStringTable(s, len1 + len2 + 2);
         }
 
         it += len1 + len2 + 2;
@@ -170,8 +388,8 @@ void O5mParser::readTagOrBbox(Elem &e, const uint8_t *&it, const uint8_t *endIt)
     }
 
     OSM::Tag tag;
-    tag.key = m_dataSet->makeTagKey(tagData.first, OSM::StringMemory::Transient); // TODO make use of mmap'ed data for this
-    tag.value = QByteArray(tagData.second);
+    tag.key = makeTagKey(tagData.first);
+    tag.value = makeTagValue(tagData.second);
     e.tags.push_back(std::move(tag));
 }
 
@@ -191,8 +409,8 @@ void O5mParser::readNode(const uint8_t *begin, const uint8_t *end)
         OSM::Tag tag;
         const auto tagData = readStringPair(it, end);
         if (tagData.first) {
-            tag.key = m_dataSet->makeTagKey(tagData.first, OSM::StringMemory::Transient); // TODO use the fact this is mmap'ed data here
-            tag.value = QByteArray(tagData.second);
+            tag.key = makeTagKey(tagData.first);
+            tag.value = makeTagValue(tagData.second);
             node.tags.push_back(std::move(tag));
         }
     }
@@ -213,10 +431,11 @@ void O5mParser::readWay(const uint8_t *begin, const uint8_t *end)
     const auto nodesBlockSize = readUnsigned(it, end);
     if (it + nodesBlockSize > end) { return; }
 
-    const auto nodesBlockEnd = it + nodesBlockSize;
-    while(it < nodesBlockEnd) {
-        way.nodes.push_back(readDelta(it, end, m_wayNodeIdDelta));
-    }
+    // each node id takes at least one byte
+    m_wayNodeBuffer.resize(nodesBlockSize);
+    const auto nodeCount = Varint::decodeDeltaZigZag(it, it + nodesBlockSize, m_wayNodeBuffer.data(), m_wayNodeIdDelta);
+    way.nodes.assign(m_wayNodeBuffer.begin(), m_wayNodeBuffer.begin() + nodeCount);
+    it += nodesBlockSize;
 
     while (it < end) {
         readTagOrBbox(way, it, end);
@@ -243,6 +462,10 @@ void O5mParser::readRelation(const uint8_t *begin, const uint8_t *end)
         const int64_t memId = readSigned(it, end);
         OSM::Member mem;
         const auto typeAndRole = readString(it, end);
+        if (!typeAndRole || typeAndRole[0] == '\0') {
+            m_error = u"Invalid o5m relation member."_s;
+            return;
+        }
         switch (typeAndRole[0]) {
             case O5M_MEMTYPE_NODE:
                 mem.id = m_relNodeMemberIdDelta += memId;
@@ -257,7 +480,7 @@ void O5mParser::readRelation(const uint8_t *begin, const uint8_t *end)
                 mem.setType(OSM::Type::Relation);
                 break;
         }
-        mem.setRole(m_dataSet->makeRole(typeAndRole + 1, OSM::StringMemory::Transient));
+        mem.setRole(makeRole(typeAndRole + 1));
 
         rel.members.push_back(std::move(mem));
     }
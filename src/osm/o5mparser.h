@@ -12,6 +12,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <vector>
 
 class O5mParserTest;
@@ -20,18 +21,49 @@ namespace OSM {
 
 class DataSet;
 class DataSetMergeBuffer;
+class Role;
+class TagKey;
 
 /** Zero-copy parser of O5M binary files.
+ *  Large inputs are parsed in parallel, split at reset blocks.
  *  @see https://wiki.openstreetmap.org/wiki/O5m
  */
 class KOSM_EXPORT O5mParser : public AbstractReader
 {
 public:
     explicit O5mParser(DataSet *dataSet);
+    ~O5mParser() override;
+
+    /** Set the maximum number of threads used for parsing.
+     *  By default QThread::idealThreadCount() is used for large inputs, 1 disables parallel parsing.
+     *  Parallel parsing requires reset blocks in the input, see O5mWriter::setResetInterval().
+     *  The result is identical either way.
+     */
+    void setThreadCount(int threadCount);
 
 private:
     void readFromData(const uint8_t *data, std::size_t len) override;
 
+    std::size_t readIncremental(const uint8_t *data, std::size_t len, std::size_t offset, bool atEnd) override;
+
+    /** Parse an entire range of blocks, sequentially. */
+    void readBlocks(const uint8_t *data, std::size_t len);
+    /** Parse all complete blocks in @p data.
+     *  @returns the number of bytes consumed.
+     */
+    [[nodiscard]] std::size_t parseBlocks(const uint8_t *data, std::size_t len);
+    [[nodiscard]] static bool hasCompleteNumber(const uint8_t *it, const uint8_t *endIt);
+    /** Split @p data into up to @p maxChunks ranges starting at reset blocks.
+     *  @returns an empty list in case of an invalid file header.
+     */
+    [[nodiscard]] std::vector<std::pair<const uint8_t*, const uint8_t*>> splitAtResetBlocks(const uint8_t *data, std::size_t len, std::size_t maxChunks) const;
+    void readChunksParallel(const std::vector<std::pair<const uint8_t*, const uint8_t*>> &chunks, int threadCount);
+
+    // string interning, synchronized when parsing a chunk on a worker thread
+    [[nodiscard]] TagKey makeTagKey(const char *key);
+    [[nodiscard]] QByteArray makeTagValue(const char *value);
+    [[nodiscard]] Role makeRole(const char *role);
+
     friend class ::O5mParserTest;
 
     [[nodiscard]] uint64_t readUnsigned(const uint8_t *&it, const uint8_t *endIt) const;
@@ -50,8 +82,11 @@ private:
     void readWay(const uint8_t *begin, const uint8_t *end);
     void readRelation(const uint8_t *begin, const uint8_t *end);
 
-    // delta coding state
+    // delta coding and string table state
     void resetDeltaCodingState();
+    void resetStringTable();
+    /** Adds @p size bytes at @p s to the string table, copying them if necessary. */
+    const char* addToStringTable(const char *s, std::size_t size);
 
     int64_t m_nodeIdDelta = 0;
     int32_t m_latDelata = 0; // this can overflow, but that is intentional according to the spec!
@@ -59,6 +94,8 @@ private:
 
     int64_t m_wayIdDelta = 0;
     int64_t m_wayNodeIdDelta = 0;
+    /** Decoding buffer for way node lists. */
+    std::vector<int64_t> m_wayNodeBuffer;
 
     int64_t m_relIdDelta = 0;
     int64_t m_relNodeMemberIdDelta = 0;
@@ -67,6 +104,13 @@ private:
 
     std::vector<const char*> m_stringLookupTable;
     uint16_t m_stringLookupPosition = 0;
+    /** Copies of the string table entries when reading incrementally. */
+    std::vector<char> m_stringStorage;
+    bool m_copyStrings = false;
+
+    int m_threadCount = 0;
+    struct ChunkContext;
+    std::unique_ptr<ChunkContext> m_chunkContext;
 };
 
 }
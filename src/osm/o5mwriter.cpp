@@ -10,6 +10,8 @@
 #include <QBuffer>
 #include <QIODevice>
 
+#include <algorithm>
+
 using namespace OSM;
 
 static void writeByte(uint8_t b, QIODevice *io)
@@ -47,6 +49,11 @@ static void writeTrailer(QIODevice *io)
     writeByte(O5M_TRAILER, io);
 }
 
+void O5mWriter::setResetInterval(uint32_t interval)
+{
+    m_resetInterval = interval;
+}
+
 void O5mWriter::writeToIODevice(const OSM::DataSet& dataSet, QIODevice* io)
 {
     writeHeader(io);
@@ -73,7 +80,16 @@ void O5mWriter::writeNodes(const OSM::DataSet &dataSet, QIODevice *io)
 
     QByteArray bufferData;
     QBuffer buffer(&bufferData);
+    uint32_t count = 0;
     for(auto const &node: dataSet.nodes) {
+        if (m_resetInterval && ++count % m_resetInterval == 0) {
+            writeByte(O5M_BLOCK_RESET, io);
+            m_stringTable.clear();
+            prevId = 0;
+            prevLat = 900'000'000ll;
+            prevLon = 1'800'000'000ll;
+        }
+
         bufferData.clear();
         buffer.open(QIODevice::WriteOnly);
         writeByte(O5M_BLOCK_NODE, io);
@@ -111,7 +127,15 @@ void O5mWriter::writeWays(const OSM::DataSet &dataSet, QIODevice *io)
     QByteArray referencesBufferData;
     QBuffer referencesBuffer(&referencesBufferData);
 
+    uint32_t count = 0;
     for (auto const &way: dataSet.ways) {
+        if (m_resetInterval && ++count % m_resetInterval == 0) {
+            writeByte(O5M_BLOCK_RESET, io);
+            m_stringTable.clear();
+            prevId = 0;
+            prevNodeId = 0;
+        }
+
         writeByte(O5M_BLOCK_WAY, io);
 
         bufferData.clear();
@@ -153,7 +177,15 @@ void O5mWriter::writeRelations(const OSM::DataSet &dataSet, QIODevice *io)
     QBuffer referencesBuffer(&referencesBufferData);
     QByteArray role;
 
+    uint32_t count = 0;
     for (auto const &relation: dataSet.relations) {
+        if (m_resetInterval && ++count % m_resetInterval == 0) {
+            writeByte(O5M_BLOCK_RESET, io);
+            m_stringTable.clear();
+            prevId = 0;
+            std::fill(std::begin(prevMemberId), std::end(prevMemberId), 0);
+        }
+
         writeByte(O5M_BLOCK_RELATION, io);
 
         bufferData.clear();
@@ -6,6 +6,7 @@
 #ifndef OSM_O5MWRITER_H
 #define OSM_O5MWRITER_H
 
+#include "kosm_export.h"
 #include "abstractwriter.h"
 
 #include <cstdint>
@@ -42,8 +43,16 @@ struct std::hash<OSM::O5mStringPair>
 namespace OSM {
 
 /** Serialize an OSM::DataSet into the o5m file format. */
-class O5mWriter : public OSM::AbstractWriter
+class KOSM_EXPORT O5mWriter : public OSM::AbstractWriter
 {
+public:
+    /** Write a reset block every @p interval elements, 0 (the default) disables this.
+     *  Reset blocks allow OSM::O5mParser to parse the output in parallel, at the cost of
+     *  slightly larger files as delta coding and the string table restart at every reset.
+     *  @see O5M_RESET_INTERVAL
+     */
+    void setResetInterval(uint32_t interval);
+
 private:
     void writeToIODevice(const OSM::DataSet& dataSet, QIODevice* io) override;
 
@@ -54,6 +63,7 @@ private:
     void writeStringPair(const char *s1, const char *s2, QIODevice *io);
 
     std::unordered_map<O5mStringPair, int16_t> m_stringTable;
+    uint32_t m_resetInterval = 0;
 };
 
 }
@@ -5,14 +5,11 @@
 
 #include "oscparser.h"
 #include "datatypes.h"
+#include "datasetchanges.h"
+#include "xmltokenizer.h"
 
 #include <QDebug>
-#include <QIODevice>
-#include <QXmlStreamReader>
 
-#include <cmath>
-
-using namespace Qt::Literals::StringLiterals;
 using namespace OSM;
 
 OscParser::OscParser(DataSet* dataSet)
@@ -20,25 +17,62 @@ OscParser::OscParser(DataSet* dataSet)
 {
 }
 
-void OscParser::readFromIODevice(QIODevice *io)
+std::size_t OscParser::readIncremental(const uint8_t *data, std::size_t len, std::size_t offset, bool atEnd)
 {
-    QXmlStreamReader reader(io);
-    while (!reader.atEnd() && !reader.hasError()) {
-        reader.readNext();
-        if (reader.tokenType() != QXmlStreamReader::StartElement) {
-            continue;
+    if (offset == 0) {
+        // modifications below change node coordinates and way node lists in place
+        m_dataSet->clearWayCoordinates();
+        m_section = Section::None;
+    }
+    return XmlParser::readIncremental(data, len, offset, atEnd);
+}
+
+const char* OscParser::parseElements(XmlTokenizer &tokenizer)
+{
+    auto consumed = tokenizer.position();
+    while (true) {
+        const auto token = tokenizer.next();
+        if (token == XmlTokenizer::EndOfData || token == XmlTokenizer::Error) {
+            return consumed;
         }
-        if (reader.name() == "create"_L1) {
-            parseCreate(reader);
-        } else if (reader.name() == "modify"_L1) {
-            parseModify(reader);
-        } else if (reader.name() == "delete"_L1){
-            parseDelete(reader);
+        if (token == XmlTokenizer::EndElement) {
+            if (tokenizer.name() == "create" || tokenizer.name() == "modify" || tokenizer.name() == "delete") {
+                m_section = Section::None;
+            }
+            --m_depth;
+            consumed = tokenizer.position();
+            continue;
         }
-    }
 
-    if (reader.hasError()) {
-        m_error = reader.errorString();
+        if (m_section != Section::None && tokenizer.name() == "node") {
+            Node node;
+            if (!parseNode(tokenizer, node)) {
+                return consumed;
+            }
+            applyNode(std::move(node));
+        } else if (m_section != Section::None && tokenizer.name() == "way") {
+            Way way;
+            if (!parseWay(tokenizer, way)) {
+                return consumed;
+            }
+            applyWay(std::move(way));
+        } else if (m_section != Section::None && tokenizer.name() == "relation") {
+            Relation rel;
+            if (!parseRelation(tokenizer, rel)) {
+                return consumed;
+            }
+            applyRelation(std::move(rel));
+        } else if (!tokenizer.isSelfClosing()) {
+            if (tokenizer.name() == "create") {
+                m_section = Section::Create;
+            } else if (tokenizer.name() == "modify") {
+                m_section = Section::Modify;
+            } else if (tokenizer.name() == "delete") {
+                m_section = Section::Delete;
+            }
+            ++m_depth;
+        }
+        consumed = tokenizer.position();
     }
 }
 
@@ -82,126 +116,120 @@ void OscParser::mapMemberIds(OSM::Relation &rel) const
     }
 }
 
-void OscParser::parseCreate(QXmlStreamReader &reader)
+void OscParser::applyNode(OSM::Node &&node)
 {
-    while (!reader.atEnd() && !reader.hasError()) {
-        reader.readNext();
-        if (reader.tokenType() == QXmlStreamReader::EndElement && reader.name() == "create"_L1) {
-            return;
-        }
-        if (reader.tokenType() != QXmlStreamReader::StartElement) {
-            continue;
-        }
-        if (reader.name() == "node"_L1) {
-            auto node = parseNode(reader);
+    switch (m_section) {
+        case Section::None:
+            break;
+        case Section::Create:
             assignNewId(node, m_nodeIdMap);
             addNode(std::move(node));
-        } else if (reader.name() == "way"_L1) {
-            auto way = parseWay(reader);
-            assignNewId(way, m_wayIdMap);
-            mapNodeIds(way);
-            addWay(std::move(way));
-        } else if (reader.name() == "releation"_L1) {
-            auto rel = parseRelation(reader);
-            assignNewId(rel, m_relIdMap);
-            mapMemberIds(rel);
-            addRelation(std::move(rel));
-        } else {
-            reader.skipCurrentElement();
-        }
+            break;
+        case Section::Modify:
+            if (const auto n = m_dataSet->node(node.id)) {
+                if (node.coordinate.isValid()) {
+                    n->coordinate = node.coordinate;
+                }
+                if (!node.tags.empty()) {
+                    n->tags = std::move(node.tags);
+                }
+                if (m_changes) {
+                    m_changes->modifiedNodes.push_back(n->id);
+                }
+            } else {
+                qDebug() << "modified node not in data set:" << node.url();
+            }
+            break;
+        case Section::Delete:
+            // we don't actually delete but just drop all tags
+            // this avoids having to deal with broken referential integrity
+            // but nevertheless results in the deleted element having not effect anymore
+            if (const auto n = m_dataSet->node(node.id)) {
+                n->tags.clear();
+                if (m_changes) {
+                    m_changes->deletedNodes.push_back(n->id);
+                }
+            } else {
+                qDebug() << "deleted node not in data set:" << node.url();
+            }
+            break;
     }
 }
 
-void OscParser::parseModify(QXmlStreamReader &reader)
+void OscParser::applyWay(OSM::Way &&way)
 {
-    while (!reader.atEnd() && !reader.hasError()) {
-        reader.readNext();
-        if (reader.tokenType() == QXmlStreamReader::EndElement && reader.name() == "modify"_L1) {
-            return;
-        }
-        if (reader.tokenType() != QXmlStreamReader::StartElement) {
-            continue;
-        }
-        if (reader.name() == "node"_L1) {
-            auto modifiedNode = parseNode(reader);
-            if (const auto it = std::lower_bound(m_dataSet->nodes.begin(), m_dataSet->nodes.end(), modifiedNode.id); it != m_dataSet->nodes.end() && (*it).id == modifiedNode.id) {
-                if (modifiedNode.coordinate.isValid()) {
-                    (*it).coordinate = modifiedNode.coordinate;
-                }
-                if (!modifiedNode.tags.empty()) {
-                    (*it).tags = std::move(modifiedNode.tags);
+    switch (m_section) {
+        case Section::None:
+            break;
+        case Section::Create:
+            assignNewId(way, m_wayIdMap);
+            mapNodeIds(way);
+            addWay(std::move(way));
+            break;
+        case Section::Modify:
+            if (const auto w = m_dataSet->way(way.id)) {
+                if (!way.tags.empty()) {
+                    w->tags = std::move(way.tags);
                 }
-            } else {
-                qDebug() << "modified node not in data set:" << modifiedNode.url();
-            }
-        } else if (reader.name() == "way"_L1) {
-            auto modifiedWay = parseWay(reader);
-            if (const auto it = std::lower_bound(m_dataSet->ways.begin(), m_dataSet->ways.end(), modifiedWay.id); it != m_dataSet->ways.end() && (*it).id == modifiedWay.id) {
-                if (!modifiedWay.tags.empty()) {
-                    (*it).tags = std::move(modifiedWay.tags);
+                if (!way.nodes.empty()) {
+                    mapNodeIds(way);
+                    w->nodes = std::move(way.nodes);
                 }
-                if (!modifiedWay.nodes.empty()) {
-                    mapNodeIds(modifiedWay);
-                    (*it).nodes = std::move(modifiedWay.nodes);
+                if (m_changes) {
+                    m_changes->modifiedWays.push_back(w->id);
                 }
             } else {
-                qDebug() << "modified way not in data set:" << modifiedWay.url();
+                qDebug() << "modified way not in data set:" << way.url();
             }
-        } else if (reader.name() == "releation"_L1) {
-            auto modifiedRel = parseRelation(reader);
-            if (const auto it = std::lower_bound(m_dataSet->relations.begin(), m_dataSet->relations.end(), modifiedRel.id); it != m_dataSet->relations.end() && (*it).id == modifiedRel.id) {
-                if (!modifiedRel.tags.empty()) {
-                    (*it).tags = std::move(modifiedRel.tags);
-                }
-                if (!modifiedRel.members.empty()) {
-                    mapMemberIds(modifiedRel);
-                    (*it).members = std::move(modifiedRel.members);
+            break;
+        case Section::Delete:
+            if (const auto w = m_dataSet->way(way.id)) {
+                w->tags.clear();
+                if (m_changes) {
+                    m_changes->deletedWays.push_back(w->id);
                 }
             } else {
-                qDebug() << "modified relation not in data set:" << modifiedRel.url();
+                qDebug() << "deleted way not in data set:" << way.url();
             }
-        } else {
-            reader.skipCurrentElement();
-        }
+            break;
     }
 }
 
-void OscParser::parseDelete(QXmlStreamReader &reader)
+void OscParser::applyRelation(OSM::Relation &&rel)
 {
-    // we don't actually delete but just drop all tags
-    // this avoids having to deal with broken referential integrity
-    // but nevertheless results in the deleted element having not effect anymore
-    while (!reader.atEnd() && !reader.hasError()) {
-        reader.readNext();
-        if (reader.tokenType() == QXmlStreamReader::EndElement && reader.name() == "modify"_L1) {
-            return;
-        }
-        if (reader.tokenType() != QXmlStreamReader::StartElement) {
-            continue;
-        }
-        if (reader.name() == "node"_L1) {
-            const auto node = parseNode(reader);
-            if (const auto it = std::lower_bound(m_dataSet->nodes.begin(), m_dataSet->nodes.end(), node.id); it != m_dataSet->nodes.end() && (*it).id == node.id) {
-                (*it).tags.clear();
-            } else {
-                qDebug() << "deleted node not in data set:" << node.url();
-            }
-        } else if (reader.name() == "way"_L1) {
-            const auto way = parseWay(reader);
-            if (const auto it = std::lower_bound(m_dataSet->ways.begin(), m_dataSet->ways.end(), way.id); it != m_dataSet->ways.end() && (*it).id == way.id) {
-                (*it).tags.clear();
+    switch (m_section) {
+        case Section::None:
+            break;
+        case Section::Create:
+            assignNewId(rel, m_relIdMap);
+            mapMemberIds(rel);
+            addRelation(std::move(rel));
+            break;
+        case Section::Modify:
+            if (const auto r = m_dataSet->relation(rel.id)) {
+                if (!rel.tags.empty()) {
+                    r->tags = std::move(rel.tags);
+                }
+                if (!rel.members.empty()) {
+                    mapMemberIds(rel);
+                    r->members = std::move(rel.members);
+                }
+                if (m_changes) {
+                    m_changes->modifiedRelations.push_back(r->id);
+                }
             } else {
-                qDebug() << "modified way not in data set:" << way.url();
+                qDebug() << "modified relation not in data set:" << rel.url();
             }
-        } else if (reader.name() == "releation"_L1) {
-            const auto rel = parseRelation(reader);
-            if (const auto it = std::lower_bound(m_dataSet->relations.begin(), m_dataSet->relations.end(), rel.id); it != m_dataSet->relations.end() && (*it).id == rel.id) {
-                (*it).tags.clear();
+            break;
+        case Section::Delete:
+            if (const auto r = m_dataSet->relation(rel.id)) {
+                r->tags.clear();
+                if (m_changes) {
+                    m_changes->deletedRelations.push_back(r->id);
+                }
             } else {
-                qDebug() << "modified relation not in data set:" << rel.url();
+                qDebug() << "deleted relation not in data set:" << rel.url();
             }
-        } else {
-            reader.skipCurrentElement();
-        }
+            break;
     }
 }
@@ -22,10 +22,12 @@ public:
     explicit OscParser(DataSet *dataSet);
 
 private:
-    void readFromIODevice(QIODevice *io) override;
-    void parseCreate(QXmlStreamReader &reader);
-    void parseModify(QXmlStreamReader &reader);
-    void parseDelete(QXmlStreamReader &reader);
+    std::size_t readIncremental(const uint8_t *data, std::size_t len, std::size_t offset, bool atEnd) override;
+    [[nodiscard]] const char* parseElements(XmlTokenizer &tokenizer) override;
+
+    void applyNode(OSM::Node &&node);
+    void applyWay(OSM::Way &&way);
+    void applyRelation(OSM::Relation &&rel);
 
     template <typename T>
     void assignNewId(T &elem, std::unordered_map<OSM::Id, OSM::Id> &idMap);
@@ -38,6 +40,14 @@ private:
     std::unordered_map<OSM::Id, OSM::Id> m_nodeIdMap;
     std::unordered_map<OSM::Id, OSM::Id> m_wayIdMap;
     std::unordered_map<OSM::Id, OSM::Id> m_relIdMap;
+
+    enum class Section {
+        None,
+        Create,
+        Modify,
+        Delete,
+    };
+    Section m_section = Section::None;
 };
 
 }
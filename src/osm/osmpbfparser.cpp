@@ -5,6 +5,8 @@
 */
 
 #include "osmpbfparser.h"
+#include "datasetmergebuffer.h"
+#include "varint.h"
 
 #include "fileformat.pb.h"
 #include "osmformat.pb.h"
@@ -13,44 +15,275 @@
 
 #include <QByteArray>
 #include <QDebug>
+#include <QMutex>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
 #include <QtEndian>
 
+#include <algorithm>
+#include <optional>
+#include <utility>
+
+using namespace Qt::Literals::StringLiterals;
 using namespace OSM;
 
+enum {
+    // blobs typically contain 8000 elements each
+    ParallelParsingMinimumBlobs = 16,
+};
+
+namespace OSM {
+/** Tag keys, roles and values of a primitive block, resolved on first use.
+ *  Strings are usually used many times within a block, so this saves most lookups
+ *  as well as most of the locking when decoding in parallel.
+ */
+class PbfStringTable
+{
+public:
+    explicit PbfStringTable(const OSMPBF::StringTable &table, OsmPbfParser *parser)
+        : m_table(table)
+        , m_parser(parser)
+    {
+    }
+
+    [[nodiscard]] TagKey tagKey(int idx)
+    {
+        if (idx < 0 || idx >= m_table.s_size()) {
+            return {};
+        }
+        if (m_tagKeys.empty()) {
+            m_tagKeys.resize(m_table.s_size());
+        }
+        auto &key = m_tagKeys[idx];
+        if (key.isNull()) {
+            QMutexLocker locker(m_parser->m_mutex);
+            key = m_parser->m_dataSet->makeTagKey(m_table.s(idx).data());
+        }
+        return key;
+    }
+
+    [[nodiscard]] Role role(int idx)
+    {
+        if (idx < 0 || idx >= m_table.s_size()) {
+            return {};
+        }
+        if (m_roles.empty()) {
+            m_roles.resize(m_table.s_size());
+        }
+        auto &role = m_roles[idx];
+        if (role.isNull()) {
+            QMutexLocker locker(m_parser->m_mutex);
+            role = m_parser->m_dataSet->makeRole(m_table.s(idx).data());
+        }
+        return role;
+    }
+
+    [[nodiscard]] QByteArray tagValue(int idx)
+    {
+        if (idx < 0 || idx >= m_table.s_size()) {
+            return {};
+        }
+        if (m_tagValues.empty()) {
+            m_tagValues.resize(m_table.s_size());
+        }
+        auto &value = m_tagValues[idx];
+        if (!value) {
+            QMutexLocker locker(m_parser->m_mutex);
+            const auto &s = m_table.s(idx);
+            value = m_parser->makeTagValue(s.data(), s.size(), StringMemory::Transient);
+        }
+        return *value;
+    }
+
+private:
+    const OSMPBF::StringTable &m_table;
+    OsmPbfParser *m_parser = nullptr;
+    std::vector<TagKey> m_tagKeys;
+    std::vector<Role> m_roles;
+    std::vector<std::optional<QByteArray>> m_tagValues;
+};
+}
+
 OsmPbfParser::OsmPbfParser(DataSet *dataSet)
     : AbstractReader(dataSet)
 {
 }
 
+void OsmPbfParser::setThreadCount(int threadCount)
+{
+    m_threadCount = threadCount;
+}
+
 void OsmPbfParser::readFromData(const uint8_t *data, std::size_t len)
 {
+    const auto blobs = sliceBlobs(data, len);
+
+    // by default only parallelize when that's worth the overhead
+    const auto threadCount = m_threadCount > 0 ? m_threadCount : blobs.size() >= ParallelParsingMinimumBlobs ? QThread::idealThreadCount() : 1;
+    if (threadCount > 1 && blobs.size() > 1 && !hasElementHandler()) {
+        readBlobsParallel(blobs, threadCount);
+        return;
+    }
+
+    for (const auto &blob : blobs) {
+        if (!parseBlob(blob)) {
+            break;
+        }
+    }
+}
+
+std::vector<OsmPbfParser::Blob> OsmPbfParser::sliceBlobs(const uint8_t *data, std::size_t len)
+{
+    std::vector<Blob> blobs;
     const uint8_t *it = data;
     const uint8_t *end = data + len;
-    while (parseBlob(it, end));
+    Blob blob;
+    while (nextBlob(it, end, blob) == BlobState::Complete) {
+        if (blob.data) {
+            blobs.push_back(blob);
+        }
+    }
+    return blobs;
 }
 
-bool OsmPbfParser::parseBlob(const uint8_t *&it, const uint8_t *end)
+OsmPbfParser::BlobState OsmPbfParser::nextBlob(const uint8_t *&it, const uint8_t *end, Blob &blob)
 {
-    if (std::distance(it, end) < (int)sizeof(int32_t)) {
-        return false;
+    auto blobIt = it;
+    if (std::distance(blobIt, end) < (int)sizeof(int32_t)) {
+        return BlobState::Incomplete;
     }
     int32_t blobHeaderSize = 0;
-    std::memcpy(&blobHeaderSize, it, sizeof(int32_t));
+    std::memcpy(&blobHeaderSize, blobIt, sizeof(int32_t));
     blobHeaderSize = qFromBigEndian(blobHeaderSize);
-    it += sizeof(int32_t);
+    blobIt += sizeof(int32_t);
 
-    if (blobHeaderSize < 0 || std::distance(it, end) < blobHeaderSize) {
-        return false;
+    if (blobHeaderSize < 0) {
+        return BlobState::Invalid;
+    }
+    if (std::distance(blobIt, end) < blobHeaderSize) {
+        return BlobState::Incomplete;
     }
 
     OSMPBF::BlobHeader blobHeader;
-    if (!blobHeader.ParseFromArray(it, blobHeaderSize)) {
-        return false;
+    if (!blobHeader.ParseFromArray(blobIt, blobHeaderSize)) {
+        return BlobState::Invalid;
     }
-    it += blobHeaderSize;
+    blobIt += blobHeaderSize;
 
+    if (blobHeader.datasize() < 0) {
+        return BlobState::Invalid;
+    }
+    if (std::distance(blobIt, end) < blobHeader.datasize()) {
+        return BlobState::Incomplete;
+    }
+    if (std::strcmp(blobHeader.type().c_str(), "OSMData") == 0) {
+        blob = { blobIt, (std::size_t)blobHeader.datasize() };
+    } else {
+        blob = { nullptr, 0 };
+    }
+    it = blobIt + blobHeader.datasize();
+    return BlobState::Complete;
+}
+
+std::size_t OsmPbfParser::readIncremental(const uint8_t *data, std::size_t len, [[maybe_unused]] std::size_t offset, bool atEnd)
+{
+    // blobs are decoded as soon as they are complete, sequentially as there's usually only one or two per chunk
+    const uint8_t *it = data;
+    const uint8_t *end = data + len;
+    Blob blob;
+    while (true) {
+        switch (nextBlob(it, end, blob)) {
+            case BlobState::Complete:
+                if (blob.data && !parseBlob(blob)) {
+                    m_error = u"Failed to decode PBF blob."_s;
+                    return len;
+                }
+                continue;
+            case BlobState::Incomplete:
+                if (atEnd && it != end) {
+                    qWarning() << "premature end of file" << std::distance(it, end);
+                }
+                return std::distance(data, it);
+            case BlobState::Invalid:
+                m_error = u"Invalid PBF blob header."_s;
+                return len;
+        }
+    }
+}
+
+void OsmPbfParser::readBlobsParallel(const std::vector<Blob> &blobs, int threadCount)
+{
+    struct BlobResult {
+        DataSetMergeBuffer elements;
+        bool success = false;
+        bool done = false;
+    };
+    std::vector<BlobResult> results(blobs.size());
+
+    // the filter is applied by the blob parsers, not again when merging
+    const auto filter = std::exchange(m_filter, nullptr);
+
+    QMutex mutex;
+    QMutex resultMutex;
+    QWaitCondition resultReady;
+    QThreadPool pool;
+    pool.setMaxThreadCount(threadCount);
+    const auto startBlob = [&](std::size_t i) {
+        pool.start([this, filter, &mutex, &resultMutex, &resultReady, &blob = blobs[i], &result = results[i]]() {
+            OsmPbfParser parser(m_dataSet);
+            parser.m_mutex = &mutex;
+            parser.setFilter(filter);
+            parser.setMergeBuffer(&result.elements);
+            const auto success = parser.parseBlob(blob);
+
+            QMutexLocker locker(&resultMutex);
+            result.success = success;
+            result.done = true;
+            resultReady.wakeAll();
+        });
+    };
+
+    // only decode a bounded number of blobs ahead of merging, decoded blobs take a multiple of their input size
+    const auto maxBlobsInFlight = std::min<std::size_t>(blobs.size(), (std::size_t)threadCount * 2);
+    std::size_t nextIndex = 0;
+    for (; nextIndex < maxBlobsInFlight; ++nextIndex) {
+        startBlob(nextIndex);
+    }
+
+    // merge in file order, so the result (including deduplication) is the same as when decoding sequentially
+    for (auto &result : results) {
+        {
+            QMutexLocker locker(&resultMutex);
+            while (!result.done) {
+                resultReady.wait(&resultMutex);
+            }
+        }
+        if (!result.success) {
+            break;
+        }
+        for (auto &node : result.elements.nodes) {
+            addNode(std::move(node));
+        }
+        for (auto &way : result.elements.ways) {
+            addWay(std::move(way));
+        }
+        for (auto &rel : result.elements.relations) {
+            addRelation(std::move(rel));
+        }
+        result.elements = {}; // release memory early
+        if (nextIndex < blobs.size()) {
+            startBlob(nextIndex++);
+        }
+    }
+    pool.waitForDone();
+    m_filter = filter;
+}
+
+bool OsmPbfParser::parseBlob(const Blob &b)
+{
     OSMPBF::Blob blob;
-    if (std::distance(it, end) < blobHeader.datasize() || !blob.ParseFromArray(it, blobHeader.datasize())) {
+    if (!blob.ParseFromArray(b.data, (int)b.size)) {
         return false;
     }
 
@@ -72,73 +305,166 @@ bool OsmPbfParser::parseBlob(const uint8_t *&it, const uint8_t *end)
             return false;
         }
         result = inflate(&zStream, Z_FINISH);
+        inflateEnd(&zStream);
         if (result != Z_STREAM_END) {
             return false;
         }
-        result = inflateEnd( &zStream );
         dataBegin = reinterpret_cast<const uint8_t*>(m_zlibBuffer.constData());
     } else {
         return false;
     }
-    if (std::strcmp(blobHeader.type().c_str(), "OSMData") == 0) {
-        parsePrimitiveBlock(dataBegin, blob.raw_size());
-    }
+    parsePrimitiveBlock(dataBegin, blob.raw_size());
 
     m_zlibBuffer.clear();
-    it += blobHeader.datasize();
+    return true;
+}
+
+namespace {
+/** Field of a protobuf message, for the parts decoded without the generated code. */
+struct PbfField {
+    uint64_t number = 0;
+    /** Payload of length-delimited fields, @c nullptr otherwise. */
+    const uint8_t *data = nullptr;
+    std::size_t size = 0;
+};
+}
+
+/** Read the next field of a protobuf message and advance @p it past it.
+ *  @returns @c false on invalid input.
+ */
+[[nodiscard]] static bool nextField(const uint8_t *&it, const uint8_t *end, PbfField &field)
+{
+    const auto key = Varint::readUnsigned(it, end);
+    field.number = key >> 3;
+    field.data = nullptr;
+    field.size = 0;
+
+    std::size_t size = 0;
+    switch (key & 0x7) {
+        case 0: // varint
+            (void)Varint::readUnsigned(it, end);
+            return true;
+        case 1: // 64 bit
+            size = 8;
+            break;
+        case 2: // length-delimited
+            size = Varint::readUnsigned(it, end);
+            field.data = it;
+            field.size = size;
+            break;
+        case 5: // 32 bit
+            size = 4;
+            break;
+        default:
+            return false;
+    }
+    if (size > (std::size_t)(end - it)) {
+        return false;
+    }
+    it += size;
     return true;
 }
 
 void OsmPbfParser::parsePrimitiveBlock(const uint8_t *data, std::size_t len)
 {
-    OSMPBF::PrimitiveBlock block;
-    if (!block.ParseFromArray(data, len)) {
-        return;
+    // dense nodes make up most of the data, those are decoded from the wire format directly
+    // as that allows bulk decoding of their packed fields, everything else uses the generated code
+    OSMPBF::StringTable stringTable;
+    std::vector<PbfField> groups;
+    PbfField field;
+    for (auto it = data; it < data + len;) {
+        if (!nextField(it, data + len, field)) {
+            return;
+        }
+        if (field.number == 1 && field.data) {
+            if (!stringTable.ParseFromArray(field.data, (int)field.size)) {
+                return;
+            }
+        } else if (field.number == 2 && field.data) {
+            groups.push_back(field);
+        }
     }
 
-    for (int i = 0; i < block.primitivegroup_size(); ++i) {
-        const auto &group = block.primitivegroup(i);
+    PbfStringTable strings(stringTable, this);
+    for (const auto &groupField : groups) {
+        // groups contain only one type of elements
+        bool hasDenseNodes = false;
+        for (auto it = groupField.data; it < groupField.data + groupField.size;) {
+            if (!nextField(it, groupField.data + groupField.size, field)) {
+                return;
+            }
+            if (field.number == 2 && field.data) {
+                parseDenseNodes(field.data, field.size, strings);
+                hasDenseNodes = true;
+            }
+        }
+        if (hasDenseNodes) {
+            continue;
+        }
 
+        OSMPBF::PrimitiveGroup group;
+        if (!group.ParseFromArray(groupField.data, (int)groupField.size)) {
+            return;
+        }
         if (group.nodes_size()) {
             qWarning() << "non-dense nodes - not implemented yet!";
-        } else if (group.has_dense()) {
-            parseDenseNodes(block, group);
         } else if (group.ways_size()) {
-            parseWays(block, group);
+            parseWays(group, strings);
         } else if (group.relations_size()) {
-            parseRelations(block, group);
+            parseRelations(group, strings);
         }
     }
 }
 
-void OsmPbfParser::parseDenseNodes(const OSMPBF::PrimitiveBlock &block, const OSMPBF::PrimitiveGroup &group)
+void OsmPbfParser::parseDenseNodes(const uint8_t *data, std::size_t len, PbfStringTable &strings)
 {
-    int64_t idDelta = 0;
-    int64_t latDelta = 0;
-    int64_t lonDelta = 0;
-    int tagIdx = 0;
+    PbfField ids, lats, lons, keysVals;
+    PbfField field;
+    for (auto it = data; it < data + len;) {
+        if (!nextField(it, data + len, field)) {
+            return;
+        }
+        switch (field.number) {
+            case 1: ids = field; break;
+            case 8: lats = field; break;
+            case 9: lons = field; break;
+            case 10: keysVals = field; break;
+        }
+    }
 
-    const auto dense = group.dense();
-    for (int i = 0; i < dense.id_size(); ++i) {
-        idDelta += dense.id(i);
-        latDelta += dense.lat(i);
-        lonDelta += dense.lon(i);
+    // packed fields, each value takes at least one byte
+    const auto decodeDelta = [](const PbfField &field) {
+        std::vector<int64_t> values(field.size);
+        int64_t state = 0;
+        values.resize(Varint::decodeDeltaZigZag(field.data, field.data + field.size, values.data(), state));
+        return values;
+    };
+    const auto id = decodeDelta(ids);
+    const auto lat = decodeDelta(lats);
+    const auto lon = decodeDelta(lons);
+    if (lat.size() != id.size() || lon.size() != id.size()) {
+        return;
+    }
+    std::vector<int32_t> tags(keysVals.size);
+    tags.resize(Varint::decodeUnsigned(keysVals.data, keysVals.data + keysVals.size, tags.data()));
 
+    std::size_t tagIdx = 0;
+    for (std::size_t i = 0; i < id.size(); ++i) {
         OSM::Node node;
-        node.id = idDelta;
-        node.coordinate.latitude = latDelta + 900'000'000ll;
-        node.coordinate.longitude = lonDelta + 1'800'000'000ll;
+        node.id = id[i];
+        node.coordinate.latitude = lat[i] + 900'000'000ll;
+        node.coordinate.longitude = lon[i] + 1'800'000'000ll;
 
-        while (tagIdx < dense.keys_vals_size()) {
-            const auto keyIdx = dense.keys_vals(tagIdx++);
-            if (keyIdx == 0) {
+        while (tagIdx < tags.size()) {
+            const auto keyIdx = tags[tagIdx++];
+            if (keyIdx == 0 || tagIdx == tags.size()) {
                 break;
             }
-            const auto valIdx = dense.keys_vals(tagIdx++);
+            const auto valIdx = tags[tagIdx++];
 
             OSM::Tag tag;
-            tag.key = m_dataSet->makeTagKey(block.stringtable().s(keyIdx).data());
-            tag.value = QByteArray(block.stringtable().s(valIdx).data());
+            tag.key = strings.tagKey(keyIdx);
+            tag.value = strings.tagValue(valIdx);
             OSM::setTag(node, std::move(tag));
         }
 
@@ -146,7 +472,7 @@ void OsmPbfParser::parseDenseNodes(const OSMPBF::PrimitiveBlock &block, const OS
     }
 }
 
-void OsmPbfParser::parseWays(const OSMPBF::PrimitiveBlock &block, const OSMPBF::PrimitiveGroup &group)
+void OsmPbfParser::parseWays(const OSMPBF::PrimitiveGroup &group, PbfStringTable &strings)
 {
     for (int i = 0; i < group.ways_size(); ++i) {
         const auto &w = group.ways(i);
@@ -163,8 +489,8 @@ void OsmPbfParser::parseWays(const OSMPBF::PrimitiveBlock &block, const OSMPBF::
 
         for (int j = 0; j < w.keys_size(); ++j) {
             OSM::Tag tag;
-            tag.key = m_dataSet->makeTagKey(block.stringtable().s(w.keys(j)).data());
-            tag.value = QByteArray(block.stringtable().s(w.vals(j)).data());
+            tag.key = strings.tagKey(w.keys(j));
+            tag.value = strings.tagValue(w.vals(j));
             OSM::setTag(way, std::move(tag));
         }
 
@@ -172,7 +498,7 @@ void OsmPbfParser::parseWays(const OSMPBF::PrimitiveBlock &block, const OSMPBF::
     }
 }
 
-void OsmPbfParser::parseRelations(const OSMPBF::PrimitiveBlock &block, const OSMPBF::PrimitiveGroup &group)
+void OsmPbfParser::parseRelations(const OSMPBF::PrimitiveGroup &group, PbfStringTable &strings)
 {
     for (int i = 0; i < group.relations_size(); ++i) {
         const auto &r = group.relations(i);
@@ -187,7 +513,7 @@ void OsmPbfParser::parseRelations(const OSMPBF::PrimitiveBlock &block, const OSM
 
             idDelta += r.memids(j);
             mem.id = idDelta;
-            mem.setRole(m_dataSet->makeRole(block.stringtable().s(r.roles_sid(j)).data()));
+            mem.setRole(strings.role(r.roles_sid(j)));
             const auto type = r.types(j);
             switch (type) {
                 case OSMPBF::Relation_MemberType_NODE: mem.setType(OSM::Type::Node); break;
@@ -200,8 +526,8 @@ void OsmPbfParser::parseRelations(const OSMPBF::PrimitiveBlock &block, const OSM
 
         for (int j = 0; j < r.keys_size(); ++j) {
             OSM::Tag tag;
-            tag.key = m_dataSet->makeTagKey(block.stringtable().s(r.keys(j)).data());
-            tag.value = QByteArray(block.stringtable().s(r.vals(j)).data());
+            tag.key = strings.tagKey(r.keys(j));
+            tag.value = strings.tagValue(r.vals(j));
             OSM::setTag(rel, std::move(tag));
         }
 
@@ -10,14 +10,20 @@
 #include "abstractreader.h"
 #include "datatypes.h"
 
+#include <vector>
+
 namespace OSMPBF {
-class PrimitiveBlock;
 class PrimitiveGroup;
 }
 
 namespace OSM {
 
+class PbfStringTable;
+
 /** Parser of .osm.pbf files.
+ *  Blobs are independent of each other, so those are decoded in parallel for large files,
+ *  with a bounded number of blobs decoded ahead of merging them into the data set,
+ *  or one by one as they arrive when reading incrementally.
  *  @see https://wiki.openstreetmap.org/wiki/PBF_Format
  */
 class OsmPbfParser : public AbstractReader
@@ -25,16 +31,45 @@ class OsmPbfParser : public AbstractReader
 public:
     explicit OsmPbfParser(DataSet *dataSet);
 
+    /** Set the maximum number of threads used for decoding.
+     *  By default QThread::idealThreadCount() is used for large inputs, 1 disables parallel decoding.
+     *  The result is identical either way.
+     */
+    void setThreadCount(int threadCount);
+
 private:
+    friend class PbfStringTable;
+
+    struct Blob {
+        const uint8_t *data = nullptr;
+        std::size_t size = 0;
+    };
+
+    enum class BlobState {
+        Complete,
+        Incomplete,
+        Invalid,
+    };
+
     void readFromData(const uint8_t *data, std::size_t len) override;
+    std::size_t readIncremental(const uint8_t *data, std::size_t len, std::size_t offset, bool atEnd) override;
+
+    /** Find the OSMData blobs, without decoding them yet. */
+    [[nodiscard]] static std::vector<Blob> sliceBlobs(const uint8_t *data, std::size_t len);
+    /** Find the next blob starting at @p it, and advance @p it past it if complete.
+     *  @p blob has a @c nullptr data pointer for blobs other than OSMData.
+     */
+    [[nodiscard]] static BlobState nextBlob(const uint8_t *&it, const uint8_t *end, Blob &blob);
+    void readBlobsParallel(const std::vector<Blob> &blobs, int threadCount);
 
-    [[nodiscard]] bool parseBlob(const uint8_t *&it, const uint8_t *end);
+    [[nodiscard]] bool parseBlob(const Blob &blob);
     void parsePrimitiveBlock(const uint8_t *data, std::size_t len);
-    void parseDenseNodes(const OSMPBF::PrimitiveBlock &block,  const OSMPBF::PrimitiveGroup &group);
-    void parseWays(const OSMPBF::PrimitiveBlock &block, const OSMPBF::PrimitiveGroup &group);
-    void parseRelations(const OSMPBF::PrimitiveBlock &block, const OSMPBF::PrimitiveGroup &group);
+    void parseDenseNodes(const uint8_t *data, std::size_t len, PbfStringTable &strings);
+    void parseWays(const OSMPBF::PrimitiveGroup &group, PbfStringTable &strings);
+    void parseRelations(const OSMPBF::PrimitiveGroup &group, PbfStringTable &strings);
 
     QByteArray m_zlibBuffer;
+    int m_threadCount = 0;
 };
 
 }
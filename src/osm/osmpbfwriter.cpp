@@ -9,231 +9,340 @@
 #include "fileformat.pb.h"
 #include "osmformat.pb.h"
 
+#include <QDebug>
 #include <QIODevice>
+#include <QThread>
+#include <QThreadPool>
 #include <QtEndian>
 
 #include <zlib.h>
 
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace Qt::Literals::StringLiterals;
 using namespace OSM;
 
 static constexpr const std::size_t BLOCK_SIZE_LIMIT = 16'777'216;
 
-OsmPbfWriter::OsmPbfWriter() = default;
-OsmPbfWriter::~OsmPbfWriter() = default;
+struct OsmPbfWriter::BlockSlice {
+    std::size_t nodesBegin = 0;
+    std::size_t nodesEnd = 0;
+    std::size_t waysBegin = 0;
+    std::size_t waysEnd = 0;
+    std::size_t relationsBegin = 0;
+    std::size_t relationsEnd = 0;
+};
 
-void OsmPbfWriter::writeToIODevice(const OSM::DataSet &dataSet, QIODevice *io)
+[[nodiscard]] static std::string_view tagValueView(const Tag &tag)
 {
-    m_io = io;
-    writeNodes(dataSet);
-    writeWays(dataSet);
-    writeRelations(dataSet);
-    if (m_block) {
-        writeBlob();
-    }
-    m_io =  nullptr;
+    return {tag.value.constData(), (std::size_t)tag.value.size()};
 }
 
-void OsmPbfWriter::writeNodes(const OSM::DataSet &dataSet)
+namespace {
+/** Approximate size of a block while it is being filled, to decide where the next one begins. */
+class BlockSizeEstimate
 {
-    if (dataSet.nodes.empty()) {
-        return;
+public:
+    void addNode(const Node &node)
+    {
+        addTags(node.tags);
+        m_size += 3 * sizeof(int64_t) + sizeof(int32_t);
+    }
+    void addWay(const Way &way)
+    {
+        addTags(way.tags);
+        m_size += sizeof(int64_t) + way.nodes.size() * sizeof(int64_t);
+    }
+    void addRelation(const Relation &rel)
+    {
+        addTags(rel.tags);
+        for (const auto &mem : rel.members) {
+            addString(mem.role().name());
+            m_size += 2 * sizeof(int32_t) + sizeof(int64_t);
+        }
+        m_size += sizeof(int64_t);
     }
 
-    int64_t prevId = 0;
-    int64_t prevLat = 900'000'000ll;
-    int64_t prevLon = 1'800'000'000ll;
+    [[nodiscard]] bool limitReached() const
+    {
+        return m_size > BLOCK_SIZE_LIMIT;
+    }
 
-    OSMPBF::DenseNodes *denseBlock = nullptr;
-    for(auto const &node: dataSet.nodes) {
-        createBlockIfNeeded();
-        if (!denseBlock) {
-            denseBlock = m_block->add_primitivegroup()->mutable_dense();
+private:
+    void addTags(const std::vector<Tag> &tags)
+    {
+        for (const auto &tag : tags) {
+            addString(tag.key.name());
+            addString(tagValueView(tag));
+            m_size += 2 * sizeof(int32_t);
+        }
+    }
+    void addString(std::string_view s)
+    {
+        if (m_strings.insert(s).second) {
+            m_size += s.size() + 1 + sizeof(int32_t);
         }
+    }
 
-        denseBlock->add_id(node.id - prevId);
-        prevId = node.id;
+    std::unordered_set<std::string_view> m_strings;
+    std::size_t m_size = 0;
+};
 
-        denseBlock->add_lat((int64_t)node.coordinate.latitude - prevLat);
-        prevLat = node.coordinate.latitude;
-        denseBlock->add_lon((int64_t)node.coordinate.longitude - prevLon);
-        prevLon = node.coordinate.longitude;
+/** Builds a single PrimitiveBlock. */
+class PbfBlockBuilder
+{
+public:
+    PbfBlockBuilder()
+    {
+        m_block.mutable_stringtable()->add_s(""); // dense node block tag separation marker
+    }
 
-        for (const auto &tag : node.tags) {
-            denseBlock->add_keys_vals(stringTableEntry(tag.key.name()));
-            denseBlock->add_keys_vals(stringTableEntry(tag.value.constData()));
-            m_blockSizeEstimate += 2 * sizeof(int32_t);
+    void addNodes(std::vector<Node>::const_iterator begin, std::vector<Node>::const_iterator end)
+    {
+        // delta encoding restarts in every dense node group
+        int64_t prevId = 0;
+        int64_t prevLat = 900'000'000ll;
+        int64_t prevLon = 1'800'000'000ll;
+
+        auto denseBlock = m_block.add_primitivegroup()->mutable_dense();
+        for (auto it = begin; it != end; ++it) {
+            const auto &node = *it;
+            denseBlock->add_id(node.id - prevId);
+            prevId = node.id;
+
+            denseBlock->add_lat((int64_t)node.coordinate.latitude - prevLat);
+            prevLat = node.coordinate.latitude;
+            denseBlock->add_lon((int64_t)node.coordinate.longitude - prevLon);
+            prevLon = node.coordinate.longitude;
+
+            for (const auto &tag : node.tags) {
+                denseBlock->add_keys_vals(stringTableEntry(tag.key.name()));
+                denseBlock->add_keys_vals(stringTableEntry(tagValueView(tag)));
+            }
+            denseBlock->add_keys_vals(0);
         }
+    }
 
-        denseBlock->add_keys_vals(0);
-        m_blockSizeEstimate += 3 * sizeof(int64_t) + sizeof(int32_t);
-
-        if (blockSizeLimitReached()) {
-            denseBlock = nullptr;
-            writeBlob();
+    void addWays(std::vector<Way>::const_iterator begin, std::vector<Way>::const_iterator end)
+    {
+        auto group = m_block.add_primitivegroup();
+        for (auto it = begin; it != end; ++it) {
+            const auto &way = *it;
+            auto w = group->add_ways();
+            w->set_id(way.id);
+
+            int64_t prevId = 0;
+            for (const auto &id : way.nodes) {
+                w->add_refs(id - prevId);
+                prevId = id;
+            }
+            for (const auto &tag : way.tags) {
+                w->add_keys(stringTableEntry(tag.key.name()));
+                w->add_vals(stringTableEntry(tagValueView(tag)));
+            }
         }
     }
-}
 
-void OsmPbfWriter::writeWays(const OSM::DataSet &dataSet)
-{
-    OSMPBF::PrimitiveGroup *group = nullptr;
-    for(auto const &way : dataSet.ways) {
-        createBlockIfNeeded();
-        if (!group) {
-            group = m_block->add_primitivegroup();
+    void addRelations(std::vector<Relation>::const_iterator begin, std::vector<Relation>::const_iterator end)
+    {
+        auto group = m_block.add_primitivegroup();
+        for (auto it = begin; it != end; ++it) {
+            const auto &rel = *it;
+            auto r = group->add_relations();
+            r->set_id(rel.id);
+
+            for (const auto &tag : rel.tags) {
+                r->add_keys(stringTableEntry(tag.key.name()));
+                r->add_vals(stringTableEntry(tagValueView(tag)));
+            }
+
+            int64_t prevMemId = 0;
+            for (const auto &mem : rel.members) {
+                r->add_roles_sid(stringTableEntry(mem.role().name()));
+                r->add_memids(mem.id - prevMemId);
+                prevMemId = mem.id;
+                r->add_types(pbfMemberType(mem.type()));
+            }
         }
+    }
 
-        auto w = group->add_ways();
-        w->set_id(way.id);
-        m_blockSizeEstimate += sizeof(int64_t);
+    [[nodiscard]] const OSMPBF::PrimitiveBlock& block() const
+    {
+        return m_block;
+    }
 
-        int64_t prevId = 0;
-        for (const auto &id : way.nodes) {
-            w->add_refs(id - prevId);
-            prevId = id;
-            m_blockSizeEstimate += sizeof(int64_t);
-        }
-        for (const auto &tag : way.tags) {
-            w->add_keys(stringTableEntry(tag.key.name()));
-            w->add_vals(stringTableEntry(tag.value.constData()));
-            m_blockSizeEstimate += 2 * sizeof(int32_t);
+private:
+    [[nodiscard]] static OSMPBF::Relation_MemberType pbfMemberType(OSM::Type t)
+    {
+        switch (t) {
+            case OSM::Type::Null:
+                Q_UNREACHABLE();
+            case OSM::Type::Node:
+                return OSMPBF::Relation_MemberType::Relation_MemberType_NODE;
+            case OSM::Type::Way:
+                return OSMPBF::Relation_MemberType::Relation_MemberType_WAY;
+            case OSM::Type::Relation:
+                return OSMPBF::Relation_MemberType::Relation_MemberType_RELATION;
         }
+        return OSMPBF::Relation_MemberType::Relation_MemberType_NODE;
+    }
 
-        if (blockSizeLimitReached()) {
-            group = nullptr;
-            writeBlob();
+    [[nodiscard]] int32_t stringTableEntry(std::string_view s)
+    {
+        const auto it = m_stringTable.find(s);
+        if (it != m_stringTable.end()) {
+            return (*it).second;
         }
+        auto st = m_block.mutable_stringtable();
+        st->add_s(std::string(s));
+        m_stringTable.emplace(s, st->s_size() - 1);
+        return st->s_size() - 1;
     }
+
+    OSMPBF::PrimitiveBlock m_block;
+    std::unordered_map<std::string_view, int32_t> m_stringTable;
+};
 }
 
-static OSMPBF::Relation_MemberType pbfMemberType(OSM::Type t)
+OsmPbfWriter::OsmPbfWriter() = default;
+OsmPbfWriter::~OsmPbfWriter() = default;
+
+void OsmPbfWriter::setThreadCount(int threadCount)
 {
-    switch (t) {
-        case OSM::Type::Null:
-            Q_UNREACHABLE();
-        case OSM::Type::Node:
-            return OSMPBF::Relation_MemberType::Relation_MemberType_NODE;
-        case OSM::Type::Way:
-            return OSMPBF::Relation_MemberType::Relation_MemberType_WAY;
-        case OSM::Type::Relation:
-            return OSMPBF::Relation_MemberType::Relation_MemberType_RELATION;
-    }
-    return OSMPBF::Relation_MemberType::Relation_MemberType_NODE;
+    m_threadCount = threadCount;
 }
 
-void OsmPbfWriter::writeRelations(const OSM::DataSet &dataSet)
+void OsmPbfWriter::writeToIODevice(const OSM::DataSet &dataSet, QIODevice *io)
 {
-    OSMPBF::PrimitiveGroup *group = nullptr;
-    for (const auto &rel :dataSet.relations) {
-        createBlockIfNeeded();
-        if (!group) {
-            group = m_block->add_primitivegroup();
-        }
-
-        auto r = group->add_relations();
-        r->set_id(rel.id);
-        m_blockSizeEstimate += sizeof(int64_t);
-
-        for (const auto &tag : rel.tags) {
-            r->add_keys(stringTableEntry(tag.key.name()));
-            r->add_vals(stringTableEntry(tag.value.constData()));
-            m_blockSizeEstimate += 2 * sizeof(int32_t);
+    const auto slices = sliceBlocks(dataSet);
+    const auto threadCount = std::min<int>(m_threadCount > 0 ? m_threadCount : QThread::idealThreadCount(), (int)slices.size());
+    if (threadCount <= 1) {
+        for (const auto &slice : slices) {
+            const auto block = encodeBlock(dataSet, slice);
+            if (!writeBlock(block, io)) {
+                return;
+            }
         }
+        return;
+    }
 
-        int64_t prevMemId = 0;
-        for (const auto &mem : rel.members) {
-            r->add_roles_sid(stringTableEntry(mem.role().name()));
-            r->add_memids(mem.id - prevMemId);
-            prevMemId = mem.id;
-            r->add_types(pbfMemberType(mem.type()));
-            m_blockSizeEstimate += 2* sizeof(int32_t) + sizeof(int64_t);
+    // encode a batch of blocks in parallel, then write that in order
+    // this bounds memory use to a few blocks rather than the entire output
+    QThreadPool pool;
+    pool.setMaxThreadCount(threadCount);
+    std::vector<std::string> blocks(threadCount);
+    for (std::size_t batchBegin = 0; batchBegin < slices.size(); batchBegin += blocks.size()) {
+        const auto batchSize = std::min(blocks.size(), slices.size() - batchBegin);
+        for (std::size_t i = 0; i < batchSize; ++i) {
+            pool.start([this, &dataSet, &slice = slices[batchBegin + i], &block = blocks[i]]() {
+                block = encodeBlock(dataSet, slice);
+            });
         }
-
-        if (blockSizeLimitReached()) {
-            group = nullptr;
-            writeBlob();
+        pool.waitForDone();
+        for (std::size_t i = 0; i < batchSize; ++i) {
+            if (!writeBlock(blocks[i], io)) {
+                return;
+            }
+            blocks[i] = {};
         }
     }
 }
 
-int32_t OsmPbfWriter::stringTableEntry(const char *s)
+bool OsmPbfWriter::writeBlock(const std::string &block, QIODevice *io)
 {
-    assert(m_block);
-    const auto it = m_stringTable.find(s);
-    if (it == m_stringTable.end()) {
-        auto st = m_block->mutable_stringtable();
-        st->add_s(s);
-        m_stringTable[s] = st->s_size() - 1;
-        m_blockSizeEstimate += std::strlen(s) + 1 + sizeof(int32_t);
-        return st->s_size() - 1;
+    if (block.empty()) {
+        m_error = u"Failed to compress PBF block."_s;
+        return false;
     }
-
-    return (*it).second;
+    if (io->write(block.data(), (qint64)block.size()) != (qint64)block.size()) {
+        m_error = io->errorString();
+        return false;
+    }
+    return true;
 }
 
-void OsmPbfWriter::createBlockIfNeeded()
+std::vector<OsmPbfWriter::BlockSlice> OsmPbfWriter::sliceBlocks(const OSM::DataSet &dataSet)
 {
-    if (!m_block) {
-        m_block = std::make_unique<OSMPBF::PrimitiveBlock>();
-        m_blockSizeEstimate = 0;
-        m_block->mutable_stringtable()->add_s(""); // dense node block tag separation marker
+    std::vector<BlockSlice> slices;
+    BlockSlice slice;
+    BlockSizeEstimate estimate;
+    const auto nextSlice = [&]() {
+        slices.push_back(slice);
+        slice = { slice.nodesEnd, slice.nodesEnd, slice.waysEnd, slice.waysEnd, slice.relationsEnd, slice.relationsEnd };
+        estimate = {};
+    };
+
+    for (const auto &node : dataSet.nodes) {
+        estimate.addNode(node);
+        ++slice.nodesEnd;
+        if (estimate.limitReached()) {
+            nextSlice();
+        }
+    }
+    for (const auto &way : dataSet.ways) {
+        estimate.addWay(way);
+        ++slice.waysEnd;
+        if (estimate.limitReached()) {
+            nextSlice();
+        }
+    }
+    for (const auto &rel : dataSet.relations) {
+        estimate.addRelation(rel);
+        ++slice.relationsEnd;
+        if (estimate.limitReached()) {
+            nextSlice();
+        }
     }
-}
 
-bool OsmPbfWriter::blockSizeLimitReached() const
-{
-    return m_blockSizeEstimate >BLOCK_SIZE_LIMIT;
+    if (slice.nodesBegin != slice.nodesEnd || slice.waysBegin != slice.waysEnd || slice.relationsBegin != slice.relationsEnd) {
+        slices.push_back(slice);
+    }
+    return slices;
 }
 
-void OsmPbfWriter::writeBlob()
+std::string OsmPbfWriter::encodeBlock(const OSM::DataSet &dataSet, const BlockSlice &slice) const
 {
+    PbfBlockBuilder builder;
+    if (slice.nodesBegin != slice.nodesEnd) {
+        builder.addNodes(dataSet.nodes.begin() + slice.nodesBegin, dataSet.nodes.begin() + slice.nodesEnd);
+    }
+    if (slice.waysBegin != slice.waysEnd) {
+        builder.addWays(dataSet.ways.begin() + slice.waysBegin, dataSet.ways.begin() + slice.waysEnd);
+    }
+    if (slice.relationsBegin != slice.relationsEnd) {
+        builder.addRelations(dataSet.relations.begin() + slice.relationsBegin, dataSet.relations.begin() + slice.relationsEnd);
+    }
+
     OSMPBF::Blob blob;
-    auto rawBlobData = m_block->SerializeAsString();
-    auto zlibBlobData = blob.mutable_zlib_data();
-    zlibBlobData->resize(32 * 1024ul * 1024ul);
-
-    z_stream zStream;
-    zStream.next_in = (uint8_t*)rawBlobData.data();
-    zStream.avail_in = rawBlobData.size();
-    zStream.next_out = (uint8_t*)zlibBlobData->data();
-    zStream.avail_out = zlibBlobData->size();
-    zStream.zalloc = nullptr;
-    zStream.zfree = nullptr;
-    zStream.opaque = nullptr;
-    deflateInit(&zStream, Z_DEFAULT_COMPRESSION);
-    while (true) {
-        const auto ret = deflate(&zStream, Z_FINISH);
-        if (ret == Z_STREAM_END) {
-            break;
-        }
+    auto rawBlobData = builder.block().SerializeAsString();
+    blob.set_raw_size((int32_t)rawBlobData.size());
+    if (m_compressionLevel == 0) {
+        blob.set_raw(std::move(rawBlobData));
+    } else {
+        auto zlibBlobData = blob.mutable_zlib_data();
+        auto zlibSize = compressBound(rawBlobData.size());
+        zlibBlobData->resize(zlibSize);
+        const auto ret = compress2(reinterpret_cast<Bytef*>(zlibBlobData->data()), &zlibSize,
+                                   reinterpret_cast<const Bytef*>(rawBlobData.data()), rawBlobData.size(), m_compressionLevel);
         if (ret != Z_OK) {
             qWarning() << "zlib compression error!" << ret;
-            break;
-        }
-        if (zStream.avail_out == 0) {
-            // we could dynamically resize the output buffer here, but that
-            // is already about twice the size of the data we want to compress
-            // so we really shouldn't end up here
-            qFatal("zlib output buffer underrun");
-            break;
+            return {};
         }
+        zlibBlobData->resize(zlibSize);
     }
-    zlibBlobData->resize(zlibBlobData->size() - zStream.avail_out);
-
-    deflateEnd(&zStream);
-    blob.set_raw_size((int32_t)rawBlobData.size());
 
     OSMPBF::BlobHeader header;
     header.set_type("OSMData");
     header.set_datasize((int32_t)blob.ByteSizeLong());
 
-    auto blobHeaderSize = (int32_t)header.ByteSizeLong();
-    blobHeaderSize = qToBigEndian(blobHeaderSize);
-    m_io->write(reinterpret_cast<const char*>(&blobHeaderSize), sizeof(blobHeaderSize));
-    m_io->write(header.SerializeAsString().c_str(), header.ByteSizeLong()); // TODO do this copy-free
-    m_io->write(blob.SerializeAsString().c_str(), blob.ByteSizeLong()); // TODO do this copy-free
-
-    m_block.reset();
-    m_blockSizeEstimate = 0;
-    m_stringTable.clear();
+    std::string out;
+    out.reserve(sizeof(int32_t) + header.ByteSizeLong() + blob.ByteSizeLong());
+    const auto blobHeaderSize = qToBigEndian((int32_t)header.ByteSizeLong());
+    out.append(reinterpret_cast<const char*>(&blobHeaderSize), sizeof(blobHeaderSize));
+    header.AppendToString(&out);
+    blob.AppendToString(&out);
+    return out;
 }
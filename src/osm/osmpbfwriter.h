@@ -8,40 +8,42 @@
 
 #include "abstractwriter.h"
 
-#include <cstdint>
-#include <cstring>
 #include <string>
-
-#include <QDebug>
-
-namespace OSMPBF {
-class PrimitiveBlock;
-}
+#include <vector>
 
 namespace OSM {
 
-/** Serialize an OSM::DataSet into the PBF file format. */
+/** Serialize an OSM::DataSet into the PBF file format.
+ *  Blocks are encoded and zlib compressed in parallel, and written in order.
+ *  @see AbstractWriter::setCompressionLevel()
+ */
 class OsmPbfWriter : public OSM::AbstractWriter
 {
 public:
     explicit OsmPbfWriter();
     ~OsmPbfWriter() override;
+
+    /** Set the maximum number of threads used for encoding.
+     *  By default QThread::idealThreadCount() is used, 1 disables parallel encoding.
+     *  The output is identical either way.
+     */
+    void setThreadCount(int threadCount);
+
 private:
-    void writeToIODevice(const OSM::DataSet &dataSet, QIODevice *io) override;
+    struct BlockSlice;
 
-    void writeNodes(const OSM::DataSet &dataSet);
-    void writeWays(const OSM::DataSet &dataSet);
-    void writeRelations(const OSM::DataSet &dataSet);
+    void writeToIODevice(const OSM::DataSet &dataSet, QIODevice *io) override;
 
-    [[nodiscard]] int32_t stringTableEntry(const char *s);
-    void createBlockIfNeeded();
-    [[nodiscard]] bool blockSizeLimitReached() const;
-    void writeBlob();
+    /** Split the data set into blocks below the block size limit. */
+    [[nodiscard]] static std::vector<BlockSlice> sliceBlocks(const OSM::DataSet &dataSet);
+    /** Serialize and compress one block, including the blob header.
+     *  @returns an empty string if compression failed.
+     */
+    [[nodiscard]] std::string encodeBlock(const OSM::DataSet &dataSet, const BlockSlice &slice) const;
+    /** Write an encoded block, sets the error state if that fails. */
+    [[nodiscard]] bool writeBlock(const std::string &block, QIODevice *io);
 
-    std::unique_ptr<OSMPBF::PrimitiveBlock> m_block;
-    std::map<std::string_view, int32_t> m_stringTable;
-    std::size_t m_blockSizeEstimate = 0;
-    QIODevice *m_io = nullptr;
+    int m_threadCount = 0;
 };
 
 }
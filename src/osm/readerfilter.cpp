@@ -0,0 +1,64 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "readerfilter.h"
+
+#include <algorithm>
+
+using namespace OSM;
+
+ReaderFilter::ReaderFilter() = default;
+ReaderFilter::~ReaderFilter() = default;
+
+void ReaderFilter::setBoundingBox(BoundingBox bbox)
+{
+    m_bbox = bbox;
+}
+
+BoundingBox ReaderFilter::boundingBox() const
+{
+    return m_bbox;
+}
+
+void ReaderFilter::setTagKeys(std::vector<TagKey> &&keys)
+{
+    m_tagKeys = std::move(keys);
+    std::sort(m_tagKeys.begin(), m_tagKeys.end());
+}
+
+template <typename Elem>
+bool ReaderFilter::hasTagKey(const Elem &elem) const
+{
+    if (m_tagKeys.empty()) {
+        return true;
+    }
+    return std::any_of(elem.tags.begin(), elem.tags.end(), [this](const auto &tag) {
+        return std::binary_search(m_tagKeys.begin(), m_tagKeys.end(), tag.key);
+    });
+}
+
+bool ReaderFilter::acceptNode(const OSM::Node &node) const
+{
+    if (m_bbox.isValid() && !OSM::contains(m_bbox, node.coordinate)) {
+        return false;
+    }
+    return hasTagKey(node);
+}
+
+bool ReaderFilter::acceptWay(const OSM::Way &way) const
+{
+    if (m_bbox.isValid() && way.bbox.isValid() && !OSM::intersects(m_bbox, way.bbox)) {
+        return false;
+    }
+    return hasTagKey(way);
+}
+
+bool ReaderFilter::acceptRelation(const OSM::Relation &relation) const
+{
+    if (m_bbox.isValid() && relation.bbox.isValid() && !OSM::intersects(m_bbox, relation.bbox)) {
+        return false;
+    }
+    return hasTagKey(relation);
+}
@@ -0,0 +1,64 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef OSM_READERFILTER_H
+#define OSM_READERFILTER_H
+
+#include "kosm_export.h"
+#include "datatypes.h"
+
+#include <vector>
+
+namespace OSM {
+
+/** Selects the elements to keep while reading.
+ *  @see OSM::AbstractReader::setFilter()
+ *
+ *  This is evaluated for every tagged element, before its tag values are stored.
+ *  Rejected elements lose their tags but are otherwise retained, as they might be
+ *  needed for the geometry of accepted elements. When reading into an OSM::DataSet
+ *  directly, everything not needed by accepted elements is removed at the end of reading.
+ *
+ *  The default implementation keeps elements within a bounding box that have
+ *  any of a given set of tag keys. Reimplement for more elaborate criteria.
+ */
+class KOSM_EXPORT ReaderFilter
+{
+public:
+    explicit ReaderFilter();
+    virtual ~ReaderFilter();
+
+    /** Only keep elements intersecting @p bbox.
+     *  For ways and relations without an explicitly specified bounding box this
+     *  is only known once all nodes have been read, those are therefore tested again
+     *  at the end of reading into an OSM::DataSet.
+     */
+    void setBoundingBox(BoundingBox bbox);
+    [[nodiscard]] BoundingBox boundingBox() const;
+
+    /** Only keep elements having at least one of the tags in @p keys.
+     *  An empty set (the default) keeps elements regardless of their tags.
+     */
+    void setTagKeys(std::vector<TagKey> &&keys);
+
+    /** Returns @c true if the given element is to be kept.
+     *  Tag values are only valid for the duration of this call. When reading in parallel,
+     *  this is called from multiple threads concurrently.
+     */
+    [[nodiscard]] virtual bool acceptNode(const OSM::Node &node) const;
+    [[nodiscard]] virtual bool acceptWay(const OSM::Way &way) const;
+    [[nodiscard]] virtual bool acceptRelation(const OSM::Relation &relation) const;
+
+private:
+    template <typename Elem>
+    [[nodiscard]] bool hasTagKey(const Elem &elem) const;
+
+    BoundingBox m_bbox;
+    std::vector<TagKey> m_tagKeys;
+};
+
+}
+
+#endif // OSM_READERFILTER_H
@@ -0,0 +1,110 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef OSM_SNAPSHOT_H
+#define OSM_SNAPSHOT_H
+
+#include <cstdint>
+
+/** @file snapshot.h
+ *  Common declarations for the binary snapshot file format.
+ *
+ *  Snapshots are a direct dump of an OSM::DataSet, meant for loading memory-mapped
+ *  data without any decoding, not for data exchange. Integers are in host byte order,
+ *  which is checked on loading. The file consists of the following sections, each
+ *  starting at an 8 byte aligned offset:
+ *  - SnapshotHeader
+ *  - string table: 0-terminated strings, referred to by their offset
+ *  - key and role tables: string table offsets (uint32_t)
+ *  - value table: SnapshotValue
+ *  - tags: SnapshotTag, referenced by element tag ranges
+ *  - nodes: SnapshotNode
+ *  - ways: SnapshotWay
+ *  - way nodes: node ids (int64_t), referenced by way node ranges
+ *  - relations: SnapshotRelation
+ *  - members: SnapshotMember, referenced by relation member ranges
+ *  - extension sections: SnapshotSection followed by its content
+ */
+
+namespace OSM {
+
+constexpr inline const char SNAPSHOT_MAGIC[8] = { 'K', 'O', 'S', 'M', 'S', 'N', 'A', 'P' };
+
+enum : uint32_t {
+    SNAPSHOT_VERSION = 1,
+    SNAPSHOT_BYTE_ORDER_MARK = 0x01020304,
+    SNAPSHOT_NULL_STRING = 0xffffffff,
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrderMark;
+    uint64_t stringTableSize;
+    uint64_t keyCount;
+    uint64_t roleCount;
+    uint64_t valueCount;
+    uint64_t tagCount;
+    uint64_t nodeCount;
+    uint64_t wayCount;
+    uint64_t wayNodeCount;
+    uint64_t relationCount;
+    uint64_t memberCount;
+    uint64_t sectionCount;
+};
+
+struct SnapshotValue {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct SnapshotTag {
+    uint32_t key;
+    uint32_t value;
+};
+
+struct SnapshotNode {
+    int64_t id;
+    uint32_t latitude;
+    uint32_t longitude;
+    uint32_t tagBegin;
+    uint32_t tagCount;
+};
+
+struct SnapshotWay {
+    int64_t id;
+    uint32_t bbox[4];
+    uint32_t nodeBegin;
+    uint32_t nodeCount;
+    uint32_t tagBegin;
+    uint32_t tagCount;
+};
+
+struct SnapshotRelation {
+    int64_t id;
+    uint32_t bbox[4];
+    uint32_t memberBegin;
+    uint32_t memberCount;
+    uint32_t tagBegin;
+    uint32_t tagCount;
+};
+
+struct SnapshotMember {
+    int64_t id;
+    uint32_t role;
+    uint8_t type;
+    uint8_t padding[3];
+};
+
+/** Header of an extension section, for additional application data. */
+struct SnapshotSection {
+    uint32_t id;
+    uint32_t padding;
+    uint64_t size;
+};
+
+}
+
+#endif // OSM_SNAPSHOT_H
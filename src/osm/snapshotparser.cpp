@@ -0,0 +1,266 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "snapshotparser.h"
+#include "snapshot.h"
+#include "datatypes.h"
+
+#include <QDebug>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace Qt::Literals::StringLiterals;
+using namespace OSM;
+
+namespace {
+/** Bounds-checked sequential access to the snapshot sections. */
+class SnapshotCursor
+{
+public:
+    explicit SnapshotCursor(const uint8_t *data, std::size_t len)
+        : m_begin(data)
+        , m_it(data)
+        , m_end(data + len)
+    {}
+
+    /** Returns the begin of an array of @p count elements of type @p T, or @c nullptr if out of bounds. */
+    template <typename T>
+    [[nodiscard]] const uint8_t* take(uint64_t count)
+    {
+        if (!m_it || count > (uint64_t)(m_end - m_it) / sizeof(T)) {
+            m_it = nullptr;
+            return nullptr;
+        }
+        const auto begin = m_it;
+        m_it += count * sizeof(T);
+        return begin;
+    }
+
+    /** Skip to the next 8 byte aligned position. */
+    void skipPadding()
+    {
+        if (!m_it) {
+            return;
+        }
+        const auto rest = (std::size_t)(m_it - m_begin) % 8;
+        if (rest != 0) {
+            m_it = (std::size_t)(m_end - m_it) < 8 - rest ? nullptr : m_it + (8 - rest);
+        }
+    }
+
+private:
+    const uint8_t *m_begin = nullptr;
+    const uint8_t *m_it = nullptr;
+    const uint8_t *m_end = nullptr;
+};
+}
+
+/** Read element @p idx of an array of @p T starting at @p data.
+ *  The data isn't necessarily aligned, so this copies rather than casts.
+ */
+template <typename T>
+[[nodiscard]] static T readAt(const uint8_t *data, std::size_t idx)
+{
+    T t;
+    std::memcpy(&t, data + idx * sizeof(T), sizeof(T));
+    return t;
+}
+
+[[nodiscard]] static bool isValidRange(uint32_t begin, uint32_t count, uint64_t size)
+{
+    return (uint64_t)begin + (uint64_t)count <= size;
+}
+
+[[nodiscard]] static BoundingBox readBoundingBox(const uint32_t bbox[4])
+{
+    return BoundingBox(Coordinate(bbox[0], bbox[1]), Coordinate(bbox[2], bbox[3]));
+}
+
+SnapshotParser::SnapshotParser(DataSet *dataSet)
+    : AbstractReader(dataSet)
+{
+}
+
+QByteArray SnapshotParser::section(uint32_t id) const
+{
+    const auto it = std::find_if(m_sections.begin(), m_sections.end(), [id](const auto &section) { return section.first == id; });
+    return it != m_sections.end() ? (*it).second : QByteArray();
+}
+
+void SnapshotParser::readFromData(const uint8_t *data, std::size_t len)
+{
+    m_sections.clear();
+
+    SnapshotCursor cursor(data, len);
+    const auto headerData = cursor.take<SnapshotHeader>(1);
+    if (!headerData) {
+        m_error = u"Snapshot header truncated."_s;
+        return;
+    }
+    const auto header = readAt<SnapshotHeader>(headerData, 0);
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        m_error = u"Not a snapshot file."_s;
+        return;
+    }
+    if (header.version != SNAPSHOT_VERSION) {
+        m_error = u"Unsupported snapshot version %1."_s.arg(header.version);
+        return;
+    }
+    if (header.byteOrderMark != SNAPSHOT_BYTE_ORDER_MARK) {
+        m_error = u"Snapshot byte order mismatch."_s;
+        return;
+    }
+
+    const auto strings = reinterpret_cast<const char*>(cursor.take<char>(header.stringTableSize));
+    cursor.skipPadding();
+    const auto keyData = cursor.take<uint32_t>(header.keyCount);
+    cursor.skipPadding();
+    const auto roleData = cursor.take<uint32_t>(header.roleCount);
+    cursor.skipPadding();
+    const auto valueData = cursor.take<SnapshotValue>(header.valueCount);
+    const auto tagData = cursor.take<SnapshotTag>(header.tagCount);
+    const auto nodeData = cursor.take<SnapshotNode>(header.nodeCount);
+    const auto wayData = cursor.take<SnapshotWay>(header.wayCount);
+    const auto wayNodeData = cursor.take<Id>(header.wayNodeCount);
+    const auto relationData = cursor.take<SnapshotRelation>(header.relationCount);
+    const auto memberData = cursor.take<SnapshotMember>(header.memberCount);
+    if (!memberData || (header.stringTableSize > 0 && strings[header.stringTableSize - 1] != '\0')) {
+        m_error = u"Snapshot data truncated."_s;
+        return;
+    }
+
+    // resolve all strings once, elements then only copy those
+    std::vector<TagKey> keys;
+    keys.reserve(header.keyCount);
+    for (std::size_t i = 0; i < header.keyCount; ++i) {
+        const auto offset = readAt<uint32_t>(keyData, i);
+        if (offset >= header.stringTableSize) {
+            m_error = u"Invalid tag key."_s;
+            return;
+        }
+        keys.push_back(m_dataSet->makeTagKey(strings + offset, m_dataMemOpt));
+    }
+    std::vector<Role> roles;
+    roles.reserve(header.roleCount);
+    for (std::size_t i = 0; i < header.roleCount; ++i) {
+        const auto offset = readAt<uint32_t>(roleData, i);
+        if (offset >= header.stringTableSize) {
+            m_error = u"Invalid role."_s;
+            return;
+        }
+        roles.push_back(m_dataSet->makeRole(strings + offset, m_dataMemOpt));
+    }
+    std::vector<QByteArray> values;
+    values.reserve(header.valueCount);
+    for (std::size_t i = 0; i < header.valueCount; ++i) {
+        const auto value = readAt<SnapshotValue>(valueData, i);
+        if (!isValidRange(value.offset, value.length, header.stringTableSize)) {
+            m_error = u"Invalid tag value."_s;
+            return;
+        }
+        values.push_back(m_dataSet->makeTagValue(strings + value.offset, value.length, m_dataMemOpt));
+    }
+
+    const auto readTags = [&](uint32_t begin, uint32_t count, std::vector<Tag> &tags) {
+        if (!isValidRange(begin, count, header.tagCount)) {
+            return false;
+        }
+        tags.reserve(count);
+        for (auto i = begin; i < begin + count; ++i) {
+            const auto tag = readAt<SnapshotTag>(tagData, i);
+            if (tag.key >= keys.size() || tag.value >= values.size()) {
+                return false;
+            }
+            tags.emplace_back(keys[tag.key], QByteArray(values[tag.value]));
+        }
+        // keys are stored in address order, so when used in place tags are sorted already
+        if (!std::is_sorted(tags.begin(), tags.end())) {
+            std::sort(tags.begin(), tags.end());
+        }
+        return true;
+    };
+
+    reserveElements(header.nodeCount, header.wayCount, header.relationCount);
+
+    for (std::size_t i = 0; i < header.nodeCount; ++i) {
+        const auto n = readAt<SnapshotNode>(nodeData, i);
+        Node node;
+        node.id = n.id;
+        node.coordinate = Coordinate(n.latitude, n.longitude);
+        if (!readTags(n.tagBegin, n.tagCount, node.tags)) {
+            m_error = u"Invalid node tags."_s;
+            return;
+        }
+        addNode(std::move(node));
+    }
+
+    for (std::size_t i = 0; i < header.wayCount; ++i) {
+        const auto w = readAt<SnapshotWay>(wayData, i);
+        Way way;
+        way.id = w.id;
+        way.bbox = readBoundingBox(w.bbox);
+        if (!isValidRange(w.nodeBegin, w.nodeCount, header.wayNodeCount)) {
+            m_error = u"Invalid way nodes."_s;
+            return;
+        }
+        way.nodes.resize(w.nodeCount);
+        if (w.nodeCount > 0) {
+            std::memcpy(way.nodes.data(), wayNodeData + (std::size_t)w.nodeBegin * sizeof(Id), w.nodeCount * sizeof(Id));
+        }
+        if (!readTags(w.tagBegin, w.tagCount, way.tags)) {
+            m_error = u"Invalid way tags."_s;
+            return;
+        }
+        addWay(std::move(way));
+    }
+
+    for (std::size_t i = 0; i < header.relationCount; ++i) {
+        const auto r = readAt<SnapshotRelation>(relationData, i);
+        Relation rel;
+        rel.id = r.id;
+        rel.bbox = readBoundingBox(r.bbox);
+        if (!isValidRange(r.memberBegin, r.memberCount, header.memberCount)) {
+            m_error = u"Invalid relation members."_s;
+            return;
+        }
+        rel.members.reserve(r.memberCount);
+        for (auto j = r.memberBegin; j < r.memberBegin + r.memberCount; ++j) {
+            const auto m = readAt<SnapshotMember>(memberData, j);
+            if ((m.role != SNAPSHOT_NULL_STRING && m.role >= roles.size()) || m.type == 0 || m.type > static_cast<uint8_t>(Type::Relation)) {
+                m_error = u"Invalid relation member."_s;
+                return;
+            }
+            Member mem;
+            mem.id = m.id;
+            mem.setRole(m.role == SNAPSHOT_NULL_STRING ? Role() : roles[m.role]);
+            mem.setType(static_cast<Type>(m.type));
+            rel.members.push_back(std::move(mem));
+        }
+        if (!readTags(r.tagBegin, r.tagCount, rel.tags)) {
+            m_error = u"Invalid relation tags."_s;
+            return;
+        }
+        addRelation(std::move(rel));
+    }
+
+    for (std::size_t i = 0; i < header.sectionCount; ++i) {
+        const auto sectionData = cursor.take<SnapshotSection>(1);
+        if (!sectionData) {
+            m_error = u"Snapshot section truncated."_s;
+            return;
+        }
+        const auto section = readAt<SnapshotSection>(sectionData, 0);
+        const auto content = reinterpret_cast<const char*>(cursor.take<char>(section.size));
+        cursor.skipPadding();
+        if (!content) {
+            m_error = u"Snapshot section truncated."_s;
+            return;
+        }
+        m_sections.emplace_back(section.id, m_dataMemOpt == StringMemory::Persistent
+            ? QByteArray::fromRawData(content, (qsizetype)section.size)
+            : QByteArray(content, (qsizetype)section.size));
+    }
+}
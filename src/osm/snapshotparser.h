@@ -0,0 +1,45 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef OSM_SNAPSHOTPARSER_H
+#define OSM_SNAPSHOTPARSER_H
+
+#include "kosm_export.h"
+#include "abstractreader.h"
+
+#include <QByteArray>
+
+#include <cstdint>
+#include <vector>
+
+namespace OSM {
+
+/** Parser for the binary snapshot format.
+ *  Snapshots need no decoding, so loading them is mostly bounded by allocating the elements.
+ *  Those are still materialized individually, as OSM::DataSet owns its elements.
+ *  When reading persistent memory-mapped data, tag keys, roles and values refer to that directly.
+ *  @see snapshot.h
+ */
+class KOSM_EXPORT SnapshotParser : public AbstractReader
+{
+public:
+    explicit SnapshotParser(DataSet *dataSet);
+
+    /** Content of the extension section @p id of the last read snapshot.
+     *  In case of persistent data this refers to the read data directly.
+     *  @returns a null byte array if there is no such section.
+     *  @see SnapshotWriter::addSection()
+     */
+    [[nodiscard]] QByteArray section(uint32_t id) const;
+
+private:
+    void readFromData(const uint8_t *data, std::size_t len) override;
+
+    std::vector<std::pair<uint32_t, QByteArray>> m_sections;
+};
+
+}
+
+#endif // OSM_SNAPSHOTPARSER_H
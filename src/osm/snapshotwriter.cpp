@@ -0,0 +1,244 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "snapshotwriter.h"
+#include "snapshot.h"
+#include "datatypes.h"
+
+#include <QHash>
+#include <QIODevice>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+
+using namespace Qt::Literals::StringLiterals;
+using namespace OSM;
+
+namespace {
+constexpr inline std::size_t KeyAlignment = 4;
+
+/** Collects the string table and the key, role and value tables. */
+class SnapshotStringTables
+{
+public:
+    [[nodiscard]] uint32_t addString(const char *s, std::size_t len, std::size_t alignment = 1)
+    {
+        while (strings.size() % alignment) {
+            strings.append('\0');
+        }
+        const auto offset = (uint32_t)strings.size();
+        strings.append(s, (qsizetype)len);
+        strings.append('\0');
+        return offset;
+    }
+
+    /** Keys and roles are unique per DataSet, so we can deduplicate by pointer.
+     *  Those are aligned so they can be used in place with tagged pointers (see Member).
+     *  Keys are numbered and stored in address order, so tags sorted by key in the source
+     *  data set remain sorted when their keys are used in place on loading.
+     */
+    void addKeys(std::vector<const char*> &&keyNames, std::unordered_map<const char*, uint32_t> &map, std::vector<uint32_t> &table)
+    {
+        std::sort(keyNames.begin(), keyNames.end(), std::less<>());
+        keyNames.erase(std::unique(keyNames.begin(), keyNames.end()), keyNames.end());
+        table.reserve(keyNames.size());
+        for (const auto key : keyNames) {
+            map.emplace(key, (uint32_t)table.size());
+            table.push_back(addString(key, std::strlen(key), KeyAlignment));
+        }
+    }
+
+    [[nodiscard]] static uint32_t keyIndex(const char *key, const std::unordered_map<const char*, uint32_t> &map)
+    {
+        return key ? (*map.find(key)).second : SNAPSHOT_NULL_STRING;
+    }
+
+    [[nodiscard]] uint32_t addValue(const QByteArray &value)
+    {
+        const auto it = valueMap.constFind(value);
+        if (it != valueMap.constEnd()) {
+            return it.value();
+        }
+        const auto idx = (uint32_t)values.size();
+        values.push_back({ addString(value.constData(), value.size()), (uint32_t)value.size() });
+        valueMap.insert(value, idx);
+        return idx;
+    }
+
+    QByteArray strings;
+    std::vector<uint32_t> keys;
+    std::vector<uint32_t> roles;
+    std::vector<SnapshotValue> values;
+    std::unordered_map<const char*, uint32_t> keyMap;
+    std::unordered_map<const char*, uint32_t> roleMap;
+    QHash<QByteArray, uint32_t> valueMap;
+};
+}
+
+template <typename T>
+static void writeArray(const std::vector<T> &data, QIODevice *io)
+{
+    io->write(reinterpret_cast<const char*>(data.data()), (qint64)(data.size() * sizeof(T)));
+}
+
+/** Pad a section of @p size bytes to the next 8 byte boundary.
+ *  This doesn't use QIODevice::pos(), as that doesn't work for sequential devices.
+ */
+static void writePadding(std::size_t size, QIODevice *io)
+{
+    static constexpr const char padding[8] = {};
+    if (const auto rest = size % 8; rest != 0) {
+        io->write(padding, (qint64)(8 - rest));
+    }
+}
+
+template <typename Elem>
+static void addTags(const Elem &elem, uint32_t &tagBegin, uint32_t &tagCount, SnapshotStringTables &strings, std::vector<SnapshotTag> &tags)
+{
+    tagBegin = (uint32_t)tags.size();
+    tagCount = (uint32_t)elem.tags.size();
+    for (const auto &tag : elem.tags) {
+        tags.push_back({ SnapshotStringTables::keyIndex(tag.key.name(), strings.keyMap), strings.addValue(tag.value) });
+    }
+}
+
+static void writeBoundingBox(BoundingBox bbox, uint32_t out[4])
+{
+    out[0] = bbox.min.latitude;
+    out[1] = bbox.min.longitude;
+    out[2] = bbox.max.latitude;
+    out[3] = bbox.max.longitude;
+}
+
+void SnapshotWriter::addSection(uint32_t id, const QByteArray &data)
+{
+    m_sections.emplace_back(id, data);
+}
+
+void SnapshotWriter::writeToIODevice(const OSM::DataSet &dataSet, QIODevice *io)
+{
+    SnapshotStringTables strings;
+    std::vector<const char*> keyNames;
+    std::vector<const char*> roleNames;
+    const auto collectKeys = [&keyNames](const auto &elems) {
+        for (const auto &elem : elems) {
+            for (const auto &tag : elem.tags) {
+                if (tag.key.name()) {
+                    keyNames.push_back(tag.key.name());
+                }
+            }
+        }
+    };
+    collectKeys(dataSet.nodes);
+    collectKeys(dataSet.ways);
+    collectKeys(dataSet.relations);
+    for (const auto &rel : dataSet.relations) {
+        for (const auto &mem : rel.members) {
+            if (mem.role().name()) {
+                roleNames.push_back(mem.role().name());
+            }
+        }
+    }
+    strings.addKeys(std::move(keyNames), strings.keyMap, strings.keys);
+    strings.addKeys(std::move(roleNames), strings.roleMap, strings.roles);
+
+    std::vector<SnapshotTag> tags;
+
+    std::vector<SnapshotNode> nodes;
+    nodes.reserve(dataSet.nodes.size());
+    for (const auto &node : dataSet.nodes) {
+        SnapshotNode n{};
+        n.id = node.id;
+        n.latitude = node.coordinate.latitude;
+        n.longitude = node.coordinate.longitude;
+        addTags(node, n.tagBegin, n.tagCount, strings, tags);
+        nodes.push_back(n);
+    }
+
+    std::vector<SnapshotWay> ways;
+    ways.reserve(dataSet.ways.size());
+    std::vector<Id> wayNodes;
+    for (const auto &way : dataSet.ways) {
+        SnapshotWay w{};
+        w.id = way.id;
+        writeBoundingBox(way.bbox, w.bbox);
+        w.nodeBegin = (uint32_t)wayNodes.size();
+        w.nodeCount = (uint32_t)way.nodes.size();
+        wayNodes.insert(wayNodes.end(), way.nodes.begin(), way.nodes.end());
+        addTags(way, w.tagBegin, w.tagCount, strings, tags);
+        ways.push_back(w);
+    }
+
+    std::vector<SnapshotRelation> relations;
+    relations.reserve(dataSet.relations.size());
+    std::vector<SnapshotMember> members;
+    for (const auto &rel : dataSet.relations) {
+        SnapshotRelation r{};
+        r.id = rel.id;
+        writeBoundingBox(rel.bbox, r.bbox);
+        r.memberBegin = (uint32_t)members.size();
+        r.memberCount = (uint32_t)rel.members.size();
+        for (const auto &mem : rel.members) {
+            SnapshotMember m{};
+            m.id = mem.id;
+            m.role = SnapshotStringTables::keyIndex(mem.role().name(), strings.roleMap);
+            m.type = static_cast<uint8_t>(mem.type());
+            members.push_back(m);
+        }
+        addTags(rel, r.tagBegin, r.tagCount, strings, tags);
+        relations.push_back(r);
+    }
+
+    if ((std::size_t)strings.strings.size() >= SNAPSHOT_NULL_STRING || tags.size() >= SNAPSHOT_NULL_STRING
+     || wayNodes.size() >= SNAPSHOT_NULL_STRING || members.size() >= SNAPSHOT_NULL_STRING) {
+        m_error = u"Data set too large for a snapshot."_s;
+        m_sections.clear();
+        return;
+    }
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrderMark = SNAPSHOT_BYTE_ORDER_MARK;
+    header.stringTableSize = (uint64_t)strings.strings.size();
+    header.keyCount = strings.keys.size();
+    header.roleCount = strings.roles.size();
+    header.valueCount = strings.values.size();
+    header.tagCount = tags.size();
+    header.nodeCount = nodes.size();
+    header.wayCount = ways.size();
+    header.wayNodeCount = wayNodes.size();
+    header.relationCount = relations.size();
+    header.memberCount = members.size();
+    header.sectionCount = m_sections.size();
+    io->write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    static_assert(sizeof(SnapshotHeader) % 8 == 0);
+    io->write(strings.strings);
+    writePadding(strings.strings.size(), io);
+    writeArray(strings.keys, io);
+    writePadding(strings.keys.size() * sizeof(uint32_t), io);
+    writeArray(strings.roles, io);
+    writePadding(strings.roles.size() * sizeof(uint32_t), io);
+    writeArray(strings.values, io);
+    writeArray(tags, io);
+    writeArray(nodes, io);
+    writeArray(ways, io);
+    writeArray(wayNodes, io);
+    writeArray(relations, io);
+    writeArray(members, io);
+
+    for (const auto &[id, data] : m_sections) {
+        SnapshotSection section{};
+        section.id = id;
+        section.size = (uint64_t)data.size();
+        io->write(reinterpret_cast<const char*>(&section), sizeof(section));
+        io->write(data);
+        writePadding(data.size(), io);
+    }
+    m_sections.clear();
+}
@@ -0,0 +1,38 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef OSM_SNAPSHOTWRITER_H
+#define OSM_SNAPSHOTWRITER_H
+
+#include "kosm_export.h"
+#include "abstractwriter.h"
+
+#include <QByteArray>
+
+#include <cstdint>
+#include <vector>
+
+namespace OSM {
+
+/** Serialize an OSM::DataSet into the binary snapshot format.
+ *  @see snapshot.h
+ */
+class KOSM_EXPORT SnapshotWriter : public OSM::AbstractWriter
+{
+public:
+    /** Add an extension section with application-specific @p data to the next written snapshot.
+     *  @see SnapshotParser::section()
+     */
+    void addSection(uint32_t id, const QByteArray &data);
+
+private:
+    void writeToIODevice(const OSM::DataSet &dataSet, QIODevice *io) override;
+
+    std::vector<std::pair<uint32_t, QByteArray>> m_sections;
+};
+
+}
+
+#endif // OSM_SNAPSHOTWRITER_H
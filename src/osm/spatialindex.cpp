@@ -0,0 +1,160 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "spatialindex.h"
+#include "geomath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <tuple>
+
+using namespace OSM;
+
+enum {
+    NodeSize = 16,
+};
+
+SpatialIndex::SpatialIndex() = default;
+SpatialIndex::SpatialIndex(const SpatialIndex&) = default;
+SpatialIndex::SpatialIndex(SpatialIndex&&) noexcept = default;
+SpatialIndex::~SpatialIndex() = default;
+SpatialIndex& SpatialIndex::operator=(const SpatialIndex&) = default;
+SpatialIndex& SpatialIndex::operator=(SpatialIndex&&) noexcept = default;
+
+void SpatialIndex::build(const std::vector<BoundingBox> &boxes)
+{
+    clear();
+
+    // sort leaves along the z-order curve, so nearby items end up in the same tree nodes
+    std::vector<std::pair<uint64_t, uint32_t>> items;
+    items.reserve(boxes.size());
+    for (std::size_t i = 0; i < boxes.size(); ++i) {
+        if (boxes[i].isValid()) {
+            items.emplace_back(boxes[i].center().z(), (uint32_t)i);
+        }
+    }
+    if (items.empty()) {
+        return;
+    }
+    std::sort(items.begin(), items.end());
+
+    m_boxes.reserve(items.size() + items.size() / (NodeSize - 1) + 1);
+    m_indices.reserve(m_boxes.capacity());
+    for (const auto &item : items) {
+        m_boxes.push_back(boxes[item.second]);
+        m_indices.push_back(item.second);
+    }
+    m_levelEnds.push_back(m_boxes.size());
+
+    // pack NodeSize nodes of each level into one parent node, until only the root is left
+    std::size_t levelBegin = 0;
+    while (m_boxes.size() - levelBegin > 1) {
+        const auto levelEnd = m_boxes.size();
+        for (auto i = levelBegin; i < levelEnd; i += NodeSize) {
+            BoundingBox bbox;
+            for (auto j = i; j < std::min<std::size_t>(i + NodeSize, levelEnd); ++j) {
+                bbox = OSM::unite(bbox, m_boxes[j]);
+            }
+            m_boxes.push_back(bbox);
+            m_indices.push_back((uint32_t)i);
+        }
+        levelBegin = levelEnd;
+        m_levelEnds.push_back(m_boxes.size());
+    }
+}
+
+void SpatialIndex::clear()
+{
+    m_boxes.clear();
+    m_indices.clear();
+    m_levelEnds.clear();
+}
+
+bool SpatialIndex::isEmpty() const
+{
+    return m_boxes.empty();
+}
+
+std::size_t SpatialIndex::size() const
+{
+    return m_levelEnds.empty() ? 0 : m_levelEnds.front();
+}
+
+std::size_t SpatialIndex::memoryUsage() const
+{
+    return m_boxes.capacity() * sizeof(BoundingBox) + m_indices.capacity() * sizeof(uint32_t) + m_levelEnds.capacity() * sizeof(std::size_t);
+}
+
+std::vector<uint32_t> SpatialIndex::query(BoundingBox bbox) const
+{
+    std::vector<uint32_t> result;
+    if (m_boxes.empty()) {
+        return result;
+    }
+
+    // node position and tree level
+    std::vector<std::pair<std::size_t, std::size_t>> stack;
+    stack.emplace_back(m_boxes.size() - 1, m_levelEnds.size() - 1);
+    while (!stack.empty()) {
+        const auto [pos, level] = stack.back();
+        stack.pop_back();
+        if (!OSM::intersects(bbox, m_boxes[pos])) {
+            continue;
+        }
+        if (level == 0) {
+            result.push_back(m_indices[pos]);
+            continue;
+        }
+        const auto childEnd = std::min<std::size_t>(m_indices[pos] + NodeSize, m_levelEnds[level - 1]);
+        for (std::size_t child = m_indices[pos]; child < childEnd; ++child) {
+            stack.emplace_back(child, level - 1);
+        }
+    }
+
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+/** Squared distance between @p coord and @p bbox, with longitude scaled by @p lonScale. */
+[[nodiscard]] static double distanceSquared(Coordinate coord, BoundingBox bbox, double lonScale)
+{
+    const auto axisDistance = [](double value, double min, double max) {
+        return value < min ? min - value : value > max ? value - max : 0.0;
+    };
+    const auto dlat = axisDistance(coord.latitude, bbox.min.latitude, bbox.max.latitude);
+    const auto dlon = axisDistance(coord.longitude, bbox.min.longitude, bbox.max.longitude) * lonScale;
+    return dlat * dlat + dlon * dlon;
+}
+
+std::vector<uint32_t> SpatialIndex::nearest(Coordinate coord, std::size_t count) const
+{
+    std::vector<uint32_t> result;
+    if (m_boxes.empty() || count == 0) {
+        return result;
+    }
+
+    // account for meridians converging towards the poles
+    const auto lonScale = std::cos(OSM::degToRad(coord.latF()));
+
+    // best-first search, a leaf reaching the top of the queue is closer than anything left in there
+    using Entry = std::tuple<double, std::size_t, std::size_t>; // distance, node position, tree level
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+    queue.emplace(distanceSquared(coord, m_boxes.back(), lonScale), m_boxes.size() - 1, m_levelEnds.size() - 1);
+    while (!queue.empty() && result.size() < count) {
+        const auto [dist, pos, level] = queue.top();
+        queue.pop();
+        if (level == 0) {
+            result.push_back(m_indices[pos]);
+            continue;
+        }
+        const auto childEnd = std::min<std::size_t>(m_indices[pos] + NodeSize, m_levelEnds[level - 1]);
+        for (std::size_t child = m_indices[pos]; child < childEnd; ++child) {
+            queue.emplace(distanceSquared(coord, m_boxes[child], lonScale), child, level - 1);
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,64 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef OSM_SPATIALINDEX_H
+#define OSM_SPATIALINDEX_H
+
+#include "kosm_export.h"
+#include "datatypes.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace OSM {
+
+/** Static spatial index over bounding boxes.
+ *  This is a packed R-tree with the leaves ordered along the z-order curve
+ *  (see OSM::ZTile), built once for a given set of bounding boxes.
+ *  Items are referred to by their position in the input passed to build().
+ */
+class KOSM_EXPORT SpatialIndex
+{
+public:
+    explicit SpatialIndex();
+    SpatialIndex(const SpatialIndex&);
+    SpatialIndex(SpatialIndex&&) noexcept;
+    ~SpatialIndex();
+    SpatialIndex& operator=(const SpatialIndex&);
+    SpatialIndex& operator=(SpatialIndex&&) noexcept;
+
+    /** Build the index for @p boxes, replacing any previous content.
+     *  Items with an invalid bounding box are not indexed.
+     */
+    void build(const std::vector<BoundingBox> &boxes);
+    /** Remove all items. */
+    void clear();
+
+    [[nodiscard]] bool isEmpty() const;
+    /** Number of indexed items. */
+    [[nodiscard]] std::size_t size() const;
+    /** Heap memory used by the index, in bytes. */
+    [[nodiscard]] std::size_t memoryUsage() const;
+
+    /** Positions of all items intersecting @p bbox, in ascending order. */
+    [[nodiscard]] std::vector<uint32_t> query(BoundingBox bbox) const;
+
+    /** Positions of up to @p count items closest to @p coord, by increasing distance.
+     *  The distance is measured to the item bounding box, and is zero for items containing @p coord.
+     */
+    [[nodiscard]] std::vector<uint32_t> nearest(Coordinate coord, std::size_t count = 1) const;
+
+private:
+    // tree nodes of all levels, leaves first and the root last
+    std::vector<BoundingBox> m_boxes;
+    // item position for leaves, position of the first child node otherwise
+    std::vector<uint32_t> m_indices;
+    // end position of each tree level in m_boxes
+    std::vector<std::size_t> m_levelEnds;
+};
+
+}
+
+#endif // OSM_SPATIALINDEX_H
@@ -7,46 +7,168 @@
 #include "stringpool.h"
 
 #include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <utility>
+
+enum {
+    ArenaBlockSize = 16384,
+    MinSlotCount = 64,
+};
+
+static std::size_t hashKey(const char *name, std::size_t len)
+{
+    // FNV-1a
+    uint64_t h = 14695981039346656037ull;
+    for (std::size_t i = 0; i < len; ++i) {
+        h ^= (uint8_t)name[i];
+        h *= 1099511628211ull;
+    }
+    return (std::size_t)h;
+}
 
 OSM::StringKeyRegistryBase::StringKeyRegistryBase() = default;
-OSM::StringKeyRegistryBase::StringKeyRegistryBase(OSM::StringKeyRegistryBase&&) noexcept = default;
-OSM::StringKeyRegistryBase& OSM::StringKeyRegistryBase::operator=(OSM::StringKeyRegistryBase&&) noexcept = default;
+
+OSM::StringKeyRegistryBase::StringKeyRegistryBase(OSM::StringKeyRegistryBase &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+OSM::StringKeyRegistryBase& OSM::StringKeyRegistryBase::operator=(OSM::StringKeyRegistryBase &&other) noexcept
+{
+    // swap, so the arena of this instance is released by other
+    std::swap(m_pool, other.m_pool);
+    std::swap(m_arenaNext, other.m_arenaNext);
+    std::swap(m_arenaFree, other.m_arenaFree);
+    std::swap(m_allocatedSize, other.m_allocatedSize);
+    std::swap(m_slots, other.m_slots);
+    std::swap(m_keyCount, other.m_keyCount);
+    return *this;
+}
 
 OSM::StringKeyRegistryBase::~StringKeyRegistryBase()
 {
     std::for_each(m_pool.begin(), m_pool.end(), free);
 }
 
-const char* OSM::StringKeyRegistryBase::makeKeyInternal(const char *name, std::size_t len, OSM::StringMemory memOpt)
-{
-    const auto it = std::lower_bound(m_registry.begin(), m_registry.end(), name, [len](const char *lhs, const char *rhs) {
-        return std::strncmp(lhs, rhs, len) < 0;
-    });
-    if (it == m_registry.end() || std::strncmp((*it), name, len) != 0 || std::strlen(*it) != len) {
-        if (memOpt == OSM::StringMemory::Transient) {
-#ifndef _MSC_VER
-            auto s = strndup(name, len);
-#else
-            auto s = static_cast<char*>(malloc(len + 1));
-            std::strncpy(s, name, len);
-            s[len] = '\0';
-#endif
-            m_pool.push_back(s);
-            name = s;
+std::size_t OSM::StringKeyRegistryBase::findSlot(const char *name, std::size_t len, std::size_t hash) const
+{
+    const auto mask = m_slots.size() - 1;
+    for (auto i = hash & mask;; i = (i + 1) & mask) {
+        const auto &slot = m_slots[i];
+        if (!slot.key || (slot.hash == hash && std::strncmp(slot.key, name, len) == 0 && slot.key[len] == '\0')) {
+            return i;
+        }
+    }
+}
+
+void OSM::StringKeyRegistryBase::rehash(std::size_t slotCount)
+{
+    std::vector<Slot> slots(slotCount);
+    std::swap(slots, m_slots);
+    const auto mask = m_slots.size() - 1;
+    for (const auto &slot : slots) {
+        if (!slot.key) {
+            continue;
+        }
+        auto i = slot.hash & mask;
+        while (m_slots[i].key) {
+            i = (i + 1) & mask;
+        }
+        m_slots[i] = slot;
+    }
+}
+
+const char* OSM::StringKeyRegistryBase::copyToArena(const char *name, std::size_t len, std::size_t alignment)
+{
+    char *s = nullptr;
+    if (len + 1 > ArenaBlockSize / 4) {
+        // large strings get their own allocation, to not waste the remainder of the current block
+        s = static_cast<char*>(malloc(len + 1));
+        m_pool.push_back(s);
+        m_allocatedSize += len + 1;
+    } else {
+        auto padding = (alignment - reinterpret_cast<std::uintptr_t>(m_arenaNext) % alignment) % alignment;
+        if (m_arenaFree < len + 1 + padding) {
+            m_arenaNext = static_cast<char*>(malloc(ArenaBlockSize));
+            m_arenaFree = ArenaBlockSize;
+            m_pool.push_back(m_arenaNext);
+            m_allocatedSize += ArenaBlockSize;
+            padding = 0;
         }
-        m_registry.insert(it, name);
-        return name;
+        s = m_arenaNext + padding;
+        m_arenaNext += padding + len + 1;
+        m_arenaFree -= padding + len + 1;
     }
-    return (*it);
+    std::memcpy(s, name, len);
+    s[len] = '\0';
+    return s;
+}
+
+const char* OSM::StringKeyRegistryBase::makeKeyInternal(const char *name, std::size_t len, OSM::StringMemory memOpt, std::size_t alignment)
+{
+    // keep the load factor below 50%, so probe sequences remain short
+    if ((m_keyCount + 1) * 2 > m_slots.size()) {
+        rehash(std::max<std::size_t>(MinSlotCount, m_slots.size() * 2));
+    }
+
+    const auto hash = hashKey(name, len);
+    auto &slot = m_slots[findSlot(name, len, hash)];
+    if (slot.key) {
+        return slot.key;
+    }
+
+    // persistent strings we can only refer to directly if they are suitably aligned
+    const auto isAligned = reinterpret_cast<std::uintptr_t>(name) % alignment == 0;
+    slot.key = memOpt == OSM::StringMemory::Persistent && isAligned ? name : copyToArena(name, len, alignment);
+    slot.hash = hash;
+    ++m_keyCount;
+    return slot.key;
 }
 
 const char* OSM::StringKeyRegistryBase::keyInternal(const char *name) const
 {
-    const auto it = std::lower_bound(m_registry.begin(), m_registry.end(), name, [](const char *lhs, const char *rhs) {
-        return std::strcmp(lhs, rhs) < 0;
-    });
-    if (it == m_registry.end() || std::strcmp((*it), name) != 0) {
+    if (m_slots.empty()) {
         return {};
     }
-    return (*it);
+    const auto len = std::strlen(name);
+    return m_slots[findSlot(name, len, hashKey(name, len))].key;
+}
+
+std::size_t OSM::StringKeyRegistryBase::memoryUsage() const
+{
+    return m_slots.capacity() * sizeof(Slot) + m_pool.capacity() * sizeof(char*) + m_allocatedSize;
+}
+
+OSM::StringValueRegistry::StringValueRegistry() = default;
+OSM::StringValueRegistry::StringValueRegistry(OSM::StringValueRegistry&&) noexcept = default;
+OSM::StringValueRegistry::~StringValueRegistry() = default;
+OSM::StringValueRegistry& OSM::StringValueRegistry::operator=(OSM::StringValueRegistry&&) noexcept = default;
+
+QByteArray OSM::StringValueRegistry::makeValue(const char *value, std::size_t len, OSM::StringMemory memOpt)
+{
+    const auto rawValue = QByteArray::fromRawData(value, (qsizetype)len);
+    if (len > MaxValueLength) {
+        return memOpt == OSM::StringMemory::Persistent ? rawValue : QByteArray(value, (qsizetype)len);
+    }
+
+    // lookup via the raw data wrapper doesn't allocate
+    if (const auto it = m_values.constFind(rawValue); it != m_values.constEnd()) {
+        return *it;
+    }
+    return *m_values.insert(memOpt == OSM::StringMemory::Persistent ? rawValue : QByteArray(value, (qsizetype)len));
+}
+
+QByteArray OSM::StringValueRegistry::value(const char *value, std::size_t len) const
+{
+    if (const auto it = m_values.constFind(QByteArray::fromRawData(value, (qsizetype)len)); it != m_values.constEnd()) {
+        return *it;
+    }
+    return {};
+}
+
+std::size_t OSM::StringValueRegistry::memoryUsage() const
+{
+    // QHash stores its entries in spans with one byte of offset per bucket
+    return (std::size_t)m_values.capacity() * (sizeof(QByteArray) + 1);
 }
@@ -9,6 +9,9 @@
 
 #include "kosm_export.h"
 
+#include <QByteArray>
+#include <QSet>
+
 #include <cstring>
 #include <vector>
 
@@ -25,11 +28,29 @@ protected:
     StringKeyRegistryBase& operator=(StringKeyRegistryBase&&) noexcept;
     ~StringKeyRegistryBase();
 
-    [[nodiscard]] const char* makeKeyInternal(const char *name, std::size_t len, StringMemory memOpt);
+    [[nodiscard]] const char* makeKeyInternal(const char *name, std::size_t len, StringMemory memOpt, std::size_t alignment);
     [[nodiscard]] const char* keyInternal(const char *name) const;
 
+    /** Heap memory used by the hash table and key copies, in bytes. */
+    [[nodiscard]] std::size_t memoryUsage() const;
+
+private:
+    struct Slot {
+        const char *key = nullptr;
+        std::size_t hash = 0;
+    };
+    [[nodiscard]] std::size_t findSlot(const char *name, std::size_t len, std::size_t hash) const;
+    void rehash(std::size_t slotCount);
+    [[nodiscard]] const char* copyToArena(const char *name, std::size_t len, std::size_t alignment);
+
+    // arena blocks for transient key strings, never moved once allocated
     std::vector<char*> m_pool;
-    std::vector<const char*> m_registry;
+    char *m_arenaNext = nullptr;
+    std::size_t m_arenaFree = 0;
+    std::size_t m_allocatedSize = 0;
+    // open addressing hash table, power of two sized
+    std::vector<Slot> m_slots;
+    std::size_t m_keyCount = 0;
 };
 
 /** Registry of unique string keys.
@@ -46,6 +67,8 @@ public:
     StringKeyRegistry& operator=(const StringKeyRegistry&) = delete;
     StringKeyRegistry& operator=(StringKeyRegistry&&) = default;
 
+    using StringKeyRegistryBase::memoryUsage;
+
     /** Add a new string to the registry if needed, or returns an existing one if already present. */
     inline T makeKey(const char *name, StringMemory memOpt)
     {
@@ -54,7 +77,7 @@ public:
     inline T makeKey(const char *name, std::size_t len, StringMemory memOpt)
     {
         T key;
-        key.key = makeKeyInternal(name, len, memOpt);
+        key.key = makeKeyInternal(name, len, memOpt, T::Alignment);
         return key;
     }
 
@@ -67,6 +90,41 @@ public:
     }
 };
 
+/** Registry of deduplicated string values.
+ *  Short values are stored only once, so equal values returned from here
+ *  share the same memory and can be compared by pointer.
+ */
+class KOSM_EXPORT StringValueRegistry
+{
+public:
+    explicit StringValueRegistry();
+    StringValueRegistry(const StringValueRegistry&) = delete;
+    StringValueRegistry(StringValueRegistry&&) noexcept;
+    ~StringValueRegistry();
+    StringValueRegistry& operator=(const StringValueRegistry&) = delete;
+    StringValueRegistry& operator=(StringValueRegistry&&) noexcept;
+
+    /** Values longer than this are not deduplicated, those rarely repeat. */
+    static constexpr std::size_t MaxValueLength = 32;
+
+    /** Returns the existing value equal to @p value, or adds a new one.
+     *  @param memOpt specifies whether @p value outlives this registry and thus can
+     *  be referenced without copying it.
+     */
+    [[nodiscard]] QByteArray makeValue(const char *value, std::size_t len, StringMemory memOpt);
+
+    /** Looks up an existing value, returns a null value if not present. */
+    [[nodiscard]] QByteArray value(const char *value, std::size_t len) const;
+
+    /** Heap memory used by the hash table, in bytes.
+     *  This doesn't include the value payloads, those are shared with the tags using them.
+     */
+    [[nodiscard]] std::size_t memoryUsage() const;
+
+private:
+    QSet<QByteArray> m_values;
+};
+
 /** Base class for unique string keys. */
 class StringKey
 {
@@ -75,6 +133,9 @@ public:
     constexpr inline const char* name() const { return key; }
     constexpr inline bool isNull() const { return !key; }
 
+    /** Required alignment of the key data. */
+    static constexpr std::size_t Alignment = 1;
+
     // yes, pointer compare is enough here
     inline constexpr bool operator<(StringKey other) const { return key < other.key; }
     inline constexpr bool operator==(StringKey other) const { return key == other.key; }
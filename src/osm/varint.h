@@ -0,0 +1,188 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef OSM_VARINT_H
+#define OSM_VARINT_H
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/** @file varint.h
+ *  Decoding of variable-length integers (LEB128) as used by o5m and protobuf.
+ */
+
+namespace OSM {
+
+namespace Varint {
+
+/** Decodes a zigzag-encoded signed value. */
+[[nodiscard]] constexpr inline int64_t zigzagDecode(uint64_t u)
+{
+    return (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+}
+
+/** Extracts the 7 bit groups of a value of @p len bytes in the little-endian @p word. */
+[[nodiscard]] inline uint64_t compact(uint64_t word, int len)
+{
+    word &= ~0ull >> (64 - len * 8);
+#if defined(__BMI2__)
+    return _pext_u64(word, 0x7f7f7f7f7f7f7f7full);
+#else
+    word &= 0x7f7f7f7f7f7f7f7full;
+    word = ((word & 0x7f007f007f007f00ull) >> 1) | (word & 0x007f007f007f007full);
+    word = ((word & 0x3fff00003fff0000ull) >> 2) | (word & 0x00003fff00003fffull);
+    word = ((word & 0x0fffffff00000000ull) >> 4) | (word & 0x000000000fffffffull);
+    return word;
+#endif
+}
+
+/** Decodes a single unsigned value and advances @p it past it.
+ *  This never reads beyond @p end, truncated values are returned as far as available.
+ */
+[[nodiscard]] inline uint64_t readUnsigned(const uint8_t *&it, const uint8_t *end)
+{
+    if constexpr (std::endian::native == std::endian::little) {
+        // up to 8 bytes (56 bits) without branching on every single byte
+        if (end - it >= 8) {
+            uint64_t word;
+            std::memcpy(&word, it, sizeof(word));
+            if (const auto stopBits = ~word & 0x8080808080808080ull) {
+                const auto len = (std::countr_zero(stopBits) >> 3) + 1;
+                it += len;
+                return compact(word, len);
+            }
+        }
+    }
+
+    uint64_t result = 0;
+    for (int shift = 0; it < end && shift < 64; shift += 7) {
+        const auto b = *it++;
+        result |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            break;
+        }
+    }
+    return result;
+}
+
+/** Continuation bits of the next 16 bytes, one bit per byte. */
+[[nodiscard]] inline uint32_t continuationMask(const uint8_t *it)
+{
+#if defined(__SSE2__)
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(it)));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    static constexpr const uint8_t weights[] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    const auto bits = vmulq_u8(vshrq_n_u8(vld1q_u8(it), 7), vld1q_u8(weights));
+    return vaddv_u8(vget_low_u8(bits)) | ((uint32_t)vaddv_u8(vget_high_u8(bits)) << 8);
+#else
+    uint64_t w[2];
+    std::memcpy(w, it, sizeof(w));
+    const auto mask = [](uint64_t x) {
+        return (uint32_t)((((x >> 7) & 0x0101010101010101ull) * 0x0102040810204080ull) >> 56);
+    };
+    return mask(w[0]) | (mask(w[1]) << 8);
+#endif
+}
+
+/** Decodes all values between @p it and @p end into @p out.
+ *  @p out needs room for up to @c end - @c it values.
+ *  @tparam ZigZag decode signed values
+ *  @tparam Delta values are delta-encoded, continuing from @p state.
+ *  @returns the number of decoded values.
+ */
+template <bool ZigZag, bool Delta, typename T>
+inline std::size_t decode(const uint8_t *it, const uint8_t *end, T *out, T &deltaState)
+{
+    // wraps around on invalid input rather than overflowing
+    const auto add = [](T lhs, T rhs) {
+        return (T)((std::make_unsigned_t<T>)lhs + (std::make_unsigned_t<T>)rhs);
+    };
+    // local copy, as @p out could alias @p deltaState otherwise
+    auto state = deltaState;
+    const auto emit = [&](T *&outIt, uint64_t u) {
+        T value;
+        if constexpr (ZigZag) {
+            value = (T)zigzagDecode(u);
+        } else {
+            value = (T)u;
+        }
+        if constexpr (Delta) {
+            state = add(state, value);
+            value = state;
+        }
+        *outIt++ = value;
+    };
+
+    auto outIt = out;
+    if constexpr (std::endian::native == std::endian::little) {
+        // 16 byte windows, locating all values in a window at once from its continuation bits
+        // avoids the dependency of each value's position on the length of the previous one
+        // the last value in a window can extend 8 bytes beyond it
+        while (end - it >= 24) {
+            const auto mask = continuationMask(it);
+            if (mask == 0) {
+                // only single byte values, typical for small deltas in way node lists or sorted ids
+                for (int i = 0; i < 16; ++i) {
+                    emit(outIt, it[i]);
+                }
+                it += 16;
+                continue;
+            }
+
+            int start = 0;
+            for (auto stops = ~mask & 0xffff; stops; stops &= stops - 1) {
+                const auto stop = std::countr_zero(stops);
+                if (stop - start >= 8) { // more than 56 bits
+                    break;
+                }
+                uint64_t word;
+                std::memcpy(&word, it + start, sizeof(word));
+                emit(outIt, compact(word, stop - start + 1));
+                start = stop + 1;
+            }
+            if (start == 0) {
+                emit(outIt, readUnsigned(it, end));
+            }
+            it += start;
+        }
+    }
+
+    while (it < end) {
+        emit(outIt, readUnsigned(it, end));
+    }
+    deltaState = state;
+    return outIt - out;
+}
+
+/** Decodes delta- and zigzag-encoded values, see decode(). */
+template <typename T>
+inline std::size_t decodeDeltaZigZag(const uint8_t *it, const uint8_t *end, T *out, T &state)
+{
+    return decode<true, true>(it, end, out, state);
+}
+
+/** Decodes plain unsigned values, see decode(). */
+template <typename T>
+inline std::size_t decodeUnsigned(const uint8_t *it, const uint8_t *end, T *out)
+{
+    T state = {};
+    return decode<false, false>(it, end, out, state);
+}
+
+}
+}
+
+#endif
@@ -6,13 +6,13 @@
 
 #include "xmlparser.h"
 #include "datatypes.h"
+#include "xmltokenizer.h"
 
 #include <QDebug>
-#include <QIODevice>
-#include <QXmlStreamReader>
 
-#include <cmath>
+#include <cstring>
 
+using namespace Qt::Literals::StringLiterals;
 using namespace OSM;
 
 XmlParser::XmlParser(DataSet* dataSet)
@@ -20,151 +20,218 @@ XmlParser::XmlParser(DataSet* dataSet)
 {
 }
 
-void XmlParser::readFromIODevice(QIODevice *io)
+void XmlParser::readFromData(const uint8_t *data, std::size_t len)
 {
-    QXmlStreamReader reader(io);
-    while (!reader.atEnd() && !reader.hasError()) {
-        const auto token = reader.readNext();
-        if (token != QXmlStreamReader::StartElement) {
+    readIncremental(data, len, 0, true);
+}
+
+std::size_t XmlParser::readIncremental(const uint8_t *data, std::size_t len, std::size_t offset, bool atEnd)
+{
+    if (offset == 0) {
+        m_depth = 0;
+    }
+
+    const auto begin = reinterpret_cast<const char*>(data);
+    XmlTokenizer tokenizer(begin, begin + len);
+    const auto consumed = parseElements(tokenizer);
+    if (!m_error.isEmpty()) {
+        return len;
+    }
+    if (tokenizer.hasError()) {
+        m_error = tokenizer.errorString();
+        return len;
+    }
+
+    if (atEnd && (m_depth > 0 || std::memchr(consumed, '<', begin + len - consumed))) {
+        m_error = u"Premature end of document."_s;
+    }
+    return consumed - begin;
+}
+
+const char* XmlParser::parseElements(XmlTokenizer &tokenizer)
+{
+    auto consumed = tokenizer.position();
+    while (true) {
+        const auto token = tokenizer.next();
+        if (token == XmlTokenizer::EndOfData || token == XmlTokenizer::Error) {
+            return consumed;
+        }
+        if (token == XmlTokenizer::EndElement) {
+            --m_depth;
+            consumed = tokenizer.position();
             continue;
         }
 
-        if (reader.name() == QLatin1String("node")) {
-            addNode(parseNode(reader));
-        } else if (reader.name() == QLatin1String("way")) {
-            addWay(parseWay(reader));
-        } else if (reader.name() == QLatin1String("relation")) {
-            addRelation(parseRelation(reader));
-        } else if (reader.name() == QLatin1String("remark")) {
-            m_error = reader.readElementText();
-            return;
+        if (tokenizer.name() == "node") {
+            Node node;
+            if (!parseNode(tokenizer, node)) {
+                return consumed;
+            }
+            addNode(std::move(node));
+        } else if (tokenizer.name() == "way") {
+            Way way;
+            if (!parseWay(tokenizer, way)) {
+                return consumed;
+            }
+            addWay(std::move(way));
+        } else if (tokenizer.name() == "relation") {
+            Relation rel;
+            if (!parseRelation(tokenizer, rel)) {
+                return consumed;
+            }
+            addRelation(std::move(rel));
+        } else if (tokenizer.name() == "remark") {
+            QByteArray text;
+            if (!tokenizer.readElementText(text)) {
+                return consumed;
+            }
+            m_error = QString::fromUtf8(text);
+            return consumed;
+        } else if (!tokenizer.isSelfClosing()) {
+            ++m_depth;
         }
+        consumed = tokenizer.position();
     }
+}
 
-    if (reader.hasError()) {
-        m_error = reader.errorString();
+/** Calls @p func for each direct child element of the current element.
+ *  @returns @c false if the input ends before the current element does.
+ */
+template <typename Func>
+[[nodiscard]] static bool forEachChildElement(XmlTokenizer &tokenizer, Func func)
+{
+    if (tokenizer.isSelfClosing()) {
+        return true;
+    }
+    for (int depth = 0;;) {
+        switch (tokenizer.next()) {
+            case XmlTokenizer::StartElement:
+                if (depth == 0) {
+                    func();
+                }
+                depth += tokenizer.isSelfClosing() ? 0 : 1;
+                break;
+            case XmlTokenizer::EndElement:
+                if (depth-- == 0) {
+                    return true;
+                }
+                break;
+            case XmlTokenizer::EndOfData:
+            case XmlTokenizer::Error:
+                return false;
+        }
     }
 }
 
 // parse double coordinate value without actually doing floating point computations
 // this avoids any loss in precision we can other get heret
-uint32_t parseCoordinateValue(QStringView s, int offset)
+[[nodiscard]] static uint32_t parseCoordinateValue(QByteArrayView s, int offset)
 {
-    const auto idx = s.indexOf(QLatin1Char('.'));
-    if (idx < 0) {
-        return s.toUInt() * 10'000'000;
+    const auto isNegative = s.startsWith('-');
+    if (isNegative) {
+        s = s.mid(1);
     }
-    uint32_t result = (uint32_t)(s.left(idx).toInt() + offset) * 10'000'000;
-    const auto decimals = s.mid(idx + 1);
-    if (decimals.size() >= 7) {
-        result += decimals.left(7).toUInt();
-    } else {
-        result += decimals.toUInt() * std::pow(10, 7 - decimals.size());
+    const auto idx = s.indexOf('.');
+    int64_t result = (idx < 0 ? s : s.left(idx)).toLongLong() * 10'000'000;
+    if (idx >= 0) {
+        const auto decimals = s.mid(idx + 1).left(7);
+        auto decimalValue = decimals.toLongLong();
+        for (auto i = decimals.size(); i < 7; ++i) {
+            decimalValue *= 10;
+        }
+        result += decimalValue;
     }
-    return result;
+    return (uint32_t)((isNegative ? -result : result) + offset * 10'000'000ll);
 }
 
-OSM::Node XmlParser::parseNode(QXmlStreamReader &reader) const
+bool XmlParser::parseNode(XmlTokenizer &tokenizer, OSM::Node &node)
 {
-    Node node;
-    node.id = reader.attributes().value(QLatin1String("id")).toLongLong();
-    node.coordinate = Coordinate(parseCoordinateValue(reader.attributes().value(QLatin1String("lat")), 90), parseCoordinateValue(reader.attributes().value(QLatin1String("lon")), 180));
-
-    while (!reader.atEnd() && reader.readNext() != QXmlStreamReader::EndElement) {
-        if (reader.tokenType() != QXmlStreamReader::StartElement) {
-            continue;
-        }
-        if (reader.name() == QLatin1String("tag")) {
-            parseTag(reader, node);
-        }
-        reader.skipCurrentElement();
+    node.id = tokenizer.attribute("id").toLongLong();
+    const auto lat = tokenizer.attribute("lat");
+    const auto lon = tokenizer.attribute("lon");
+    if (!lat.isEmpty() && !lon.isEmpty()) {
+        node.coordinate = Coordinate(parseCoordinateValue(lat, 90), parseCoordinateValue(lon, 180));
     }
 
-    return node;
+    return forEachChildElement(tokenizer, [&]() {
+        if (tokenizer.name() == "tag") {
+            parseTag(tokenizer, node);
+        }
+    });
 }
 
-OSM::Way XmlParser::parseWay(QXmlStreamReader &reader) const
+bool XmlParser::parseWay(XmlTokenizer &tokenizer, OSM::Way &way)
 {
-    Way way;
-    way.id = reader.attributes().value(QLatin1String("id")).toLongLong();
-
-    while (!reader.atEnd() && reader.readNext() != QXmlStreamReader::EndElement) {
-        if (reader.tokenType() != QXmlStreamReader::StartElement) {
-            continue;
-        }
-        if (reader.name() == QLatin1String("nd")) {
-            OSM::Id node;
-            node = reader.attributes().value(QLatin1String("ref")).toLongLong();
-            way.nodes.push_back(node);
-        } else if (reader.name() == QLatin1String("tag")) {
-            parseTagOrBounds(reader, way);
-        } else if (reader.name() == QLatin1String("bounds")) {
-            parseBounds(reader, way);
+    way.id = tokenizer.attribute("id").toLongLong();
+
+    return forEachChildElement(tokenizer, [&]() {
+        if (tokenizer.name() == "nd") {
+            way.nodes.push_back(tokenizer.attribute("ref").toLongLong());
+        } else if (tokenizer.name() == "tag") {
+            parseTagOrBounds(tokenizer, way);
+        } else if (tokenizer.name() == "bounds") {
+            parseBounds(tokenizer, way);
         }
-        reader.skipCurrentElement();
-    }
-
-    return way;
+    });
 }
 
-OSM::Relation XmlParser::parseRelation(QXmlStreamReader &reader) const
+bool XmlParser::parseRelation(XmlTokenizer &tokenizer, OSM::Relation &rel)
 {
-    Relation rel;
-    rel.id = reader.attributes().value(QLatin1String("id")).toLongLong();
-
-    while (!reader.atEnd() && reader.readNext() != QXmlStreamReader::EndElement) {
-        if (reader.tokenType() != QXmlStreamReader::StartElement) {
-            continue;
-        }
-        if (reader.name() == QLatin1String("tag")) {
-            parseTagOrBounds(reader, rel);
-        } else if (reader.name() == QLatin1String("bounds")) { // Overpass style bounding box
-            parseBounds(reader, rel);
-        } else if (reader.name() == QLatin1String("member")) {
+    rel.id = tokenizer.attribute("id").toLongLong();
+
+    return forEachChildElement(tokenizer, [&]() {
+        if (tokenizer.name() == "tag") {
+            parseTagOrBounds(tokenizer, rel);
+        } else if (tokenizer.name() == "bounds") { // Overpass style bounding box
+            parseBounds(tokenizer, rel);
+        } else if (tokenizer.name() == "member") {
             Member member;
-            member.id = reader.attributes().value(QLatin1String("ref")).toLongLong();
-            const auto type = reader.attributes().value(QLatin1String("type"));
-            if (type == QLatin1String("node")) {
+            member.id = tokenizer.attribute("ref").toLongLong();
+            const auto type = tokenizer.attribute("type");
+            if (type == "node") {
                 member.setType(Type::Node);
-            } else if (type == QLatin1String("way")) {
+            } else if (type == "way") {
                 member.setType(Type::Way);
             } else {
                 member.setType(Type::Relation);
             }
-            member.setRole(m_dataSet->makeRole(reader.attributes().value(QLatin1String("role")).toUtf8().constData(), OSM::StringMemory::Transient));
+            const auto role = tokenizer.attribute("role");
+            member.setRole(m_dataSet->makeRole(role.isNull() ? "" : role.data(), role.size()));
             rel.members.push_back(std::move(member));
         }
-        reader.skipCurrentElement();
-    }
-
-    return rel;
+    });
 }
 
 template <typename T>
-void XmlParser::parseTag(QXmlStreamReader &reader, T &elem) const
+void XmlParser::parseTag(const XmlTokenizer &tokenizer, T &elem)
 {
-    const auto key = m_dataSet->makeTagKey(reader.attributes().value(QLatin1String("k")).toString().toUtf8().constData(), OSM::StringMemory::Transient);
-    OSM::setTagValue(elem, key, reader.attributes().value(QLatin1String("v")).toUtf8());
+    const auto key = tokenizer.attribute("k");
+    const auto value = tokenizer.attribute("v");
+    const auto valueData = value.isNull() ? "" : value.data();
+    // the input data remains valid until the element is added, decoded values don't
+    OSM::setTagValue(elem, m_dataSet->makeTagKey(key.isNull() ? "" : key.data(), key.size()), tokenizer.isInputData(value)
+        ? makeTagValue(valueData, value.size(), StringMemory::Transient)
+        : m_dataSet->makeTagValue(valueData, value.size(), StringMemory::Transient));
 }
 
 template <typename T>
-void XmlParser::parseTagOrBounds(QXmlStreamReader &reader, T &elem) const
+void XmlParser::parseTagOrBounds(const XmlTokenizer &tokenizer, T &elem)
 {
-    if (reader.attributes().value(QLatin1String("k")) == QLatin1String("bBox")) { // osmconvert style bounding box
-        const auto v = reader.attributes().value(QLatin1String("v")).split(QLatin1Char(','));
+    if (tokenizer.attribute("k") == "bBox") { // osmconvert style bounding box
+        const auto v = tokenizer.attribute("v").toByteArray().split(',');
         if (v.size() == 4) {
             elem.bbox.min = Coordinate(v[1].toDouble(), v[0].toDouble());
             elem.bbox.max = Coordinate(v[3].toDouble(), v[2].toDouble());
         }
     } else {
-        parseTag(reader, elem);
+        parseTag(tokenizer, elem);
     }
 }
 
 template<typename T>
-void XmlParser::parseBounds(QXmlStreamReader &reader, T &elem) const
+void XmlParser::parseBounds(const XmlTokenizer &tokenizer, T &elem) const
 {
     // overpass style bounding box
-    elem.bbox.min = Coordinate(reader.attributes().value(QLatin1String("minlat")).toDouble(), reader.attributes().value(QLatin1String("minlon")).toDouble());
-    elem.bbox.max = Coordinate(reader.attributes().value(QLatin1String("maxlat")).toDouble(), reader.attributes().value(QLatin1String("maxlon")).toDouble());
+    elem.bbox.min = Coordinate(tokenizer.attribute("minlat").toDouble(), tokenizer.attribute("minlon").toDouble());
+    elem.bbox.max = Coordinate(tokenizer.attribute("maxlat").toDouble(), tokenizer.attribute("maxlon").toDouble());
 }
@@ -11,32 +11,46 @@
 
 #include <QString>
 
-class QIODevice;
-class QXmlStreamReader;
-
 namespace OSM {
 
 class DataSet;
+class XmlTokenizer;
 
+/** Parser for OSM XML data.
+ *  Works on the UTF-8 input directly, and parses incrementally element by element.
+ */
 class XmlParser : public AbstractReader
 {
 public:
     explicit XmlParser(DataSet *dataSet);
 
 protected: // for reuse by the OSC parser
-    [[nodiscard]] OSM::Node parseNode(QXmlStreamReader &reader) const;
-    [[nodiscard]] OSM::Way parseWay(QXmlStreamReader &reader) const;
-    [[nodiscard]] OSM::Relation parseRelation(QXmlStreamReader &reader) const;
+    std::size_t readIncremental(const uint8_t *data, std::size_t len, std::size_t offset, bool atEnd) override;
+
+    /** Parse all complete top-level elements.
+     *  @returns the position up to which the input has been consumed.
+     */
+    [[nodiscard]] virtual const char* parseElements(XmlTokenizer &tokenizer);
+
+    /** Parse the element the tokenizer is currently positioned at.
+     *  @returns @c false if the input ends before the element does.
+     */
+    [[nodiscard]] bool parseNode(XmlTokenizer &tokenizer, OSM::Node &node);
+    [[nodiscard]] bool parseWay(XmlTokenizer &tokenizer, OSM::Way &way);
+    [[nodiscard]] bool parseRelation(XmlTokenizer &tokenizer, OSM::Relation &rel);
+
+    /** Nesting depth of elements not handled by the above. */
+    int m_depth = 0;
 
 private:
-    void readFromIODevice(QIODevice *io) override;
+    void readFromData(const uint8_t *data, std::size_t len) override;
 
     template <typename T>
-    void parseTag(QXmlStreamReader &reader, T &elem) const;
+    void parseTag(const XmlTokenizer &tokenizer, T &elem);
     template <typename T>
-    void parseTagOrBounds(QXmlStreamReader &reader, T&elem) const;
+    void parseTagOrBounds(const XmlTokenizer &tokenizer, T &elem);
     template <typename T>
-    void parseBounds(QXmlStreamReader &reader, T &elem) const;
+    void parseBounds(const XmlTokenizer &tokenizer, T &elem) const;
 };
 
 }
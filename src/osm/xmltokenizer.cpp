@@ -0,0 +1,298 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "xmltokenizer.h"
+
+#include <cstring>
+
+using namespace OSM;
+
+[[nodiscard]] static constexpr inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+[[nodiscard]] static constexpr inline bool isNameEnd(char c)
+{
+    return isSpace(c) || c == '>' || c == '/';
+}
+
+XmlTokenizer::XmlTokenizer(const char *begin, const char *end)
+    : m_begin(begin)
+    , m_end(end)
+    , m_it(begin)
+{
+}
+
+XmlTokenizer::Token XmlTokenizer::next()
+{
+    if (hasError()) {
+        return Error;
+    }
+
+    while (true) {
+        // text content is irrelevant for OSM data
+        const auto lt = static_cast<const char*>(std::memchr(m_it, '<', m_end - m_it));
+        if (!lt) {
+            return EndOfData;
+        }
+        m_it = lt;
+
+        const QByteArrayView rest(lt, m_end);
+        if (rest.size() < 2) {
+            return EndOfData;
+        }
+        if (rest[1] == '/') {
+            return parseEndElement(lt);
+        }
+        if (rest[1] != '!' && rest[1] != '?') {
+            return parseStartElement(lt);
+        }
+
+        bool complete = false;
+        if (rest.startsWith("<!--")) {
+            complete = skipPast("-->");
+        } else if (rest.startsWith("<![CDATA[")) {
+            complete = skipPast("]]>");
+        } else if (rest[1] == '?') {
+            complete = skipPast("?>");
+        } else { // DOCTYPE, OSM data doesn't use internal subsets
+            complete = skipPast(">");
+        }
+        if (!complete) {
+            return EndOfData;
+        }
+    }
+}
+
+XmlTokenizer::Token XmlTokenizer::parseStartElement(const char *it)
+{
+    auto p = it + 1;
+    while (p < m_end && !isNameEnd(*p)) {
+        ++p;
+    }
+    if (p == m_end) {
+        return EndOfData;
+    }
+    m_name = QByteArrayView(it + 1, p);
+    if (m_name.isEmpty()) {
+        return setError("Invalid element name.");
+    }
+
+    m_attributes.clear();
+    m_decoded.clear();
+    while (true) {
+        while (p < m_end && isSpace(*p)) {
+            ++p;
+        }
+        if (p == m_end) {
+            return EndOfData;
+        }
+        if (*p == '>') {
+            m_selfClosing = false;
+            m_it = p + 1;
+            break;
+        }
+        if (*p == '/') {
+            if (p + 1 == m_end) {
+                return EndOfData;
+            }
+            if (*(p + 1) != '>') {
+                return setError("Invalid element end.");
+            }
+            m_selfClosing = true;
+            m_it = p + 2;
+            break;
+        }
+
+        const auto nameBegin = p;
+        while (p < m_end && *p != '=' && !isNameEnd(*p)) {
+            ++p;
+        }
+        const QByteArrayView name(nameBegin, p);
+        while (p < m_end && isSpace(*p)) {
+            ++p;
+        }
+        if (p == m_end) {
+            return EndOfData;
+        }
+        if (*p != '=' || name.isEmpty()) {
+            return setError("Invalid attribute.");
+        }
+        ++p;
+        while (p < m_end && isSpace(*p)) {
+            ++p;
+        }
+        if (p == m_end) {
+            return EndOfData;
+        }
+        const auto quote = *p;
+        if (quote != '"' && quote != '\'') {
+            return setError("Invalid attribute value.");
+        }
+        const auto valueBegin = ++p;
+        p = static_cast<const char*>(std::memchr(p, quote, m_end - p));
+        if (!p) {
+            return EndOfData;
+        }
+
+        Attribute attr{ name, QByteArrayView(valueBegin, p), -1, 0 };
+        if (std::memchr(valueBegin, '&', p - valueBegin)) {
+            attr.decodedOffset = m_decoded.size();
+            decodeEntities(attr.value);
+            attr.decodedSize = m_decoded.size() - attr.decodedOffset;
+        }
+        m_attributes.push_back(attr);
+        ++p;
+    }
+
+    // m_decoded doesn't change anymore at this point, so we can refer to it
+    for (auto &attr : m_attributes) {
+        if (attr.decodedOffset >= 0) {
+            attr.value = QByteArrayView(m_decoded.constData() + attr.decodedOffset, attr.decodedSize);
+        }
+    }
+    return StartElement;
+}
+
+XmlTokenizer::Token XmlTokenizer::parseEndElement(const char *it)
+{
+    auto p = it + 2;
+    while (p < m_end && !isNameEnd(*p)) {
+        ++p;
+    }
+    const QByteArrayView name(it + 2, p);
+    while (p < m_end && isSpace(*p)) {
+        ++p;
+    }
+    if (p == m_end) {
+        return EndOfData;
+    }
+    if (*p != '>' || name.isEmpty()) {
+        return setError("Invalid end element.");
+    }
+
+    m_name = name;
+    m_selfClosing = false;
+    m_attributes.clear();
+    m_it = p + 1;
+    return EndElement;
+}
+
+bool XmlTokenizer::skipPast(QByteArrayView terminator)
+{
+    const auto idx = QByteArrayView(m_it, m_end).indexOf(terminator);
+    if (idx < 0) {
+        return false;
+    }
+    m_it += idx + terminator.size();
+    return true;
+}
+
+XmlTokenizer::Token XmlTokenizer::setError(const char *message)
+{
+    m_error = QString::fromUtf8(message) + QLatin1String(" At offset ") + QString::number(m_it - m_begin);
+    return Error;
+}
+
+QByteArrayView XmlTokenizer::attribute(QByteArrayView name) const
+{
+    for (const auto &attr : m_attributes) {
+        if (attr.name == name) {
+            return attr.value;
+        }
+    }
+    return {};
+}
+
+bool XmlTokenizer::isInputData(QByteArrayView s) const
+{
+    return s.data() >= m_begin && s.data() + s.size() <= m_end;
+}
+
+bool XmlTokenizer::readElementText(QByteArray &text)
+{
+    const auto lt = static_cast<const char*>(std::memchr(m_it, '<', m_end - m_it));
+    if (!lt) {
+        return false;
+    }
+    m_decoded.clear();
+    decodeEntities(QByteArrayView(m_it, lt));
+    text = m_decoded;
+    m_it = lt;
+
+    // skip everything up to the corresponding end element
+    for (int depth = 0;;) {
+        switch (next()) {
+            case StartElement:
+                depth += isSelfClosing() ? 0 : 1;
+                break;
+            case EndElement:
+                if (depth-- == 0) {
+                    return true;
+                }
+                break;
+            case EndOfData:
+            case Error:
+                return false;
+        }
+    }
+}
+
+static void appendUtf8(QByteArray &out, char32_t c)
+{
+    if (c < 0x80) {
+        out.append((char)c);
+    } else if (c < 0x800) {
+        out.append((char)(0xc0 | (c >> 6)));
+        out.append((char)(0x80 | (c & 0x3f)));
+    } else if (c < 0x10000) {
+        out.append((char)(0xe0 | (c >> 12)));
+        out.append((char)(0x80 | ((c >> 6) & 0x3f)));
+        out.append((char)(0x80 | (c & 0x3f)));
+    } else if (c < 0x110000) {
+        out.append((char)(0xf0 | (c >> 18)));
+        out.append((char)(0x80 | ((c >> 12) & 0x3f)));
+        out.append((char)(0x80 | ((c >> 6) & 0x3f)));
+        out.append((char)(0x80 | (c & 0x3f)));
+    }
+}
+
+void XmlTokenizer::decodeEntities(QByteArrayView s)
+{
+    for (qsizetype i = 0; i < s.size(); ++i) {
+        if (s[i] != '&') {
+            m_decoded.append(s[i]);
+            continue;
+        }
+        const auto end = s.indexOf(';', i);
+        if (end < 0) {
+            m_decoded.append(s.mid(i));
+            return;
+        }
+        const auto entity = s.mid(i + 1, end - i - 1);
+        if (entity == "lt") {
+            m_decoded.append('<');
+        } else if (entity == "gt") {
+            m_decoded.append('>');
+        } else if (entity == "amp") {
+            m_decoded.append('&');
+        } else if (entity == "quot") {
+            m_decoded.append('"');
+        } else if (entity == "apos") {
+            m_decoded.append('\'');
+        } else if (entity.startsWith('#')) {
+            bool ok = false;
+            const auto c = entity.startsWith("#x") ? entity.mid(2).toUInt(&ok, 16) : entity.mid(1).toUInt(&ok, 10);
+            if (ok) {
+                appendUtf8(m_decoded, c);
+            }
+        } else {
+            // unknown entity, keep as-is
+            m_decoded.append(s.mid(i, end - i + 1));
+        }
+        i = end;
+    }
+}
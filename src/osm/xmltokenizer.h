@@ -0,0 +1,89 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef OSM_XMLTOKENIZER_H
+#define OSM_XMLTOKENIZER_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QString>
+
+#include <vector>
+
+namespace OSM {
+
+/** Minimal pull tokenizer for UTF-8 encoded OSM XML.
+ *  This only covers what is needed for the rather restricted OSM XML schema, ie. elements
+ *  and their attributes. Text, comments, processing instructions and CDATA sections are skipped.
+ *  Names and attribute values refer to the input data directly unless they contain entities.
+ */
+class XmlTokenizer
+{
+public:
+    explicit XmlTokenizer(const char *begin, const char *end);
+
+    enum Token {
+        StartElement,
+        EndElement,
+        /** End of the input reached, possibly in the middle of a token. */
+        EndOfData,
+        Error,
+    };
+
+    /** Advance to the next element token. */
+    [[nodiscard]] Token next();
+
+    /** Element name of the current start or end element. */
+    [[nodiscard]] inline QByteArrayView name() const { return m_name; }
+    /** The current start element has no content and no corresponding end element. */
+    [[nodiscard]] inline bool isSelfClosing() const { return m_selfClosing; }
+    /** Value of attribute @p name of the current start element, with entities resolved.
+     *  Remains valid until the next call to next().
+     */
+    [[nodiscard]] QByteArrayView attribute(QByteArrayView name) const;
+    /** Returns @c true if @p s refers to the input data rather than decoded content. */
+    [[nodiscard]] bool isInputData(QByteArrayView s) const;
+
+    /** Reads the text content of the current start element, up to and including its end element.
+     *  @returns @c false if the input ends before that.
+     */
+    [[nodiscard]] bool readElementText(QByteArray &text);
+
+    /** Position after the last complete token. */
+    [[nodiscard]] inline const char* position() const { return m_it; }
+    [[nodiscard]] inline bool hasError() const { return !m_error.isEmpty(); }
+    [[nodiscard]] inline QString errorString() const { return m_error; }
+
+private:
+    [[nodiscard]] Token parseStartElement(const char *it);
+    [[nodiscard]] Token parseEndElement(const char *it);
+    /** Skips a construct ending with @p terminator, @returns @c false if the input ends before that. */
+    [[nodiscard]] bool skipPast(QByteArrayView terminator);
+    [[nodiscard]] Token setError(const char *message);
+    void decodeEntities(QByteArrayView s);
+
+    const char *m_begin = nullptr;
+    const char *m_end = nullptr;
+    const char *m_it = nullptr;
+
+    QByteArrayView m_name;
+    bool m_selfClosing = false;
+
+    struct Attribute {
+        QByteArrayView name;
+        QByteArrayView value;
+        /** Position in m_decoded, offset is -1 if not decoded. */
+        qsizetype decodedOffset;
+        qsizetype decodedSize;
+    };
+    std::vector<Attribute> m_attributes;
+    QByteArray m_decoded;
+
+    QString m_error;
+};
+
+}
+
+#endif // OSM_XMLTOKENIZER_H
@@ -26,6 +26,8 @@ int main(int argc, char **argv)
     parser.addHelpOption();
     QCommandLineOption outOpt({QStringLiteral("o"), QStringLiteral("output")}, QStringLiteral("output file"), QStringLiteral("file"));
     parser.addOption(outOpt);
+    QCommandLineOption memoryUsageOpt({QStringLiteral("m"), QStringLiteral("memory-usage")}, QStringLiteral("print memory usage of the assembled data"));
+    parser.addOption(memoryUsageOpt);
     parser.process(app);
 
     const auto fileNames = parser.positionalArguments();
@@ -52,6 +54,9 @@ int main(int argc, char **argv)
     }
 
     marbleMerger.finalize();
+    if (parser.isSet(memoryUsageOpt)) {
+        qInfo() << dataSet.memoryUsage();
+    }
 
     QFile outputFile;
     std::unique_ptr<OSM::AbstractWriter> writer;
@@ -73,5 +78,9 @@ int main(int argc, char **argv)
         return 1;
     }
     writer->write(dataSet, &outputFile);
+    if (writer->hasError()) {
+        qCritical() << writer->errorString();
+        return 1;
+    }
     return 0;
 }
@@ -6,6 +6,7 @@
 
 #include <KOSMIndoorMap/MapData>
 #include <KOSMIndoorMap/MapLoader>
+#include <loader/mapdatasnapshot_p.h>
 #include <loader/tilecache_p.h>
 
 #include <osm/datatypes.h>
@@ -34,6 +35,7 @@ static void filterByBbox(OSM::DataSet &dataSet, OSM::BoundingBox bbox)
     dataSet.nodes.erase(std::remove_if(dataSet.nodes.begin(), dataSet.nodes.end(), [bbox](const auto &nd) {
         return !OSM::contains(bbox, nd.coordinate);
     }), dataSet.nodes.end());
+    dataSet.elementsChanged();
 }
 
 template <typename Elem>
@@ -71,6 +73,10 @@ int main(int argc, char **argv)
     parser.addOption(bboxOpt);
     QCommandLineOption clipOpt({QStringLiteral("c"), QStringLiteral("clip")}, QStringLiteral("clip to bounding box"));
     parser.addOption(clipOpt);
+    QCommandLineOption compressionOpt({QStringLiteral("z"), QStringLiteral("compression-level")}, QStringLiteral("compression level for .osm.pbf output, 0 for uncompressed"), QStringLiteral("0-9"));
+    parser.addOption(compressionOpt);
+    QCommandLineOption memoryUsageOpt({QStringLiteral("m"), QStringLiteral("memory-usage")}, QStringLiteral("print memory usage of the loaded data"));
+    parser.addOption(memoryUsageOpt);
     QCommandLineOption outOpt({QStringLiteral("o"), QStringLiteral("out")}, QStringLiteral("output file"), QStringLiteral("file"));
     parser.addOption(outOpt);
     QCommandLineOption pointOpt({QStringLiteral("p"), QStringLiteral("point")}, QStringLiteral("download area around point"), QStringLiteral("lat,lon"));
@@ -121,10 +127,20 @@ int main(int argc, char **argv)
     QObject::connect(&loader, &MapLoader::done, &app, &QCoreApplication::quit);
     QCoreApplication::exec();
     auto data = loader.takeData();
+    if (parser.isSet(memoryUsageOpt)) {
+        qInfo() << data.memoryUsage();
+    }
 
+    const auto isSnapshot = parser.value(outOpt).endsWith(QLatin1StringView(MapDataSnapshot::FileExtension));
     if (parser.isSet(clipOpt) && parser.isSet(bboxOpt)) {
         filterByBbox(data.dataSet(), bbox);
         purgeDanglingReferences(data.dataSet());
+        if (isSnapshot) {
+            // the level map refers to the removed elements
+            auto dataSet = std::move(data.dataSet());
+            data.setDataSet(std::move(dataSet));
+            data.setBoundingBox(bbox);
+        }
     }
 
     QFile f(parser.value(outOpt));
@@ -132,11 +148,26 @@ int main(int argc, char **argv)
         qCritical() << f.errorString();
         return 1;
     }
+    if (isSnapshot) {
+        QString errorMessage;
+        if (!MapDataSnapshot::write(data, &f, errorMessage)) {
+            qCritical() << errorMessage;
+            return 1;
+        }
+        return 0;
+    }
     auto writer = OSM::IO::writerForFileName(f.fileName());
     if (!writer) {
         qCritical() << "no file writer for requested format:" << f.fileName();
         return 1;
     }
+    if (parser.isSet(compressionOpt)) {
+        writer->setCompressionLevel(parser.value(compressionOpt).toInt());
+    }
     writer->write(data.dataSet(), &f);
+    if (writer->hasError()) {
+        qCritical() << writer->errorString();
+        return 1;
+    }
     return 0;
 }
@@ -0,0 +1,269 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <osm/abstractreader.h>
+#include <osm/abstractwriter.h>
+#include <osm/datatypes.h>
+#include <osm/elementhandler.h>
+#include <osm/io.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QtPlugin>
+
+#include <algorithm>
+#include <utility>
+
+#if HAVE_OSM_PBF_SUPPORT
+Q_IMPORT_PLUGIN(OSM_PbfIOPlugin)
+#endif
+
+struct TagFilter {
+    OSM::TagKey key;
+    QByteArray value;
+};
+
+/** Collects elements matching any of the tag filters, and everything those depend on.
+ *  As references point from relations to ways to nodes this needs one pass over the input
+ *  per element type, in that order, but only the result is kept in memory. Relations that are
+ *  members of other relations can need further passes, see repeatPass().
+ */
+class FilterHandler : public OSM::ElementHandler
+{
+public:
+    explicit FilterHandler(OSM::DataSet *dataSet, std::vector<TagFilter> &&filters)
+        : m_dataSet(dataSet)
+        , m_filters(std::move(filters))
+    {
+    }
+
+    void setPass(OSM::Type type)
+    {
+        m_pass = type;
+        m_repeatedPass = false;
+        // make the ids collected in the previous pass searchable
+        for (auto ids : {&m_wayIds, &m_nodeIds}) {
+            std::sort(ids->begin(), ids->end());
+            ids->erase(std::unique(ids->begin(), ids->end()), ids->end());
+        }
+    }
+
+    /** Returns @c true if the current pass has to be repeated.
+     *  That's the case for relations that are members of relations collected in the last pass,
+     *  unless those had been collected already. Every relation is collected only once, so this terminates.
+     */
+    [[nodiscard]] bool repeatPass()
+    {
+        if (m_pass != OSM::Type::Relation) {
+            return false;
+        }
+        m_relationIds.clear();
+        std::swap(m_relationIds, m_pendingRelationIds);
+        m_relationIds.erase(std::remove_if(m_relationIds.begin(), m_relationIds.end(), [this](auto id) {
+            return m_dataSet->relation(id) != nullptr;
+        }), m_relationIds.end());
+        std::sort(m_relationIds.begin(), m_relationIds.end());
+        m_relationIds.erase(std::unique(m_relationIds.begin(), m_relationIds.end()), m_relationIds.end());
+        m_repeatedPass = true;
+        return !m_relationIds.empty();
+    }
+
+    void handleNode(const OSM::Node &node) override
+    {
+        if (m_pass != OSM::Type::Node) {
+            return;
+        }
+        ++m_nodeCount;
+        if (matches(node) || std::binary_search(m_nodeIds.begin(), m_nodeIds.end(), node.id)) {
+            m_dataSet->addNode(retain(node));
+        }
+    }
+
+    void handleWay(const OSM::Way &way) override
+    {
+        if (m_pass != OSM::Type::Way) {
+            return;
+        }
+        ++m_wayCount;
+        if (matches(way) || std::binary_search(m_wayIds.begin(), m_wayIds.end(), way.id)) {
+            m_nodeIds.insert(m_nodeIds.end(), way.nodes.begin(), way.nodes.end());
+            m_dataSet->addWay(retain(way));
+        }
+    }
+
+    void handleRelation(const OSM::Relation &rel) override
+    {
+        if (m_pass != OSM::Type::Relation) {
+            return;
+        }
+        if (!m_repeatedPass) {
+            ++m_relationCount;
+        }
+        if (!matches(rel) && !std::binary_search(m_relationIds.begin(), m_relationIds.end(), rel.id)) {
+            return;
+        }
+        if (m_repeatedPass && m_dataSet->relation(rel.id)) {
+            return;
+        }
+        for (const auto &mem : rel.members) {
+            switch (mem.type()) {
+                case OSM::Type::Null:
+                    break;
+                case OSM::Type::Node:
+                    m_nodeIds.push_back(mem.id);
+                    break;
+                case OSM::Type::Way:
+                    m_wayIds.push_back(mem.id);
+                    break;
+                case OSM::Type::Relation:
+                    m_pendingRelationIds.push_back(mem.id);
+                    break;
+            }
+        }
+        m_dataSet->addRelation(retain(rel));
+    }
+
+    std::size_t m_nodeCount = 0;
+    std::size_t m_wayCount = 0;
+    std::size_t m_relationCount = 0;
+
+private:
+    template <typename Elem>
+    [[nodiscard]] bool matches(const Elem &elem) const
+    {
+        if (m_filters.empty()) {
+            return true;
+        }
+        return std::any_of(m_filters.begin(), m_filters.end(), [&elem](const auto &filter) {
+            const auto value = OSM::tagValue(elem, filter.key);
+            return !value.isEmpty() && (filter.value.isEmpty() || value == filter.value);
+        });
+    }
+
+    /** Copy of @p elem not referring to the reader's input data anymore. */
+    template <typename Elem>
+    [[nodiscard]] Elem retain(const Elem &elem) const
+    {
+        auto copy = elem;
+        for (auto &tag : copy.tags) {
+            tag.value = m_dataSet->makeTagValue(tag.value.constData(), tag.value.size(), OSM::StringMemory::Transient);
+        }
+        return copy;
+    }
+
+    OSM::DataSet *m_dataSet = nullptr;
+    std::vector<TagFilter> m_filters;
+    OSM::Type m_pass = OSM::Type::Null;
+    bool m_repeatedPass = false;
+    std::vector<OSM::Id> m_relationIds;
+    std::vector<OSM::Id> m_pendingRelationIds;
+    std::vector<OSM::Id> m_wayIds;
+    std::vector<OSM::Id> m_nodeIds;
+};
+
+[[nodiscard]] static bool readFile(const QString &fileName, OSM::DataSet *dataSet, OSM::ElementHandler *handler)
+{
+    QFile f(fileName);
+    if (!f.open(QFile::ReadOnly)) {
+        qCritical() << f.fileName() << f.errorString();
+        return false;
+    }
+    auto reader = OSM::IO::readerForFileName(fileName, dataSet);
+    if (!reader) {
+        qCritical() << "no file reader for" << fileName;
+        return false;
+    }
+    reader->setElementHandler(handler);
+
+    // memory-mapping leaves it to the OS to keep only what's currently needed in memory
+    if (const auto data = f.map(0, f.size())) {
+        reader->read(data, f.size());
+    } else {
+        reader->read(&f);
+    }
+    return !reader->hasError();
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Extract elements by tag from OSM files larger than the available memory."));
+    parser.addHelpOption();
+    QCommandLineOption outOpt({QStringLiteral("o"), QStringLiteral("output")}, QStringLiteral("output file"), QStringLiteral("file"));
+    parser.addOption(outOpt);
+    QCommandLineOption tagOpt({QStringLiteral("t"), QStringLiteral("tag")}, QStringLiteral("select elements with the given tag, can be repeated"), QStringLiteral("key[=value]"));
+    parser.addOption(tagOpt);
+    QCommandLineOption statsOpt({QStringLiteral("s"), QStringLiteral("stats")}, QStringLiteral("print element statistics"));
+    parser.addOption(statsOpt);
+    parser.addPositionalArgument(QStringLiteral("input"), QStringLiteral("OSM file to read"));
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+    const auto fileName = parser.positionalArguments().at(0);
+
+    OSM::DataSet dataSet;
+    std::vector<TagFilter> filters;
+    for (const auto &tag : parser.values(tagOpt)) {
+        const auto idx = tag.indexOf(QLatin1Char('='));
+        TagFilter filter;
+        filter.key = dataSet.makeTagKey(tag.left(idx).toUtf8().constData(), OSM::StringMemory::Transient);
+        if (idx > 0) {
+            filter.value = tag.mid(idx + 1).toUtf8();
+        }
+        filters.push_back(std::move(filter));
+    }
+
+    FilterHandler handler(&dataSet, std::move(filters));
+    dataSet.beginBulkLoad();
+    for (auto type : {OSM::Type::Relation, OSM::Type::Way, OSM::Type::Node}) {
+        handler.setPass(type);
+        do {
+            if (!readFile(fileName, &dataSet, &handler)) {
+                return 1;
+            }
+        } while (handler.repeatPass());
+    }
+    dataSet.endBulkLoad();
+
+    if (parser.isSet(statsOpt)) {
+        qInfo() << "nodes:" << dataSet.nodes.size() << "of" << handler.m_nodeCount;
+        qInfo() << "ways:" << dataSet.ways.size() << "of" << handler.m_wayCount;
+        qInfo() << "relations:" << dataSet.relations.size() << "of" << handler.m_relationCount;
+        qInfo() << dataSet.memoryUsage();
+    }
+
+    QFile outputFile;
+    std::unique_ptr<OSM::AbstractWriter> writer;
+    if (parser.isSet(outOpt)) {
+        outputFile.setFileName(parser.value(outOpt));
+        outputFile.open(QFile::WriteOnly);
+        writer = OSM::IO::writerForFileName(outputFile.fileName());
+    } else if (parser.isSet(statsOpt)) {
+        return 0;
+    } else {
+        outputFile.open(stdout, QFile::WriteOnly);
+        writer = OSM::IO::writerForMimeType(u"application/vnd.openstreetmap.data+xml");
+    }
+    if (!outputFile.isOpen()) {
+        qCritical() << outputFile.errorString();
+        return 1;
+    }
+
+    if (!writer) {
+        qCritical() << "no file writer for requested format:" << outputFile.fileName();
+        return 1;
+    }
+    writer->write(dataSet, &outputFile);
+    if (writer->hasError()) {
+        qCritical() << writer->errorString();
+        return 1;
+    }
+    return 0;
+}
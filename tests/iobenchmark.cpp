@@ -0,0 +1,130 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "syntheticvenue.h"
+
+#include <osm/datatypes.h>
+#include <osm/io.h>
+
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QTest>
+#include <QtPlugin>
+
+#include <map>
+
+using namespace Qt::Literals::StringLiterals;
+
+#if HAVE_OSM_PBF_SUPPORT
+Q_IMPORT_PLUGIN(OSM_PbfIOPlugin)
+#endif
+
+/** Measures reading and writing throughput of the supported file formats,
+ *  on synthetic indoor venue data of various sizes.
+ */
+class IoBenchmark : public QObject
+{
+    Q_OBJECT
+private:
+    void addRows()
+    {
+        QTest::addColumn<QString>("fileName");
+        QTest::addColumn<int>("buildings");
+
+        QStringList fileNames({u"data.o5m"_s, u"data.osm"_s});
+#if HAVE_OSM_PBF_SUPPORT
+        fileNames.push_back(u"data.osm.pbf"_s);
+#endif
+        for (const auto &fileName : fileNames) {
+            for (const auto buildings : {1, 20, 400}) {
+                QTest::addRow("%s %d buildings", qPrintable(fileName), buildings) << fileName << buildings;
+            }
+        }
+    }
+
+    [[nodiscard]] const OSM::DataSet& dataSet(int buildings)
+    {
+        auto &dataSet = m_dataSets[buildings];
+        if (dataSet.nodes.empty()) {
+            SyntheticVenue(dataSet).generate(buildings);
+        }
+        return dataSet;
+    }
+
+    [[nodiscard]] static std::size_t elementCount(const OSM::DataSet &dataSet)
+    {
+        return dataSet.nodes.size() + dataSet.ways.size() + dataSet.relations.size();
+    }
+
+    static void printThroughput(std::size_t bytes, std::size_t elements, qint64 nsecs)
+    {
+        nsecs = std::max<qint64>(1, nsecs);
+        qDebug() << elements << "elements" << bytes << "bytes:"
+            << (bytes * 1000 / nsecs) << "MB/s" << (elements * 1000'000'000 / nsecs) << "elements/s";
+    }
+
+private Q_SLOTS:
+    void benchmarkRead_data()
+    {
+        addRows();
+    }
+
+    void benchmarkRead()
+    {
+        QFETCH(QString, fileName);
+        QFETCH(int, buildings);
+
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+        auto writer = OSM::IO::writerForFileName(fileName);
+        QVERIFY(writer);
+        writer->write(dataSet(buildings), &buffer);
+        const auto data = buffer.data();
+
+        QBENCHMARK {
+            OSM::DataSet result;
+            auto reader = OSM::IO::readerForFileName(fileName, &result);
+            QVERIFY(reader);
+            QElapsedTimer timer;
+            timer.start();
+            reader->read(reinterpret_cast<const uint8_t*>(data.constData()), data.size());
+            const auto elapsed = timer.nsecsElapsed();
+            QVERIFY(!reader->hasError());
+            QCOMPARE(elementCount(result), elementCount(dataSet(buildings)));
+            printThroughput(data.size(), elementCount(result), elapsed);
+        }
+    }
+
+    void benchmarkWrite_data()
+    {
+        addRows();
+    }
+
+    void benchmarkWrite()
+    {
+        QFETCH(QString, fileName);
+        QFETCH(int, buildings);
+
+        const auto &data = dataSet(buildings);
+        auto writer = OSM::IO::writerForFileName(fileName);
+        QVERIFY(writer);
+
+        QBENCHMARK {
+            QBuffer buffer;
+            buffer.open(QIODevice::WriteOnly);
+            QElapsedTimer timer;
+            timer.start();
+            writer->write(data, &buffer);
+            printThroughput(buffer.size(), elementCount(data), timer.nsecsElapsed());
+        }
+    }
+
+private:
+    std::map<int, OSM::DataSet> m_dataSets;
+};
+
+QTEST_GUILESS_MAIN(IoBenchmark)
+
+#include "iobenchmark.moc"
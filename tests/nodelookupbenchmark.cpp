@@ -0,0 +1,77 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <osm/datatypes.h>
+#include <osm/element.h>
+#include <osm/o5mparser.h>
+
+#include <QFile>
+#include <QTest>
+
+/** Compares node lookup via binary search and via OSM::NodeIndex.
+ *  Point KOSMINDOORMAP_BENCHMARK_DATA to a large o5m file to run this.
+ */
+class NodeLookupBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase()
+    {
+        const auto fileName = qEnvironmentVariable("KOSMINDOORMAP_BENCHMARK_DATA");
+        if (fileName.isEmpty()) {
+            QSKIP("KOSMINDOORMAP_BENCHMARK_DATA not set");
+        }
+
+        QFile f(fileName);
+        QVERIFY(f.open(QFile::ReadOnly));
+        const auto data = f.map(0, f.size());
+        QVERIFY(data);
+        OSM::O5mParser p(&m_dataSet);
+        p.read(data, f.size());
+        QVERIFY(!m_dataSet.ways.empty());
+        qDebug() << m_dataSet.nodes.size() << "nodes" << m_dataSet.ways.size() << "ways";
+    }
+
+    void benchmarkWayNodeLookup_data()
+    {
+        QTest::addColumn<bool>("useIndex");
+        QTest::newRow("binary search") << false;
+        QTest::newRow("node index") << true;
+    }
+
+    void benchmarkWayNodeLookup()
+    {
+        QFETCH(bool, useIndex);
+        if (useIndex) {
+            m_dataSet.buildNodeIndex();
+        } else {
+            m_dataSet.clearNodeIndex();
+        }
+
+        uint64_t sum = 0;
+        QBENCHMARK {
+            for (const auto &way : m_dataSet.ways) {
+                OSM::for_each_node(m_dataSet, way, [&sum](const OSM::Node &node) {
+                    sum += node.coordinate.latitude;
+                });
+            }
+        }
+        QVERIFY(sum > 0);
+    }
+
+    void benchmarkBuildIndex()
+    {
+        QBENCHMARK {
+            m_dataSet.buildNodeIndex();
+        }
+    }
+
+private:
+    OSM::DataSet m_dataSet;
+};
+
+QTEST_GUILESS_MAIN(NodeLookupBenchmark)
+
+#include "nodelookupbenchmark.moc"
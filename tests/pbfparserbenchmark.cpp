@@ -0,0 +1,68 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <osm/datatypes.h>
+#include <osm/osmpbfparser.h>
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTest>
+#include <QThread>
+
+/** Measures .osm.pbf decoding throughput depending on the number of threads.
+ *  Point KOSMINDOORMAP_BENCHMARK_DATA to a large (e.g. country-sized) .osm.pbf file to run this.
+ */
+class PbfParserBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase()
+    {
+        const auto fileName = qEnvironmentVariable("KOSMINDOORMAP_BENCHMARK_DATA");
+        if (fileName.isEmpty()) {
+            QSKIP("KOSMINDOORMAP_BENCHMARK_DATA not set");
+        }
+
+        m_file.setFileName(fileName);
+        QVERIFY(m_file.open(QFile::ReadOnly));
+        m_data = m_file.map(0, m_file.size());
+        QVERIFY(m_data);
+    }
+
+    void benchmarkParse_data()
+    {
+        QTest::addColumn<int>("threadCount");
+        for (int i = 1; i < QThread::idealThreadCount(); i *= 2) {
+            QTest::addRow("%d thread(s)", i) << i;
+        }
+        QTest::addRow("%d threads", QThread::idealThreadCount()) << QThread::idealThreadCount();
+    }
+
+    void benchmarkParse()
+    {
+        QFETCH(int, threadCount);
+
+        QBENCHMARK_ONCE {
+            OSM::DataSet dataSet;
+            OSM::OsmPbfParser p(&dataSet);
+            p.setThreadCount(threadCount);
+            QElapsedTimer timer;
+            timer.start();
+            p.read(m_data, m_file.size());
+            const auto elapsed = std::max<qint64>(1, timer.elapsed());
+            qDebug() << dataSet.nodes.size() << "nodes" << dataSet.ways.size() << "ways" << dataSet.relations.size() << "relations"
+                << ((m_file.size() / 1024 / 1024) * 1000 / elapsed) << "MiB/s";
+            QVERIFY(!dataSet.nodes.empty());
+        }
+    }
+
+private:
+    QFile m_file;
+    const uint8_t *m_data = nullptr;
+};
+
+QTEST_GUILESS_MAIN(PbfParserBenchmark)
+
+#include "pbfparserbenchmark.moc"
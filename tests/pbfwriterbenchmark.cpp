@@ -0,0 +1,79 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "syntheticvenue.h"
+
+#include <osm/datatypes.h>
+#include <osm/osmpbfparser.h>
+#include <osm/osmpbfwriter.h>
+
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTest>
+#include <QThread>
+
+/** Measures .osm.pbf encoding throughput depending on the number of threads and the compression level.
+ *  This uses the .osm.pbf file KOSMINDOORMAP_BENCHMARK_DATA points to when set, and large synthetic data otherwise.
+ */
+class PbfWriterBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase()
+    {
+        const auto fileName = qEnvironmentVariable("KOSMINDOORMAP_BENCHMARK_DATA");
+        if (fileName.isEmpty()) {
+            SyntheticVenue(m_dataSet).generate(2000);
+            return;
+        }
+
+        QFile file(fileName);
+        QVERIFY(file.open(QFile::ReadOnly));
+        OSM::OsmPbfParser p(&m_dataSet);
+        p.read(file.map(0, file.size()), file.size());
+        QVERIFY(!p.hasError());
+    }
+
+    void benchmarkWrite_data()
+    {
+        QTest::addColumn<int>("threadCount");
+        QTest::addColumn<int>("compressionLevel");
+        for (const auto level : {0, 1, -1, 9}) {
+            for (int i = 1; i < QThread::idealThreadCount(); i *= 2) {
+                QTest::addRow("level %d, %d thread(s)", level, i) << i << level;
+            }
+            QTest::addRow("level %d, %d threads", level, QThread::idealThreadCount()) << QThread::idealThreadCount() << level;
+        }
+    }
+
+    void benchmarkWrite()
+    {
+        QFETCH(int, threadCount);
+        QFETCH(int, compressionLevel);
+
+        QBENCHMARK_ONCE {
+            OSM::OsmPbfWriter writer;
+            writer.setThreadCount(threadCount);
+            writer.setCompressionLevel(compressionLevel);
+            QBuffer buffer;
+            buffer.open(QIODevice::WriteOnly);
+            QElapsedTimer timer;
+            timer.start();
+            writer.write(m_dataSet, &buffer);
+            const auto elapsed = std::max<qint64>(1, timer.elapsed());
+            qDebug() << m_dataSet.nodes.size() << "nodes" << m_dataSet.ways.size() << "ways" << m_dataSet.relations.size() << "relations"
+                << (buffer.size() / 1024 / 1024) << "MiB" << ((m_dataSet.nodes.size() + m_dataSet.ways.size() + m_dataSet.relations.size()) * 1000 / elapsed) << "elements/s";
+            QVERIFY(buffer.size() > 0);
+        }
+    }
+
+private:
+    OSM::DataSet m_dataSet;
+};
+
+QTEST_GUILESS_MAIN(PbfWriterBenchmark)
+
+#include "pbfwriterbenchmark.moc"
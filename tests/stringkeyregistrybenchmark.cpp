@@ -0,0 +1,103 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <osm/datatypes.h>
+
+#include <QTest>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+/** The previous sorted vector based key registry, for comparison. */
+class SortedVectorKeyRegistry
+{
+public:
+    ~SortedVectorKeyRegistry()
+    {
+        std::for_each(m_pool.begin(), m_pool.end(), free);
+    }
+
+    const char* makeKey(const char *name, std::size_t len, OSM::StringMemory memOpt)
+    {
+        const auto it = std::lower_bound(m_registry.begin(), m_registry.end(), name, [len](const char *lhs, const char *rhs) {
+            return std::strncmp(lhs, rhs, len) < 0;
+        });
+        if (it == m_registry.end() || std::strncmp((*it), name, len) != 0 || std::strlen(*it) != len) {
+            if (memOpt == OSM::StringMemory::Transient) {
+                auto s = static_cast<char*>(malloc(len + 1));
+                std::memcpy(s, name, len);
+                s[len] = '\0';
+                m_pool.push_back(s);
+                name = s;
+            }
+            m_registry.insert(it, name);
+            return name;
+        }
+        return (*it);
+    }
+
+private:
+    std::vector<char*> m_pool;
+    std::vector<const char*> m_registry;
+};
+
+/** Compares the hash based OSM::StringKeyRegistry against the previous sorted vector implementation.
+ *  The input mimics the key distribution of OSM data, a few very common keys and many rare variants.
+ */
+class StringKeyRegistryBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase()
+    {
+        const char* commonKeys[] = { "name", "building", "indoor", "level", "highway", "railway", "public_transport", "ref", "amenity", "shop" };
+        const char* variantPrefixes[] = { "name:", "addr:", "ref:", "old_name:", "description:" };
+
+        std::vector<QByteArray> keys;
+        for (int i = 0; i < 2000; ++i) {
+            keys.push_back(QByteArray(variantPrefixes[i % std::size(variantPrefixes)]) + QByteArray::number(i));
+        }
+
+        // repeat as seen while parsing, common keys occur far more often than the variants
+        srand(42);
+        for (int i = 0; i < 200000; ++i) {
+            if (i % 4) {
+                m_input.push_back(commonKeys[rand() % std::size(commonKeys)]);
+            } else {
+                m_input.push_back(keys[rand() % keys.size()]);
+            }
+        }
+        qDebug() << m_input.size() << "lookups," << keys.size() + std::size(commonKeys) << "distinct keys";
+    }
+
+    void benchmarkSortedVector()
+    {
+        QBENCHMARK {
+            SortedVectorKeyRegistry registry;
+            for (const auto &key : m_input) {
+                (void)registry.makeKey(key.constData(), key.size(), OSM::StringMemory::Transient);
+            }
+        }
+    }
+
+    void benchmarkHashTable()
+    {
+        QBENCHMARK {
+            OSM::StringKeyRegistry<OSM::TagKey> registry;
+            for (const auto &key : m_input) {
+                (void)registry.makeKey(key.constData(), key.size(), OSM::StringMemory::Transient);
+            }
+        }
+    }
+
+private:
+    std::vector<QByteArray> m_input;
+};
+
+QTEST_GUILESS_MAIN(StringKeyRegistryBenchmark)
+
+#include "stringkeyregistrybenchmark.moc"
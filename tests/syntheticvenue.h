@@ -0,0 +1,284 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef SYNTHETICVENUE_H
+#define SYNTHETICVENUE_H
+
+#include <osm/datatypes.h>
+
+#include <QByteArray>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <random>
+
+/** Deterministic synthetic OSM data resembling indoor venues such as train stations or malls.
+ *  Each building has a few floor levels with rooms, corridors, doors, points of interest and
+ *  vertical connections, with the usual mix of untagged geometry nodes, shared nodes, multi-level
+ *  elements and multipolygon relations.
+ */
+class SyntheticVenue
+{
+public:
+    explicit SyntheticVenue(OSM::DataSet &dataSet, uint32_t seed = 42)
+        : m_dataSet(dataSet)
+        , m_rng(seed)
+    {
+        m_keys.amenity = dataSet.makeTagKey("amenity");
+        m_keys.building = dataSet.makeTagKey("building");
+        m_keys.buildingLevels = dataSet.makeTagKey("building:levels");
+        m_keys.buildingLevelsUnderground = dataSet.makeTagKey("building:levels:underground");
+        m_keys.door = dataSet.makeTagKey("door");
+        m_keys.highway = dataSet.makeTagKey("highway");
+        m_keys.indoor = dataSet.makeTagKey("indoor");
+        m_keys.level = dataSet.makeTagKey("level");
+        m_keys.levelRef = dataSet.makeTagKey("level:ref");
+        m_keys.name = dataSet.makeTagKey("name");
+        m_keys.openingHours = dataSet.makeTagKey("opening_hours");
+        m_keys.ref = dataSet.makeTagKey("ref");
+        m_keys.repeatOn = dataSet.makeTagKey("repeat_on");
+        m_keys.room = dataSet.makeTagKey("room");
+        m_keys.shop = dataSet.makeTagKey("shop");
+        m_keys.type = dataSet.makeTagKey("type");
+        m_keys.wheelchair = dataSet.makeTagKey("wheelchair");
+        m_outerRole = dataSet.makeRole("outer");
+        m_innerRole = dataSet.makeRole("inner");
+    }
+
+    /** Adds @p count buildings, placed on a grid. */
+    void generate(int count)
+    {
+        m_dataSet.beginBulkLoad();
+        const auto columns = std::max(1, (int)std::sqrt(count));
+        for (int i = 0; i < count; ++i) {
+            addBuilding(BaseLat + (i / columns) * BuildingSpacing, BaseLon + (i % columns) * BuildingSpacing * 1.5);
+        }
+        m_dataSet.endBulkLoad();
+    }
+
+private:
+    static constexpr double BaseLat = 52.52;
+    static constexpr double BaseLon = 13.37;
+    static constexpr double BuildingSpacing = 0.002;
+    static constexpr double BuildingSize = 0.0015;
+
+    [[nodiscard]] int random(int min, int max)
+    {
+        return std::uniform_int_distribution<int>(min, max)(m_rng);
+    }
+    [[nodiscard]] double jitter()
+    {
+        return std::uniform_real_distribution<double>(-0.000005, 0.000005)(m_rng);
+    }
+    template <std::size_t N>
+    [[nodiscard]] const char* pick(const std::array<const char*, N> &values)
+    {
+        return values[random(0, N - 1)];
+    }
+
+    template <typename Elem>
+    void tag(Elem &elem, OSM::TagKey key, QByteArray value)
+    {
+        OSM::setTagValue(elem, key, std::move(value));
+    }
+
+    OSM::Id addNode(double lat, double lon)
+    {
+        OSM::Node node;
+        node.id = ++m_nodeId;
+        node.coordinate = OSM::Coordinate(lat, lon);
+        m_dataSet.addNode(std::move(node));
+        return m_nodeId;
+    }
+
+    /** Closed way along a rectangle, with intermediate nodes on its edges. */
+    OSM::Way rectangle(double lat, double lon, double height, double width, int edgeNodes)
+    {
+        OSM::Way way;
+        way.id = ++m_wayId;
+        const std::array<std::pair<double, double>, 4> corners = {{{lat, lon}, {lat, lon + width}, {lat + height, lon + width}, {lat + height, lon}}};
+        for (std::size_t i = 0; i < corners.size(); ++i) {
+            const auto &from = corners[i];
+            const auto &to = corners[(i + 1) % corners.size()];
+            for (int j = 0; j <= edgeNodes; ++j) {
+                const auto t = (double)j / (edgeNodes + 1);
+                way.nodes.push_back(addNode(from.first + (to.first - from.first) * t + jitter(), from.second + (to.second - from.second) * t + jitter()));
+            }
+        }
+        way.nodes.push_back(way.nodes.front());
+        return way;
+    }
+
+    void addBuilding(double lat, double lon)
+    {
+        ++m_buildingCount;
+        const auto levels = random(1, 6);
+        const auto undergroundLevels = random(0, 2);
+
+        auto outline = rectangle(lat, lon, BuildingSize, BuildingSize * 1.5, random(2, 8));
+        tag(outline, m_keys.building, pick(std::array{"train_station", "retail", "university", "hospital"}));
+        tag(outline, m_keys.buildingLevels, QByteArray::number(levels));
+        if (undergroundLevels) {
+            tag(outline, m_keys.buildingLevelsUnderground, QByteArray::number(undergroundLevels));
+        }
+        tag(outline, m_keys.name, "Building " + QByteArray::number(m_buildingCount));
+        const auto outlineNodes = outline.nodes;
+        const auto outlineId = outline.id;
+        m_dataSet.addWay(std::move(outline));
+
+        // vertical connections present on all levels
+        QByteArray allLevels;
+        for (int l = -undergroundLevels; l < levels; ++l) {
+            if (!allLevels.isEmpty()) {
+                allLevels += ';';
+            }
+            allLevels += QByteArray::number(l);
+        }
+        for (int i = random(1, 3); i > 0; --i) {
+            OSM::Node elevator;
+            elevator.id = ++m_nodeId;
+            elevator.coordinate = OSM::Coordinate(lat + BuildingSize * 0.5 + jitter() * 100, lon + BuildingSize * 0.75 + jitter() * 100);
+            tag(elevator, m_keys.highway, "elevator");
+            tag(elevator, m_keys.repeatOn, allLevels);
+            tag(elevator, m_keys.wheelchair, "yes");
+            m_dataSet.addNode(std::move(elevator));
+        }
+
+        for (int l = -undergroundLevels; l < levels; ++l) {
+            addLevel(lat, lon, l, outlineNodes, outlineId);
+        }
+    }
+
+    void addLevel(double lat, double lon, int level, const std::vector<OSM::Id> &outlineNodes, OSM::Id outlineId)
+    {
+        const auto levelValue = QByteArray::number(level);
+
+        // level outline sharing the nodes of the building outline
+        OSM::Way levelOutline;
+        levelOutline.id = ++m_wayId;
+        levelOutline.nodes = outlineNodes;
+        tag(levelOutline, m_keys.indoor, "level");
+        tag(levelOutline, m_keys.level, levelValue);
+        tag(levelOutline, m_keys.levelRef, level == 0 ? QByteArray("EG") : QByteArray(levelValue + ". OG"));
+        m_dataSet.addWay(std::move(levelOutline));
+
+        // rooms on both sides of a corridor
+        const auto roomsPerSide = random(3, 12);
+        const auto roomWidth = BuildingSize * 1.5 / roomsPerSide;
+        const auto roomDepth = BuildingSize * 0.4;
+        std::vector<OSM::Id> roomIds;
+        for (int side = 0; side < 2; ++side) {
+            const auto roomLat = lat + side * (BuildingSize - roomDepth);
+            for (int i = 0; i < roomsPerSide; ++i) {
+                auto room = rectangle(roomLat, lon + i * roomWidth, roomDepth, roomWidth, random(0, 2));
+
+                // door on the corridor side, as part of the room outline
+                OSM::Node door;
+                door.id = ++m_nodeId;
+                door.coordinate = OSM::Coordinate(side ? roomLat : roomLat + roomDepth, lon + (i + 0.5) * roomWidth);
+                tag(door, m_keys.door, pick(std::array{"hinged", "sliding", "yes"}));
+                tag(door, m_keys.indoor, "door");
+                tag(door, m_keys.level, levelValue);
+                room.nodes.insert(room.nodes.begin() + 1, door.id);
+                m_dataSet.addNode(std::move(door));
+
+                tag(room, m_keys.indoor, "room");
+                tag(room, m_keys.level, levelValue);
+                tag(room, m_keys.ref, levelValue + '.' + QByteArray::number(side * roomsPerSide + i));
+                const auto type = random(0, 9);
+                if (type < 3) {
+                    tag(room, m_keys.shop, pick(std::array{"bakery", "kiosk", "clothes", "books", "convenience"}));
+                    tag(room, m_keys.name, "Shop " + QByteArray::number(m_wayId));
+                    tag(room, m_keys.openingHours, pick(std::array{"Mo-Fr 08:00-20:00; Sa 09:00-18:00", "24/7", "Mo-Su 06:00-22:00"}));
+                } else if (type < 4) {
+                    tag(room, m_keys.amenity, "toilets");
+                    tag(room, m_keys.wheelchair, pick(std::array{"yes", "no", "limited"}));
+                } else {
+                    tag(room, m_keys.room, pick(std::array{"office", "storage", "technical", "lecture_hall"}));
+                }
+                roomIds.push_back(room.id);
+                m_dataSet.addWay(std::move(room));
+            }
+        }
+
+        OSM::Way corridor = rectangle(lat + roomDepth, lon, BuildingSize - 2 * roomDepth, BuildingSize * 1.5, roomsPerSide);
+        tag(corridor, m_keys.indoor, "corridor");
+        tag(corridor, m_keys.level, levelValue);
+        m_dataSet.addWay(std::move(corridor));
+
+        // points of interest in the corridor
+        for (int i = random(2, 15); i > 0; --i) {
+            OSM::Node poi;
+            poi.id = ++m_nodeId;
+            poi.coordinate = OSM::Coordinate(lat + BuildingSize * 0.5 + jitter() * 50, lon + BuildingSize * 0.75 + jitter() * 150);
+            tag(poi, m_keys.amenity, pick(std::array{"bench", "vending_machine", "waste_basket", "atm", "ticket_validator", "cafe"}));
+            tag(poi, m_keys.level, levelValue);
+            if (random(0, 1)) {
+                tag(poi, m_keys.name, "Point " + QByteArray::number(m_nodeId));
+            }
+            m_dataSet.addNode(std::move(poi));
+        }
+
+        // stairs between this level and the next one
+        OSM::Way stairs;
+        stairs.id = ++m_wayId;
+        stairs.nodes = {addNode(lat + roomDepth + jitter(), lon + jitter()), addNode(lat + roomDepth + jitter(), lon + roomWidth + jitter())};
+        tag(stairs, m_keys.highway, "steps");
+        tag(stairs, m_keys.level, levelValue + ';' + QByteArray::number(level + 1));
+        m_dataSet.addWay(std::move(stairs));
+
+        // level area as multipolygon, with the rooms cut out
+        OSM::Relation area;
+        area.id = ++m_relationId;
+        OSM::Member outer;
+        outer.id = outlineId;
+        outer.setType(OSM::Type::Way);
+        outer.setRole(m_outerRole);
+        area.members.push_back(outer);
+        for (const auto id : roomIds) {
+            OSM::Member inner;
+            inner.id = id;
+            inner.setType(OSM::Type::Way);
+            inner.setRole(m_innerRole);
+            area.members.push_back(inner);
+        }
+        tag(area, m_keys.type, "multipolygon");
+        tag(area, m_keys.indoor, "area");
+        tag(area, m_keys.level, levelValue);
+        m_dataSet.addRelation(std::move(area));
+    }
+
+    OSM::DataSet &m_dataSet;
+    std::mt19937 m_rng;
+    OSM::Id m_nodeId = 0;
+    OSM::Id m_wayId = 0;
+    OSM::Id m_relationId = 0;
+    int m_buildingCount = 0;
+
+    struct {
+        OSM::TagKey amenity;
+        OSM::TagKey building;
+        OSM::TagKey buildingLevels;
+        OSM::TagKey buildingLevelsUnderground;
+        OSM::TagKey door;
+        OSM::TagKey highway;
+        OSM::TagKey indoor;
+        OSM::TagKey level;
+        OSM::TagKey levelRef;
+        OSM::TagKey name;
+        OSM::TagKey openingHours;
+        OSM::TagKey ref;
+        OSM::TagKey repeatOn;
+        OSM::TagKey room;
+        OSM::TagKey shop;
+        OSM::TagKey type;
+        OSM::TagKey wheelchair;
+    } m_keys;
+    OSM::Role m_outerRole;
+    OSM::Role m_innerRole;
+};
+
+#endif // SYNTHETICVENUE_H
@@ -0,0 +1,117 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <osm/datatypes.h>
+#include <osm/element.h>
+#include <osm/elementhandler.h>
+#include <osm/o5mparser.h>
+
+#include <QFile>
+#include <QSet>
+#include <QTest>
+
+/** Compares memory use of deduplicated and individually allocated tag values.
+ *  Point KOSMINDOORMAP_BENCHMARK_DATA to a large o5m file to run this.
+ */
+class TagValueBenchmark : public QObject
+{
+    Q_OBJECT
+private:
+    /** Stores elements with every tag value in its own allocation, as before value deduplication. */
+    class CopyingHandler : public OSM::ElementHandler
+    {
+    public:
+        explicit CopyingHandler(OSM::DataSet *dataSet)
+            : m_dataSet(dataSet)
+        {
+        }
+
+        void handleNode(const OSM::Node &node) override
+        {
+            m_dataSet->addNode(copy(node));
+        }
+        void handleWay(const OSM::Way &way) override
+        {
+            m_dataSet->addWay(copy(way));
+        }
+        void handleRelation(const OSM::Relation &rel) override
+        {
+            m_dataSet->addRelation(copy(rel));
+        }
+
+    private:
+        template <typename Elem>
+        [[nodiscard]] static Elem copy(const Elem &elem)
+        {
+            auto c = elem;
+            for (auto &tag : c.tags) {
+                tag.value = QByteArray(tag.value.constData(), tag.value.size());
+            }
+            return c;
+        }
+
+        OSM::DataSet *m_dataSet;
+    };
+
+    void loadDataSet(OSM::DataSet &dataSet, OSM::ElementHandler *handler = nullptr)
+    {
+        QFile f(qEnvironmentVariable("KOSMINDOORMAP_BENCHMARK_DATA"));
+        QVERIFY(f.open(QFile::ReadOnly));
+        const auto data = f.map(0, f.size());
+        QVERIFY(data);
+        OSM::O5mParser p(&dataSet);
+        p.setElementHandler(handler);
+        dataSet.beginBulkLoad();
+        p.read(data, f.size());
+        dataSet.endBulkLoad();
+        QVERIFY(!dataSet.ways.empty());
+    }
+
+    static void printMemoryUsage(const char *label, const OSM::DataSet &dataSet)
+    {
+        std::size_t valueCount = 0;
+        std::size_t valueBytes = 0;
+        QSet<const char*> buffers;
+        std::size_t bufferBytes = 0;
+        OSM::for_each(dataSet, [&](OSM::Element e) {
+            std::for_each(e.tagsBegin(), e.tagsEnd(), [&](const OSM::Tag &tag) {
+                ++valueCount;
+                valueBytes += tag.value.size();
+                if (!buffers.contains(tag.value.constData())) {
+                    buffers.insert(tag.value.constData());
+                    bufferBytes += tag.value.size() + 1;
+                }
+            });
+        });
+        qDebug() << label << valueCount << "values" << valueBytes << "bytes," << buffers.size() << "distinct buffers" << bufferBytes << "bytes";
+        qDebug() << label << dataSet.memoryUsage();
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        if (qEnvironmentVariableIsEmpty("KOSMINDOORMAP_BENCHMARK_DATA")) {
+            QSKIP("KOSMINDOORMAP_BENCHMARK_DATA not set");
+        }
+    }
+
+    void benchmarkMemoryUsage()
+    {
+        OSM::DataSet internedDataSet;
+        loadDataSet(internedDataSet);
+        printMemoryUsage("deduplicated:", internedDataSet);
+
+        OSM::DataSet copiedDataSet;
+        CopyingHandler handler(&copiedDataSet);
+        loadDataSet(copiedDataSet, &handler);
+        printMemoryUsage("individual:", copiedDataSet);
+
+        QCOMPARE(copiedDataSet.nodes.size(), internedDataSet.nodes.size());
+    }
+};
+
+QTEST_GUILESS_MAIN(TagValueBenchmark)
+
+#include "tagvaluebenchmark.moc"
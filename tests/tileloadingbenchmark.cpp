@@ -0,0 +1,243 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <KOSMIndoorMap/MapLoader>
+
+#include <map/loader/tilecache_p.h>
+
+#include <osm/datatypes.h>
+#include <osm/io.h>
+
+#include <QBuffer>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSignalSpy>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QTimer>
+
+#include <map>
+#include <unordered_map>
+
+using namespace Qt::Literals;
+using namespace KOSMIndoorMap;
+
+/** Local HTTP server standing in for the tile server, serving tiles from a directory
+ *  with a fixed response latency. Tiles not present there are served empty.
+ */
+class TileServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TileServer(const QString &path, QObject *parent = nullptr)
+        : QObject(parent)
+        , m_path(path)
+    {
+        QBuffer buffer(&m_emptyTile);
+        buffer.open(QIODevice::WriteOnly);
+        OSM::IO::writerForFileName(u"empty.o5m")->write(OSM::DataSet(), &buffer);
+
+        m_server.listen(QHostAddress::LocalHost);
+        connect(&m_server, &QTcpServer::newConnection, this, [this]() {
+            while (auto socket = m_server.nextPendingConnection()) {
+                connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { readRequests(socket); });
+                connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+                    m_buffers.erase(socket);
+                    socket->deleteLater();
+                });
+            }
+        });
+    }
+
+    [[nodiscard]] QByteArray url() const
+    {
+        return "http://127.0.0.1:" + QByteArray::number(m_server.serverPort()) + '/';
+    }
+
+    int latency = 100;
+    int requestCount = 0;
+
+private:
+    void readRequests(QTcpSocket *socket)
+    {
+        auto &buffer = m_buffers[socket];
+        buffer += socket->readAll();
+        for (auto idx = buffer.indexOf("\r\n\r\n"); idx >= 0; idx = buffer.indexOf("\r\n\r\n")) {
+            const auto path = buffer.left(buffer.indexOf("\r\n")).split(' ').value(1);
+            buffer.remove(0, idx + 4);
+            ++requestCount;
+            QFile f(m_path + QString::fromUtf8(path));
+            const auto body = f.open(QFile::ReadOnly) ? f.readAll() : m_emptyTile;
+            QTimer::singleShot(latency, socket, [socket, body]() {
+                socket->write(QByteArray("HTTP/1.1 200 OK\r\nContent-Length: " + QByteArray::number(body.size()) + "\r\n\r\n" + body));
+            });
+        }
+    }
+
+    QString m_path;
+    QByteArray m_emptyTile;
+    QTcpServer m_server;
+    std::unordered_map<QTcpSocket*, QByteArray> m_buffers;
+};
+
+/** Measures the time to load a large station spanning several tiles in each direction,
+ *  with the tile server having a noticeable latency.
+ */
+class TileLoadingBenchmark : public QObject
+{
+    Q_OBJECT
+private:
+    static constexpr double CenterLat = 52.5250;
+    static constexpr double CenterLon = 13.3690;
+    static constexpr int TileZoomLevel = 17;
+
+    /** Platforms crossing the center tile, split into one piece per tile as in Marble vector tiles. */
+    void generateTiles()
+    {
+        const auto center = Tile::fromCoordinate(CenterLat, CenterLon, TileZoomLevel);
+        const auto edgeLon = [&](int x) { return Tile(x, center.y, TileZoomLevel).topLeft().lonF(); };
+        const auto edgeLat = [&](int y) { return Tile(center.x, y, TileZoomLevel).topLeft().latF(); };
+
+        // east-west platform across 7 tiles, north-south platform across 5 tiles
+        for (int x = -3; x <= 3; ++x) {
+            const auto fromLon = x == -3 ? edgeLon(center.x + x) * 0.9 + edgeLon(center.x + x + 1) * 0.1 : edgeLon(center.x + x);
+            const auto toLon = x == 3 ? edgeLon(center.x + x) * 0.1 + edgeLon(center.x + x + 1) * 0.9 : edgeLon(center.x + x + 1);
+            addPlatformPiece(Tile(center.x + x, center.y, TileZoomLevel), 1, {CenterLat, fromLon}, {CenterLat, toLon}, x != -3, x != 3);
+        }
+        for (int y = -2; y <= 2; ++y) {
+            const auto fromLat = y == -2 ? edgeLat(center.y + y) * 0.9 + edgeLat(center.y + y + 1) * 0.1 : edgeLat(center.y + y);
+            const auto toLat = y == 2 ? edgeLat(center.y + y) * 0.1 + edgeLat(center.y + y + 1) * 0.9 : edgeLat(center.y + y + 1);
+            addPlatformPiece(Tile(center.x, center.y + y, TileZoomLevel), 2, {fromLat, CenterLon + 0.0001}, {toLat, CenterLon + 0.0001}, y != -2, y != 2);
+        }
+
+        for (auto &[key, dataSet] : m_tiles) {
+            const auto path = m_serverDir.path() + "/%1/%2/"_L1.arg(TileZoomLevel).arg(key.first);
+            QDir().mkpath(path);
+            QFile f(path + QString::number(key.second) + ".o5m"_L1);
+            f.open(QFile::WriteOnly);
+            OSM::IO::writerForFileName(f.fileName())->write(dataSet, &f);
+        }
+        m_tiles.clear();
+    }
+
+    /** Adds the part of platform @p id in @p tile, with synthetic nodes where it got cut at the tile boundary. */
+    void addPlatformPiece(const Tile &tile, OSM::Id id, OSM::Coordinate from, OSM::Coordinate to, bool cutAtStart, bool cutAtEnd)
+    {
+        auto &dataSet = m_tiles[{tile.x, tile.y}];
+        const auto addNode = [&dataSet](OSM::Id nodeId, double lat, double lon) {
+            OSM::Node node;
+            node.id = nodeId;
+            node.coordinate = OSM::Coordinate(lat, lon);
+            dataSet.addNode(std::move(node));
+            return nodeId;
+        };
+
+        OSM::Way way;
+        way.id = --m_syntheticId;
+        for (int i = 0; i <= 4; ++i) {
+            const auto lat = from.latF() + (to.latF() - from.latF()) * i / 4.0;
+            const auto lon = from.lonF() + (to.lonF() - from.lonF()) * i / 4.0;
+            const bool synthetic = (i == 0 && cutAtStart) || (i == 4 && cutAtEnd);
+            way.nodes.push_back(addNode(synthetic ? --m_syntheticId : ++m_nodeId, lat, lon));
+        }
+        OSM::setTagValue(way, dataSet.makeTagKey("railway"), "platform");
+        OSM::setTagValue(way, dataSet.makeTagKey("mx:oid"), QByteArray::number((qlonglong)id));
+        dataSet.addWay(std::move(way));
+    }
+
+    QTemporaryDir m_serverDir;
+    std::map<std::pair<uint32_t, uint32_t>, OSM::DataSet> m_tiles;
+    OSM::Id m_nodeId = 100;
+    OSM::Id m_syntheticId = 0;
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        generateTiles();
+    }
+
+    void benchmarkLoadForCoordinate_data()
+    {
+        QTest::addColumn<int>("prefetchLimit");
+        QTest::newRow("no prefetch") << 0;
+        QTest::newRow("prefetch 16") << 16;
+        QTest::newRow("prefetch 64") << 64;
+    }
+
+    void benchmarkLoadForCoordinate()
+    {
+        QFETCH(int, prefetchLimit);
+
+        TileServer server(m_serverDir.path());
+        qputenv("KOSMINDOORMAP_TILESERVER", server.url());
+
+        QBENCHMARK {
+            QTemporaryDir cacheDir;
+            qputenv("KOSMINDOORMAP_CACHE_PATH", QFile::encodeName(cacheDir.path() + '/'_L1));
+            server.requestCount = 0;
+
+            MapLoader loader;
+            loader.setTilePrefetchLimit(prefetchLimit);
+            QSignalSpy doneSpy(&loader, &MapLoader::done);
+            QElapsedTimer timer;
+            timer.start();
+            loader.loadForCoordinate(CenterLat, CenterLon);
+            QVERIFY(doneSpy.wait(30000));
+            QVERIFY(!loader.hasError());
+            qDebug() << timer.elapsed() << "ms," << server.requestCount << "requests";
+        }
+    }
+
+    /** Loading with a local tile server without latency, to see the processing cost alone. */
+    void benchmarkColdAndWarmLoad_data()
+    {
+        QTest::addColumn<bool>("warm");
+        QTest::addColumn<bool>("snapshotCache");
+        QTest::newRow("cold") << false << false;
+        QTest::newRow("cold, snapshot cache") << false << true;
+        QTest::newRow("warm") << true << false;
+        QTest::newRow("warm, snapshot cache") << true << true;
+    }
+
+    void benchmarkColdAndWarmLoad()
+    {
+        QFETCH(bool, warm);
+        QFETCH(bool, snapshotCache);
+
+        TileServer server(m_serverDir.path());
+        server.latency = 0;
+        qputenv("KOSMINDOORMAP_TILESERVER", server.url());
+
+        const auto load = [snapshotCache]() {
+            MapLoader loader;
+            loader.setUseSnapshotCache(snapshotCache);
+            QSignalSpy doneSpy(&loader, &MapLoader::done);
+            loader.loadForCoordinate(CenterLat, CenterLon);
+            QVERIFY(doneSpy.wait(30000));
+            QVERIFY(!loader.hasError());
+        };
+
+        QTemporaryDir warmCacheDir;
+        if (warm) {
+            qputenv("KOSMINDOORMAP_CACHE_PATH", QFile::encodeName(warmCacheDir.path() + '/'_L1));
+            load();
+        }
+
+        QBENCHMARK {
+            QTemporaryDir coldCacheDir;
+            if (!warm) {
+                qputenv("KOSMINDOORMAP_CACHE_PATH", QFile::encodeName(coldCacheDir.path() + '/'_L1));
+            }
+            load();
+        }
+    }
+};
+
+QTEST_GUILESS_MAIN(TileLoadingBenchmark)
+
+#include "tileloadingbenchmark.moc"
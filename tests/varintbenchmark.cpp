@@ -0,0 +1,86 @@
+/*
+    SPDX-FileCopyrightText: 2026 Volker Krause <vkrause@kde.org>
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <osm/varint.h>
+
+#include <QElapsedTimer>
+#include <QTest>
+
+#include <array>
+#include <random>
+#include <vector>
+
+/** Byte-wise decoding, as done previously. */
+[[nodiscard]] static std::size_t decodeByteWise(const uint8_t *it, const uint8_t *end, int64_t *out, int64_t &state)
+{
+    auto outIt = out;
+    while (it < end) {
+        uint64_t u = 0;
+        for (int shift = 0; it < end; shift += 7) {
+            const auto b = *it++;
+            u |= (uint64_t)(b & 0x7f) << shift;
+            if (!(b & 0x80)) {
+                break;
+            }
+        }
+        state += OSM::Varint::zigzagDecode(u);
+        *outIt++ = state;
+    }
+    return outIt - out;
+}
+
+/** Measures delta-coded varint decoding throughput on synthetic data
+ *  resembling node id and coordinate sequences, compared to byte-wise decoding.
+ */
+class VarintBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void benchmarkDecode_data()
+    {
+        QTest::addColumn<int>("maxDelta");
+        QTest::addColumn<bool>("byteWise");
+        // uniform value lengths favor branch prediction in byte-wise decoding, real data is more mixed
+        for (const auto maxDelta : {32, 8000, 1000000, 0}) {
+            QTest::addRow("delta %d byte-wise", maxDelta) << maxDelta << true;
+            QTest::addRow("delta %d", maxDelta) << maxDelta << false;
+        }
+    }
+
+    void benchmarkDecode()
+    {
+        QFETCH(int, maxDelta);
+        QFETCH(bool, byteWise);
+
+        // 0 mixes all magnitudes
+        std::mt19937 rng(42);
+        std::vector<uint8_t> data;
+        for (int i = 0; i < 4'000'000; ++i) {
+            const int64_t range = maxDelta ? maxDelta : std::array<int64_t, 4>{32, 8000, 1000000, 100000000}[rng() % 4];
+            const auto v = std::uniform_int_distribution<int64_t>(-range, range)(rng);
+            auto u = (uint64_t)((v << 1) ^ (v >> 63));
+            do {
+                data.push_back((u & 0x7f) | (u > 0x7f ? 0x80 : 0));
+                u >>= 7;
+            } while (u);
+        }
+        std::vector<int64_t> result(data.size());
+
+        QBENCHMARK {
+            QElapsedTimer timer;
+            timer.start();
+            int64_t state = 0;
+            const auto n = byteWise
+                ? decodeByteWise(data.data(), data.data() + data.size(), result.data(), state)
+                : OSM::Varint::decodeDeltaZigZag(data.data(), data.data() + data.size(), result.data(), state);
+            const auto elapsed = std::max<qint64>(1, timer.nsecsElapsed());
+            qDebug() << n << "values" << (data.size() * 1000 / elapsed) << "MB/s";
+        }
+    }
+};
+
+QTEST_GUILESS_MAIN(VarintBenchmark)
+
+#include "varintbenchmark.moc"